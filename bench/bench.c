@@ -0,0 +1,426 @@
+// Benchmark suite. Assembles and runs a fixed corpus, the examples and a set
+// of synthetic programs for dispatch, branch, float and deep stack heavy code,
+// under every engine. For each program it reports the assembly throughput, the
+// instructions retired, and the wall time and ns/instruction of each engine,
+// and writes the results as JSON so runs can be compared across commits:
+//
+//     ./build/bench [-o <results.json>] [-b <baseline.json>]
+//
+// With -b, each result is printed next to its change from the baseline.
+#define VM_IMPLEMENTATION
+#include "../src/vvm.h"
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT "unknown"
+#endif
+
+#define BENCH_TRIALS 3
+#define BENCH_MIN_SECONDS 0.1
+#define BENCH_SOURCE_CAPACITY (1 << 16)
+
+typedef struct {
+    const char* name;
+    error (*execute)(vvm_t*, int);
+} engine_t;
+
+static const engine_t engines[] = {
+    { "switch",   vm_execute_program },
+    { "threaded", vm_execute_program_threaded },
+    { "register", vm_execute_program_registers },
+    { "jit",      vm_execute_program_jit },
+    { "compact",  vm_execute_program_compact },
+    { "tos",      vm_execute_program_tos },
+};
+
+typedef struct {
+    const char* name;
+    const char* path;                   // Source file, or NULL if generated.
+    void (*generate)(FILE* p_stream);
+} program_t;
+
+// A counter below an accumulator, decremented once per iteration. The body
+// adds to the accumulator with the cheapest instructions there are.
+static void generate_dispatch(FILE* p_stream)
+{
+    fprintf(p_stream, "push 200000\npush 0\nloop:\n");
+    for (int i = 0; i < 16; ++i)
+        fprintf(p_stream, "    push 3\n    addi\n    push 1\n    subi\n    nop\n");
+    fprintf(p_stream, "    swap 1\n    push 1\n    subi\n    swap 1\n    rdup 1\n    jnz loop\nhalt\n");
+}
+
+// Every other instruction is a conditional jump, alternating between taken
+// and not taken with a value that is flipped after each one.
+static void generate_branch(FILE* p_stream)
+{
+    fprintf(p_stream, "push 200000\npush 0\nloop:\n");
+    for (int i = 0; i < 8; ++i)
+        fprintf(p_stream,
+            "    push 1\n    swap 1\n    subi\n"
+            "    rdup 0\n    jnz skip_%d\n    nop\nskip_%d:\n"
+            "    rdup 1\n    push %d\n    eq\n    jnz never_%d\n    nop\nnever_%d:\n",
+            i, i, i + 1, i, i);
+    fprintf(p_stream, "    swap 1\n    push 1\n    subi\n    swap 1\n    rdup 1\n    jnz loop\nhalt\n");
+}
+
+// Two floats below the counter, relaxed towards each other every iteration.
+static void generate_float(FILE* p_stream)
+{
+    fprintf(p_stream, "push 200000\npush 1.0\npush 2.0\nloop:\n");
+    for (int i = 0; i < 8; ++i)
+        fprintf(p_stream,
+            "    push 0.999\n    mulf\n    rdup 1\n    push 0.001\n    mulf\n    addf\n"
+            "    swap 1\n    push 1.5\n    divf\n    push 0.75\n    addf\n    swap 1\n");
+    fprintf(p_stream, "    swap 2\n    push 1\n    subi\n    swap 2\n    rdup 2\n    jnz loop\nhalt\n");
+}
+
+// Close to a thousand values on the stack, read and written far below the top.
+static void generate_deep_stack(FILE* p_stream)
+{
+    const int depth = 900;
+
+    fprintf(p_stream, "push 100000\n");
+    for (int i = 0; i < depth; ++i)
+        fprintf(p_stream, "push %d\n", i);
+
+    fprintf(p_stream, "loop:\n");
+    for (int i = 0; i < 8; ++i)
+        fprintf(p_stream,
+            "    rdup %d\n    rdup %d\n    addi\n    swap %d\n    push 0\n    muli\n    addi\n",
+            800 - 50 * i, 400 + 30 * i, 500 + 40 * i);
+    fprintf(p_stream, "    swap %d\n    push 1\n    subi\n    swap %d\n    rdup %d\n    jnz loop\nhalt\n",
+        depth, depth, depth);
+}
+
+static const program_t programs[] = {
+    { "123i",       "./examples/123i.vasm", NULL },
+    { "123f",       "./examples/123f.vasm", NULL },
+    { "e",          "./examples/e.vasm",    NULL },
+    { "pi",         "./examples/pi.vasm",   NULL },
+    { "fib",        "./examples/fib.vasm",  NULL },
+    { "dispatch",   NULL, generate_dispatch },
+    { "branch",     NULL, generate_branch },
+    { "float",      NULL, generate_float },
+    { "deep-stack", NULL, generate_deep_stack },
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static string_view_t load_source(const program_t* p_program, char* p_buffer, size_t p_capacity)
+{
+    FILE* f = NULL;
+    if (p_program->path != NULL)
+    {
+        f = fopen(p_program->path, "r");
+        if (f == NULL)
+        {
+            fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", p_program->path, strerror(errno));
+            exit(1);
+        }
+    }
+    else
+    {
+        f = fmemopen(p_buffer, p_capacity, "w");
+        if (f == NULL)
+        {
+            fprintf(stderr, "[ERROR]: Could Not Generate `%s`: %s\n", p_program->name, strerror(errno));
+            exit(1);
+        }
+        p_program->generate(f);
+        const long size = ftell(f);
+        fclose(f);
+        if (size < 0 || (size_t)size >= p_capacity)
+        {
+            fprintf(stderr, "[ERROR]: Generated Source For `%s` Is Too Large\n", p_program->name);
+            exit(1);
+        }
+        return (string_view_t) { .count = size, .data = p_buffer };
+    }
+
+    const size_t size = fread(p_buffer, 1, p_capacity, f);
+    if (ferror(f) || size >= p_capacity)
+    {
+        fprintf(stderr, "[ERROR]: Could Not Read File `%s`\n", p_program->path);
+        exit(1);
+    }
+    fclose(f);
+
+    return (string_view_t) { .count = size, .data = p_buffer };
+}
+
+static void vm_reset(vvm_t* p_vm)
+{
+    p_vm->stack_size = 0;
+    p_vm->inst_pointer = 0;
+    p_vm->halt = 0;
+}
+
+// Steps through the program one instruction at a time, counting those that
+// complete, which is what an engine's limit counts as well.
+static uint64_t count_retired(vvm_t* p_vm, error* p_error)
+{
+    uint64_t count = 0;
+    vm_reset(p_vm);
+
+    *p_error = ERR_OK;
+    while (!p_vm->halt)
+    {
+        *p_error = vm_execute_inst(p_vm);
+        if (*p_error != ERR_OK)
+            break;
+        ++count;
+    }
+
+    return count;
+}
+
+// print_debug writes to stdout, which would end up in the middle of the table.
+static int stdout_silence(void)
+{
+    fflush(stdout);
+    const int saved = dup(STDOUT_FILENO);
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+    return saved;
+}
+
+static void stdout_restore(int p_saved)
+{
+    fflush(stdout);
+    dup2(p_saved, STDOUT_FILENO);
+    close(p_saved);
+}
+
+typedef struct {
+    char program[64];
+    char engine[64];
+    double ns_per_inst;
+} baseline_t;
+
+// Reads back the engine results of a previous run. Every result is written on
+// its own line, so the file does not need a JSON parser to be compared.
+static size_t load_baseline(const char* p_file_path, baseline_t* p_baseline, size_t p_capacity)
+{
+    FILE* f = fopen(p_file_path, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", p_file_path, strerror(errno));
+        exit(1);
+    }
+
+    size_t count = 0;
+    char line[512];
+    while (count < p_capacity && fgets(line, sizeof(line), f) != NULL)
+    {
+        const char* program = strstr(line, "\"program\": \"");
+        const char* engine = strstr(line, "\"engine\": \"");
+        const char* ns = strstr(line, "\"ns_per_inst\": ");
+        if (program == NULL || engine == NULL || ns == NULL)
+            continue;
+
+        baseline_t* entry = &p_baseline[count];
+        if (sscanf(program, "\"program\": \"%63[^\"]\"", entry->program) == 1 &&
+            sscanf(engine, "\"engine\": \"%63[^\"]\"", entry->engine) == 1 &&
+            sscanf(ns, "\"ns_per_inst\": %lf", &entry->ns_per_inst) == 1)
+            ++count;
+    }
+
+    fclose(f);
+    return count;
+}
+
+static const baseline_t* find_baseline(const baseline_t* p_baseline, size_t p_count, const char* p_program, const char* p_engine)
+{
+    for (size_t i = 0; i < p_count; ++i)
+        if (strcmp(p_baseline[i].program, p_program) == 0 && strcmp(p_baseline[i].engine, p_engine) == 0)
+            return &p_baseline[i];
+
+    return NULL;
+}
+
+static const char* shift(int* argc, char*** argv)
+{
+    assert(*argc > 0);
+
+    char* result = **argv;
+    *argv += 1;
+    *argc -= 1;
+
+    return result;
+}
+
+static void usage(FILE* p_stream, const char* p_program)
+{
+    fprintf(p_stream, "Usage: %s [-o <results.json>] [-b <baseline.json>]\n", p_program);
+}
+
+arena_t arena = {0};
+char source_buffer[BENCH_SOURCE_CAPACITY];
+baseline_t baseline[ARRAY_SIZE(programs) * ARRAY_SIZE(engines)];
+
+int main(int argc, char** argv)
+{
+    const char* program_name = shift(&argc, &argv);
+    const char* output_file_path = NULL;
+    const char* baseline_file_path = NULL;
+
+    while (argc > 0)
+    {
+        const char* flag = shift(&argc, &argv);
+        if (strcmp(flag, "-o") == 0 || strcmp(flag, "-b") == 0)
+        {
+            if (argc == 0)
+            {
+                usage(stderr, program_name);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+            if (flag[1] == 'o')
+                output_file_path = shift(&argc, &argv);
+            else
+                baseline_file_path = shift(&argc, &argv);
+        }
+        else if (strcmp(flag, "-h") == 0)
+        {
+            usage(stdout, program_name);
+            exit(0);
+        }
+        else
+        {
+            usage(stderr, program_name);
+            fprintf(stderr, "[ERROR]: Unknown Flag `%s`\n", flag);
+            exit(1);
+        }
+    }
+
+    size_t baseline_count = 0;
+    if (baseline_file_path != NULL)
+        baseline_count = load_baseline(baseline_file_path, baseline, ARRAY_SIZE(baseline));
+
+    FILE* json = NULL;
+    if (output_file_path != NULL)
+    {
+        json = fopen(output_file_path, "w");
+        if (json == NULL)
+        {
+            fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", output_file_path, strerror(errno));
+            exit(1);
+        }
+        fprintf(json, "{\n  \"commit\": \"%s\",\n  \"results\": [\n", BENCH_COMMIT);
+    }
+
+    printf("%-10s %-8s %9s %10s %10s %9s %s\n", "program", "engine", "vasm MB/s", "retired", "ms", "ns/inst",
+           baseline_count > 0 ? "  vs baseline" : "");
+
+    uint64_t total_bytes = 0;
+    double total_assembly = 0.0;
+    int first = 1;
+
+    for (size_t p = 0; p < ARRAY_SIZE(programs); ++p)
+    {
+        const string_view_t source = load_source(&programs[p], source_buffer, sizeof(source_buffer));
+
+        // Assembles the program until enough time has passed to measure it.
+        vvm_t vm;
+        vasm_t vasm;
+        uint64_t assemblies = 0;
+        double assembly = 0.0;
+        do
+        {
+            arena_reset(&arena);
+            if (vm_init(&vm, &arena, VVM_DEFAULT_STACK_CAPACITY) != ERR_OK)
+            {
+                fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+                exit(1);
+            }
+            vasm_init(&vasm, &arena);
+
+            const double start = now();
+            if (vm_translate_source(source, &vm, &vasm) != ERR_OK)
+                exit(1);
+            assembly += now() - start;
+            ++assemblies;
+        } while (assembly < BENCH_MIN_SECONDS);
+
+        const double mb_per_s = source.count * assemblies / assembly / (1 << 20);
+        total_bytes += source.count * assemblies;
+        total_assembly += assembly;
+
+        vm_verify_program(&vm, NULL);
+
+        error expected = ERR_OK;
+        const int saved = stdout_silence();
+        const uint64_t retired = count_retired(&vm, &expected);
+        stdout_restore(saved);
+
+        for (size_t e = 0; e < ARRAY_SIZE(engines); ++e)
+        {
+            double best = 0.0;
+            for (int trial = 0; trial < BENCH_TRIALS; ++trial)
+            {
+                uint64_t runs = 0;
+                double elapsed = 0.0;
+                const int saved = stdout_silence();
+                do
+                {
+                    vm_reset(&vm);
+                    const double start = now();
+                    const error err = engines[e].execute(&vm, -1);
+                    elapsed += now() - start;
+                    ++runs;
+
+                    if (err != expected)
+                    {
+                        stdout_restore(saved);
+                        fprintf(stderr, "[ERROR]: Engine `%s` Returned %s On `%s`, Expected %s\n",
+                            engines[e].name, error_as_cstr(err), programs[p].name, error_as_cstr(expected));
+                        exit(1);
+                    }
+                } while (elapsed < BENCH_MIN_SECONDS);
+                stdout_restore(saved);
+
+                if (trial == 0 || elapsed / runs < best)
+                    best = elapsed / runs;
+            }
+
+            const double ns_per_inst = retired > 0 ? best * 1e9 / retired : 0.0;
+            printf("%-10s %-8s %9.1f %10lu %10.3f %9.3f", programs[p].name, engines[e].name, mb_per_s,
+                   retired, best * 1e3, ns_per_inst);
+
+            const baseline_t* base = find_baseline(baseline, baseline_count, programs[p].name, engines[e].name);
+            if (base != NULL && base->ns_per_inst > 0.0)
+                printf("  %+7.1f%%", (ns_per_inst / base->ns_per_inst - 1.0) * 100.0);
+            printf("\n");
+
+            if (json != NULL)
+            {
+                fprintf(json,
+                    "%s    {\"program\": \"%s\", \"engine\": \"%s\", \"source_bytes\": %lu, \"insts\": %lu, "
+                    "\"vasm_mb_per_s\": %.3f, \"retired\": %lu, \"error\": \"%s\", \"wall_ms\": %.6f, \"ns_per_inst\": %.4f}",
+                    first ? "" : ",\n", programs[p].name, engines[e].name, source.count, vm.program_size,
+                    mb_per_s, retired, error_as_cstr(expected), best * 1e3, ns_per_inst);
+                first = 0;
+            }
+        }
+    }
+
+    const double total_mb_per_s = total_bytes / total_assembly / (1 << 20);
+    printf("vasm: %.1f MB/s over the corpus\n", total_mb_per_s);
+
+    if (json != NULL)
+    {
+        fprintf(json, "\n  ],\n  \"vasm_mb_per_s\": %.3f\n}\n", total_mb_per_s);
+        fclose(json);
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Measures how assembly time grows with the number of labels. A synthetic
+// source of N labels is assembled, where each label is followed by a backward
+// jump to an earlier label and a forward jump to a later one, and the time per
+// label is reported; it stays flat as N grows when label lookups are O(1).
+#define VM_IMPLEMENTATION
+#include "../src/vvm.h"
+
+#include <time.h>
+
+#define BENCH_RUNS 5
+#define BENCH_MIN_LABELS 3125
+#define BENCH_MAX_LABELS 100000
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static string_view_t build_source(arena_t* p_arena, uint64_t p_labels)
+{
+    const size_t capacity = p_labels * 64 + 64;
+    char* source = arena_alloc(p_arena, capacity);
+    if (source == NULL)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+    size_t size = 0;
+
+    for (uint64_t i = 0; i < p_labels; ++i)
+    {
+        const uint64_t backward = i / 2;
+        const uint64_t forward = 2 * i + 1 < p_labels ? 2 * i + 1 : p_labels - 1;
+        size += snprintf(source + size, capacity - size,
+            "l%lu:\n    jmp l%lu\n    jnz l%lu\n", i, backward, forward);
+    }
+    size += snprintf(source + size, capacity - size, "    halt\n");
+
+    return (string_view_t) { .count = size, .data = source };
+}
+
+arena_t arena = {0};
+arena_t source_arena = {0};
+
+int main(void)
+{
+    printf("%8s %8s %10s %10s\n", "labels", "insts", "ms", "ns/label");
+
+    for (uint64_t labels = BENCH_MIN_LABELS; labels <= BENCH_MAX_LABELS; labels *= 2)
+    {
+        arena_reset(&source_arena);
+        const string_view_t source = build_source(&source_arena, labels);
+
+        double best = 0.0;
+        uint64_t insts = 0;
+        for (int run = 0; run < BENCH_RUNS; ++run)
+        {
+            vvm_t vm;
+            vasm_t vasm;
+            arena_reset(&arena);
+            if (vm_init(&vm, &arena, VVM_DEFAULT_STACK_CAPACITY) != ERR_OK)
+            {
+                fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+                exit(1);
+            }
+            vasm_init(&vasm, &arena);
+
+            const double start = now();
+            if (vm_translate_source(source, &vm, &vasm) != ERR_OK)
+                exit(1);
+            const double elapsed = now() - start;
+
+            if (vasm.labels_size != labels)
+            {
+                fprintf(stderr, "[ERROR]: Expected %lu Labels, Got %lu\n", labels, vasm.labels_size);
+                exit(1);
+            }
+
+            insts = vm.program_size;
+            if (run == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("%8lu %8lu %10.3f %10.1f\n", labels, insts, best * 1e3, best * 1e9 / labels);
+    }
+
+    return 0;
+}
@@ -0,0 +1,233 @@
+// Measures how the program layout affects cache misses as programs grow. A
+// synthetic program of N instructions is run under engines that read 16 byte
+// instructions (switch, threaded) and under the compact layout, reporting the
+// time per instruction and, where perf_event_open is available, the L1 and
+// last level cache misses per thousand instructions.
+#define VM_IMPLEMENTATION
+#include "../src/vvm.h"
+
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_EXECUTED_INSTS 50000000
+#define BENCH_RUNS 3
+#define BENCH_BLOCK_SIZE 8
+#define BENCH_MAX_INSTS (1 << 18)
+
+typedef struct {
+    const char* name;
+    error (*execute)(vvm_t*, int);
+} engine_t;
+
+static const engine_t engines[] = {
+    { "switch",   vm_execute_program },
+    { "threaded", vm_execute_program_threaded },
+    { "compact",  vm_execute_program_compact },
+};
+
+typedef enum {
+    COUNTER_L1D = 0,
+    COUNTER_L1I,
+    COUNTER_LLC,
+    NUMBER_OF_COUNTERS,
+} counter_type;
+
+static const char* const counter_names[NUMBER_OF_COUNTERS] = {
+    "L1d-miss/kinst",
+    "L1i-miss/kinst",
+    "LLC-miss/kinst",
+};
+
+static int counters[NUMBER_OF_COUNTERS];
+
+static void counters_open(void)
+{
+#ifdef __linux__
+    static const uint64_t configs[NUMBER_OF_COUNTERS] = {
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_L1I | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_LL  | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    };
+
+    for (size_t i = 0; i < NUMBER_OF_COUNTERS; ++i)
+    {
+        struct perf_event_attr attr = {0};
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counters[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#else
+    for (size_t i = 0; i < NUMBER_OF_COUNTERS; ++i)
+        counters[i] = -1;
+#endif
+}
+
+static void counters_start(void)
+{
+#ifdef __linux__
+    for (size_t i = 0; i < NUMBER_OF_COUNTERS; ++i)
+    {
+        if (counters[i] < 0)
+            continue;
+        ioctl(counters[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+static void counters_stop(int64_t* p_values)
+{
+    for (size_t i = 0; i < NUMBER_OF_COUNTERS; ++i)
+    {
+        p_values[i] = -1;
+#ifdef __linux__
+        uint64_t value = 0;
+        if (counters[i] < 0)
+            continue;
+        ioctl(counters[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counters[i], &value, sizeof(value)) == sizeof(value))
+            p_values[i] = (int64_t)value;
+#endif
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The instructions have already been diagnosed when they cannot be stored.
+static void push(vvm_t* p_vm, inst_t p_inst)
+{
+    if (vm_push_inst(p_vm, p_inst) != ERR_OK)
+        exit(1);
+}
+
+// Builds a loop whose body is p_blocks copies of an eight instruction block,
+// two of which carry an operand. The stack holds the loop counter and an
+// accumulator between blocks.
+static void build_program(vvm_t* p_vm, uint64_t p_blocks, uint64_t p_iterations)
+{
+    p_vm->program_size = 0;
+    push(p_vm, (inst_t) { .type = INST_PUSH, .operand = { .as_u64 = p_iterations } });
+    push(p_vm, (inst_t) { .type = INST_PUSH, .operand = { .as_u64 = 0 } });
+
+    const inst_addr_t loop = p_vm->program_size;
+    for (uint64_t i = 0; i < p_blocks; ++i)
+    {
+        push(p_vm, (inst_t) { .type = INST_PUSH, .operand = { .as_u64 = i } });
+        push(p_vm, (inst_t) { .type = INST_DUP_REL, .operand = { .as_u64 = 0 } });
+        push(p_vm, (inst_t) { .type = INST_MULI });
+        push(p_vm, (inst_t) { .type = INST_ADDI });
+        push(p_vm, (inst_t) { .type = INST_NOT });
+        push(p_vm, (inst_t) { .type = INST_NOT });
+        push(p_vm, (inst_t) { .type = INST_NOP });
+        push(p_vm, (inst_t) { .type = INST_NOP });
+    }
+
+    push(p_vm, (inst_t) { .type = INST_SWAP, .operand = { .as_u64 = 1 } });
+    push(p_vm, (inst_t) { .type = INST_PUSH, .operand = { .as_u64 = 1 } });
+    push(p_vm, (inst_t) { .type = INST_SUBI });
+    push(p_vm, (inst_t) { .type = INST_DUP_REL, .operand = { .as_u64 = 0 } });
+    push(p_vm, (inst_t) { .type = INST_SWAP, .operand = { .as_u64 = 2 } });
+    push(p_vm, (inst_t) { .type = INST_SWAP, .operand = { .as_u64 = 1 } });
+    push(p_vm, (inst_t) { .type = INST_JMP_NZ, .operand = { .as_u64 = loop } });
+    push(p_vm, (inst_t) { .type = INST_HALT });
+}
+
+static uint64_t layout_bytes(const engine_t* p_engine, const vvm_t* p_vm)
+{
+    if (p_engine->execute == vm_execute_program_compact)
+    {
+        uint64_t operands = 0;
+        for (inst_addr_t i = 0; i < p_vm->program_size; ++i)
+            operands += inst_has_operand(p_vm->program[i].type);
+        return p_vm->program_size + operands * sizeof(word_t);
+    }
+
+    if (p_engine->execute == vm_execute_program_threaded)
+        return p_vm->program_size * sizeof(threaded_inst_t);
+
+    return p_vm->program_size * sizeof(inst_t);
+}
+
+arena_t arena = {0};
+vvm_t vm = {0};
+
+int main(void)
+{
+    counters_open();
+    if (vm_init(&vm, &arena, VVM_DEFAULT_STACK_CAPACITY) != ERR_OK)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+
+    printf("%-9s %8s %9s %8s", "engine", "insts", "bytes", "ns/inst");
+    for (size_t i = 0; i < NUMBER_OF_COUNTERS; ++i)
+        printf(" %15s", counter_names[i]);
+    printf("\n");
+
+    for (uint64_t blocks = 32; blocks * BENCH_BLOCK_SIZE <= BENCH_MAX_INSTS; blocks *= 4)
+    {
+        const uint64_t iterations = BENCH_EXECUTED_INSTS / (blocks * BENCH_BLOCK_SIZE) + 1;
+        build_program(&vm, blocks, iterations);
+
+        for (size_t e = 0; e < ARRAY_SIZE(engines); ++e)
+        {
+            double best = 0.0;
+            int64_t values[NUMBER_OF_COUNTERS];
+            uint64_t executed = 0;
+
+            for (int run = 0; run < BENCH_RUNS; ++run)
+            {
+                vm.stack_size = 0;
+                vm.inst_pointer = 0;
+                vm.halt = 0;
+
+                int64_t run_values[NUMBER_OF_COUNTERS];
+                const double start = now();
+                counters_start();
+                error err = engines[e].execute(&vm, -1);
+                counters_stop(run_values);
+                const double elapsed = now() - start;
+
+                if (err != ERR_OK || !vm.halt)
+                {
+                    fprintf(stderr, "[ERROR]: Engine `%s` Failed: %s\n", engines[e].name, error_as_cstr(err));
+                    exit(1);
+                }
+
+                if (run == 0 || elapsed < best)
+                {
+                    best = elapsed;
+                    memcpy(values, run_values, sizeof(values));
+                }
+            }
+
+            executed = 2 + iterations * (blocks * BENCH_BLOCK_SIZE + 7);
+            printf("%-9s %8lu %9lu %8.3f", engines[e].name, vm.program_size,
+                   layout_bytes(&engines[e], &vm), best * 1e9 / executed);
+            for (size_t i = 0; i < NUMBER_OF_COUNTERS; ++i)
+                if (values[i] < 0)
+                    printf(" %15s", "-");
+                else
+                    printf(" %15.3f", values[i] * 1000.0 / executed);
+            printf("\n");
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Measures the throughput of the assembler front end. A synthetic source of
+// about 32MB, mixing every operand kind, labels and comments, is written to
+// ./build and assembled repeatedly, once reading the file into memory and once
+// mapping it, reporting the best time as MB/s of source.
+#define VM_IMPLEMENTATION
+#include "../src/vvm.h"
+
+#include <time.h>
+
+#define BENCH_RUNS 5
+#define BENCH_SOURCE_SIZE (32 << 20)
+#define BENCH_SOURCE_PATH "./build/bench-vasm.vasm"
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t write_source(const char* p_file_path)
+{
+    FILE* f = fopen(p_file_path, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", p_file_path, strerror(errno));
+        exit(1);
+    }
+
+    long size = 0;
+    uint64_t i = 0;
+    for (; size < BENCH_SOURCE_SIZE; ++i)
+    {
+        fprintf(f,
+            "# block %lu\n"
+            "block_%lu:\n"
+            "    push %lu\n"
+            "    push %lu.%03lu\n"
+            "    push -%lue-3\n"
+            "    rdup 1\n"
+            "    swap 2\n"
+            "    addi\n"
+            "    mulf # scale\n"
+            "    geq\n"
+            "    jnz block_%lu\n"
+            "    jmp block_%lu\n",
+            i, i, i * 7919, i % 1000, i % 997, i % 89, i / 2, i + 1);
+        size = ftell(f);
+    }
+    // The forward jump of the last block lands on the halt.
+    fprintf(f, "block_%lu:\n    halt\n", i);
+    fclose(f);
+    return size;
+}
+
+typedef struct {
+    const char* name;
+    int map;
+} input_t;
+
+static const input_t inputs[] = {
+    { "read", 0 },
+    { "mmap", 1 },
+};
+
+arena_t arena = {0};
+
+int main(void)
+{
+    const uint64_t size = write_source(BENCH_SOURCE_PATH);
+
+    printf("%-6s %10s %10s %8s %12s\n", "input", "bytes", "insts", "ms", "MB/s");
+    for (size_t i = 0; i < ARRAY_SIZE(inputs); ++i)
+    {
+        double best = 0.0;
+        uint64_t insts = 0;
+
+        for (int run = 0; run < BENCH_RUNS; ++run)
+        {
+            vvm_t vm;
+            vasm_t vasm;
+            arena_reset(&arena);
+            if (vm_init(&vm, &arena, VVM_DEFAULT_STACK_CAPACITY) != ERR_OK)
+            {
+                fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+                exit(1);
+            }
+            vasm_init(&vasm, &arena);
+
+            const double start = now();
+            file_view_t source = { .content = {0} };
+            const error err = inputs[i].map
+                ? file_view_open(BENCH_SOURCE_PATH, &source, stderr)
+                : sv_slurp_file(BENCH_SOURCE_PATH, &source.content, stderr);
+            if (err != ERR_OK || vm_translate_source(source.content, &vm, &vasm) != ERR_OK)
+                exit(1);
+            file_view_close(&source);
+            const double elapsed = now() - start;
+
+            insts = vm.program_size;
+            if (run == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("%-6s %10lu %10lu %8.1f %12.1f\n", inputs[i].name, size, insts,
+               best * 1e3, size / best / (1 << 20));
+    }
+
+    remove(BENCH_SOURCE_PATH);
+    return 0;
+}
@@ -0,0 +1,193 @@
+// Measures what the vector instructions save per element. Two kernels are
+// written once with scalar instructions and once with vector instructions of
+// 2, 4 and 8 lanes, and every vector program runs on each set of lane kernels
+// the CPU supports:
+//
+//  - axpy updates every lane to a * x + y. The scalar form swaps each lane to
+//    the top, the vector form broadcasts x and y over the lanes.
+//  - sum broadcasts a value over the lanes and adds them back up. The scalar
+//    form duplicates and adds.
+//
+// The time per element is reported for the switch, threaded and compact
+// engines.
+#define VM_IMPLEMENTATION
+#include "../src/vvm.h"
+
+#include <time.h>
+
+#define BENCH_ELEMENTS 10000000
+#define BENCH_RUNS 3
+#define BENCH_UNROLL 16
+
+typedef struct {
+    const char* name;
+    error (*execute)(vvm_t*, int);
+} engine_t;
+
+static const engine_t engines[] = {
+    { "switch",   vm_execute_program },
+    { "threaded", vm_execute_program_threaded },
+    { "compact",  vm_execute_program_compact },
+};
+
+static const char* const kernels[] = { "scalar", "sse2", "avx2" };
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The iteration counter sits below the lanes, and is brought up to be
+// decremented at the end of every iteration.
+static void generate_loop_end(FILE* p_stream, int p_depth)
+{
+    fprintf(p_stream, "    swap %d\n    push 1\n    subi\n    swap %d\n    rdup %d\n    jnz loop\nhalt\n",
+        p_depth, p_depth, p_depth);
+}
+
+static void generate_axpy(FILE* p_stream, int p_lanes, int p_vector, uint64_t p_iterations)
+{
+    fprintf(p_stream, "push %lu\n", p_iterations);
+    for (int i = 0; i < p_lanes; ++i)
+        fprintf(p_stream, "push %d.5\n", i);
+
+    fprintf(p_stream, "loop:\n");
+    for (int k = 0; k < BENCH_UNROLL; ++k)
+    {
+        if (p_vector)
+        {
+            fprintf(p_stream, "    push 0.999\n    vbcast %d\n    vmulf %d\n", p_lanes, p_lanes);
+            fprintf(p_stream, "    push 0.001\n    vbcast %d\n    vaddf %d\n", p_lanes, p_lanes);
+            continue;
+        }
+
+        for (int i = 0; i < p_lanes; ++i)
+        {
+            if (i > 0)
+                fprintf(p_stream, "    swap %d\n", i);
+            fprintf(p_stream, "    push 0.999\n    mulf\n    push 0.001\n    addf\n");
+            if (i > 0)
+                fprintf(p_stream, "    swap %d\n", i);
+        }
+    }
+    generate_loop_end(p_stream, p_lanes);
+}
+
+static void generate_sum(FILE* p_stream, int p_lanes, int p_vector, uint64_t p_iterations)
+{
+    fprintf(p_stream, "push %lu\npush 1.0\nloop:\n", p_iterations);
+    for (int k = 0; k < BENCH_UNROLL; ++k)
+    {
+        if (p_vector)
+        {
+            fprintf(p_stream, "    vbcast %d\n    vsumf %d\n", p_lanes, p_lanes);
+        }
+        else
+        {
+            for (int i = 1; i < p_lanes; ++i)
+                fprintf(p_stream, "    rdup 0\n");
+            for (int i = 1; i < p_lanes; ++i)
+                fprintf(p_stream, "    addf\n");
+        }
+        fprintf(p_stream, "    push %lf\n    mulf\n", 1.0 / p_lanes);
+    }
+    generate_loop_end(p_stream, 1);
+}
+
+typedef struct {
+    const char* name;
+    void (*generate)(FILE* p_stream, int p_lanes, int p_vector, uint64_t p_iterations);
+} workload_t;
+
+static const workload_t workloads[] = {
+    { "axpy", generate_axpy },
+    { "sum",  generate_sum },
+};
+
+arena_t arena = {0};
+vvm_t vm = {0};
+vasm_t vasm = {0};
+
+// Returns the best time per element, or a negative number if the program
+// failed.
+static double measure(const engine_t* p_engine, const string_view_t* p_source, const vector_kernels_t* p_kernels, uint64_t p_elements)
+{
+    double best = 0.0;
+    for (int run = 0; run < BENCH_RUNS; ++run)
+    {
+        arena_reset(&arena);
+        if (vm_init(&vm, &arena, VVM_DEFAULT_STACK_CAPACITY) != ERR_OK)
+        {
+            fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+            exit(1);
+        }
+        vasm_init(&vasm, &arena);
+        vm.vector = p_kernels;
+        if (vm_translate_source(*p_source, &vm, &vasm) != ERR_OK)
+            exit(1);
+        vm_verify_program(&vm, NULL);
+
+        const double start = now();
+        const error err = p_engine->execute(&vm, -1);
+        const double elapsed = now() - start;
+
+        if (err != ERR_OK || !vm.halt)
+        {
+            fprintf(stderr, "[ERROR]: Engine `%s` Failed: %s\n", p_engine->name, error_as_cstr(err));
+            return -1.0;
+        }
+
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    return best * 1e9 / p_elements;
+}
+
+int main(void)
+{
+    static char buffer[1 << 16];
+
+    printf("%-6s %5s %-8s", "kernel", "lanes", "insts");
+    for (size_t e = 0; e < ARRAY_SIZE(engines); ++e)
+        printf(" %12s", engines[e].name);
+    printf("   (ns/element)\n");
+
+    for (size_t w = 0; w < ARRAY_SIZE(workloads); ++w)
+    {
+        for (int lanes = 2; lanes <= 8; lanes *= 2)
+        {
+            const uint64_t iterations = BENCH_ELEMENTS / (BENCH_UNROLL * lanes);
+            const uint64_t elements = iterations * BENCH_UNROLL * lanes;
+
+            // The scalar instructions first, then the vector ones on every
+            // set of lane kernels.
+            for (int isa = -1; isa < (int)ARRAY_SIZE(kernels); ++isa)
+            {
+                const vector_kernels_t* kernel = vm_vector_kernels(isa < 0 ? "scalar" : kernels[isa]);
+                if (kernel == NULL)
+                    continue;
+
+                FILE* f = fmemopen(buffer, sizeof(buffer), "w");
+                workloads[w].generate(f, lanes, isa >= 0, iterations);
+                const long size = ftell(f);
+                fclose(f);
+                const string_view_t source = { .count = size, .data = buffer };
+
+                if (isa < 0)
+                    printf("%-6s %5d %-8s", workloads[w].name, lanes, "scalar");
+                else
+                    printf("%-6s %5d v-%-6s", workloads[w].name, lanes, kernel->name);
+                for (size_t e = 0; e < ARRAY_SIZE(engines); ++e)
+                    printf(" %12.3f", measure(&engines[e], &source, kernel, elements));
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+    }
+
+    arena_free(&arena);
+    return 0;
+}
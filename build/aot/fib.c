@@ -0,0 +1,179 @@
+#define VM_IMPLEMENTATION
+#include "vvm.h"
+
+// Writes the machine state back and runs one instruction on the interpreter.
+#define VVM2C_INTERPRET(p_addr) do {                                    \
+        p_vm->stack_size = sp;                                          \
+        p_vm->inst_pointer = (p_addr);                                  \
+        const error err = vm_execute_inst(p_vm);                        \
+        if (err != ERR_OK || p_vm->halt)                                \
+            return err;                                                 \
+        sp = p_vm->stack_size;                                          \
+    } while (0)
+
+// Leaves the rest of the run, and whatever is left of the limit, to the
+// interpreter.
+#define VVM2C_BUDGET (p_limit < 0 ? -1 : (int)budget)
+#define VVM2C_RESUME(p_addr) do {                                       \
+        p_vm->stack_size = sp;                                          \
+        p_vm->inst_pointer = (p_addr);                                  \
+        return vm_execute_program(p_vm, VVM2C_BUDGET);                  \
+    } while (0)
+#define VVM2C_INTERPRET_JUMP(p_addr) do {                               \
+        VVM2C_INTERPRET(p_addr);                                        \
+        return vm_execute_program(p_vm, VVM2C_BUDGET);                  \
+    } while (0)
+
+static inline double vvm2c_f64(uint64_t p_bits)
+{
+    const word_t word = { .as_u64 = p_bits };
+    return word.as_f64;
+}
+
+#define VVM2C_STACK_CAPACITY UINT64_C(1024)
+#define VVM2C_MEMORY_SIZE UINT64_C(1048576)
+#define VVM2C_PROGRAM_SIZE UINT64_C(10)
+
+static inst_t program[] = {
+    { INST_JMP, { .as_u64 = UINT64_C(0x0000000000000001) } },
+    { INST_NOP, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_NOP, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_NOP, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_PUSH, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_PUSH, { .as_u64 = UINT64_C(0x0000000000000001) } },
+    { INST_DUP_REL, { .as_u64 = UINT64_C(0x0000000000000001) } },
+    { INST_DUP_REL, { .as_u64 = UINT64_C(0x0000000000000001) } },
+    { INST_ADDI, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_JMP, { .as_u64 = UINT64_C(0x0000000000000006) } },
+};
+
+static error vvm2c_run(vvm_t* p_vm, int p_limit)
+{
+    static word_t stack[VVM2C_STACK_CAPACITY];
+    uint64_t sp = 0;
+    uint64_t budget = p_limit < 0 ? UINT64_MAX : (uint64_t)p_limit;
+    word_t* const memory = p_vm->memory;
+    p_vm->stack = stack;
+
+    if (budget < 1) VVM2C_RESUME(0);
+    budget -= 1;
+    /* 0: jmp 1 */
+    goto L_1;
+
+L_1:
+    if (budget < 5) VVM2C_RESUME(1);
+    budget -= 5;
+    /* 1: nop */
+    /* 2: nop */
+    /* 3: nop */
+    /* 4: push 0 */
+    { stack[sp++].as_u64 = UINT64_C(0x0000000000000000); }
+    /* 5: push 1 */
+    { stack[sp++].as_u64 = UINT64_C(0x0000000000000001); }
+
+L_6:
+    if (budget < 4) VVM2C_RESUME(6);
+    budget -= 4;
+    /* 6: rdup 1 */
+    { stack[sp] = stack[sp - 1 - UINT64_C(1)]; sp++; }
+    /* 7: rdup 1 */
+    if (sp >= VVM2C_STACK_CAPACITY || sp <= UINT64_C(1)) VVM2C_INTERPRET(7); else { stack[sp] = stack[sp - 1 - UINT64_C(1)]; sp++; }
+    /* 8: addi */
+    { stack[sp - 2].as_u64 += stack[sp - 1].as_u64; sp--; }
+    /* 9: jmp 6 */
+    goto L_6;
+
+    (void)budget;
+    VVM2C_RESUME(VVM2C_PROGRAM_SIZE);
+}
+
+static void usage(FILE* p_stream, const char* p_program)
+{
+    fprintf(p_stream, "Usage: %s [-l <limit>] [--native <lib.so>] [-s] [-h]\n", p_program);
+}
+
+int main(int argc, char** argv)
+{
+    int limit = -1;
+    int dump = 0;
+    const char* native_file_path = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-l") == 0) {
+            if (i + 1 == argc)
+            {
+                usage(stderr, argv[0]);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", argv[i]);
+                exit(1);
+            }
+            limit = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--native") == 0) {
+            if (i + 1 == argc)
+            {
+                usage(stderr, argv[0]);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", argv[i]);
+                exit(1);
+            }
+            native_file_path = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0) {
+            dump = 1;
+        } else if (strcmp(argv[i], "-h") == 0) {
+            usage(stdout, argv[0]);
+            exit(0);
+        } else {
+            usage(stderr, argv[0]);
+            fprintf(stderr, "[ERROR]: Unknown Flag `%s`\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    arena_t arena = {0};
+    vvm_t vm = {0};
+    if (vm_init(&vm, &arena, VVM2C_STACK_CAPACITY) != ERR_OK)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+    if (vm_map_memory(&vm, VVM2C_MEMORY_SIZE, 0) != ERR_OK ||
+        vm_load_program_from_memory(&vm, program, VVM2C_PROGRAM_SIZE) != ERR_OK)
+        exit(1);
+
+    // Natives are always interpreted, and the program is compiled against
+    // no table, so any table with the ids it calls will do.
+#ifdef VVM_DLOPEN
+    native_library_t natives = {0};
+    if (native_file_path != NULL)
+    {
+        if (native_library_open(native_file_path, &natives, stderr) != ERR_OK)
+            exit(1);
+        vm.natives = natives.table;
+    }
+#else
+    if (native_file_path != NULL)
+    {
+        fprintf(stderr, "[ERROR]: Flag `--native` Is Not Supported By This Build\n");
+        exit(1);
+    }
+#endif
+
+    const error err = vvm2c_run(&vm, limit);
+
+    // Output up to an error is written out all the same.
+    if (vm_flush_channel(&vm) != ERR_OK)
+        exit(1);
+    if (dump)
+        vm_dump_stack(stdout, &vm);
+    if (err != ERR_OK)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(err));
+        exit(1);
+    }
+
+    vm_unmap_memory(&vm);
+#ifdef VVM_DLOPEN
+    native_library_close(&natives);
+#endif
+    arena_free(&arena);
+    return 0;
+}
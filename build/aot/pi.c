@@ -0,0 +1,220 @@
+#define VM_IMPLEMENTATION
+#include "vvm.h"
+
+// Writes the machine state back and runs one instruction on the interpreter.
+#define VVM2C_INTERPRET(p_addr) do {                                    \
+        p_vm->stack_size = sp;                                          \
+        p_vm->inst_pointer = (p_addr);                                  \
+        const error err = vm_execute_inst(p_vm);                        \
+        if (err != ERR_OK || p_vm->halt)                                \
+            return err;                                                 \
+        sp = p_vm->stack_size;                                          \
+    } while (0)
+
+// Leaves the rest of the run, and whatever is left of the limit, to the
+// interpreter.
+#define VVM2C_BUDGET (p_limit < 0 ? -1 : (int)budget)
+#define VVM2C_RESUME(p_addr) do {                                       \
+        p_vm->stack_size = sp;                                          \
+        p_vm->inst_pointer = (p_addr);                                  \
+        return vm_execute_program(p_vm, VVM2C_BUDGET);                  \
+    } while (0)
+#define VVM2C_INTERPRET_JUMP(p_addr) do {                               \
+        VVM2C_INTERPRET(p_addr);                                        \
+        return vm_execute_program(p_vm, VVM2C_BUDGET);                  \
+    } while (0)
+
+static inline double vvm2c_f64(uint64_t p_bits)
+{
+    const word_t word = { .as_u64 = p_bits };
+    return word.as_f64;
+}
+
+#define VVM2C_STACK_CAPACITY UINT64_C(1024)
+#define VVM2C_MEMORY_SIZE UINT64_C(1048576)
+#define VVM2C_PROGRAM_SIZE UINT64_C(23)
+
+static inst_t program[] = {
+    { INST_PUSH, { .as_u64 = UINT64_C(0x4000000000000000) } },
+    { INST_PUSH, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_PUSH, { .as_u64 = UINT64_C(0x4020000000000000) } },
+    { INST_DUP_REL, { .as_u64 = UINT64_C(0x0000000000000002) } },
+    { INST_DUP_REL, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_PUSH, { .as_u64 = UINT64_C(0xbff0000000000000) } },
+    { INST_FMA, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_DIVF, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_ADDF, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_SWAP, { .as_u64 = UINT64_C(0x0000000000000001) } },
+    { INST_PUSH, { .as_u64 = UINT64_C(0x4010000000000000) } },
+    { INST_ADDF, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_SWAP, { .as_u64 = UINT64_C(0x0000000000000001) } },
+    { INST_DUP_REL, { .as_u64 = UINT64_C(0x0000000000000001) } },
+    { INST_PUSH, { .as_u64 = UINT64_C(0x4146e36000000000) } },
+    { INST_LTF, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_JMP_NZ, { .as_u64 = UINT64_C(0x0000000000000002) } },
+    { INST_SWAP, { .as_u64 = UINT64_C(0x0000000000000001) } },
+    { INST_PUSH, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_MULI, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_ADDI, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_PRINT_DEBUG, { .as_u64 = UINT64_C(0x0000000000000000) } },
+    { INST_HALT, { .as_u64 = UINT64_C(0x0000000000000000) } },
+};
+
+static error vvm2c_run(vvm_t* p_vm, int p_limit)
+{
+    static word_t stack[VVM2C_STACK_CAPACITY];
+    uint64_t sp = 0;
+    uint64_t budget = p_limit < 0 ? UINT64_MAX : (uint64_t)p_limit;
+    word_t* const memory = p_vm->memory;
+    p_vm->stack = stack;
+
+    if (budget < 2) VVM2C_RESUME(0);
+    budget -= 2;
+    /* 0: push 4611686018427387904 */
+    { stack[sp++].as_u64 = UINT64_C(0x4000000000000000); }
+    /* 1: push 0 */
+    { stack[sp++].as_u64 = UINT64_C(0x0000000000000000); }
+
+L_2:
+    if (budget < 15) VVM2C_RESUME(2);
+    budget -= 15;
+    /* 2: push 4620693217682128896 */
+    { stack[sp++].as_u64 = UINT64_C(0x4020000000000000); }
+    /* 3: rdup 2 */
+    { stack[sp] = stack[sp - 1 - UINT64_C(2)]; sp++; }
+    /* 4: rdup 0 */
+    { stack[sp] = stack[sp - 1 - UINT64_C(0)]; sp++; }
+    /* 5: push -4616189618054758400 */
+    { stack[sp++].as_u64 = UINT64_C(0xbff0000000000000); }
+    /* 6: fma */
+    { stack[sp - 3].as_f64 = fma(stack[sp - 3].as_f64, stack[sp - 2].as_f64, stack[sp - 1].as_f64); sp -= 2; }
+    /* 7: divf */
+    { stack[sp - 2].as_f64 /= stack[sp - 1].as_f64; sp--; }
+    /* 8: addf */
+    { stack[sp - 2].as_f64 += stack[sp - 1].as_f64; sp--; }
+    /* 9: swap 1 */
+    { const word_t t = stack[sp - 1]; stack[sp - 1] = stack[sp - 1 - UINT64_C(1)]; stack[sp - 1 - UINT64_C(1)] = t; }
+    /* 10: push 4616189618054758400 */
+    { stack[sp++].as_u64 = UINT64_C(0x4010000000000000); }
+    /* 11: addf */
+    { stack[sp - 2].as_f64 += stack[sp - 1].as_f64; sp--; }
+    /* 12: swap 1 */
+    { const word_t t = stack[sp - 1]; stack[sp - 1] = stack[sp - 1 - UINT64_C(1)]; stack[sp - 1 - UINT64_C(1)] = t; }
+    /* 13: rdup 1 */
+    { stack[sp] = stack[sp - 1 - UINT64_C(1)]; sp++; }
+    /* 14: push 4703696862291427328 */
+    { stack[sp++].as_u64 = UINT64_C(0x4146e36000000000); }
+    /* 15: ltf */
+    { stack[sp - 2].as_u64 = stack[sp - 2].as_f64 < stack[sp - 1].as_f64; sp--; }
+    /* 16: jnz 2 */
+    if (stack[--sp].as_u64) goto L_2;
+
+    if (budget < 6) VVM2C_RESUME(17);
+    budget -= 6;
+    /* 17: swap 1 */
+    { const word_t t = stack[sp - 1]; stack[sp - 1] = stack[sp - 1 - UINT64_C(1)]; stack[sp - 1 - UINT64_C(1)] = t; }
+    /* 18: push 0 */
+    { stack[sp++].as_u64 = UINT64_C(0x0000000000000000); }
+    /* 19: muli */
+    { stack[sp - 2].as_u64 *= stack[sp - 1].as_u64; sp--; }
+    /* 20: addi */
+    { stack[sp - 2].as_u64 += stack[sp - 1].as_u64; sp--; }
+    /* 21: print_debug */
+    VVM2C_INTERPRET(21);
+    /* 22: halt */
+    VVM2C_INTERPRET(22);
+
+    (void)budget;
+    VVM2C_RESUME(VVM2C_PROGRAM_SIZE);
+}
+
+static void usage(FILE* p_stream, const char* p_program)
+{
+    fprintf(p_stream, "Usage: %s [-l <limit>] [--native <lib.so>] [-s] [-h]\n", p_program);
+}
+
+int main(int argc, char** argv)
+{
+    int limit = -1;
+    int dump = 0;
+    const char* native_file_path = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-l") == 0) {
+            if (i + 1 == argc)
+            {
+                usage(stderr, argv[0]);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", argv[i]);
+                exit(1);
+            }
+            limit = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--native") == 0) {
+            if (i + 1 == argc)
+            {
+                usage(stderr, argv[0]);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", argv[i]);
+                exit(1);
+            }
+            native_file_path = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0) {
+            dump = 1;
+        } else if (strcmp(argv[i], "-h") == 0) {
+            usage(stdout, argv[0]);
+            exit(0);
+        } else {
+            usage(stderr, argv[0]);
+            fprintf(stderr, "[ERROR]: Unknown Flag `%s`\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    arena_t arena = {0};
+    vvm_t vm = {0};
+    if (vm_init(&vm, &arena, VVM2C_STACK_CAPACITY) != ERR_OK)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+    if (vm_map_memory(&vm, VVM2C_MEMORY_SIZE, 0) != ERR_OK ||
+        vm_load_program_from_memory(&vm, program, VVM2C_PROGRAM_SIZE) != ERR_OK)
+        exit(1);
+
+    // Natives are always interpreted, and the program is compiled against
+    // no table, so any table with the ids it calls will do.
+#ifdef VVM_DLOPEN
+    native_library_t natives = {0};
+    if (native_file_path != NULL)
+    {
+        if (native_library_open(native_file_path, &natives, stderr) != ERR_OK)
+            exit(1);
+        vm.natives = natives.table;
+    }
+#else
+    if (native_file_path != NULL)
+    {
+        fprintf(stderr, "[ERROR]: Flag `--native` Is Not Supported By This Build\n");
+        exit(1);
+    }
+#endif
+
+    const error err = vvm2c_run(&vm, limit);
+
+    // Output up to an error is written out all the same.
+    if (vm_flush_channel(&vm) != ERR_OK)
+        exit(1);
+    if (dump)
+        vm_dump_stack(stdout, &vm);
+    if (err != ERR_OK)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(err));
+        exit(1);
+    }
+
+    vm_unmap_memory(&vm);
+#ifdef VVM_DLOPEN
+    native_library_close(&natives);
+#endif
+    arena_free(&arena);
+    return 0;
+}
@@ -0,0 +1,81 @@
+// A table of natives for `--native ./build/natives.so`, see natives.vasm. It
+// only needs the types of vvm.h, so it's built without VM_IMPLEMENTATION.
+#include <math.h>
+
+#include "../src/vvm.h"
+
+// splitmix64, which mixes every bit of the word into every bit of the hash.
+static error native_hash(void* p_user, word_t* p_words)
+{
+    (void)p_user;
+    uint64_t x = p_words[0].as_u64 + 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    p_words[0].as_u64 = x ^ (x >> 31);
+    return ERR_OK;
+}
+
+static error native_sin(void* p_user, word_t* p_words)
+{
+    (void)p_user;
+    p_words[0].as_f64 = sin(p_words[0].as_f64);
+    return ERR_OK;
+}
+
+static error native_cos(void* p_user, word_t* p_words)
+{
+    (void)p_user;
+    p_words[0].as_f64 = cos(p_words[0].as_f64);
+    return ERR_OK;
+}
+
+// Leaves the sine deepest and the cosine on top.
+static error native_sincos(void* p_user, word_t* p_words)
+{
+    (void)p_user;
+    const double x = p_words[0].as_f64;
+    p_words[0].as_f64 = sin(x);
+    p_words[1].as_f64 = cos(x);
+    return ERR_OK;
+}
+
+static error native_exp(void* p_user, word_t* p_words)
+{
+    (void)p_user;
+    p_words[0].as_f64 = exp(p_words[0].as_f64);
+    return ERR_OK;
+}
+
+// Stops the program on numbers that have no logarithm.
+static error native_log(void* p_user, word_t* p_words)
+{
+    (void)p_user;
+    if (!(p_words[0].as_f64 > 0.0))
+        return ERR_ILLEGAL_OPERAND;
+    p_words[0].as_f64 = log(p_words[0].as_f64);
+    return ERR_OK;
+}
+
+// Raises the deeper word to the power on top.
+static error native_pow(void* p_user, word_t* p_words)
+{
+    (void)p_user;
+    p_words[0].as_f64 = pow(p_words[0].as_f64, p_words[1].as_f64);
+    return ERR_OK;
+}
+
+static const native_t entries[] = {
+    { "hash",   native_hash,   1, 1 },
+    { "sin",    native_sin,    1, 1 },
+    { "cos",    native_cos,    1, 1 },
+    { "sincos", native_sincos, 1, 2 },
+    { "exp",    native_exp,    1, 1 },
+    { "log",    native_log,    1, 1 },
+    { "pow",    native_pow,    2, 1 },
+};
+
+const native_table_t vvm_natives = {
+    .entries = entries,
+    .count = ARRAY_SIZE(entries),
+    .user = NULL,
+};
@@ -0,0 +1,111 @@
+#define VM_IMPLEMENTATION
+#include "./vvm.h"
+
+// Formats the words written by `out`, which land on the channel as their raw
+// 8 bytes, one per line. The default format is the one of print_debug.
+typedef enum {
+    FORMAT_ALL = 0,
+    FORMAT_U64,
+    FORMAT_I64,
+    FORMAT_F64,
+    FORMAT_HEX,
+} format_type;
+
+static const char* const format_names[] = {
+    [FORMAT_ALL] = "all",
+    [FORMAT_U64] = "u64",
+    [FORMAT_I64] = "i64",
+    [FORMAT_F64] = "f64",
+    [FORMAT_HEX] = "hex",
+};
+
+static void print_word(FILE* p_stream, word_t p_word, format_type p_format)
+{
+    switch (p_format)
+    {
+        case FORMAT_ALL:
+            fprintf(p_stream, "  u64: %lu, i64: %ld, f64: %lf, ptr: %p\n", p_word.as_u64, p_word.as_i64, p_word.as_f64, p_word.as_ptr);
+            break;
+        case FORMAT_U64:
+            fprintf(p_stream, "%lu\n", p_word.as_u64);
+            break;
+        case FORMAT_I64:
+            fprintf(p_stream, "%ld\n", p_word.as_i64);
+            break;
+        case FORMAT_F64:
+            fprintf(p_stream, "%lf\n", p_word.as_f64);
+            break;
+        case FORMAT_HEX:
+            fprintf(p_stream, "0x%016lx\n", p_word.as_u64);
+            break;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: ./deout <output> [all | u64 | i64 | f64 | hex]\n");
+        fprintf(stderr, "[ERROR]: No Input Provided\n");
+        exit(1);
+    }
+
+    format_type format = FORMAT_ALL;
+    if (argc > 2)
+    {
+        size_t i = 0;
+        while (i < ARRAY_SIZE(format_names) && strcmp(argv[2], format_names[i]) != 0)
+            ++i;
+        if (i == ARRAY_SIZE(format_names))
+        {
+            fprintf(stderr, "[ERROR]: Unknown Format `%s`\n", argv[2]);
+            exit(1);
+        }
+        format = (format_type)i;
+    }
+
+    // `-` reads the output of a program piped into deout.
+    const char* input_file_path = argv[1];
+    FILE* f = strcmp(input_file_path, "-") == 0 ? stdin : fopen(input_file_path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", input_file_path, strerror(errno));
+        exit(1);
+    }
+
+    static uint8_t buffer[VVM_CHANNEL_CAPACITY];
+    size_t size = 0;
+    size_t count = 0;
+    while ((count = fread(buffer + size, 1, sizeof(buffer) - size, f)) > 0)
+    {
+        size += count;
+
+        const size_t words = size / sizeof(word_t);
+        for (size_t i = 0; i < words; ++i)
+        {
+            word_t word;
+            memcpy(&word, buffer + i * sizeof(word), sizeof(word));
+            print_word(stdout, word, format);
+        }
+
+        // A word may be split across reads.
+        size -= words * sizeof(word_t);
+        memmove(buffer, buffer + words * sizeof(word_t), size);
+    }
+
+    if (ferror(f))
+    {
+        fprintf(stderr, "[ERROR]: Could Not Read File `%s`: %s\n", input_file_path, strerror(errno));
+        exit(1);
+    }
+
+    if (size != 0)
+    {
+        fprintf(stderr, "[ERROR]: `%s` Ends In The Middle Of A Word\n", input_file_path);
+        exit(1);
+    }
+
+    if (f != stdin)
+        fclose(f);
+    return 0;
+}
@@ -0,0 +1,211 @@
+#define VM_IMPLEMENTATION
+#include "./vvm.h"
+
+arena_t arena = {0};
+vvm_t vm = {0};
+vasm_t vasm = {0};
+
+#ifdef VVM_TRACE
+#define STACK_SIZE_UNKNOWN UINT64_MAX
+
+static const char* const trace_kind_names[] = {
+    [TRACE_START] = "start",
+    [TRACE_JUMP] = "jump",
+    [TRACE_STOP] = "stop",
+};
+
+static void print_raw_entry(uint64_t p_index, const trace_entry_t* p_entry)
+{
+    char inst[32] = "<out of range>";
+    if (p_entry->opcode < NUMBER_OF_INSTS)
+        snprintf(inst, sizeof(inst), "%s", inst_name(p_entry->opcode));
+    else if (p_entry->opcode != VVM_TRACE_NO_OPCODE)
+        snprintf(inst, sizeof(inst), "<illegal %u>", p_entry->opcode);
+
+    const char* kind = p_entry->kind <= TRACE_STOP ? trace_kind_names[p_entry->kind] : "?";
+    fprintf(stdout, "%12lu %-6s %10lu  %-24s %8u\n", p_index, kind, p_entry->inst_pointer, inst, p_entry->stack_size);
+}
+
+// Prints the instruction at p_addr with the stack size it starts at, and
+// returns the size it leaves behind, which is unknown after natives.
+static uint64_t print_inst(inst_addr_t p_addr, uint64_t p_stack_size, const char* p_note)
+{
+    for (size_t i = 0; i < vasm.labels_size; ++i)
+        if (vasm.labels[i].addr == p_addr)
+            fprintf(stdout, "%.*s:\n", (int)vasm.labels[i].name.count, vasm.labels[i].name.data);
+
+    char inst[64] = "<out of range>";
+    if (p_addr < vm.program_size)
+    {
+        const inst_t program_inst = vm.program[p_addr];
+        if (program_inst.type >= NUMBER_OF_INSTS)
+            snprintf(inst, sizeof(inst), "<illegal %u>", (unsigned)program_inst.type);
+        else if (inst_has_operand(program_inst.type))
+            snprintf(inst, sizeof(inst), "%s %ld", inst_name(program_inst.type), program_inst.operand.as_i64);
+        else
+            snprintf(inst, sizeof(inst), "%s", inst_name(program_inst.type));
+    }
+
+    char stack_size[24] = "?";
+    if (p_stack_size != STACK_SIZE_UNKNOWN)
+        snprintf(stack_size, sizeof(stack_size), "%lu", p_stack_size);
+    fprintf(stdout, "%10lu  %-24s %8s%s%s\n", p_addr, inst, stack_size, *p_note != '\0' ? "  " : "", p_note);
+
+    uint64_t pops = 0;
+    uint64_t pushes = 0;
+    if (p_stack_size == STACK_SIZE_UNKNOWN || p_addr >= vm.program_size ||
+        !vm_stack_effect(vm.program[p_addr], &pops, &pushes) || pops > p_stack_size)
+        return STACK_SIZE_UNKNOWN;
+    return p_stack_size - pops + pushes;
+}
+
+// Prints the instructions from p_from through p_last, the first of them
+// with p_note, and returns the stack size they end at.
+static uint64_t print_straight_line(inst_addr_t p_from, inst_addr_t p_last, uint64_t p_stack_size, const char* p_note)
+{
+    for (inst_addr_t addr = p_from; addr <= p_last && addr < vm.program_size; ++addr)
+    {
+        p_stack_size = print_inst(addr, p_stack_size, p_note);
+        p_note = "";
+    }
+    return p_stack_size;
+}
+
+// Only the jumps that are taken are recorded, so between two entries the run
+// went down the straight line from where the first of them landed. Runs that
+// leave the program do so by a jump to where they stopped, which is far and
+// not recorded, or by running off its end, and a run caught by a signal is
+// somewhere between the last entry and the next jump or halt.
+static void print_rebuilt(const trace_entry_t* p_entries, uint64_t p_count, int p_signal)
+{
+    inst_addr_t from = 0;
+    uint64_t stack_size = 0;
+    int on_line = 0;
+    const char* note = "";
+
+    for (uint64_t i = 0; i < p_count; ++i)
+    {
+        const trace_entry_t* entry = &p_entries[i];
+        const inst_addr_t at = entry->inst_pointer;
+
+        if (on_line && at >= vm.program_size)
+        {
+            inst_addr_t last = from;
+            while (last + 1 < vm.program_size &&
+                   !(inst_is_jump(vm.program[last].type) && vm.program[last].operand.as_u64 == at))
+                last++;
+            print_straight_line(from, last, stack_size, note);
+        }
+        else if (on_line && at > from)
+            print_straight_line(from, at - 1, stack_size, note);
+
+        stack_size = entry->stack_size;
+        on_line = 0;
+        note = "";
+        switch (entry->kind)
+        {
+            case TRACE_START:
+                // Printed with the first instruction of the line it starts.
+                from = at;
+                on_line = at < vm.program_size;
+                note = "start";
+                break;
+            case TRACE_JUMP:
+                stack_size = print_inst(at, stack_size, "taken");
+                from = at < vm.program_size ? vm.program[at].operand.as_u64 : at;
+                on_line = from < vm.program_size;
+                break;
+            case TRACE_STOP:
+                print_inst(at, stack_size, "failed");
+                break;
+            default:
+                fprintf(stdout, "%10lu  <unknown entry %u>\n", at, entry->kind);
+                break;
+        }
+    }
+
+    if (on_line && p_signal != 0)
+    {
+        inst_addr_t last = from;
+        while (last + 1 < vm.program_size && !inst_is_jump(vm.program[last].type) && vm.program[last].type != INST_HALT)
+            last++;
+        for (inst_addr_t addr = from; addr <= last; ++addr)
+            stack_size = print_inst(addr, stack_size, "running");
+    }
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: ./detrace <trace> [<input.vm>]\n");
+        fprintf(stderr, "[ERROR]: No Input Provided\n");
+        exit(1);
+    }
+
+#ifdef VVM_TRACE
+    const char* trace_file_path = argv[1];
+    string_view_t image;
+    if (sv_slurp_file(trace_file_path, &image, stderr) != ERR_OK)
+        exit(1);
+
+    trace_file_header_t header;
+    if (image.count < sizeof(header) || memcmp(image.data, VVM_TRACE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fprintf(stderr, "[ERROR]: `%s` Is Not A Trace\n", trace_file_path);
+        exit(1);
+    }
+
+    memcpy(&header, image.data, sizeof(header));
+    if (header.version != VVM_TRACE_VERSION || header.entry_size != sizeof(trace_entry_t) ||
+        header.count > (image.count - sizeof(header)) / sizeof(trace_entry_t))
+    {
+        fprintf(stderr, "[ERROR]: Invalid Trace File `%s`\n", trace_file_path);
+        exit(1);
+    }
+
+    // The entries are copied out, as the image need not be aligned for them.
+    trace_entry_t* entries = arena_alloc(&arena, header.count * sizeof(trace_entry_t));
+    if (entries == NULL)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+    memcpy(entries, image.data + sizeof(header), header.count * sizeof(trace_entry_t));
+
+    fprintf(stdout, "Trace: last %lu of %lu entries, stopped by ", header.count, header.recorded);
+    if (header.signal != 0)
+        fprintf(stdout, "signal %d (%s)\n", header.signal, strsignal(header.signal));
+    else
+        fprintf(stdout, "%s\n", header.error < NUMBER_OF_ERRORS ? error_as_cstr(header.error) : "an unknown error");
+
+    if (argc > 2)
+    {
+        if (vm_init(&vm, &arena, VVM_DEFAULT_STACK_CAPACITY) != ERR_OK)
+        {
+            fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+            exit(1);
+        }
+        vasm_init(&vasm, &arena);
+        if (vm_load_program_from_file(&vm, argv[2]) != ERR_OK ||
+            vm_load_symbols_from_file(argv[2], &vasm) != ERR_OK)
+            exit(1);
+
+        fprintf(stdout, "%10s  %-24s %8s\n", "addr", "inst", "stack");
+        print_rebuilt(entries, header.count, header.signal);
+    }
+    else
+    {
+        fprintf(stdout, "%12s %-6s %10s  %-24s %8s\n", "index", "kind", "addr", "inst", "stack");
+        for (uint64_t i = 0; i < header.count; ++i)
+            print_raw_entry(header.recorded - header.count + i, &entries[i]);
+    }
+#else
+    (void)argv;
+    fprintf(stderr, "[ERROR]: Tracing Is Not Supported By This Build\n");
+    exit(1);
+#endif
+
+    return 0;
+}
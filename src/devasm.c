@@ -1,27 +1,113 @@
 #define VM_IMPLEMENTATION
 #include "./vvm.h"
 
+arena_t arena = {0};
 vvm_t vm = {0};
+vasm_t vasm = {0};
+
+typedef struct {
+    uint64_t count;
+    double share;
+    char taken[16];
+} annotation_t;
+
+// Reads the hot spots of a profile written by `vme -p` back into one
+// annotation per address.
+static annotation_t* load_profile(const char* p_file_path, uint64_t p_program_size)
+{
+    FILE* f = fopen(p_file_path, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", p_file_path, strerror(errno));
+        exit(1);
+    }
+
+    annotation_t* annotations = arena_alloc(&arena, sizeof(annotations[0]) * (p_program_size + 1));
+    if (annotations == NULL)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+    memset(annotations, 0, sizeof(annotations[0]) * (p_program_size + 1));
+
+    char line[512];
+    int hot_spots = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (!hot_spots)
+        {
+            hot_spots = strncmp(line, "Hot spots:", 10) == 0;
+            continue;
+        }
+
+        uint64_t addr = 0;
+        annotation_t annotation = {0};
+        if (sscanf(line, "%lu %lu %lf%% %15s", &addr, &annotation.count, &annotation.share, annotation.taken) != 4)
+            continue;
+
+        if (addr >= p_program_size)
+        {
+            fprintf(stderr, "[ERROR]: Profile `%s` Does Not Match The Program: Address %lu Is Out Of Range\n", p_file_path, addr);
+            exit(1);
+        }
+        annotations[addr] = annotation;
+    }
+
+    if (!hot_spots)
+    {
+        fprintf(stderr, "[ERROR]: `%s` Is Not A Profile\n", p_file_path);
+        exit(1);
+    }
+
+    fclose(f);
+    return annotations;
+}
 
 int main(int argc, char** argv)
 {
     if (argc < 2)
     {
-        fprintf(stderr, "Usage: ./devasm <input.vm>\n");
+        fprintf(stderr, "Usage: ./devasm <input.vm> [<profile>]\n");
         fprintf(stderr, "[ERROR]: No Input Provided\n");
         exit(1);
     }
 
     const char* input_file_path = argv[1];
-    vm_load_program_from_file(&vm, input_file_path);
+    if (vm_init(&vm, &arena, VVM_DEFAULT_STACK_CAPACITY) != ERR_OK)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+    vasm_init(&vasm, &arena);
+    if (vm_load_program_from_file(&vm, input_file_path) != ERR_OK ||
+        vm_load_symbols_from_file(input_file_path, &vasm) != ERR_OK)
+        exit(1);
+
+    // With a profile, every instruction is prefixed by its execution count
+    // and share, and conditional jumps are followed by how often they jumped.
+    const annotation_t* annotations = NULL;
+    if (argc > 2)
+        annotations = load_profile(argv[2], vm.program_size);
 
     for (inst_addr_t i = 0; i < vm.program_size; ++i)
     {
+        for (size_t j = 0; j < vasm.labels_size; ++j)
+            if (vasm.labels[j].addr == i)
+                fprintf(stdout, "%.*s:\n", (int)vasm.labels[j].name.count, vasm.labels[j].name.data);
+        if (annotations != NULL)
+        {
+            if (annotations[i].count > 0)
+                fprintf(stdout, "%14lu %7.2f%%  ", annotations[i].count, annotations[i].share);
+            else
+                fprintf(stdout, "%14s %8s  ", "-", "");
+        }
         fprintf(stdout, "%s", inst_name(vm.program[i].type));
         if (inst_has_operand(vm.program[i].type))
             fprintf(stdout, " %ld", vm.program[i].operand.as_i64);
+        if (annotations != NULL && annotations[i].count > 0 && strcmp(annotations[i].taken, "-") != 0)
+            fprintf(stdout, " # taken %s", annotations[i].taken);
         fprintf(stdout, "\n");
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,216 @@
+#define VM_IMPLEMENTATION
+#include "./vvm.h"
+#include "./libvvm.h"
+
+static_assert((int)VVM_STATUS_STACK_OVERFLOW == (int)ERR_STACK_OVERFLOW, "Statuses Must Match Errors");
+static_assert((int)VVM_STATUS_DIV_BY_ZERO == (int)ERR_DIV_BY_ZERO, "Statuses Must Match Errors");
+static_assert((int)VVM_STATUS_ILLEGAL_MEMORY_ACCESS == (int)ERR_ILLEGAL_MEMORY_ACCESS, "Statuses Must Match Errors");
+static_assert((int)VVM_STATUS_INVALID_SOURCE == (int)ERR_INVALID_SOURCE, "Statuses Must Match Errors");
+static_assert((int)VVM_STATUS_INVALID_SOURCE + 1 == (int)NUMBER_OF_ERRORS, "Statuses Must Match Errors");
+
+struct vvm_handle_t {
+    arena_t arena;
+    vvm_t vm;
+    uint64_t stack_capacity;
+    uint64_t memory_size;
+    FILE* output;
+    FILE* diagnostics;
+    vvm_channel_fn sink;
+    void* sink_user;
+
+    // Whether vm.verified holds for the current state. Verification starts
+    // from the state it is run in, so it has to be redone when the stack is
+    // changed from outside of the program, and only holds again after a reset
+    // when it started from the empty machine.
+    int verified;
+    int verified_from_start;
+};
+
+// Drops the program and everything else in the arena, and starts over with
+// an empty machine and zeroed memory.
+static error vvm_handle_clear(vvm_handle_t* p_handle)
+{
+    vm_unload_program(&p_handle->vm);
+    vm_unmap_memory(&p_handle->vm);
+    arena_reset(&p_handle->arena);
+    const error err = vm_init(&p_handle->vm, &p_handle->arena, p_handle->stack_capacity);
+    p_handle->vm.output = p_handle->output;
+    p_handle->vm.diagnostics = p_handle->diagnostics;
+    p_handle->vm.channel.sink = p_handle->sink;
+    p_handle->vm.channel.user = p_handle->sink_user;
+    p_handle->verified = 0;
+    p_handle->verified_from_start = 0;
+    if (err != ERR_OK)
+        return err;
+    return vm_map_memory(&p_handle->vm, p_handle->memory_size, 0);
+}
+
+vvm_handle_t* vvm_create(uint64_t p_stack_capacity)
+{
+    vvm_handle_t* handle = calloc(1, sizeof(*handle));
+    if (handle == NULL)
+        return NULL;
+
+    handle->stack_capacity = p_stack_capacity;
+    handle->memory_size = VVM_DEFAULT_MEMORY_SIZE;
+    handle->output = stdout;
+    const error err = vm_init(&handle->vm, &handle->arena, p_stack_capacity);
+    handle->vm.diagnostics = NULL;
+    if (err != ERR_OK || vm_map_memory(&handle->vm, handle->memory_size, 0) != ERR_OK)
+    {
+        arena_free(&handle->arena);
+        free(handle);
+        return NULL;
+    }
+
+    return handle;
+}
+
+void vvm_destroy(vvm_handle_t* p_handle)
+{
+    if (p_handle == NULL)
+        return;
+
+    vm_unload_program(&p_handle->vm);
+    vm_unmap_memory(&p_handle->vm);
+    arena_free(&p_handle->arena);
+    free(p_handle);
+}
+
+void vvm_set_output(vvm_handle_t* p_handle, FILE* p_stream)
+{
+    p_handle->output = p_stream;
+    p_handle->vm.output = p_stream;
+}
+
+void vvm_set_diagnostics(vvm_handle_t* p_handle, FILE* p_stream)
+{
+    p_handle->diagnostics = p_stream;
+    p_handle->vm.diagnostics = p_stream;
+}
+
+void vvm_set_sink(vvm_handle_t* p_handle, vvm_channel_fn p_sink, void* p_user)
+{
+    p_handle->sink = p_sink;
+    p_handle->sink_user = p_user;
+    p_handle->vm.channel.sink = p_sink;
+    p_handle->vm.channel.user = p_user;
+}
+
+vvm_status vvm_set_memory_size(vvm_handle_t* p_handle, uint64_t p_size)
+{
+    // Constant addresses are verified against the memory size.
+    p_handle->memory_size = p_size;
+    p_handle->verified = 0;
+    const error err = vm_map_memory(&p_handle->vm, p_size, 0);
+    if (err != ERR_OK)
+        p_handle->memory_size = 0;
+
+    return (vvm_status)err;
+}
+
+uint64_t* vvm_memory(vvm_handle_t* p_handle, uint64_t* p_size)
+{
+    if (p_size != NULL)
+        *p_size = p_handle->vm.memory_size;
+
+    return (uint64_t*)p_handle->vm.memory;
+}
+
+vvm_status vvm_load_image(vvm_handle_t* p_handle, const void* p_image, size_t p_size)
+{
+    const error err = vvm_handle_clear(p_handle);
+    if (err != ERR_OK)
+        return (vvm_status)err;
+
+    return (vvm_status)vm_load_program_from_image(&p_handle->vm, p_image, p_size);
+}
+
+vvm_status vvm_load_file(vvm_handle_t* p_handle, const char* p_file_path)
+{
+    const error err = vvm_handle_clear(p_handle);
+    if (err != ERR_OK)
+        return (vvm_status)err;
+
+    return (vvm_status)vm_map_program_from_file(&p_handle->vm, p_file_path);
+}
+
+vvm_status vvm_assemble(vvm_handle_t* p_handle, const char* p_source, size_t p_size)
+{
+    error err = vvm_handle_clear(p_handle);
+    if (err != ERR_OK)
+        return (vvm_status)err;
+
+    vasm_t vasm;
+    vasm_init(&vasm, &p_handle->arena);
+    vasm.diagnostics = p_handle->diagnostics;
+
+    err = vm_translate_source((string_view_t) { .count = p_size, .data = p_source }, &p_handle->vm, &vasm);
+    if (err != ERR_OK)
+        vm_unload_program(&p_handle->vm);
+
+    return (vvm_status)err;
+}
+
+vvm_status vvm_run(vvm_handle_t* p_handle, int p_budget)
+{
+    // The threaded engine runs the instructions the verifier proves safe
+    // without their checks, and takes budgets without falling back.
+    if (!p_handle->verified)
+    {
+        vm_verify_program(&p_handle->vm, NULL);
+        p_handle->verified = 1;
+        p_handle->verified_from_start = p_handle->vm.inst_pointer == 0 && p_handle->vm.stack_size == 0;
+    }
+
+    const error err = vm_execute_program_threaded(&p_handle->vm, p_budget);
+    const error flushed = vm_flush_channel(&p_handle->vm);
+    return (vvm_status)(err != ERR_OK ? err : flushed);
+}
+
+int vvm_halted(const vvm_handle_t* p_handle)
+{
+    return p_handle->vm.halt;
+}
+
+vvm_status vvm_push(vvm_handle_t* p_handle, uint64_t p_word)
+{
+    vvm_t* vm = &p_handle->vm;
+    if (vm->stack_size >= vm->stack_capacity)
+        return VVM_STATUS_STACK_OVERFLOW;
+
+    vm->stack[vm->stack_size++].as_u64 = p_word;
+    p_handle->verified = 0;
+    return VVM_STATUS_OK;
+}
+
+uint64_t vvm_stack_size(const vvm_handle_t* p_handle)
+{
+    return p_handle->vm.stack_size;
+}
+
+vvm_status vvm_stack_read(const vvm_handle_t* p_handle, uint64_t p_index, uint64_t* p_word)
+{
+    const vvm_t* vm = &p_handle->vm;
+    if (p_index >= vm->stack_size)
+        return VVM_STATUS_STACK_UNDERFLOW;
+
+    *p_word = vm->stack[vm->stack_size - 1 - p_index].as_u64;
+    return VVM_STATUS_OK;
+}
+
+void vvm_reset(vvm_handle_t* p_handle)
+{
+    p_handle->verified = p_handle->verified && p_handle->verified_from_start;
+    p_handle->vm.stack_size = 0;
+    p_handle->vm.inst_pointer = 0;
+    p_handle->vm.halt = 0;
+}
+
+const char* vvm_status_as_cstr(vvm_status p_status)
+{
+    if ((int)p_status < 0 || (int)p_status >= NUMBER_OF_ERRORS)
+        return "unknown status";
+
+    return error_as_cstr((error)p_status);
+}
@@ -0,0 +1,90 @@
+#ifndef __LIBVVM_H_INCLUDED__
+#define __LIBVVM_H_INCLUDED__
+
+// Embedding interface of the virtual machine, built into build/libvvm.a and
+// build/libvvm.so by `make libvvm`. A handle owns a machine, its program and
+// all of their memory, and handles share nothing, so different threads can
+// use different handles at the same time. The library never exits and only
+// prints what programs print: failures are returned as a status, and
+// described on the diagnostics stream of the handle when it has one.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VVM_API __attribute__((visibility("default")))
+#else
+#define VVM_API
+#endif
+
+// The errors of vvm.h, in the same order.
+typedef enum {
+    VVM_STATUS_OK = 0,
+
+    VVM_STATUS_STACK_OVERFLOW,
+    VVM_STATUS_STACK_UNDERFLOW,
+
+    VVM_STATUS_ILLEGAL_INSTRUCTION,
+    VVM_STATUS_ILLEGAL_INSTRUCTION_ACCESS,
+    VVM_STATUS_ILLEGAL_OPERAND,
+
+    VVM_STATUS_DIV_BY_ZERO,
+    VVM_STATUS_ILLEGAL_MEMORY_ACCESS,
+
+    VVM_STATUS_OUT_OF_MEMORY,
+    VVM_STATUS_FILE_ACCESS,
+    VVM_STATUS_INVALID_FILE,
+    VVM_STATUS_INVALID_SOURCE,
+} vvm_status;
+
+typedef struct vvm_handle_t vvm_handle_t;
+
+// Receives blocks of what out and outi write, see vvm_set_sink.
+typedef void (*vvm_channel_fn)(void* p_user, const void* p_data, size_t p_size);
+
+// Returns NULL when out of memory.
+VVM_API vvm_handle_t* vvm_create(uint64_t p_stack_capacity);
+VVM_API void vvm_destroy(vvm_handle_t* p_handle);
+
+// print_debug writes to stdout unless told otherwise, failures are described
+// nowhere unless given a stream. Either can be NULL, the output only when
+// programs never print.
+VVM_API void vvm_set_output(vvm_handle_t* p_handle, FILE* p_stream);
+VVM_API void vvm_set_diagnostics(vvm_handle_t* p_handle, FILE* p_stream);
+
+// out and outi are buffered and written to stdout in large blocks, or handed
+// to p_sink when it is not NULL. Whatever is buffered goes out before
+// vvm_run returns.
+VVM_API void vvm_set_sink(vvm_handle_t* p_handle, vvm_channel_fn p_sink, void* p_user);
+
+// Machines start with 1 << 20 words of memory for load and store, which can
+// be resized, or dropped with a size of 0. Memory is zeroed when a program is
+// loaded and kept across resets. Hosts can fill it in and read it back
+// through vvm_memory, which returns NULL when there is none.
+VVM_API vvm_status vvm_set_memory_size(vvm_handle_t* p_handle, uint64_t p_size);
+VVM_API uint64_t* vvm_memory(vvm_handle_t* p_handle, uint64_t* p_size);
+
+// Replace the program and reset the machine. Images are the contents of a .vm
+// file and sources are assembly, both are copied, so they can go away once
+// loaded. A program that fails to load leaves the machine without one.
+VVM_API vvm_status vvm_load_image(vvm_handle_t* p_handle, const void* p_image, size_t p_size);
+VVM_API vvm_status vvm_load_file(vvm_handle_t* p_handle, const char* p_file_path);
+VVM_API vvm_status vvm_assemble(vvm_handle_t* p_handle, const char* p_source, size_t p_size);
+
+// Runs at most p_budget instructions, or until the program halts or fails
+// when p_budget is negative. Runs that stop on the budget can be resumed.
+VVM_API vvm_status vvm_run(vvm_handle_t* p_handle, int p_budget);
+VVM_API int vvm_halted(const vvm_handle_t* p_handle);
+
+// Stack words are read from the top, index 0 is the top of the stack.
+VVM_API vvm_status vvm_push(vvm_handle_t* p_handle, uint64_t p_word);
+VVM_API uint64_t vvm_stack_size(const vvm_handle_t* p_handle);
+VVM_API vvm_status vvm_stack_read(const vvm_handle_t* p_handle, uint64_t p_index, uint64_t* p_word);
+
+// Empties the stack and starts the program over.
+VVM_API void vvm_reset(vvm_handle_t* p_handle);
+
+VVM_API const char* vvm_status_as_cstr(vvm_status p_status);
+
+#endif // __LIBVVM_H_INCLUDED__
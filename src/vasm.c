@@ -1,6 +1,7 @@
 #define VM_IMPLEMENTATION
 #include "./vvm.h"
 
+arena_t arena = {0};
 vvm_t vm = {0};
 vasm_t vasm = {0};
 
@@ -17,7 +18,7 @@ static const char* shift(int* argc, char*** argv)
 
 static void usage(FILE* p_stream, const char* p_program)
 {
-    fprintf(p_stream, "Usage: %s <input.vasm> <output.vm>\n", p_program);
+    fprintf(p_stream, "Usage: %s [-O] [--native <lib.so>] <input.vasm> <output.vm>\n", p_program);
 }
 
 int main(int argc, char** argv)
@@ -31,6 +32,32 @@ int main(int argc, char** argv)
         exit(1);
     }
 
+    // Check for the optimization flag and the native library, in any order.
+    int optimize = 0;
+    const char* native_file_path = NULL;
+    while (strcmp(argv[0], "-O") == 0 || strcmp(argv[0], "--native") == 0)
+    {
+        const char* flag = shift(&argc, &argv);
+        if (strcmp(flag, "-O") == 0) {
+            optimize = 1;
+        } else {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+            native_file_path = shift(&argc, &argv);
+        }
+
+        if (argc == 0)
+        {
+            usage(stderr, program);
+            fprintf(stderr, "[ERROR]: Expected Input\n");
+            exit(1);
+        }
+    }
+
     // Get the input path.
     const char* input_file_path = shift(&argc, &argv);
     if (argc == 0)
@@ -43,9 +70,51 @@ int main(int argc, char** argv)
     // Get the output file.
     const char* output_file_path = shift(&argc, &argv);
 
-    string_view_t source = sv_slurp_file(input_file_path);
-    vm_translate_source(source, &vm, &vasm);
-    vm_save_program_to_file(&vm, output_file_path);
-    
+    if (vm_init(&vm, &arena, VVM_DEFAULT_STACK_CAPACITY) != ERR_OK)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+    vasm_init(&vasm, &arena);
+
+    // Native names resolve to the ids of the table, which the verifier also
+    // checks the arities against.
+#ifdef VVM_DLOPEN
+    native_library_t native_library = {0};
+    if (native_file_path != NULL)
+    {
+        if (native_library_open(native_file_path, &native_library, stderr) != ERR_OK)
+            exit(1);
+        vasm.natives = native_library.table;
+        vm.natives = native_library.table;
+    }
+#else
+    if (native_file_path != NULL)
+    {
+        fprintf(stderr, "[ERROR]: Flag `--native` Is Not Supported By This Build\n");
+        exit(1);
+    }
+#endif
+
+    // Failures have already been described on stderr.
+    file_view_t source;
+    if (file_view_open(input_file_path, &source, stderr) != ERR_OK)
+        exit(1);
+    if (vm_translate_source(source.content, &vm, &vasm) != ERR_OK)
+        exit(1);
+    if (optimize)
+    {
+        if (vm_optimize_program(&vm, &vasm) != ERR_OK ||
+            vm_fuse_superinstructions(&vm, &vasm) != ERR_OK)
+            exit(1);
+    }
+    vm_verify_program(&vm, stderr);
+    if (vm_save_program_to_file(&vm, &vasm, output_file_path) != ERR_OK)
+        exit(1);
+    file_view_close(&source);
+#ifdef VVM_DLOPEN
+    native_library_close(&native_library);
+#endif
+
     return 0;
 }
\ No newline at end of file
@@ -1,6 +1,16 @@
 #define VM_IMPLEMENTATION
 #include "./vvm.h"
 
+#include <limits.h>
+#include <signal.h>
+
+// Batch mode runs jobs on a pool of POSIX threads.
+#if defined(__unix__)
+#define VME_BATCH
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
 static const char* shift(int* argc, char*** argv)
 {
     assert(*argc > 0);
@@ -14,17 +24,431 @@ static const char* shift(int* argc, char*** argv)
 
 static void usage(FILE* p_stream, const char* p_program)
 {
-    fprintf(p_stream, "Usage: %s -i <input.vm> [-l <limit>] [-h] [-d]\n", p_program);
+    fprintf(p_stream, "Usage: %s (-i <input.vm> | --restore <snapshot>) [-l <limit>] [-e <engine>] [--stack-size <n>] [--memory-size <n>] [--huge-pages] [--native <lib.so>] [-p <profile>] [-t <trace>] [--trace-size <n>] [--save-snapshot <snapshot> [--snapshot-at <n>]] [-o <output>] [-s] [-h] [-d]\n", p_program);
+    fprintf(p_stream, "       %s --batch <jobs> [-i <input.vm>] [-j <threads>] [-l <limit>] [-e <engine>] [--stack-size <n>] [--memory-size <n>] [--huge-pages] [--native <lib.so>] [-s]\n", p_program);
+    fprintf(p_stream, "Engines: switch (default), threaded, register, jit, compact, tos\n");
+    fprintf(p_stream, "With --memory-size, the machine has <n> words of memory for load and store, and --huge-pages backs it with huge pages\n");
+    fprintf(p_stream, "With --native, native calls go to the table that <lib.so> exports as %s\n", VVM_NATIVE_SYMBOL);
+    fprintf(p_stream, "With -p, the program is interpreted and a profile is written to <profile>\n");
+    fprintf(p_stream, "With -t, the program is interpreted and the last jumps it takes are written to <trace> on errors and signals\n");
+    fprintf(p_stream, "With --save-snapshot, the state is saved after <n> instructions, or once the program stops, and --restore resumes from it\n");
+    fprintf(p_stream, "With -o, what out and outi write goes to <output> instead of stdout\n");
+    fprintf(p_stream, "With --batch, every line of <jobs> is a program to run, or the initial stack of <input.vm> when -i is given\n");
+}
+
+typedef struct {
+    const char* name;
+    error (*execute)(vvm_t*, int);
+} engine_t;
+
+// The arena returns NULL once malloc fails, which vme cannot go on from.
+static void* expect_memory(void* p_data)
+{
+    if (p_data == NULL)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+    return p_data;
+}
+
+static void expect_ok(error p_error)
+{
+    if (p_error != ERR_OK)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(p_error));
+        exit(1);
+    }
+}
+
+static const engine_t engines[] = {
+    { "switch",   vm_execute_program },
+    { "threaded", vm_execute_program_threaded },
+    { "register", vm_execute_program_registers },
+    { "jit",      vm_execute_program_jit },
+    { "compact",  vm_execute_program_compact },
+    { "tos",      vm_execute_program_tos },
+};
+
+#ifdef VVM_TRACE
+// Signal handlers cannot be handed arguments, so the trace is the one piece of
+// state that lives outside of main.
+static trace_t trace = {0};
+static const char* trace_file_path = NULL;
+
+static int trace_dump(error p_error, int p_signal)
+{
+    const int fd = open(trace_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return 0;
+
+    const int result = vm_trace_write(&trace, fd, p_error, p_signal);
+    close(fd);
+    return result;
+}
+
+// SIGUSR1 dumps the trace of a running program and lets it carry on, the
+// other signals dump it before the process dies as it would have.
+static void trace_signal_handler(int p_signal)
+{
+    const int saved_errno = errno;
+    trace_dump(ERR_OK, p_signal);
+    errno = saved_errno;
+
+    if (p_signal != SIGUSR1)
+    {
+        signal(p_signal, SIG_DFL);
+        raise(p_signal);
+    }
+}
+
+static void trace_install_signal_handlers(void)
+{
+    static const int signals[] = { SIGUSR1, SIGINT, SIGTERM, SIGSEGV, SIGBUS, SIGFPE, SIGABRT };
+
+    for (size_t i = 0; i < ARRAY_SIZE(signals); ++i)
+    {
+        struct sigaction action = {0};
+        action.sa_handler = trace_signal_handler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(signals[i], &action, NULL);
+    }
+}
+#endif
+
+#ifdef VME_BATCH
+typedef struct {
+    const char* program;            // Program to run, NULL for the shared one.
+    word_t* inputs;                 // Initial stack, bottom first.
+    uint64_t inputs_count;
+    const uint8_t* verified;        // Verification of the shared program at
+                                    // the depth of the inputs.
+    char* output;                   // What the job printed.
+    size_t output_size;
+    char* diagnostics;              // Why its program could not be loaded.
+    size_t diagnostics_size;
+    error err;
+} batch_job_t;
+
+// Every worker owns a contiguous range of jobs and takes them from the front.
+// Once its range is empty it takes jobs from the front of the other ranges,
+// so uneven jobs do not leave workers idle. Ranges sit on their own cache
+// lines because every take writes to one.
+typedef struct {
+    _Alignas(64) _Atomic size_t next;
+    size_t end;
+} batch_range_t;
+
+typedef struct {
+    batch_job_t* jobs;
+    size_t jobs_count;
+    batch_range_t* ranges;
+    size_t workers_count;
+
+    const vvm_t* program;           // The program every input runs, if any.
+    const engine_t* engine;
+    int limit;
+    uint64_t stack_size;
+    uint64_t memory_size;
+    int huge_pages;
+    const native_table_t* natives;
+    int dump;
+} batch_t;
+
+typedef struct {
+    batch_t* batch;
+    size_t id;
+    pthread_t thread;
+} batch_worker_t;
+
+// Input lines start the shared program at different depths, which changes
+// what the verifier can prove, so every depth gets its own verification.
+typedef struct {
+    uint64_t depth;
+    const uint8_t* verified;
+} batch_depth_t;
+
+static size_t batch_take(batch_t* p_batch, size_t p_worker)
+{
+    for (size_t i = 0; i < p_batch->workers_count; ++i)
+    {
+        batch_range_t* range = &p_batch->ranges[(p_worker + i) % p_batch->workers_count];
+        if (atomic_load_explicit(&range->next, memory_order_relaxed) >= range->end)
+            continue;
+
+        const size_t job = atomic_fetch_add_explicit(&range->next, 1, memory_order_relaxed);
+        if (job < range->end)
+            return job;
+    }
+
+    return SIZE_MAX;
+}
+
+// Channel output of a job goes into the same buffer as what it printed.
+static void batch_sink(void* p_user, const void* p_data, size_t p_size)
+{
+    fwrite(p_data, 1, p_size, p_user);
+}
+
+static void batch_run(const batch_t* p_batch, batch_job_t* p_job, arena_t* p_arena, vvm_t* p_vm)
+{
+    // Every job starts from an empty arena, which keeps its blocks, so a
+    // worker stops allocating once it has seen its largest job.
+    arena_reset(p_arena);
+    const error err = vm_init(p_vm, p_arena, p_batch->stack_size);
+
+    FILE* output = open_memstream(&p_job->output, &p_job->output_size);
+    FILE* diagnostics = open_memstream(&p_job->diagnostics, &p_job->diagnostics_size);
+    if (output == NULL || diagnostics == NULL)
+    {
+        fprintf(stderr, "[ERROR]: Could Not Allocate Memory: %s\n", strerror(errno));
+        exit(1);
+    }
+    p_vm->output = output;
+    p_vm->diagnostics = diagnostics;
+    p_vm->channel.sink = batch_sink;
+    p_vm->channel.user = output;
+    p_vm->natives = p_batch->natives;
+
+    // Memory is mapped per job so none of it leaks from one job to the next.
+    // Pages the job never touches are never backed. A machine the arena
+    // could not allocate fails its job with ERR_OUT_OF_MEMORY.
+    p_job->err = err != ERR_OK ? err : vm_map_memory(p_vm, p_batch->memory_size, p_batch->huge_pages);
+    if (p_job->err == ERR_OK && p_job->program != NULL)
+    {
+        // Programs are read rather than mapped, since unmapping them from
+        // many threads at once stalls every core on TLB shootdowns.
+        p_job->err = vm_load_program_from_file(p_vm, p_job->program);
+        if (p_job->err == ERR_OK)
+            vm_verify_program(p_vm, NULL);
+    }
+    else if (p_job->err == ERR_OK)
+    {
+        p_vm->program = p_batch->program->program;
+        p_vm->program_size = p_batch->program->program_size;
+        p_vm->verified = (uint8_t*)p_job->verified;
+        memcpy(p_vm->stack, p_job->inputs, sizeof(p_job->inputs[0]) * p_job->inputs_count);
+        p_vm->stack_size = p_job->inputs_count;
+    }
+
+    if (p_job->err == ERR_OK)
+    {
+        p_job->err = p_batch->engine->execute(p_vm, p_batch->limit);
+        vm_flush_channel(p_vm);
+        if (p_batch->dump)
+            vm_dump_stack(output, p_vm);
+    }
+
+    vm_unmap_memory(p_vm);
+    fclose(output);
+    fclose(diagnostics);
+}
+
+static void* batch_worker(void* p_argument)
+{
+    batch_worker_t* worker = p_argument;
+    arena_t arena = {0};
+    vvm_t vm;
+
+    for (;;)
+    {
+        const size_t job = batch_take(worker->batch, worker->id);
+        if (job == SIZE_MAX)
+            break;
+        batch_run(worker->batch, &worker->batch->jobs[job], &arena, &vm);
+    }
+
+    arena_free(&arena);
+    return NULL;
+}
+
+// Reads one job per non-empty line of p_jobs_file_path: a program path, or
+// with p_inputs, the initial stack to run p_vm's program on.
+static batch_job_t* batch_read_jobs(vvm_t* p_vm, int p_inputs, const char* p_jobs_file_path, size_t* p_count)
+{
+    arena_t* arena = p_vm->arena;
+    file_view_t file;
+    if (file_view_open(p_jobs_file_path, &file, stderr) != ERR_OK)
+        exit(1);
+    string_view_t content = file.content;
+    batch_job_t* jobs = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    batch_depth_t* depths = NULL;
+    size_t depths_count = 0;
+
+    while (content.count > 0)
+    {
+        string_view_t line = sv_trim(sv_chop_by_delim(&content, '\n'));
+        if (line.count == 0)
+            continue;
+
+        if (count == capacity)
+        {
+            const size_t new_capacity = capacity == 0 ? 64 : capacity * 2;
+            jobs = expect_memory(arena_grow(arena, jobs, sizeof(jobs[0]) * capacity, sizeof(jobs[0]) * new_capacity));
+            capacity = new_capacity;
+        }
+
+        batch_job_t* job = &jobs[count++];
+        memset(job, 0, sizeof(*job));
+
+        if (!p_inputs)
+        {
+            char* path = expect_memory(arena_alloc(arena, line.count + 1));
+            memcpy(path, line.data, line.count);
+            path[line.count] = '\0';
+            job->program = path;
+            continue;
+        }
+
+        // Inputs are counted first so they can be stored in one block.
+        string_view_t words = line;
+        while (words.count > 0)
+        {
+            sv_chop_by_delim(&words, ' ');
+            words = sv_trim_left(words);
+            job->inputs_count++;
+        }
+
+        if (job->inputs_count > p_vm->stack_capacity)
+        {
+            fprintf(stderr, "[ERROR]: Inputs Of Job %zu Do Not Fit On The Stack\n", count);
+            exit(1);
+        }
+
+        job->inputs = expect_memory(arena_alloc(arena, sizeof(job->inputs[0]) * job->inputs_count));
+        words = line;
+        for (uint64_t i = 0; i < job->inputs_count; ++i)
+        {
+            const string_view_t word = sv_trim_right(sv_chop_by_delim(&words, ' '));
+            if (number_literal_as_word(word, &job->inputs[i]) != ERR_OK)
+            {
+                fprintf(stderr, "[ERROR]: Input `%.*s` Of Job %zu Is Not A Number Literal\n", (int)word.count, word.data, count);
+                exit(1);
+            }
+            words = sv_trim_left(words);
+        }
+
+        for (size_t i = 0; i < depths_count && job->verified == NULL; ++i)
+            if (depths[i].depth == job->inputs_count)
+                job->verified = depths[i].verified;
+
+        if (job->verified == NULL)
+        {
+            p_vm->verified = expect_memory(arena_alloc(arena, p_vm->program_size));
+            p_vm->stack_size = job->inputs_count;
+            vm_verify_program(p_vm, NULL);
+
+            depths = expect_memory(arena_grow(arena, depths, sizeof(depths[0]) * depths_count, sizeof(depths[0]) * (depths_count + 1)));
+            depths[depths_count].depth = job->inputs_count;
+            depths[depths_count].verified = p_vm->verified;
+            job->verified = depths[depths_count++].verified;
+        }
+    }
+
+    // Program paths point into the arena, inputs have been parsed.
+    file_view_close(&file);
+    p_vm->stack_size = 0;
+    *p_count = count;
+    return jobs;
 }
 
-vvm_t vm = {0};
+// Runs every job and prints their output in input order. Returns the number
+// of jobs that failed.
+static size_t batch_execute(batch_t* p_batch, arena_t* p_arena)
+{
+    if (p_batch->workers_count > p_batch->jobs_count)
+        p_batch->workers_count = p_batch->jobs_count;
+    if (p_batch->workers_count == 0)
+        return 0;
+
+    // The arena only aligns to VVM_ARENA_ALIGNMENT, ranges need a cache line.
+    p_batch->ranges = aligned_alloc(_Alignof(batch_range_t), sizeof(p_batch->ranges[0]) * p_batch->workers_count);
+    if (p_batch->ranges == NULL)
+    {
+        fprintf(stderr, "[ERROR]: Could Not Allocate Memory: %s\n", strerror(errno));
+        exit(1);
+    }
+    batch_worker_t* workers = expect_memory(arena_alloc(p_arena, sizeof(workers[0]) * p_batch->workers_count));
+
+    for (size_t i = 0; i < p_batch->workers_count; ++i)
+    {
+        atomic_init(&p_batch->ranges[i].next, p_batch->jobs_count * i / p_batch->workers_count);
+        p_batch->ranges[i].end = p_batch->jobs_count * (i + 1) / p_batch->workers_count;
+        workers[i].batch = p_batch;
+        workers[i].id = i;
+    }
+
+    // The calling thread is the first worker.
+    for (size_t i = 1; i < p_batch->workers_count; ++i)
+    {
+        const int result = pthread_create(&workers[i].thread, NULL, batch_worker, &workers[i]);
+        if (result != 0)
+        {
+            fprintf(stderr, "[ERROR]: Could Not Create Thread: %s\n", strerror(result));
+            exit(1);
+        }
+    }
+    batch_worker(&workers[0]);
+    for (size_t i = 1; i < p_batch->workers_count; ++i)
+        pthread_join(workers[i].thread, NULL);
+    free(p_batch->ranges);
+
+    size_t failed = 0;
+    for (size_t i = 0; i < p_batch->jobs_count; ++i)
+    {
+        batch_job_t* job = &p_batch->jobs[i];
+        fwrite(job->output, 1, job->output_size, stdout);
+        free(job->output);
+
+        if (job->err != ERR_OK)
+        {
+            fflush(stdout);
+            fwrite(job->diagnostics, 1, job->diagnostics_size, stderr);
+            fprintf(stderr, "[ERROR]: Job %zu: %s\n", i + 1, error_as_cstr(job->err));
+            failed++;
+        }
+        free(job->diagnostics);
+    }
+
+    return failed;
+}
+#endif
 
 int main(int argc, char** argv)
 {
     const char* program = shift(&argc, &argv);
     const char* input_file_path = NULL;
+#ifdef VVM_PROFILE
+    const char* profile_file_path = NULL;
+#endif
+#ifdef VVM_TRACE
+    uint64_t trace_size = VVM_TRACE_DEFAULT_CAPACITY;
+#endif
+#ifdef VME_BATCH
+    const char* batch_file_path = NULL;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    arena_t arena = {0};
+    vvm_t vm = {0};
+    const char* snapshot_file_path = NULL;
+    const char* restore_file_path = NULL;
+    const char* channel_file_path = NULL;
+    int snapshot_at = -1;
     int limit = -1;
     int debug = 0;
+    int dump = 0;
+    int stack_size_given = 0;
+    uint64_t stack_size = VVM_DEFAULT_STACK_CAPACITY;
+    int memory_size_given = 0;
+    uint64_t memory_size = VVM_DEFAULT_MEMORY_SIZE;
+    int huge_pages = 0;
+#ifdef VVM_DLOPEN
+    const char* native_file_path = NULL;
+#endif
+    const engine_t* engine = &engines[0];
 
     while (argc > 0)
     {
@@ -46,6 +470,180 @@ int main(int argc, char** argv)
                 exit(1);
             }
             limit = atoi(shift(&argc, &argv));
+        } else if (strcmp(flag, "-e") == 0) {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+            const char* name = shift(&argc, &argv);
+            engine = NULL;
+            for (size_t i = 0; i < ARRAY_SIZE(engines); ++i)
+                if (strcmp(name, engines[i].name) == 0)
+                    engine = &engines[i];
+            if (engine == NULL)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: Unknown Engine `%s`\n", name);
+                exit(1);
+            }
+        } else if (strcmp(flag, "--stack-size") == 0) {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+            const char* size = shift(&argc, &argv);
+            char* end = NULL;
+            stack_size = strtoull(size, &end, 10);
+            if (*size == '\0' || *end != '\0' || stack_size == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: Invalid Stack Size `%s`\n", size);
+                exit(1);
+            }
+            stack_size_given = 1;
+        } else if (strcmp(flag, "--memory-size") == 0) {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+            const char* size = shift(&argc, &argv);
+            char* end = NULL;
+            memory_size = strtoull(size, &end, 10);
+            if (*size == '\0' || *end != '\0')
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: Invalid Memory Size `%s`\n", size);
+                exit(1);
+            }
+            memory_size_given = 1;
+        } else if (strcmp(flag, "--huge-pages") == 0) {
+            huge_pages = 1;
+        } else if (strcmp(flag, "--native") == 0) {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+#ifdef VVM_DLOPEN
+            native_file_path = shift(&argc, &argv);
+#else
+            fprintf(stderr, "[ERROR]: Flag `--native` Is Not Supported By This Build\n");
+            exit(1);
+#endif
+        } else if (strcmp(flag, "--save-snapshot") == 0 || strcmp(flag, "--restore") == 0) {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+            if (flag[2] == 's')
+                snapshot_file_path = shift(&argc, &argv);
+            else
+                restore_file_path = shift(&argc, &argv);
+        } else if (strcmp(flag, "--snapshot-at") == 0) {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+            const char* count = shift(&argc, &argv);
+            char* end = NULL;
+            const long value = strtol(count, &end, 10);
+            if (*count == '\0' || *end != '\0' || value < 0 || value > INT_MAX)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: Invalid Instruction Count `%s`\n", count);
+                exit(1);
+            }
+            snapshot_at = (int)value;
+        } else if (strcmp(flag, "-p") == 0) {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+#ifdef VVM_PROFILE
+            profile_file_path = shift(&argc, &argv);
+#else
+            fprintf(stderr, "[ERROR]: Profiling Is Not Supported By This Build\n");
+            exit(1);
+#endif
+        } else if (strcmp(flag, "-t") == 0 || strcmp(flag, "--trace-size") == 0) {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+#ifdef VVM_TRACE
+            const char* value = shift(&argc, &argv);
+            if (flag[1] == 't')
+            {
+                trace_file_path = value;
+            }
+            else
+            {
+                char* end = NULL;
+                trace_size = strtoull(value, &end, 10);
+                if (*value == '\0' || *end != '\0' || trace_size == 0)
+                {
+                    usage(stderr, program);
+                    fprintf(stderr, "[ERROR]: Invalid Trace Size `%s`\n", value);
+                    exit(1);
+                }
+            }
+#else
+            fprintf(stderr, "[ERROR]: Tracing Is Not Supported By This Build\n");
+            exit(1);
+#endif
+        } else if (strcmp(flag, "--batch") == 0 || strcmp(flag, "-j") == 0) {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+#ifdef VME_BATCH
+            const char* value = shift(&argc, &argv);
+            if (flag[1] == '-')
+            {
+                batch_file_path = value;
+            }
+            else
+            {
+                char* end = NULL;
+                threads = strtol(value, &end, 10);
+                if (*value == '\0' || *end != '\0' || threads <= 0)
+                {
+                    usage(stderr, program);
+                    fprintf(stderr, "[ERROR]: Invalid Thread Count `%s`\n", value);
+                    exit(1);
+                }
+            }
+#else
+            fprintf(stderr, "[ERROR]: Batch Mode Is Not Supported By This Build\n");
+            exit(1);
+#endif
+        } else if (strcmp(flag, "-o") == 0) {
+            if (argc == 0)
+            {
+                usage(stderr, program);
+                fprintf(stderr, "[ERROR]: No Argument Provided For Flag `%s`\n", flag);
+                exit(1);
+            }
+            channel_file_path = shift(&argc, &argv);
+        } else if (strcmp(flag, "-s") == 0) {
+            dump = 1;
         } else if (strcmp(flag, "-h") == 0) {
             usage(stdout, program);
             exit(0);
@@ -58,19 +656,228 @@ int main(int argc, char** argv)
         }
     }
 
-    if (input_file_path == NULL)
+    // The table of the library stays in use until exit.
+    const native_table_t* natives = NULL;
+#ifdef VVM_DLOPEN
+    native_library_t native_library = {0};
+    if (native_file_path != NULL)
+    {
+        if (native_library_open(native_file_path, &native_library, stderr) != ERR_OK)
+            exit(1);
+        natives = native_library.table;
+    }
+#endif
+
+#ifdef VME_BATCH
+    if (batch_file_path != NULL)
+    {
+        int combined = debug || restore_file_path != NULL || snapshot_file_path != NULL || channel_file_path != NULL;
+#ifdef VVM_PROFILE
+        combined |= profile_file_path != NULL;
+#endif
+#ifdef VVM_TRACE
+        combined |= trace_file_path != NULL;
+#endif
+        if (combined)
+        {
+            usage(stderr, program);
+            fprintf(stderr, "[ERROR]: Flag `--batch` Cannot Be Combined With `-d`, `-o`, `-p`, `-t` Or Snapshots\n");
+            exit(1);
+        }
+
+        // With -i, every job runs the same mapped program on its own inputs.
+        // The verifier checks constant addresses against the memory size, so
+        // the shared machine has the memory of the jobs while it verifies.
+        expect_ok(vm_init(&vm, &arena, stack_size));
+        vm.natives = natives;
+        if (input_file_path != NULL && vm_map_program_from_file(&vm, input_file_path) != ERR_OK)
+            exit(1);
+        if (vm_map_memory(&vm, memory_size, 0) != ERR_OK)
+            exit(1);
+
+        batch_t batch = {0};
+        batch.jobs = batch_read_jobs(&vm, input_file_path != NULL, batch_file_path, &batch.jobs_count);
+        batch.workers_count = threads > 0 ? (size_t)threads : 1;
+        batch.program = &vm;
+        batch.engine = engine;
+        batch.limit = limit;
+        batch.stack_size = stack_size;
+        batch.memory_size = memory_size;
+        batch.huge_pages = huge_pages;
+        batch.natives = natives;
+        batch.dump = dump;
+        vm_unmap_memory(&vm);
+
+        const size_t failed = batch_execute(&batch, &arena);
+        vm_unload_program(&vm);
+#ifdef VVM_DLOPEN
+        native_library_close(&native_library);
+#endif
+        arena_free(&arena);
+
+        if (failed > 0)
+            exit(1);
+        return 0;
+    }
+#endif
+
+    if (input_file_path == NULL && restore_file_path == NULL)
     {
         usage(stderr, program);
         fprintf(stderr, "[ERROR]: Input Was Not Provided\n");
         exit(1);
     }
 
-    vm_load_program_from_file(&vm, input_file_path);
+    if (input_file_path != NULL && restore_file_path != NULL)
+    {
+        usage(stderr, program);
+        fprintf(stderr, "[ERROR]: Flags `-i` And `--restore` Cannot Be Combined\n");
+        exit(1);
+    }
+
+    if (snapshot_at >= 0 && snapshot_file_path == NULL)
+    {
+        usage(stderr, program);
+        fprintf(stderr, "[ERROR]: Flag `--snapshot-at` Needs `--save-snapshot`\n");
+        exit(1);
+    }
+
+    // A restored machine keeps the stack capacity and memory size it was saved
+    // with, unless others are asked for. The snapshot stays mapped until exit.
+    snapshot_t snapshot = {0};
+    if (restore_file_path != NULL)
+    {
+        if (snapshot_open(restore_file_path, &snapshot, stderr) != ERR_OK)
+            exit(1);
+        if (!stack_size_given)
+            stack_size = snapshot.state.stack_capacity;
+        if (!memory_size_given)
+            memory_size = snapshot.memory_size;
+        expect_ok(vm_init(&vm, &arena, stack_size));
+        vm.natives = natives;
+        if (vm_map_memory(&vm, memory_size, huge_pages) != ERR_OK)
+            exit(1);
+        if (vm_restore_snapshot(&vm, &snapshot) != ERR_OK)
+            exit(1);
+    }
+    else
+    {
+        expect_ok(vm_init(&vm, &arena, stack_size));
+        vm.natives = natives;
+        if (vm_map_memory(&vm, memory_size, huge_pages) != ERR_OK)
+            exit(1);
+        if (vm_map_program_from_file(&vm, input_file_path) != ERR_OK)
+            exit(1);
+    }
+
+    if (channel_file_path != NULL)
+    {
+#if defined(__unix__)
+        vm.channel.fd = open(channel_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (vm.channel.fd < 0)
+        {
+            fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", channel_file_path, strerror(errno));
+            exit(1);
+        }
+#else
+        fprintf(stderr, "[ERROR]: Flag `-o` Is Not Supported By This Build\n");
+        exit(1);
+#endif
+    }
+
+    // Instructions the verifier proves safe run without stack checks on the
+    // engines that support it, everything else keeps the checked path.
+    const verification_t verification = vm_verify_program(&vm, NULL);
+
+#ifdef VVM_UNCHECKED
+    // vme-fast runs the switch engine without any stack checks when the whole
+    // program is proven safe.
+    static const engine_t unchecked = { "switch", vm_execute_program_unchecked };
+    if (engine->execute == vm_execute_program && verification.proven == verification.reachable)
+        engine = &unchecked;
+#else
+    (void)verification;
+#endif
+
+#if defined(VVM_PROFILE) && defined(VVM_TRACE)
+    if (profile_file_path != NULL && trace_file_path != NULL)
+    {
+        usage(stderr, program);
+        fprintf(stderr, "[ERROR]: Flags `-p` And `-t` Cannot Be Combined\n");
+        exit(1);
+    }
+#endif
+
+    // The first instructions run on the selected engine, and the rest of the
+    // run carries on from the state that was saved.
+    if (snapshot_at >= 0)
+    {
+        const int count = limit >= 0 && limit < snapshot_at ? limit : snapshot_at;
+        error err = engine->execute(&vm, count);
+        if (vm_flush_channel(&vm) != ERR_OK)
+            exit(1);
+        if (err != ERR_OK)
+        {
+            fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(err));
+            exit(1);
+        }
+
+        if (vm_save_snapshot_to_file(&vm, snapshot_file_path) != ERR_OK)
+            exit(1);
+        if (limit >= 0)
+            limit -= count;
+    }
     
     if (!debug)
     {
-        error err = vm_execute_program(&vm, limit);
-        // vm_dump_stack(stdout, &vm);
+        error err = ERR_OK;
+#ifdef VVM_TRACE
+        if (trace_file_path != NULL)
+        {
+            expect_ok(vm_trace_init(&vm, &trace, trace_size));
+            trace_install_signal_handlers();
+            err = vm_execute_program_traced(&vm, &trace, limit);
+
+            if (err != ERR_OK && !trace_dump(err, 0))
+            {
+                fprintf(stderr, "[ERROR]: Could Not Write To File `%s`: %s\n", trace_file_path, strerror(errno));
+                exit(1);
+            }
+        }
+        else
+#endif
+#ifdef VVM_PROFILE
+        if (profile_file_path != NULL)
+        {
+            // Programs that fail are profiled up to the error.
+            profile_t profile;
+            expect_ok(vm_profile_init(&vm, &profile));
+            err = vm_execute_program_profiled(&vm, &profile, limit);
+
+            FILE* f = fopen(profile_file_path, "w");
+            if (f == NULL)
+            {
+                fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", profile_file_path, strerror(errno));
+                exit(1);
+            }
+            const error report = vm_profile_report(f, &vm, &profile);
+            fclose(f);
+            expect_ok(report);
+        }
+        else
+#endif
+            err = engine->execute(&vm, limit);
+
+        // Output up to an error is written out all the same.
+        if (vm_flush_channel(&vm) != ERR_OK)
+            exit(1);
+
+        if (err == ERR_OK && snapshot_file_path != NULL && snapshot_at < 0 &&
+            vm_save_snapshot_to_file(&vm, snapshot_file_path) != ERR_OK)
+            exit(1);
+
+        if (dump)
+            vm_dump_stack(stdout, &vm);
         if (err != ERR_OK)
         {
             fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(err));
@@ -84,6 +891,8 @@ int main(int argc, char** argv)
             // vm_dump_stack(stdout, &vm);
             getchar();
             error err = vm_execute_inst(&vm);
+            if (vm_flush_channel(&vm) != ERR_OK)
+                exit(1);
             if (err != ERR_OK)
             {
                 fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(err));
@@ -92,7 +901,24 @@ int main(int argc, char** argv)
             if (limit > 0)
                 --limit;
         }
+
+        if (snapshot_file_path != NULL && snapshot_at < 0 &&
+            vm_save_snapshot_to_file(&vm, snapshot_file_path) != ERR_OK)
+            exit(1);
     }
 
+#if defined(__unix__)
+    if (channel_file_path != NULL)
+        close(vm.channel.fd);
+#endif
+    vm_unload_program(&vm);
+    vm_unmap_memory(&vm);
+    if (restore_file_path != NULL)
+        snapshot_close(&snapshot);
+#ifdef VVM_DLOPEN
+    native_library_close(&native_library);
+#endif
+    arena_free(&arena);
+
     return 0;
 }
\ No newline at end of file
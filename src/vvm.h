@@ -1,34 +1,123 @@
 #ifndef __VVM_H_INCLUDED__
 #define __VVM_H_INCLUDED__
 
+// POSIX interfaces such as mmap are hidden by -std=c11 otherwise.
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// The JIT emits x86-64 machine code into mmap'd memory.
+#if defined(__unix__)
+#define VVM_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) && defined(__unix__) && !defined(VVM_NO_JIT)
+#define VVM_JIT
+#endif
+
+// Vector instructions run on SSE2, or AVX2 when the CPU has it, on x86-64
+// with GCC or Clang, and on scalar loops elsewhere or with VVM_NO_SIMD.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(VVM_NO_SIMD)
+#define VVM_SIMD
+#include <immintrin.h>
+#endif
+
+// Native tables are loaded from shared objects with dlopen on Unix, which
+// older C libraries keep in libdl. VVM_NO_DLOPEN leaves it out.
+#if defined(__unix__) && !defined(VVM_NO_DLOPEN)
+#define VVM_DLOPEN
+#include <dlfcn.h>
+#endif
+
+// Traces are dumped with write(2), which can be called from signal handlers.
+#if defined(__unix__) && !defined(VVM_NO_TRACE)
+#define VVM_TRACE
+#include <stdatomic.h>
+#endif
+
+typedef struct trace_t trace_t;
+
 #define ARRAY_SIZE(xs) (sizeof(xs) / sizeof((xs)[0]))
 
-#define VVM_STACK_CAPACITY 1024
-#define VVM_PROGRAM_CAPACITY 1024
-#define VVM_LABEL_CAPACITY 1024
-#define VVM_DEFERRED_OPERANDS_CAPACITY 1024
+#define VVM_DEFAULT_STACK_CAPACITY 1024
+#define VVM_DEFAULT_MEMORY_SIZE (1 << 20)
+#define VVM_HUGE_PAGE_SIZE (2 << 20)
+#define VVM_ARENA_BLOCK_SIZE (1 << 20)
+#define VVM_ARENA_ALIGNMENT 16
+
+// Backward jumps the JIT engine interprets before compiling the program.
+#ifndef VVM_JIT_THRESHOLD
+#define VVM_JIT_THRESHOLD 1000
+#endif
+
+// Times vm_optimize_program runs its passes over a program that keeps
+// changing. Each pass can enable the others, but rarely for long.
+#ifndef VVM_OPTIMIZE_ROUNDS
+#define VVM_OPTIMIZE_ROUNDS 16
+#endif
+
+// The threaded engine uses labels-as-values when the compiler supports them
+// and falls back to a switch over pre-translated handler ids otherwise.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VVM_NO_COMPUTED_GOTO)
+#define VVM_COMPUTED_GOTO
+#endif
+
+// The profiler is a separate interpreter loop, so the engines never pay for
+// it. Building with VVM_NO_PROFILE leaves it out entirely.
+#if !defined(VVM_NO_PROFILE)
+#define VVM_PROFILE
+#ifndef VVM_PROFILE_SAMPLE_PERIOD
+#define VVM_PROFILE_SAMPLE_PERIOD 16
+#endif
+#if !defined(__x86_64__) || !(defined(__GNUC__) || defined(__clang__))
+#include <time.h>
+#endif
+#endif
+
+// Region allocator backing the stack, the program and the assembler tables.
+// Memory is handed out from a chain of blocks and only returned all at once,
+// either by arena_rewind to an earlier mark or by arena_reset. Blocks are
+// kept across resets, so a process that loads and runs program after program
+// stops calling malloc once the chain is large enough.
+typedef struct arena_block_t {
+    struct arena_block_t* next;
+    size_t capacity;
+    size_t size;
+    size_t padding;
+    uint8_t data[];
+} arena_block_t;
 
 typedef struct {
-    size_t count;
-    const char* data;
-} string_view_t;
+    arena_block_t* first;
+    arena_block_t* current;
+} arena_t;
 
-string_view_t cstr_as_sv(const char* p_cstr);
-string_view_t sv_trim_left(string_view_t p_sv);
-string_view_t sv_trim_right(string_view_t p_sv);
-string_view_t sv_trim(string_view_t p_sv);
-string_view_t sv_chop_by_delim(string_view_t* p_sv, char p_delim);
-int sv_equal(string_view_t p_a, string_view_t p_b);
-int sv_to_int(string_view_t p_sv);
-string_view_t sv_slurp_file(const char* p_file_path);
+typedef struct {
+    arena_block_t* block;
+    size_t size;
+} arena_mark_t;
+
+void* arena_alloc(arena_t* p_arena, size_t p_size);
+void* arena_grow(arena_t* p_arena, void* p_data, size_t p_old_size, size_t p_new_size);
+arena_mark_t arena_mark(const arena_t* p_arena);
+void arena_rewind(arena_t* p_arena, arena_mark_t p_mark);
+void arena_reset(arena_t* p_arena);
+void arena_free(arena_t* p_arena);
 
 typedef enum {
     ERR_OK = 0,
@@ -41,10 +130,42 @@ typedef enum {
     ERR_ILLEGAL_OPERAND,
 
     ERR_DIV_BY_ZERO,
+    ERR_ILLEGAL_MEMORY_ACCESS,
+
+    // Loading, assembling and saving programs. Functions that fail this way
+    // describe the failure on a diagnostics stream instead of exiting.
+    ERR_OUT_OF_MEMORY,
+    ERR_FILE_ACCESS,
+    ERR_INVALID_FILE,
+    ERR_INVALID_SOURCE,
+    NUMBER_OF_ERRORS,
 } error;
 
 const char* error_as_cstr(error p_error);
 
+typedef struct {
+    size_t count;
+    const char* data;
+} string_view_t;
+
+string_view_t cstr_as_sv(const char* p_cstr);
+string_view_t sv_trim_left(string_view_t p_sv);
+string_view_t sv_trim_right(string_view_t p_sv);
+string_view_t sv_trim(string_view_t p_sv);
+string_view_t sv_chop_by_delim(string_view_t* p_sv, char p_delim);
+int sv_equal(string_view_t p_a, string_view_t p_b);
+int sv_to_int(string_view_t p_sv);
+error sv_slurp_file(const char* p_file_path, string_view_t* p_content, FILE* p_diagnostics);
+
+typedef struct {
+    string_view_t content;
+    void* mapping;              // The mapping content points into, or NULL
+    size_t mapping_size;        // when the file was read into a malloc buffer.
+} file_view_t;
+
+error file_view_open(const char* p_file_path, file_view_t* p_file, FILE* p_diagnostics);
+void file_view_close(file_view_t* p_file);
+
 typedef uint64_t inst_addr_t;
 
 typedef union {
@@ -56,37 +177,250 @@ typedef union {
 
 static_assert(sizeof(word_t) == 8, "The Virtual Machine's Word Is Expected To Be 64 Bits");
 
-word_t number_literal_as_word(string_view_t p_sv);
+error number_literal_as_word(string_view_t p_sv, word_t* p_word);
+
+// The instruction set, in the order of the opcodes. Every instruction is
+//
+//     X(id, mnemonic, operand, pops, pushes, body)
+//
+// where pops and pushes are how many elements it takes off the top of the
+// stack and leaves there when it succeeds (in terms of VVM_LANES for vector
+// instructions), and body is its implementation in vm_execute_inst. Bodies
+// use VVM_CHECK for the stack and memory checks that verified programs can
+// skip, and plain ifs for everything else that can fail. The opcode enum,
+// the names, operand types and stack effects of the instructions, and the
+// checked and unchecked interpreters are generated from this table.
+#define VVM_INSTRUCTIONS(X)                                                                         \
+    X(INST_NOP,         "nop",          OPERAND_NONE,   0, 0,                                       \
+        VVM_NEXT();)                                                                                \
+                                                                                                    \
+    X(INST_PUSH,        "push",         OPERAND_WORD,   0, 1,                                       \
+        VVM_CHECK(VVM_SP >= p_vm->stack_capacity, ERR_STACK_OVERFLOW);                              \
+        p_vm->stack[VVM_SP++] = inst.operand;                                                       \
+        VVM_NEXT();)                                                                                \
+    X(INST_DUP_REL,     "rdup",         OPERAND_INT,    0, 1,                                       \
+        VVM_CHECK(VVM_SP >= p_vm->stack_capacity, ERR_STACK_OVERFLOW);                              \
+        VVM_CHECK(inst.operand.as_u64 >= VVM_SP, ERR_STACK_UNDERFLOW);                              \
+        p_vm->stack[VVM_SP].as_u64 = VVM_TOP(inst.operand.as_u64).as_u64;                           \
+        VVM_SP++;                                                                                   \
+        VVM_NEXT();)                                                                                \
+    X(INST_SWAP,        "swap",         OPERAND_INT,    0, 0,                                       \
+        VVM_CHECK(inst.operand.as_u64 >= VVM_SP, ERR_STACK_UNDERFLOW);                              \
+        const word_t t = VVM_TOP(0);                                                                \
+        VVM_TOP(0) = VVM_TOP(inst.operand.as_u64);                                                  \
+        VVM_TOP(inst.operand.as_u64) = t;                                                           \
+        VVM_NEXT();)                                                                                \
+                                                                                                    \
+    X(INST_ADDI,        "addi",         OPERAND_NONE,   2, 1,   VVM_BINARY(as_u64, +=))             \
+    X(INST_SUBI,        "subi",         OPERAND_NONE,   2, 1,   VVM_BINARY(as_u64, -=))             \
+    X(INST_MULI,        "muli",         OPERAND_NONE,   2, 1,   VVM_BINARY(as_u64, *=))             \
+    X(INST_DIVI,        "divi",         OPERAND_NONE,   2, 1,                                       \
+        VVM_CHECK(VVM_SP < 2, ERR_STACK_UNDERFLOW);                                                 \
+        if (VVM_TOP(0).as_u64 == 0)                                                                 \
+            return ERR_DIV_BY_ZERO;                                                                 \
+        VVM_TOP(1).as_u64 /= VVM_TOP(0).as_u64;                                                     \
+        VVM_SP--;                                                                                   \
+        VVM_NEXT();)                                                                                \
+    X(INST_ADDF,        "addf",         OPERAND_NONE,   2, 1,   VVM_BINARY(as_f64, +=))             \
+    X(INST_SUBF,        "subf",         OPERAND_NONE,   2, 1,   VVM_BINARY(as_f64, -=))             \
+    X(INST_MULF,        "mulf",         OPERAND_NONE,   2, 1,   VVM_BINARY(as_f64, *=))             \
+    X(INST_DIVF,        "divf",         OPERAND_NONE,   2, 1,   VVM_BINARY(as_f64, /=))             \
+                                                                                                    \
+    X(INST_JMP,         "jmp",          OPERAND_ADDR,   0, 0,                                       \
+        p_vm->inst_pointer = inst.operand.as_u64;)                                                  \
+    X(INST_JMP_NZ,      "jnz",          OPERAND_ADDR,   1, 0,                                       \
+        VVM_CHECK(VVM_SP < 1, ERR_STACK_UNDERFLOW);                                                 \
+        if (VVM_TOP(0).as_u64)                                                                      \
+            p_vm->inst_pointer = inst.operand.as_u64;                                               \
+        else                                                                                        \
+            VVM_NEXT();                                                                             \
+        VVM_SP--;)                                                                                  \
+    X(INST_EQ,          "eq",           OPERAND_NONE,   2, 1,                                       \
+        VVM_CHECK(VVM_SP < 2, ERR_STACK_UNDERFLOW);                                                 \
+        VVM_TOP(1).as_u64 = VVM_TOP(1).as_u64 == VVM_TOP(0).as_u64;                                 \
+        VVM_SP--;                                                                                   \
+        VVM_NEXT();)                                                                                \
+    X(INST_NOT,         "not",          OPERAND_NONE,   1, 1,                                       \
+        VVM_CHECK(VVM_SP < 1, ERR_STACK_OVERFLOW);                                                  \
+        VVM_TOP(0).as_u64 = !VVM_TOP(0).as_u64;                                                     \
+        VVM_NEXT();)                                                                                \
+    X(INST_GEQ,         "geq",          OPERAND_NONE,   2, 1,                                       \
+        VVM_CHECK(VVM_SP < 2, ERR_STACK_OVERFLOW);                                                  \
+        VVM_TOP(1).as_u64 = VVM_TOP(0).as_f64 >= VVM_TOP(1).as_f64;                                 \
+        VVM_SP--;                                                                                   \
+        VVM_NEXT();)                                                                                \
+                                                                                                    \
+    X(INST_HALT,        "halt",         OPERAND_NONE,   0, 0,                                       \
+        p_vm->halt = 1;)                                                                            \
+    X(INST_PRINT_DEBUG, "print_debug",  OPERAND_NONE,   0, 0,                                       \
+        vm_dump_stack(p_vm->output, p_vm);                                                          \
+        VVM_NEXT();)                                                                                \
+                                                                                                    \
+    /* Superinstructions, produced by vm_fuse_superinstructions. */                                 \
+    X(INST_ADDI_IMM,    "addi_imm",     OPERAND_WORD,   1, 1,   VVM_IMMEDIATE(as_u64, +=))          \
+    X(INST_SUBI_IMM,    "subi_imm",     OPERAND_WORD,   1, 1,   VVM_IMMEDIATE(as_u64, -=))          \
+    X(INST_MULI_IMM,    "muli_imm",     OPERAND_WORD,   1, 1,   VVM_IMMEDIATE(as_u64, *=))          \
+    X(INST_ADDF_IMM,    "addf_imm",     OPERAND_WORD,   1, 1,   VVM_IMMEDIATE(as_f64, +=))          \
+    X(INST_SUBF_IMM,    "subf_imm",     OPERAND_WORD,   1, 1,   VVM_IMMEDIATE(as_f64, -=))          \
+    X(INST_MULF_IMM,    "mulf_imm",     OPERAND_WORD,   1, 1,   VVM_IMMEDIATE(as_f64, *=))          \
+    X(INST_DIVF_IMM,    "divf_imm",     OPERAND_WORD,   1, 1,   VVM_IMMEDIATE(as_f64, /=))          \
+    X(INST_ADDI_REL,    "addi_rel",     OPERAND_INT,    1, 1,   VVM_RELATIVE(as_u64))               \
+    X(INST_ADDF_REL,    "addf_rel",     OPERAND_INT,    1, 1,   VVM_RELATIVE(as_f64))               \
+    X(INST_DEC_JMP_NZ,  "dec_jnz",      OPERAND_ADDR,   1, 1,                                       \
+        VVM_CHECK(VVM_SP >= p_vm->stack_capacity, ERR_STACK_OVERFLOW);                              \
+        VVM_CHECK_PUSHED(VVM_SP < 1, (word_t){ .as_u64 = 1 }, ERR_STACK_UNDERFLOW);                 \
+        if (--VVM_TOP(0).as_u64)                                                                    \
+            p_vm->inst_pointer = inst.operand.as_u64;                                               \
+        else                                                                                        \
+            VVM_NEXT();)                                                                            \
+                                                                                                    \
+    /* Output on the channel of the machine, see vvm_channel_t. */                                  \
+    X(INST_OUT,         "out",          OPERAND_NONE,   1, 0,                                       \
+        VVM_CHECK(VVM_SP < 1, ERR_STACK_UNDERFLOW);                                                 \
+        vm_channel_word(&p_vm->channel, p_vm->stack[--VVM_SP]);                                     \
+        VVM_NEXT();)                                                                                \
+    X(INST_OUTI,        "outi",         OPERAND_NONE,   1, 0,                                       \
+        VVM_CHECK(VVM_SP < 1, ERR_STACK_UNDERFLOW);                                                 \
+        vm_channel_decimal(&p_vm->channel, p_vm->stack[--VVM_SP].as_i64);                           \
+        VVM_NEXT();)                                                                                \
+                                                                                                    \
+    /* Vector instructions. The operand is the number of lanes, 2, 4 or 8,  */                      \
+    /* which are the words at the top of the stack, the first lane deepest. */                      \
+    /* Binary ones apply the top vector to the one below it. Their checks   */                      \
+    /* are made by vm_execute_vector.                                       */                      \
+    X(INST_VADDF,       "vaddf",        OPERAND_LANES,  2 * VVM_LANES, VVM_LANES,   VVM_VECTOR)     \
+    X(INST_VSUBF,       "vsubf",        OPERAND_LANES,  2 * VVM_LANES, VVM_LANES,   VVM_VECTOR)     \
+    X(INST_VMULF,       "vmulf",        OPERAND_LANES,  2 * VVM_LANES, VVM_LANES,   VVM_VECTOR)     \
+    X(INST_VDIVF,       "vdivf",        OPERAND_LANES,  2 * VVM_LANES, VVM_LANES,   VVM_VECTOR)     \
+    X(INST_VADDI,       "vaddi",        OPERAND_LANES,  2 * VVM_LANES, VVM_LANES,   VVM_VECTOR)     \
+    X(INST_VSUBI,       "vsubi",        OPERAND_LANES,  2 * VVM_LANES, VVM_LANES,   VVM_VECTOR)     \
+    X(INST_VMULI,       "vmuli",        OPERAND_LANES,  2 * VVM_LANES, VVM_LANES,   VVM_VECTOR)     \
+    X(INST_VDIVI,       "vdivi",        OPERAND_LANES,  2 * VVM_LANES, VVM_LANES,   VVM_VECTOR)     \
+    X(INST_VSUMF,       "vsumf",        OPERAND_LANES,  VVM_LANES, 1,               VVM_VECTOR)     \
+    X(INST_VSUMI,       "vsumi",        OPERAND_LANES,  VVM_LANES, 1,               VVM_VECTOR)     \
+    X(INST_VBCAST,      "vbcast",       OPERAND_LANES,  1, VVM_LANES,               VVM_VECTOR)     \
+                                                                                                    \
+    /* Math intrinsics, each the work of one hardware instruction. fma pops */                      \
+    /* c, b and a and pushes a * b + c rounded once, minf, maxf, ltf and    */                      \
+    /* lti compare the second element against the top.                      */                      \
+    X(INST_FMA,         "fma",          OPERAND_NONE,   3, 1,                                       \
+        VVM_CHECK(VVM_SP < 3, ERR_STACK_UNDERFLOW);                                                 \
+        VVM_TOP(2).as_f64 = fma(VVM_TOP(2).as_f64, VVM_TOP(1).as_f64, VVM_TOP(0).as_f64);           \
+        VVM_SP -= 2;                                                                                \
+        VVM_NEXT();)                                                                                \
+    X(INST_SQRTF,       "sqrtf",        OPERAND_NONE,   1, 1,                                       \
+        VVM_CHECK(VVM_SP < 1, ERR_STACK_UNDERFLOW);                                                 \
+        VVM_TOP(0).as_f64 = sqrt(VVM_TOP(0).as_f64);                                                \
+        VVM_NEXT();)                                                                                \
+    X(INST_I2F,         "i2f",          OPERAND_NONE,   1, 1,                                       \
+        VVM_CHECK(VVM_SP < 1, ERR_STACK_UNDERFLOW);                                                 \
+        VVM_TOP(0).as_f64 = (double)VVM_TOP(0).as_i64;                                              \
+        VVM_NEXT();)                                                                                \
+    X(INST_F2I,         "f2i",          OPERAND_NONE,   1, 1,                                       \
+        VVM_CHECK(VVM_SP < 1, ERR_STACK_UNDERFLOW);                                                 \
+        if (!vm_float_fits_int(VVM_TOP(0).as_f64))                                                  \
+            return ERR_ILLEGAL_OPERAND;                                                             \
+        VVM_TOP(0).as_i64 = (int64_t)VVM_TOP(0).as_f64;                                             \
+        VVM_NEXT();)                                                                                \
+    X(INST_NEGF,        "negf",         OPERAND_NONE,   1, 1,                                       \
+        VVM_CHECK(VVM_SP < 1, ERR_STACK_UNDERFLOW);                                                 \
+        VVM_TOP(0).as_u64 ^= UINT64_C(1) << 63;                                                     \
+        VVM_NEXT();)                                                                                \
+    X(INST_MINF,        "minf",         OPERAND_NONE,   2, 1,                                       \
+        VVM_CHECK(VVM_SP < 2, ERR_STACK_UNDERFLOW);                                                 \
+        if (!(VVM_TOP(1).as_f64 < VVM_TOP(0).as_f64))                                               \
+            VVM_TOP(1) = VVM_TOP(0);                                                                \
+        VVM_SP--;                                                                                   \
+        VVM_NEXT();)                                                                                \
+    X(INST_MAXF,        "maxf",         OPERAND_NONE,   2, 1,                                       \
+        VVM_CHECK(VVM_SP < 2, ERR_STACK_UNDERFLOW);                                                 \
+        if (!(VVM_TOP(1).as_f64 > VVM_TOP(0).as_f64))                                               \
+            VVM_TOP(1) = VVM_TOP(0);                                                                \
+        VVM_SP--;                                                                                   \
+        VVM_NEXT();)                                                                                \
+    X(INST_LTF,         "ltf",          OPERAND_NONE,   2, 1,                                       \
+        VVM_CHECK(VVM_SP < 2, ERR_STACK_UNDERFLOW);                                                 \
+        VVM_TOP(1).as_u64 = VVM_TOP(1).as_f64 < VVM_TOP(0).as_f64;                                  \
+        VVM_SP--;                                                                                   \
+        VVM_NEXT();)                                                                                \
+    X(INST_LTI,         "lti",          OPERAND_NONE,   2, 1,                                       \
+        VVM_CHECK(VVM_SP < 2, ERR_STACK_UNDERFLOW);                                                 \
+        VVM_TOP(1).as_u64 = VVM_TOP(1).as_i64 < VVM_TOP(0).as_i64;                                  \
+        VVM_SP--;                                                                                   \
+        VVM_NEXT();)                                                                                \
+                                                                                                    \
+    /* Linear memory, the memory_size words of p_vm->memory. Addresses are */                       \
+    /* word indices, and load and store take theirs from the top, the     */                        \
+    /* _imm forms from the operand. memcpy pops n, src and dst and copies */                        \
+    /* n words as memmove does, memset pops n, x and dst and fills n words */                       \
+    /* with x.                                                             */                       \
+    X(INST_LOAD,        "load",         OPERAND_NONE,   1, 1,                                       \
+        VVM_CHECK(VVM_SP < 1, ERR_STACK_UNDERFLOW);                                                 \
+        if (VVM_TOP(0).as_u64 >= p_vm->memory_size)                                                 \
+            return ERR_ILLEGAL_MEMORY_ACCESS;                                                       \
+        VVM_TOP(0) = p_vm->memory[VVM_TOP(0).as_u64];                                               \
+        VVM_NEXT();)                                                                                \
+    X(INST_STORE,       "store",        OPERAND_NONE,   2, 0,                                       \
+        VVM_CHECK(VVM_SP < 2, ERR_STACK_UNDERFLOW);                                                 \
+        if (VVM_TOP(0).as_u64 >= p_vm->memory_size)                                                 \
+            return ERR_ILLEGAL_MEMORY_ACCESS;                                                       \
+        p_vm->memory[VVM_TOP(0).as_u64] = VVM_TOP(1);                                               \
+        VVM_SP -= 2;                                                                                \
+        VVM_NEXT();)                                                                                \
+    X(INST_LOAD_IMM,    "load_imm",     OPERAND_WORD,   0, 1,                                       \
+        VVM_CHECK(VVM_SP >= p_vm->stack_capacity, ERR_STACK_OVERFLOW);                              \
+        VVM_CHECK_PUSHED(inst.operand.as_u64 >= p_vm->memory_size, inst.operand, ERR_ILLEGAL_MEMORY_ACCESS); \
+        p_vm->stack[VVM_SP++] = p_vm->memory[inst.operand.as_u64];                                  \
+        VVM_NEXT();)                                                                                \
+    X(INST_STORE_IMM,   "store_imm",    OPERAND_WORD,   1, 0,                                       \
+        VVM_CHECK(VVM_SP >= p_vm->stack_capacity, ERR_STACK_OVERFLOW);                              \
+        VVM_CHECK_PUSHED(VVM_SP < 1, inst.operand, ERR_STACK_UNDERFLOW);                            \
+        VVM_CHECK_PUSHED(inst.operand.as_u64 >= p_vm->memory_size, inst.operand, ERR_ILLEGAL_MEMORY_ACCESS); \
+        p_vm->memory[inst.operand.as_u64] = p_vm->stack[--VVM_SP];                                  \
+        VVM_NEXT();)                                                                                \
+    X(INST_MEMCPY,      "memcpy",       OPERAND_NONE,   3, 0,                                       \
+        VVM_CHECK(VVM_SP < 3, ERR_STACK_UNDERFLOW);                                                 \
+        if (!vm_memory_copy(p_vm, VVM_TOP(2).as_u64, VVM_TOP(1).as_u64, VVM_TOP(0).as_u64))         \
+            return ERR_ILLEGAL_MEMORY_ACCESS;                                                       \
+        VVM_SP -= 3;                                                                                \
+        VVM_NEXT();)                                                                                \
+    X(INST_MEMSET,      "memset",       OPERAND_NONE,   3, 0,                                       \
+        VVM_CHECK(VVM_SP < 3, ERR_STACK_UNDERFLOW);                                                 \
+        if (!vm_memory_fill(p_vm, VVM_TOP(2).as_u64, VVM_TOP(1), VVM_TOP(0).as_u64))                \
+            return ERR_ILLEGAL_MEMORY_ACCESS;                                                       \
+        VVM_SP -= 3;                                                                                \
+        VVM_NEXT();)                                                                                \
+                                                                                                    \
+    /* Host functions, see native_table_t. The operand is the index    */                           \
+    /* of an entry, which declares what it pops and pushes in place of */                           \
+    /* this table. Its checks are made by vm_execute_native.           */                           \
+    X(INST_NATIVE,      "native",       OPERAND_NATIVE, 0, 0,   VVM_NATIVE)
 
+// What the operand of an instruction is, which decides how vasm reads it.
 typedef enum {
-    INST_NOP = 0,
-
-    INST_PUSH,
-    INST_DUP_REL,
-    INST_SWAP,
-
-    INST_ADDI,
-    INST_SUBI,
-    INST_MULI,
-    INST_DIVI,
-    INST_ADDF,
-    INST_SUBF,
-    INST_MULF,
-    INST_DIVF,
-    
-    INST_JMP,
-    INST_JMP_NZ,
-    INST_EQ,
-    INST_NOT,
-    INST_GEQ,
-
-    INST_HALT,
-    INST_PRINT_DEBUG,
+    OPERAND_NONE = 0,
+    OPERAND_WORD,       // A number literal.
+    OPERAND_INT,        // A distance into the stack.
+    OPERAND_LANES,      // The number of lanes of a vector instruction.
+    OPERAND_NATIVE,     // An entry of the native table, or its name.
+    OPERAND_ADDR,       // An address or a label.
+} operand_type;
+
+#define VVM_INST_ENUM(p_id, p_name, p_operand, p_pops, p_pushes, ...) p_id,
+
+typedef enum {
+    VVM_INSTRUCTIONS(VVM_INST_ENUM)
     NUMBER_OF_INSTS,
 } inst_type;
 
+#undef VVM_INST_ENUM
+
 const char *inst_name(inst_type p_type);
+inst_type inst_from_name(string_view_t p_name);
+operand_type inst_operand_type(inst_type p_type);
 int inst_has_operand(inst_type p_type);
+int inst_is_jump(inst_type p_type);
+int inst_is_vector(inst_type p_type);
 const char* inst_type_as_cstr(inst_type p_type);
 
 typedef struct {
@@ -94,9 +428,48 @@ typedef struct {
     word_t operand;
 } inst_t;
 
+static_assert(sizeof(inst_t) == 16, "Instructions Are Stored As 16 Bytes In .vm Files");
+
+// Functions of the host that `native <id>` calls, so that work like hashing
+// or transcendental math runs as one call instead of many instructions. An
+// entry is handed the pops words it takes, deepest first, and writes the
+// pushes words it leaves over them, so it never moves the stack. Anything but
+// ERR_OK stops the program with that error, and should leave the words alone.
+typedef error (*native_fn_t)(void* p_user, word_t* p_words);
+
+typedef struct {
+    const char* name;       // What vasm resolves `native <name>` to.
+    native_fn_t fn;
+    uint8_t pops;
+    uint8_t pushes;
+} native_t;
+
+// Entries are called by their index, which vasm writes into the program, so a
+// program runs against a table with the same entries in the same order.
+typedef struct {
+    const native_t* entries;
+    uint64_t count;
+    void* user;             // Handed to every call.
+} native_table_t;
+
+// Shared objects export their table as VVM_NATIVE_SYMBOL.
+#define VVM_NATIVE_SYMBOL "vvm_natives"
+
+typedef struct {
+    const native_table_t* table;
+    void* handle;
+} native_library_t;
+
+#ifdef VVM_DLOPEN
+error native_library_open(const char* p_file_path, native_library_t* p_library, FILE* p_diagnostics);
+void native_library_close(native_library_t* p_library);
+#endif
+int native_lookup(const native_table_t* p_natives, string_view_t p_name, uint64_t* p_id);
+
 typedef struct {
     string_view_t name;
     inst_addr_t addr;
+    uint64_t hash;
 } label_t;
 
 typedef struct {
@@ -105,40 +478,502 @@ typedef struct {
 } deferred_operand_t;
 
 typedef struct {
-    label_t labels[VVM_LABEL_CAPACITY];
+    arena_t* arena;
+    label_t* labels;                // In order of definition.
     size_t labels_size;
-    deferred_operand_t deferred_operands[VVM_DEFERRED_OPERANDS_CAPACITY];
+    size_t labels_capacity;
+    uint32_t* label_slots;          // Open addressing index of labels by name,
+    size_t label_slots_capacity;    // holding index + 1, or 0 for a free slot.
+    deferred_operand_t* deferred_operands;
     size_t deferred_operands_size;
+    size_t deferred_operands_capacity;
+    FILE* diagnostics;              // Where failures are described, stderr
+                                    // unless changed after vasm_init.
+    const native_table_t* natives;  // Names `native` can use, if any.
 } vasm_t;
 
-inst_addr_t vasm_find_label_addr(vasm_t* p_vasm, string_view_t p_name);
-void vasm_push_label(vasm_t* p_vasm, string_view_t p_name, inst_addr_t p_addr);
-void vasm_push_deferred_operand(vasm_t* p_vasm, inst_addr_t p_addr, string_view_t p_name);
+void vasm_init(vasm_t* p_vasm, arena_t* p_arena);
+int vasm_lookup_label(const vasm_t* p_vasm, string_view_t p_name, inst_addr_t* p_addr);
+error vasm_find_label_addr(vasm_t* p_vasm, string_view_t p_name, inst_addr_t* p_addr);
+error vasm_push_label(vasm_t* p_vasm, string_view_t p_name, inst_addr_t p_addr);
+error vasm_push_deferred_operand(vasm_t* p_vasm, inst_addr_t p_addr, string_view_t p_name);
+error vasm_resolve_label(vasm_t* p_vasm, inst_addr_t p_addr, string_view_t p_name, inst_addr_t* p_target);
+
+// Lane kernels of the vector instructions. vm_init picks the widest ones the
+// CPU supports, and all of them give the same results: horizontal sums fold
+// the upper half of the lanes onto the lower half until one is left.
+#define VVM_VECTOR_BINARY_OPS (INST_VDIVI - INST_VADDF + 1)
+
+typedef void (*vector_binary_t)(word_t* p_a, const word_t* p_b, uint64_t p_lanes);
+
+typedef struct {
+    const char* name;
+    vector_binary_t binary[VVM_VECTOR_BINARY_OPS];  // INST_VADDF to INST_VDIVI.
+    double (*sumf)(const word_t* p_lanes, uint64_t p_count);
+    uint64_t (*sumi)(const word_t* p_lanes, uint64_t p_count);
+    void (*bcast)(word_t* p_lanes, uint64_t p_count);  // The first lane to the rest.
+} vector_kernels_t;
+
+// Receives every block of channel output, in order, when set.
+typedef void (*vvm_sink_t)(void* p_user, const void* p_data, size_t p_size);
+
+// Buffered output of out and outi. Nothing is formatted on the way: out
+// appends the top of the stack as its 8 raw bytes, outi as a decimal integer
+// and a newline, and the buffer only goes out once it is full or flushed.
+#define VVM_CHANNEL_CAPACITY (64 * 1024)
+#define VVM_CHANNEL_RECORD_MAX 21       // "-9223372036854775808\n"
+
+typedef struct {
+    uint8_t* buffer;        // VVM_CHANNEL_CAPACITY bytes from the arena.
+    size_t size;
+    int fd;                 // Written to with write(2), 1 after vm_init,
+    vvm_sink_t sink;        // unless there is a sink, which is handed
+    void* user;             // every block along with user instead.
+    int failed;             // errno of the first failed write, after which
+                            // the output is dropped.
+} vvm_channel_t;
 
 typedef struct {
-    word_t stack[VVM_STACK_CAPACITY];
+    // Storage of the stack and the program, and scratch memory of the engines.
+    arena_t* arena;
+
+    word_t* stack;
     uint64_t stack_size;
+    uint64_t stack_capacity;
 
-    inst_t program[VVM_PROGRAM_CAPACITY];
+    // Lives in the arena and grows as instructions are pushed, or points into
+    // a read-only mapping of a .vm file after vm_map_program_from_file, in
+    // which case program_capacity is 0. Functions that modify the program copy
+    // a mapped program into the arena first.
+    inst_t* program;
     uint64_t program_size;
+    uint64_t program_capacity;
     inst_addr_t inst_pointer;
+    void* mapping;
+    size_t mapping_size;
+
+    // Set by vm_verify_program for every instruction whose stack checks can
+    // never fail. Cleared whenever a new program is loaded.
+    uint8_t* verified;
+
+    // Where print_debug writes, stdout unless changed after vm_init. Nothing
+    // else in a vvm_t is shared, so machines on different threads only need
+    // their own arena and output.
+    FILE* output;
+
+    // Where loading and saving describe their failures, stderr unless changed
+    // after vm_init, or NULL to stay silent.
+    FILE* diagnostics;
+
+    vvm_channel_t channel;
+
+    // Linear memory of load and store, memory_size zeroed words after
+    // vm_map_memory and none after vm_init. It lives outside of the arena,
+    // in a mapping of memory_mapping_size bytes, or a calloc buffer when
+    // memory_mapping_size is 0.
+    word_t* memory;
+    uint64_t memory_size;
+    size_t memory_mapping_size;
+
+    const vector_kernels_t* vector;
+
+    // What native calls, NULL after vm_init, in which case every native fails
+    // with ERR_ILLEGAL_OPERAND. The verifier relies on the arities of the
+    // entries, so the table is set before vm_verify_program.
+    const native_table_t* natives;
 
     int halt;
 } vvm_t;
 
+typedef struct {
+    uint64_t reachable;     // Instructions reachable from inst_pointer.
+    uint64_t proven;        // Reachable instructions whose checks were elided.
+    uint64_t bad_jumps;     // Jumps whose target lies outside of the program.
+} verification_t;
+
+// Container format of .vm files: a header, a section table and the sections,
+// each aligned to 16 bytes, all in the byte order of the machine that wrote
+// the file. Files that do not start with the magic are read as a raw array of
+// inst_t, the format used before the container existed.
+#define VVM_FILE_MAGIC "\x7FVVM"
+#define VVM_FILE_VERSION 1
+#define VVM_FILE_BYTE_ORDER 0x01020304
+#define VVM_FILE_ALIGNMENT 16
+
+typedef enum {
+    VVM_SECTION_CODE = 1,       // The inst_t array.
+    VVM_SECTION_CONSTANTS,      // Reserved for a constant pool.
+    VVM_SECTION_SYMBOLS,        // vvm_symbol_t entries, each followed by its name.
+    VVM_SECTION_STATE,          // vvm_state_t of a snapshot.
+    VVM_SECTION_STACK,          // The word_t stack of a snapshot, bottom first.
+    VVM_SECTION_MEMORY,         // The memory size of a snapshot in words, then
+                                // its memory up to the last word that is not 0.
+} vvm_section_kind;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t sections_count;
+    uint64_t hash;              // FNV-1a of everything that follows the header.
+} vvm_file_header_t;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+} vvm_section_t;
+
+typedef struct {
+    inst_addr_t addr;
+    uint64_t name_size;         // The name follows, padded to 8 bytes.
+} vvm_symbol_t;
+
+typedef struct {
+    inst_addr_t inst_pointer;
+    uint64_t stack_size;
+    uint64_t stack_capacity;
+    uint32_t halt;
+    uint32_t reserved;
+} vvm_state_t;
+
+// A snapshot is a .vm file that also holds the state of a machine. Its code
+// and stack are used straight from the file, so one opened snapshot can be
+// restored into any number of machines, as often as needed.
+typedef struct {
+    file_view_t file;
+    const inst_t* program;
+    uint64_t program_size;
+    const word_t* stack;
+    vvm_state_t state;
+    const word_t* memory;       // memory_used words, the rest of the
+    uint64_t memory_used;       // memory_size words are 0. Snapshots of
+    uint64_t memory_size;       // machines without memory have none.
+} snapshot_t;
+
+// Three-address operations of the register engine. Operands are indices into
+// a register file that starts with the stack slots.
+typedef enum {
+    REG_OP_MOV = 0,
+
+    REG_OP_ADDI,
+    REG_OP_SUBI,
+    REG_OP_MULI,
+    REG_OP_DIVI,
+    REG_OP_ADDF,
+    REG_OP_SUBF,
+    REG_OP_MULF,
+    REG_OP_DIVF,
+
+    REG_OP_EQ,
+    REG_OP_NOT,
+    REG_OP_GEQ,
+
+    REG_OP_FMA,
+    REG_OP_SQRTF,
+    REG_OP_I2F,
+    REG_OP_F2I,
+    REG_OP_NEGF,
+    REG_OP_MINF,
+    REG_OP_MAXF,
+    REG_OP_LTF,
+    REG_OP_LTI,
+
+    REG_OP_LOAD,
+    REG_OP_STORE,       // Stores a at the address in b.
+    REG_OP_MEMCPY,
+    REG_OP_MEMSET,
+    REG_OP_NATIVE,      // Calls the native in b on the slots from a up.
+
+    REG_OP_JMP,
+    REG_OP_JNZ,
+    REG_OP_BUDGET,      // Takes the c instructions of a block from the limit.
+
+    REG_OP_PRINT,
+    REG_OP_OUT,
+    REG_OP_OUTI,
+    REG_OP_HALT,
+    REG_OP_EXIT,
+} reg_op_type;
+
+typedef struct {
+    reg_op_type op;
+    uint32_t dst;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;         // Addend of fma, count of memcpy and memset,
+                        // instructions of a block for budget.
+    uint32_t target;
+    uint32_t vm_ip;     // Instruction to report for halt and errors.
+    uint32_t depth;     // Stack size at print_debug, halt and errors.
+} reg_inst_t;
+
+// Register file layout: the first first_temp registers are the stack slots,
+// followed by temporaries and constants.
+typedef struct {
+    reg_inst_t* code;
+    uint64_t code_size;
+    uint64_t code_capacity;
+    word_t* consts;
+    uint32_t consts_size;
+    uint32_t consts_capacity;
+    uint64_t* entry;            // Register code index of each instruction.
+    uint64_t start;
+    uint32_t first_temp;
+    uint32_t first_const;
+    word_t* regs;
+} reg_program_t;
+
+// Compact layout of a program for execution. Instead of 16 bytes per
+// instruction, every instruction takes one opcode byte and only instructions
+// that have an operand take a slot in the operand pool. Operands of the
+// instructions preceding ip are always operand_index[ip] slots into the pool.
+typedef struct {
+    uint8_t* ops;
+    word_t* operands;
+    uint32_t* operand_index;
+    uint64_t program_size;
+    uint64_t operands_size;
+} compact_program_t;
+
+#ifdef VVM_PROFILE
+typedef struct {
+    uint64_t count;
+    uint64_t samples;       // Executions that were timed,
+    uint64_t ticks;         // and the ticks they took in total.
+} profile_opcode_t;
+
+// Execution counts per instruction type and per address, and how often each
+// conditional jump was taken. Ticks come from rdtsc on x86-64 and are
+// nanoseconds elsewhere, less the cost of reading the clock itself.
+typedef struct {
+    uint64_t* counts;
+    uint64_t* taken;
+    uint64_t program_size;
+    uint64_t retired;
+    profile_opcode_t opcodes[NUMBER_OF_INSTS];
+    uint64_t clock_overhead;
+    uint64_t next_sample;       // Countdown to the next timed instruction.
+    uint64_t random;
+} profile_t;
+#endif
+
+#ifdef VVM_TRACE
+#define VVM_TRACE_DEFAULT_CAPACITY 4096
+#define VVM_TRACE_MAGIC "\x7FVVT"
+#define VVM_TRACE_VERSION 2
+#define VVM_TRACE_NO_OPCODE 0xFF    // The instruction pointer was out of range.
+
+typedef enum {
+    TRACE_START = 0,                // Where a run starts.
+    TRACE_JUMP,                     // A jump that is taken.
+    TRACE_STOP,                     // The instruction a run fails at.
+} trace_kind_t;
+
+// The state of the machine as an instruction starts executing. Only the
+// points where control does not go on to the next instruction are recorded,
+// and the instructions in between are the straight line from one entry to
+// the next, which detrace rebuilds from the program.
+typedef struct {
+    uint64_t inst_pointer;
+    uint32_t stack_size;            // Saturates at UINT32_MAX.
+    uint8_t opcode;
+    uint8_t kind;                   // A trace_kind_t.
+    uint8_t padding[2];
+} trace_entry_t;
+
+static_assert(sizeof(trace_entry_t) == 16, "Trace Entries Are Stored As 16 Bytes In Trace Files");
+
+// Ring buffer of the last capacity entries, a power of two. The interpreter
+// is the only writer and publishes every entry by advancing head, so a signal
+// handler on the same thread can dump it at any point without taking a lock.
+struct trace_t {
+    trace_entry_t* entries;
+    uint64_t capacity;
+    _Atomic uint64_t head;          // Entries recorded so far.
+};
+
+// Trace files are a header followed by the entries, oldest first.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t error;                 // What stopped the run: an error,
+    int32_t signal;                 // or a signal, 0 if there was none.
+    uint32_t reserved;
+    uint64_t recorded;              // Entries recorded over the whole run.
+    uint64_t count;                 // Entries in the file.
+} trace_file_header_t;
+#endif
+
+#ifdef VVM_JIT
+typedef struct {
+    void* code;
+    size_t capacity;
+    uint64_t program_size;
+    void** entries;             // Native code of each instruction.
+} jit_t;
+#endif
+
+error vm_init(vvm_t* p_vm, arena_t* p_arena, uint64_t p_stack_capacity);
+error vm_map_memory(vvm_t* p_vm, uint64_t p_size, int p_huge_pages);
+void vm_unmap_memory(vvm_t* p_vm);
 error vm_execute_inst(vvm_t* p_vm);
 error vm_execute_program(vvm_t* p_vm, int p_limit);
+#ifdef VVM_UNCHECKED
+error vm_execute_program_unchecked(vvm_t* p_vm, int p_limit);
+#endif
+error vm_execute_program_threaded(vvm_t* p_vm, int p_limit);
+error vm_execute_threaded(vvm_t* p_vm, trace_t* p_trace, int p_limit);
+verification_t vm_verify_program(vvm_t* p_vm, FILE* p_diagnostics);
+int vm_translate_to_registers(const vvm_t* p_vm, reg_program_t* p_program, int p_counted);
+error vm_execute_registers(vvm_t* p_vm, const reg_program_t* p_program, int p_limit);
+// Programs the register code cannot be made of run on the threaded engine.
+error vm_execute_program_registers(vvm_t* p_vm, int p_limit);
+#ifdef VVM_JIT
+int vm_jit_compile(const vvm_t* p_vm, jit_t* p_jit);
+void vm_jit_free(jit_t* p_jit);
+error vm_execute_jit(vvm_t* p_vm, const jit_t* p_jit, int p_limit);
+#endif
+error vm_execute_program_jit(vvm_t* p_vm, int p_limit);
+error vm_compact_program(const vvm_t* p_vm, compact_program_t* p_program);
+error vm_execute_compact(vvm_t* p_vm, const compact_program_t* p_program, int p_limit);
+error vm_execute_program_compact(vvm_t* p_vm, int p_limit);
+error vm_execute_tos(vvm_t* p_vm, const compact_program_t* p_program, int p_limit);
+error vm_execute_program_tos(vvm_t* p_vm, int p_limit);
+#ifdef VVM_PROFILE
+error vm_profile_init(const vvm_t* p_vm, profile_t* p_profile);
+error vm_execute_program_profiled(vvm_t* p_vm, profile_t* p_profile, int p_limit);
+error vm_profile_report(FILE* p_stream, const vvm_t* p_vm, const profile_t* p_profile);
+#endif
+#ifdef VVM_TRACE
+error vm_trace_init(const vvm_t* p_vm, trace_t* p_trace, uint64_t p_capacity);
+error vm_execute_program_traced(vvm_t* p_vm, trace_t* p_trace, int p_limit);
+int vm_trace_write(const trace_t* p_trace, int p_fd, error p_error, int p_signal);
+#endif
 void vm_dump_stack(FILE* p_stream, const vvm_t* p_vm);
-void vm_push_inst(vvm_t* p_vm, inst_t p_inst);
-void vm_load_program_from_memory(vvm_t* p_vm, inst_t* p_program, size_t p_program_size);
-void vm_load_program_from_file(vvm_t* p_vm, const char* p_file_path);
-void vm_save_program_to_file(const vvm_t* p_vm, const char* p_file_path);
-void vm_translate_source(string_view_t p_source, vvm_t* p_vm, vasm_t* p_vasm);
+error vm_flush_channel(vvm_t* p_vm);
+const vector_kernels_t* vm_vector_kernels(const char* p_name);
+error vm_reserve_program(vvm_t* p_vm, uint64_t p_count);
+error vm_push_inst(vvm_t* p_vm, inst_t p_inst);
+error vm_load_program_from_memory(vvm_t* p_vm, inst_t* p_program, size_t p_program_size);
+error vm_load_program_from_image(vvm_t* p_vm, const void* p_image, size_t p_size);
+error vm_load_program_from_file(vvm_t* p_vm, const char* p_file_path);
+error vm_map_program_from_file(vvm_t* p_vm, const char* p_file_path);
+void vm_unload_program(vvm_t* p_vm);
+error vm_load_symbols_from_file(const char* p_file_path, vasm_t* p_vasm);
+error vm_save_program_to_file(const vvm_t* p_vm, const vasm_t* p_vasm, const char* p_file_path);
+error vm_save_snapshot_to_file(const vvm_t* p_vm, const char* p_file_path);
+error snapshot_open(const char* p_file_path, snapshot_t* p_snapshot, FILE* p_diagnostics);
+void snapshot_close(snapshot_t* p_snapshot);
+error vm_restore_snapshot(vvm_t* p_vm, const snapshot_t* p_snapshot);
+error vm_translate_source(string_view_t p_source, vvm_t* p_vm, vasm_t* p_vasm);
+error vm_fuse_superinstructions(vvm_t* p_vm, vasm_t* p_vasm);
+error vm_optimize_program(vvm_t* p_vm, vasm_t* p_vasm);
 
 #endif // __VVM_H_INCLUDED__
 
 #ifdef VM_IMPLEMENTATION
 
+static_assert(offsetof(arena_block_t, data) % VVM_ARENA_ALIGNMENT == 0, "Arena Blocks Must Keep Their Data Aligned");
+
+void* arena_alloc(arena_t* p_arena, size_t p_size)
+{
+    p_size = (p_size + VVM_ARENA_ALIGNMENT - 1) / VVM_ARENA_ALIGNMENT * VVM_ARENA_ALIGNMENT;
+
+    if (p_arena->current == NULL && p_arena->first != NULL)
+    {
+        p_arena->current = p_arena->first;
+        p_arena->current->size = 0;
+    }
+
+    while (p_arena->current == NULL || p_arena->current->capacity - p_arena->current->size < p_size)
+    {
+        // Move on to the next block, reusing it if it is large enough.
+        arena_block_t* next = p_arena->current != NULL ? p_arena->current->next : NULL;
+        if (next == NULL || next->capacity < p_size)
+        {
+            const size_t capacity = p_size > VVM_ARENA_BLOCK_SIZE ? p_size : VVM_ARENA_BLOCK_SIZE;
+            arena_block_t* block = malloc(sizeof(*block) + capacity);
+            if (block == NULL)
+                return NULL;
+
+            block->capacity = capacity;
+            block->next = next;
+            if (p_arena->current != NULL)
+                p_arena->current->next = block;
+            else
+                p_arena->first = block;
+            next = block;
+        }
+
+        next->size = 0;
+        p_arena->current = next;
+    }
+
+    void* result = p_arena->current->data + p_arena->current->size;
+    p_arena->current->size += p_size;
+    return result;
+}
+
+void* arena_grow(arena_t* p_arena, void* p_data, size_t p_old_size, size_t p_new_size)
+{
+    // The most recent allocation grows in place when its block has room.
+    arena_block_t* block = p_arena->current;
+    if (p_data != NULL && block != NULL)
+    {
+        const size_t offset = (uint8_t*)p_data - block->data;
+        const size_t old_end = offset + (p_old_size + VVM_ARENA_ALIGNMENT - 1) / VVM_ARENA_ALIGNMENT * VVM_ARENA_ALIGNMENT;
+        const size_t new_end = offset + (p_new_size + VVM_ARENA_ALIGNMENT - 1) / VVM_ARENA_ALIGNMENT * VVM_ARENA_ALIGNMENT;
+        if ((uint8_t*)p_data >= block->data && old_end == block->size && new_end <= block->capacity)
+        {
+            block->size = new_end;
+            return p_data;
+        }
+    }
+
+    void* result = arena_alloc(p_arena, p_new_size);
+    if (result != NULL && p_data != NULL)
+        memcpy(result, p_data, p_old_size < p_new_size ? p_old_size : p_new_size);
+
+    return result;
+}
+
+arena_mark_t arena_mark(const arena_t* p_arena)
+{
+    return (arena_mark_t) {
+        .block = p_arena->current,
+        .size = p_arena->current != NULL ? p_arena->current->size : 0,
+    };
+}
+
+void arena_rewind(arena_t* p_arena, arena_mark_t p_mark)
+{
+    p_arena->current = p_mark.block;
+    if (p_mark.block != NULL)
+        p_mark.block->size = p_mark.size;
+}
+
+void arena_reset(arena_t* p_arena)
+{
+    p_arena->current = NULL;
+}
+
+void arena_free(arena_t* p_arena)
+{
+    arena_block_t* block = p_arena->first;
+    while (block != NULL)
+    {
+        arena_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    p_arena->first = NULL;
+    p_arena->current = NULL;
+}
+
 string_view_t cstr_as_sv(const char* p_cstr)
 {
     return (string_view_t) {
@@ -214,58 +1049,183 @@ int sv_to_int(string_view_t p_sv)
     int result = 0;
 
     for (size_t i = 0; i < p_sv.count && isdigit(p_sv.data[i]); ++i)
-        result = result * 10 + *p_sv.data - '0';
+        result = result * 10 + p_sv.data[i] - '0';
 
     return result;
 }
 
-string_view_t sv_slurp_file(const char* p_file_path)
+// Reports a failure on p_stream, if there is one.
+static void vvm_diagnose(FILE* p_stream, const char* p_format, ...)
+{
+    if (p_stream == NULL)
+        return;
+
+    va_list args;
+    va_start(args, p_format);
+    vfprintf(p_stream, p_format, args);
+    va_end(args);
+}
+
+error sv_slurp_file(const char* p_file_path, string_view_t* p_content, FILE* p_diagnostics)
 {
     FILE* f = fopen(p_file_path, "r");
     if (f == NULL)
     {
-        fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
+        vvm_diagnose(p_diagnostics, "[ERROR]: Could Not Open File `%s`: %s\n", p_file_path, strerror(errno));
+        return ERR_FILE_ACCESS;
     }
 
-    if (fseek(f, 0, SEEK_END) < 0)
+    char* buffer = NULL;
+    long m = 0;
+    if (fseek(f, 0, SEEK_END) < 0 || (m = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) < 0)
+        goto read_failed;
+
+    // One spare byte, so empty files do not depend on what malloc(0) does.
+    buffer = malloc(m + 1);
+    if (buffer == NULL)
     {
-        fprintf(stderr, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
+        vvm_diagnose(p_diagnostics, "[ERROR]: Could Not Allocate Memory For File: %s\n", strerror(errno));
+        fclose(f);
+        return ERR_OUT_OF_MEMORY;
     }
 
-    long m = ftell(f);
-    if (m < 0)
+    size_t n = fread(buffer, 1, m, f);
+    if (ferror(f))
+        goto read_failed;
+
+    fclose(f);
+    *p_content = (string_view_t){
+        .count = n,
+        .data = buffer
+    };
+    return ERR_OK;
+
+read_failed:
+    vvm_diagnose(p_diagnostics, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
+    free(buffer);
+    fclose(f);
+    return ERR_FILE_ACCESS;
+}
+
+error file_view_open(const char* p_file_path, file_view_t* p_file, FILE* p_diagnostics)
+{
+    // Sources are mapped rather than read, so assembling a large file does not
+    // copy it first. Labels point into the content, so it has to stay open
+    // until the program is saved.
+#ifdef VVM_MMAP
+    int fd = open(p_file_path, O_RDONLY);
+    if (fd < 0)
     {
-        fprintf(stderr, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
+        vvm_diagnose(p_diagnostics, "[ERROR]: Could Not Open File `%s`: %s\n", p_file_path, strerror(errno));
+        return ERR_FILE_ACCESS;
     }
 
-    char* buffer = malloc(m);
-    if (buffer == NULL)
+    struct stat st;
+    if (fstat(fd, &st) < 0)
     {
-        fprintf(stderr, "[ERROR]: Could Not Allocate Memory For File: %s\n", strerror(errno));
-        exit(1);
+        vvm_diagnose(p_diagnostics, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
+        close(fd);
+        return ERR_FILE_ACCESS;
     }
 
-    if (fseek(f, 0, SEEK_SET) < 0)
+    // Empty files cannot be mapped, and pipes and the like are read instead.
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
     {
-        fprintf(stderr, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
+        void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            close(fd);
+            madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+            *p_file = (file_view_t) {
+                .content = { .count = st.st_size, .data = mapping },
+                .mapping = mapping,
+                .mapping_size = st.st_size,
+            };
+            return ERR_OK;
+        }
     }
 
-    size_t n = fread(buffer, 1, m, f);
-    if (ferror(f))
+    close(fd);
+#endif
+    *p_file = (file_view_t) {0};
+    return sv_slurp_file(p_file_path, &p_file->content, p_diagnostics);
+}
+
+void file_view_close(file_view_t* p_file)
+{
+#ifdef VVM_MMAP
+    if (p_file->mapping != NULL)
+        munmap(p_file->mapping, p_file->mapping_size);
+    else
+#endif
+        free((void*)p_file->content.data);
+
+    *p_file = (file_view_t) {0};
+}
+
+#ifdef VVM_DLOPEN
+// The library stays loaded until native_library_close, since the table and
+// its functions live in it.
+error native_library_open(const char* p_file_path, native_library_t* p_library, FILE* p_diagnostics)
+{
+    *p_library = (native_library_t) {0};
+
+    // dlopen only searches the library path for names without a slash.
+    void* handle = dlopen(p_file_path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL)
     {
-        fprintf(stderr, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
+        vvm_diagnose(p_diagnostics, "[ERROR]: Could Not Open Native Library `%s`: %s\n", p_file_path, dlerror());
+        return ERR_FILE_ACCESS;
     }
 
-    fclose(f);
-    return (string_view_t){
-        .count = n,
-        .data = buffer
-    };
+    const native_table_t* table = dlsym(handle, VVM_NATIVE_SYMBOL);
+    if (table == NULL)
+    {
+        vvm_diagnose(p_diagnostics, "[ERROR]: Native Library `%s` Does Not Export `%s`\n", p_file_path, VVM_NATIVE_SYMBOL);
+        dlclose(handle);
+        return ERR_INVALID_FILE;
+    }
+
+    for (uint64_t i = 0; i < table->count; ++i)
+    {
+        if (table->entries[i].fn == NULL)
+        {
+            vvm_diagnose(p_diagnostics, "[ERROR]: Native %lu Of `%s` Has No Function\n", i, p_file_path);
+            dlclose(handle);
+            return ERR_INVALID_FILE;
+        }
+    }
+
+    p_library->table = table;
+    p_library->handle = handle;
+    return ERR_OK;
+}
+
+void native_library_close(native_library_t* p_library)
+{
+    if (p_library->handle != NULL)
+        dlclose(p_library->handle);
+
+    *p_library = (native_library_t) {0};
+}
+#endif
+
+int native_lookup(const native_table_t* p_natives, string_view_t p_name, uint64_t* p_id)
+{
+    if (p_natives == NULL)
+        return 0;
+
+    for (uint64_t i = 0; i < p_natives->count; ++i)
+    {
+        const char* name = p_natives->entries[i].name;
+        if (name != NULL && sv_equal(cstr_as_sv(name), p_name))
+        {
+            *p_id = i;
+            return 1;
+        }
+    }
+
+    return 0;
 }
 
 const char* error_as_cstr(error p_error)
@@ -286,588 +1246,6091 @@ const char* error_as_cstr(error p_error)
             return "ERR_ILLEGAL_OPERAND";
         case ERR_DIV_BY_ZERO:
             return "ERR_DIV_BY_ZERO";
+        case ERR_ILLEGAL_MEMORY_ACCESS:
+            return "ERR_ILLEGAL_MEMORY_ACCESS";
+        case ERR_OUT_OF_MEMORY:
+            return "ERR_OUT_OF_MEMORY";
+        case ERR_FILE_ACCESS:
+            return "ERR_FILE_ACCESS";
+        case ERR_INVALID_FILE:
+            return "ERR_INVALID_FILE";
+        case ERR_INVALID_SOURCE:
+            return "ERR_INVALID_SOURCE";
+        case NUMBER_OF_ERRORS:
         default:
             assert(0 && "error_as_cstr: Unreachable (How Did You Get Here)");
     }
 }
 
-word_t number_literal_as_word(string_view_t p_sv)
+// Parses integers and decimal floats in a single pass. Floats are only taken
+// when the mantissa and the power of ten are both exact in a double, so one
+// rounding gives the same result as strtod. Returns 0 for anything else.
+static int number_literal_parse(string_view_t p_sv, word_t* p_word)
 {
-    assert(p_sv.count < 1024);
-    char cstr[p_sv.count + 1];
-    char* endptr = 0;
+    static const double powers_of_ten[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
 
-    memcpy(cstr, p_sv.data, p_sv.count);
-    cstr[p_sv.count] = '\0';
+    const char* it = p_sv.data;
+    const char* end = p_sv.data + p_sv.count;
 
-    word_t result = {0};
+    int negative = 0;
+    if (it < end && (*it == '-' || *it == '+'))
+        negative = *it++ == '-';
 
-    result.as_u64 = strtoull(cstr, &endptr, 10);
-    if ((size_t)(endptr - cstr) != p_sv.count)
+    uint64_t mantissa = 0;
+    int digits = 0;
+    for (; it < end && (unsigned)(*it - '0') < 10; ++it, ++digits)
+        mantissa = mantissa * 10 + (*it - '0');
+
+    // At most 19 digits always fit in 64 bits.
+    if (it == end)
     {
-        result.as_f64 = strtod(cstr, &endptr);
-        if ((size_t)(endptr - cstr) != p_sv.count)
-        {
-            fprintf(stderr, "[ERROR]: `%s` is not a number literal\n", cstr);
-            exit(1);
-        }
+        if (digits == 0 || digits > 19)
+            return 0;
+        p_word->as_u64 = negative ? 0 - mantissa : mantissa;
+        return 1;
     }
 
-    return result;
-}
+    int exponent = 0;
+    if (*it == '.')
+    {
+        for (++it; it < end && (unsigned)(*it - '0') < 10; ++it, ++digits, --exponent)
+            mantissa = mantissa * 10 + (*it - '0');
+    }
 
-const char* inst_name(inst_type p_type)
-{
-    switch (p_type)
+    if (digits == 0 || digits > 19)
+        return 0;
+
+    if (it < end && (*it == 'e' || *it == 'E'))
     {
-        case INST_NOP:          return "nop";
-
-        case INST_PUSH:         return "push";
-        case INST_DUP_REL:      return "rdup";
-        case INST_SWAP:         return "swap";
-
-        case INST_ADDI:         return "addi";
-        case INST_SUBI:         return "subi";
-        case INST_MULI:         return "muli";
-        case INST_DIVI:         return "divi";
-        case INST_ADDF:         return "addf";
-        case INST_SUBF:         return "subf";
-        case INST_MULF:         return "mulf";
-        case INST_DIVF:         return "divf";
-
-        case INST_JMP:          return "jmp";
-        case INST_JMP_NZ:       return "jnz";
-        case INST_EQ:           return "eq";
-        case INST_NOT:          return "not";
-        case INST_GEQ:          return "geq";
-
-        case INST_HALT:         return "halt";
-        case INST_PRINT_DEBUG:  return "print_debug";
-        case NUMBER_OF_INSTS:
-        default: assert(0 && "inst_name: unreachable");
+        ++it;
+        int exponent_negative = 0;
+        if (it < end && (*it == '-' || *it == '+'))
+            exponent_negative = *it++ == '-';
+
+        const char* exponent_start = it;
+        int value = 0;
+        for (; it < end && (unsigned)(*it - '0') < 10; ++it)
+            if (value < 1000)
+                value = value * 10 + (*it - '0');
+
+        if (it == exponent_start)
+            return 0;
+        exponent += exponent_negative ? -value : value;
     }
+
+    if (it != end || mantissa > (UINT64_C(1) << 53) || exponent < -22 || exponent > 22)
+        return 0;
+
+    double value = (double)mantissa;
+    value = exponent < 0 ? value / powers_of_ten[-exponent] : value * powers_of_ten[exponent];
+    p_word->as_f64 = negative ? -value : value;
+    return 1;
 }
 
-int inst_has_operand(inst_type p_type)
+error number_literal_as_word(string_view_t p_sv, word_t* p_word)
 {
-    switch (p_type) {
-        case INST_NOP:          return 0;
-
-        case INST_PUSH:         return 1;
-        case INST_DUP_REL:      return 1;
-        case INST_SWAP:         return 1;
-
-        case INST_ADDI:         return 0;
-        case INST_SUBI:         return 0;
-        case INST_MULI:         return 0;
-        case INST_DIVI:         return 0;
-        case INST_ADDF:         return 0;
-        case INST_SUBF:         return 0;
-        case INST_MULF:         return 0;
-        case INST_DIVF:         return 0;
-
-        case INST_JMP:          return 1;
-        case INST_JMP_NZ:       return 1;
-        case INST_EQ:           return 0;
-        case INST_NOT:          return 0;
-        case INST_GEQ:          return 0;
-
-        case INST_HALT:         return 0;
-        case INST_PRINT_DEBUG:  return 0;
-        case NUMBER_OF_INSTS:
-        default: assert(0 && "inst_name: unreachable");
-    }
+    if (number_literal_parse(p_sv, p_word))
+        return ERR_OK;
+
+    // Long mantissas, large exponents, hex floats, inf and nan.
+    char cstr[1024];
+    char* endptr = 0;
+
+    if (p_sv.count == 0 || p_sv.count >= sizeof(cstr))
+        return ERR_INVALID_SOURCE;
+    memcpy(cstr, p_sv.data, p_sv.count);
+    cstr[p_sv.count] = '\0';
+
+    p_word->as_u64 = strtoull(cstr, &endptr, 10);
+    if ((size_t)(endptr - cstr) != p_sv.count)
+    {
+        p_word->as_f64 = strtod(cstr, &endptr);
+        if ((size_t)(endptr - cstr) != p_sv.count)
+            return ERR_INVALID_SOURCE;
+    }
+
+    return ERR_OK;
+}
+
+#define VVM_INST_NAME(p_id, p_name, p_operand, p_pops, p_pushes, ...) [p_id] = p_name,
+#define VVM_INST_OPERAND(p_id, p_name, p_operand, p_pops, p_pushes, ...) [p_id] = p_operand,
+#define VVM_INST_ID(p_id, p_name, p_operand, p_pops, p_pushes, ...) [p_id] = #p_id,
+
+static const char* const inst_names[NUMBER_OF_INSTS] = { VVM_INSTRUCTIONS(VVM_INST_NAME) };
+static const uint8_t inst_operand_types[NUMBER_OF_INSTS] = { VVM_INSTRUCTIONS(VVM_INST_OPERAND) };
+static const char* const inst_ids[NUMBER_OF_INSTS] = { VVM_INSTRUCTIONS(VVM_INST_ID) };
+
+#undef VVM_INST_NAME
+#undef VVM_INST_OPERAND
+#undef VVM_INST_ID
+
+const char* inst_name(inst_type p_type)
+{
+    assert((unsigned)p_type < NUMBER_OF_INSTS && "inst_name: unreachable");
+    return inst_names[p_type];
+}
+
+// Mnemonics are dispatched on their length. Every case expands the whole
+// table, and the compiler drops the names of other lengths, which leaves a
+// few integer compares against the same loaded bytes.
+#define VVM_MNEMONIC_MAX 12
+
+#define VVM_INST_NAME_FITS(p_id, p_mnemonic, p_operand, p_pops, p_pushes, ...) \
+    static_assert(sizeof(p_mnemonic) - 1 <= VVM_MNEMONIC_MAX, "Mnemonics Are Expected To Fit In VVM_MNEMONIC_MAX");
+VVM_INSTRUCTIONS(VVM_INST_NAME_FITS)
+#undef VVM_INST_NAME_FITS
+
+#define VVM_INST_FROM_NAME(p_id, p_mnemonic, p_operand, p_pops, p_pushes, ...) \
+    if (sizeof(p_mnemonic) - 1 == length && memcmp(p_name.data, p_mnemonic, sizeof(p_mnemonic) - 1) == 0) \
+        return p_id;
+#define VVM_INST_FROM_NAME_OF_LENGTH(p_length)                                  \
+    case p_length:                                                              \
+    {                                                                           \
+        const size_t length = p_length;                                         \
+        VVM_INSTRUCTIONS(VVM_INST_FROM_NAME)                                    \
+        break;                                                                  \
+    }
+
+inst_type inst_from_name(string_view_t p_name)
+{
+    // Returns NUMBER_OF_INSTS if there is no instruction by that name.
+    switch (p_name.count)
+    {
+    VVM_INST_FROM_NAME_OF_LENGTH(1)
+    VVM_INST_FROM_NAME_OF_LENGTH(2)
+    VVM_INST_FROM_NAME_OF_LENGTH(3)
+    VVM_INST_FROM_NAME_OF_LENGTH(4)
+    VVM_INST_FROM_NAME_OF_LENGTH(5)
+    VVM_INST_FROM_NAME_OF_LENGTH(6)
+    VVM_INST_FROM_NAME_OF_LENGTH(7)
+    VVM_INST_FROM_NAME_OF_LENGTH(8)
+    VVM_INST_FROM_NAME_OF_LENGTH(9)
+    VVM_INST_FROM_NAME_OF_LENGTH(10)
+    VVM_INST_FROM_NAME_OF_LENGTH(11)
+    VVM_INST_FROM_NAME_OF_LENGTH(12)
+    default:
+        break;
+    }
+
+    return NUMBER_OF_INSTS;
+}
+
+#undef VVM_INST_FROM_NAME_OF_LENGTH
+#undef VVM_INST_FROM_NAME
+
+operand_type inst_operand_type(inst_type p_type)
+{
+    assert((unsigned)p_type < NUMBER_OF_INSTS && "inst_operand_type: unreachable");
+    return (operand_type)inst_operand_types[p_type];
+}
+
+int inst_has_operand(inst_type p_type)
+{
+    return inst_operand_type(p_type) != OPERAND_NONE;
+}
+
+int inst_is_jump(inst_type p_type)
+{
+    return (unsigned)p_type < NUMBER_OF_INSTS && inst_operand_types[p_type] == OPERAND_ADDR;
+}
+
+int inst_is_vector(inst_type p_type)
+{
+    return (unsigned)p_type < NUMBER_OF_INSTS && inst_operand_types[p_type] == OPERAND_LANES;
 }
 
 const char* inst_type_as_cstr(inst_type p_type)
 {
-    switch (p_type)
+    assert((unsigned)p_type < NUMBER_OF_INSTS && "inst_type_as_cstr: Unreachable (How Did You Get Here)");
+    return inst_ids[p_type];
+}
+
+void vasm_init(vasm_t* p_vasm, arena_t* p_arena)
+{
+    memset(p_vasm, 0, sizeof(*p_vasm));
+    p_vasm->arena = p_arena;
+    p_vasm->diagnostics = stderr;
+}
+
+static uint64_t vasm_hash_name(string_view_t p_name)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < p_name.count; ++i)
     {
-        case INST_NOP:
-            return "INST_NOP";
-        case INST_PUSH:
-            return "INST_PUSH";
-        case INST_DUP_REL:
-            return "INST_DUP_REL";
-        case INST_SWAP:
-            return "INST_SWAP";
-        case INST_ADDI:
-            return "INST_ADDI";
-        case INST_SUBI:
-            return "INST_SUBI";
-        case INST_MULI:
-            return "INST_MULI";
-        case INST_DIVI:
-            return "INST_DIVI";
-        case INST_ADDF:
-            return "INST_ADDF";
-        case INST_SUBF:
-            return "INST_SUBF";
-        case INST_MULF:
-            return "INST_MULF";
-        case INST_DIVF:
-            return "INST_DIVF";
-        case INST_JMP:
-            return "INST_JMP";
-        case INST_JMP_NZ:
-            return "INST_JMP_NZ";
-        case INST_EQ:
-            return "INST_EQ";
-        case INST_NOT:
-            return "INST_NOT";
-        case INST_GEQ:
-            return "INST_GEQ";
-        case INST_HALT:
-            return "INST_HALT";
-        case INST_PRINT_DEBUG:
-            return "INST_PRINT_DEBUG";
-        case NUMBER_OF_INSTS:
-        default:
-            assert(0 && "inst_type_as_cstr: Unreachable (How Did You Get Here)");
+        hash ^= (uint8_t)p_name.data[i];
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+// Returns the slot holding p_name, or the free slot where it would go.
+static size_t vasm_label_slot(const vasm_t* p_vasm, string_view_t p_name, uint64_t p_hash)
+{
+    const size_t mask = p_vasm->label_slots_capacity - 1;
+    size_t slot = p_hash & mask;
+
+    while (p_vasm->label_slots[slot] != 0)
+    {
+        const label_t* label = &p_vasm->labels[p_vasm->label_slots[slot] - 1];
+        if (label->hash == p_hash && sv_equal(label->name, p_name))
+            break;
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+int vasm_lookup_label(const vasm_t* p_vasm, string_view_t p_name, inst_addr_t* p_addr)
+{
+    if (p_vasm->label_slots_capacity == 0)
+        return 0;
+
+    const size_t slot = vasm_label_slot(p_vasm, p_name, vasm_hash_name(p_name));
+    if (p_vasm->label_slots[slot] == 0)
+        return 0;
+
+    *p_addr = p_vasm->labels[p_vasm->label_slots[slot] - 1].addr;
+    return 1;
+}
+
+error vasm_find_label_addr(vasm_t* p_vasm, string_view_t p_name, inst_addr_t* p_addr)
+{
+    if (vasm_lookup_label(p_vasm, p_name, p_addr))
+        return ERR_OK;
+
+    vvm_diagnose(p_vasm->diagnostics, "[ERROR]: label `%.*s` does not exist\n", (int)p_name.count, p_name.data);
+    return ERR_INVALID_SOURCE;
+}
+
+error vasm_push_label(vasm_t* p_vasm, string_view_t p_name, inst_addr_t p_addr)
+{
+    // The index is kept at most half full, and rebuilt at twice the size
+    // when it would fill up further.
+    if (2 * (p_vasm->labels_size + 1) > p_vasm->label_slots_capacity)
+    {
+        const size_t capacity = p_vasm->label_slots_capacity > 0 ? 2 * p_vasm->label_slots_capacity : 128;
+        uint32_t* slots = arena_alloc(p_vasm->arena, sizeof(p_vasm->label_slots[0]) * capacity);
+        if (slots == NULL)
+        {
+            vvm_diagnose(p_vasm->diagnostics, "[ERROR]: Could Not Allocate Memory For Labels\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        p_vasm->label_slots = slots;
+        p_vasm->label_slots_capacity = capacity;
+        memset(p_vasm->label_slots, 0, sizeof(p_vasm->label_slots[0]) * capacity);
+
+        for (size_t i = 0; i < p_vasm->labels_size; ++i)
+        {
+            const size_t slot = vasm_label_slot(p_vasm, p_vasm->labels[i].name, p_vasm->labels[i].hash);
+            p_vasm->label_slots[slot] = (uint32_t)(i + 1);
+        }
+    }
+
+    const uint64_t hash = vasm_hash_name(p_name);
+    const size_t slot = vasm_label_slot(p_vasm, p_name, hash);
+    if (p_vasm->label_slots[slot] != 0)
+    {
+        const label_t* label = &p_vasm->labels[p_vasm->label_slots[slot] - 1];
+        vvm_diagnose(p_vasm->diagnostics, "[ERROR]: Label `%.*s` At Address %lu Is Already Defined At Address %lu\n",
+            (int)p_name.count, p_name.data, p_addr, label->addr);
+        return ERR_INVALID_SOURCE;
+    }
+
+    if (p_vasm->labels_size >= p_vasm->labels_capacity)
+    {
+        const size_t capacity = p_vasm->labels_capacity > 0 ? 2 * p_vasm->labels_capacity : 64;
+        label_t* labels = arena_grow(p_vasm->arena, p_vasm->labels,
+            sizeof(p_vasm->labels[0]) * p_vasm->labels_capacity, sizeof(p_vasm->labels[0]) * capacity);
+        if (labels == NULL)
+        {
+            vvm_diagnose(p_vasm->diagnostics, "[ERROR]: Could Not Allocate Memory For Labels\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        p_vasm->labels = labels;
+        p_vasm->labels_capacity = capacity;
+    }
+
+    assert(p_vasm->labels_size < UINT32_MAX);
+    p_vasm->label_slots[slot] = (uint32_t)(p_vasm->labels_size + 1);
+    p_vasm->labels[p_vasm->labels_size++] = (label_t){
+        .name = p_name,
+        .addr = p_addr,
+        .hash = hash,
+    };
+    return ERR_OK;
+}
+
+error vasm_resolve_label(vasm_t* p_vasm, inst_addr_t p_addr, string_view_t p_name, inst_addr_t* p_target)
+{
+    // Labels that are already defined resolve right away, the operand of the
+    // instruction at p_addr is patched once a later label is defined.
+    *p_target = 0;
+    if (vasm_lookup_label(p_vasm, p_name, p_target))
+        return ERR_OK;
+
+    return vasm_push_deferred_operand(p_vasm, p_addr, p_name);
+}
+
+error vasm_push_deferred_operand(vasm_t* p_vasm, inst_addr_t p_addr, string_view_t p_name)
+{
+    if (p_vasm->deferred_operands_size >= p_vasm->deferred_operands_capacity)
+    {
+        const size_t capacity = p_vasm->deferred_operands_capacity > 0 ? 2 * p_vasm->deferred_operands_capacity : 64;
+        deferred_operand_t* deferred_operands = arena_grow(p_vasm->arena, p_vasm->deferred_operands,
+            sizeof(p_vasm->deferred_operands[0]) * p_vasm->deferred_operands_capacity,
+            sizeof(p_vasm->deferred_operands[0]) * capacity);
+        if (deferred_operands == NULL)
+        {
+            vvm_diagnose(p_vasm->diagnostics, "[ERROR]: Could Not Allocate Memory For Labels\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        p_vasm->deferred_operands = deferred_operands;
+        p_vasm->deferred_operands_capacity = capacity;
+    }
+
+    p_vasm->deferred_operands[p_vasm->deferred_operands_size++] = (deferred_operand_t){
+        .addr = p_addr,
+        .label = p_name,
+    };
+    return ERR_OK;
+}
+
+error vm_init(vvm_t* p_vm, arena_t* p_arena, uint64_t p_stack_capacity)
+{
+    memset(p_vm, 0, sizeof(*p_vm));
+    p_vm->arena = p_arena;
+    p_vm->output = stdout;
+    p_vm->diagnostics = stderr;
+    p_vm->channel.fd = 1;
+    p_vm->vector = vm_vector_kernels(NULL);
+
+    // Nothing is described here, the caller has yet to pick the stream.
+    if (p_stack_capacity > SIZE_MAX / sizeof(p_vm->stack[0]))
+        return ERR_OUT_OF_MEMORY;
+    p_vm->stack = arena_alloc(p_arena, sizeof(p_vm->stack[0]) * p_stack_capacity);
+    p_vm->channel.buffer = arena_alloc(p_arena, VVM_CHANNEL_CAPACITY);
+    if (p_vm->stack == NULL || p_vm->channel.buffer == NULL)
+        return ERR_OUT_OF_MEMORY;
+
+    p_vm->stack_capacity = p_stack_capacity;
+    return ERR_OK;
+}
+
+// Gives the machine p_size words of zeroed memory in place of what it had.
+// Pages are only backed once they are touched, so a large memory costs
+// nothing until it is used. Huge pages come from the reserved pool when there
+// is one, and are asked of the kernel as transparent huge pages otherwise.
+error vm_map_memory(vvm_t* p_vm, uint64_t p_size, int p_huge_pages)
+{
+    vm_unmap_memory(p_vm);
+    if (p_size == 0)
+        return ERR_OK;
+
+    if (p_size > SIZE_MAX / sizeof(word_t))
+    {
+        vvm_diagnose(p_vm->diagnostics, "[ERROR]: Memory Of %lu Words Is Too Large\n", p_size);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+#ifdef VVM_MMAP
+    size_t size = p_size * sizeof(word_t);
+    void* memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (p_huge_pages && size <= SIZE_MAX - VVM_HUGE_PAGE_SIZE)
+    {
+        const size_t huge_size = (size + VVM_HUGE_PAGE_SIZE - 1) / VVM_HUGE_PAGE_SIZE * VVM_HUGE_PAGE_SIZE;
+        memory = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED)
+            size = huge_size;
+    }
+#endif
+    if (memory == MAP_FAILED)
+    {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            vvm_diagnose(p_vm->diagnostics, "[ERROR]: Could Not Map Memory Of %lu Words: %s\n", p_size, strerror(errno));
+            return ERR_OUT_OF_MEMORY;
+        }
+#ifdef MADV_HUGEPAGE
+        if (p_huge_pages)
+            madvise(memory, size, MADV_HUGEPAGE);
+#endif
+    }
+    p_vm->memory_mapping_size = size;
+#else
+    (void)p_huge_pages;
+    void* memory = calloc(p_size, sizeof(word_t));
+    if (memory == NULL)
+    {
+        vvm_diagnose(p_vm->diagnostics, "[ERROR]: Could Not Allocate Memory Of %lu Words\n", p_size);
+        return ERR_OUT_OF_MEMORY;
+    }
+#endif
+
+    p_vm->memory = memory;
+    p_vm->memory_size = p_size;
+    return ERR_OK;
+}
+
+void vm_unmap_memory(vvm_t* p_vm)
+{
+    if (p_vm->memory != NULL)
+    {
+#ifdef VVM_MMAP
+        munmap(p_vm->memory, p_vm->memory_mapping_size);
+#else
+        free(p_vm->memory);
+#endif
+    }
+    p_vm->memory = NULL;
+    p_vm->memory_size = 0;
+    p_vm->memory_mapping_size = 0;
+}
+
+// Empties the channel buffer into the sink or the file descriptor. Failed
+// writes are left for vm_flush_channel to report.
+static void vm_channel_drain(vvm_channel_t* p_channel)
+{
+    if (p_channel->sink != NULL)
+    {
+        if (p_channel->size > 0)
+            p_channel->sink(p_channel->user, p_channel->buffer, p_channel->size);
+        p_channel->size = 0;
+        return;
+    }
+
+#if defined(__unix__)
+    // What print_debug left in stdout goes first.
+    if (p_channel->fd == STDOUT_FILENO)
+        fflush(stdout);
+
+    size_t written = 0;
+    while (written < p_channel->size && p_channel->failed == 0)
+    {
+        const ssize_t count = write(p_channel->fd, p_channel->buffer + written, p_channel->size - written);
+        if (count >= 0)
+            written += count;
+        else if (errno != EINTR)
+            p_channel->failed = errno;
+    }
+#else
+    if (p_channel->failed == 0 && fwrite(p_channel->buffer, 1, p_channel->size, stdout) != p_channel->size)
+        p_channel->failed = errno != 0 ? errno : EIO;
+#endif
+    p_channel->size = 0;
+}
+
+static void vm_channel_word(vvm_channel_t* p_channel, word_t p_word)
+{
+    if (VVM_CHANNEL_CAPACITY - p_channel->size < sizeof(p_word))
+        vm_channel_drain(p_channel);
+
+    memcpy(p_channel->buffer + p_channel->size, &p_word, sizeof(p_word));
+    p_channel->size += sizeof(p_word);
+}
+
+static void vm_channel_decimal(vvm_channel_t* p_channel, int64_t p_value)
+{
+    if (VVM_CHANNEL_CAPACITY - p_channel->size < VVM_CHANNEL_RECORD_MAX)
+        vm_channel_drain(p_channel);
+
+    // Digits are produced from the right.
+    char record[VVM_CHANNEL_RECORD_MAX];
+    size_t start = sizeof(record);
+    uint64_t magnitude = p_value < 0 ? -(uint64_t)p_value : (uint64_t)p_value;
+
+    record[--start] = '\n';
+    do {
+        record[--start] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (p_value < 0)
+        record[--start] = '-';
+
+    memcpy(p_channel->buffer + p_channel->size, record + start, sizeof(record) - start);
+    p_channel->size += sizeof(record) - start;
+}
+
+#define VVM_VECTOR_SCALAR_BINARY(p_name, p_field, p_op)                         \
+    static void p_name(word_t* p_a, const word_t* p_b, uint64_t p_lanes)       \
+    {                                                                           \
+        for (uint64_t i = 0; i < p_lanes; ++i)                                  \
+            p_a[i].p_field p_op p_b[i].p_field;                                 \
+    }
+
+VVM_VECTOR_SCALAR_BINARY(vector_addf_scalar, as_f64, +=)
+VVM_VECTOR_SCALAR_BINARY(vector_subf_scalar, as_f64, -=)
+VVM_VECTOR_SCALAR_BINARY(vector_mulf_scalar, as_f64, *=)
+VVM_VECTOR_SCALAR_BINARY(vector_divf_scalar, as_f64, /=)
+VVM_VECTOR_SCALAR_BINARY(vector_addi_scalar, as_u64, +=)
+VVM_VECTOR_SCALAR_BINARY(vector_subi_scalar, as_u64, -=)
+VVM_VECTOR_SCALAR_BINARY(vector_muli_scalar, as_u64, *=)
+VVM_VECTOR_SCALAR_BINARY(vector_divi_scalar, as_u64, /=)
+#undef VVM_VECTOR_SCALAR_BINARY
+
+static double vector_sumf_scalar(const word_t* p_lanes, uint64_t p_count)
+{
+    double sums[8];
+    for (uint64_t i = 0; i < p_count; ++i)
+        sums[i] = p_lanes[i].as_f64;
+
+    for (uint64_t half = p_count / 2; half > 0; half /= 2)
+        for (uint64_t i = 0; i < half; ++i)
+            sums[i] += sums[i + half];
+
+    return sums[0];
+}
+
+static uint64_t vector_sumi_scalar(const word_t* p_lanes, uint64_t p_count)
+{
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < p_count; ++i)
+        sum += p_lanes[i].as_u64;
+    return sum;
+}
+
+static void vector_bcast_scalar(word_t* p_lanes, uint64_t p_count)
+{
+    for (uint64_t i = 1; i < p_count; ++i)
+        p_lanes[i] = p_lanes[0];
+}
+
+static const vector_kernels_t vector_kernels_scalar = {
+    .name = "scalar",
+    .binary = {
+        vector_addf_scalar, vector_subf_scalar, vector_mulf_scalar, vector_divf_scalar,
+        vector_addi_scalar, vector_subi_scalar, vector_muli_scalar, vector_divi_scalar,
+    },
+    .sumf = vector_sumf_scalar,
+    .sumi = vector_sumi_scalar,
+    .bcast = vector_bcast_scalar,
+};
+
+#ifdef VVM_SIMD
+// Neither SSE2 nor AVX2 multiply or divide 64 bit integers, so vmuli and
+// vdivi stay scalar.
+#define VVM_VECTOR_SSE2_F64(p_name, p_op)                                       \
+    static void p_name(word_t* p_a, const word_t* p_b, uint64_t p_lanes)       \
+    {                                                                           \
+        for (uint64_t i = 0; i < p_lanes; i += 2)                               \
+            _mm_storeu_pd(&p_a[i].as_f64, p_op(_mm_loadu_pd(&p_a[i].as_f64), _mm_loadu_pd(&p_b[i].as_f64))); \
+    }
+
+#define VVM_VECTOR_SSE2_I64(p_name, p_op)                                       \
+    static void p_name(word_t* p_a, const word_t* p_b, uint64_t p_lanes)       \
+    {                                                                           \
+        for (uint64_t i = 0; i < p_lanes; i += 2)                               \
+            _mm_storeu_si128((__m128i*)&p_a[i], p_op(_mm_loadu_si128((const __m128i*)&p_a[i]), _mm_loadu_si128((const __m128i*)&p_b[i]))); \
+    }
+
+VVM_VECTOR_SSE2_F64(vector_addf_sse2, _mm_add_pd)
+VVM_VECTOR_SSE2_F64(vector_subf_sse2, _mm_sub_pd)
+VVM_VECTOR_SSE2_F64(vector_mulf_sse2, _mm_mul_pd)
+VVM_VECTOR_SSE2_F64(vector_divf_sse2, _mm_div_pd)
+VVM_VECTOR_SSE2_I64(vector_addi_sse2, _mm_add_epi64)
+VVM_VECTOR_SSE2_I64(vector_subi_sse2, _mm_sub_epi64)
+#undef VVM_VECTOR_SSE2_F64
+#undef VVM_VECTOR_SSE2_I64
+
+static double vector_sumf_sse2(const word_t* p_lanes, uint64_t p_count)
+{
+    __m128d sums[4];
+    for (uint64_t i = 0; i < p_count / 2; ++i)
+        sums[i] = _mm_loadu_pd(&p_lanes[2 * i].as_f64);
+
+    for (uint64_t half = p_count / 4; half > 0; half /= 2)
+        for (uint64_t i = 0; i < half; ++i)
+            sums[i] = _mm_add_pd(sums[i], sums[i + half]);
+
+    return _mm_cvtsd_f64(_mm_add_sd(sums[0], _mm_unpackhi_pd(sums[0], sums[0])));
+}
+
+static uint64_t vector_sumi_sse2(const word_t* p_lanes, uint64_t p_count)
+{
+    __m128i sum = _mm_loadu_si128((const __m128i*)p_lanes);
+    for (uint64_t i = 2; i < p_count; i += 2)
+        sum = _mm_add_epi64(sum, _mm_loadu_si128((const __m128i*)&p_lanes[i]));
+
+    return (uint64_t)_mm_cvtsi128_si64(_mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum)));
+}
+
+static void vector_bcast_sse2(word_t* p_lanes, uint64_t p_count)
+{
+    const __m128i lanes = _mm_set1_epi64x(p_lanes[0].as_i64);
+    for (uint64_t i = 0; i < p_count; i += 2)
+        _mm_storeu_si128((__m128i*)&p_lanes[i], lanes);
+}
+
+static const vector_kernels_t vector_kernels_sse2 = {
+    .name = "sse2",
+    .binary = {
+        vector_addf_sse2, vector_subf_sse2, vector_mulf_sse2, vector_divf_sse2,
+        vector_addi_sse2, vector_subi_sse2, vector_muli_scalar, vector_divi_scalar,
+    },
+    .sumf = vector_sumf_sse2,
+    .sumi = vector_sumi_sse2,
+    .bcast = vector_bcast_sse2,
+};
+
+// Two lanes do not fill an AVX2 register, so they take the SSE2 kernels.
+#define VVM_VECTOR_AVX2_F64(p_name, p_op, p_narrow)                             \
+    __attribute__((target("avx2")))                                             \
+    static void p_name(word_t* p_a, const word_t* p_b, uint64_t p_lanes)       \
+    {                                                                           \
+        if (p_lanes == 2)                                                       \
+        {                                                                       \
+            p_narrow(p_a, p_b, p_lanes);                                        \
+            return;                                                             \
+        }                                                                       \
+        for (uint64_t i = 0; i < p_lanes; i += 4)                               \
+            _mm256_storeu_pd(&p_a[i].as_f64, p_op(_mm256_loadu_pd(&p_a[i].as_f64), _mm256_loadu_pd(&p_b[i].as_f64))); \
+    }
+
+#define VVM_VECTOR_AVX2_I64(p_name, p_op, p_narrow)                             \
+    __attribute__((target("avx2")))                                             \
+    static void p_name(word_t* p_a, const word_t* p_b, uint64_t p_lanes)       \
+    {                                                                           \
+        if (p_lanes == 2)                                                       \
+        {                                                                       \
+            p_narrow(p_a, p_b, p_lanes);                                        \
+            return;                                                             \
+        }                                                                       \
+        for (uint64_t i = 0; i < p_lanes; i += 4)                               \
+            _mm256_storeu_si256((__m256i*)&p_a[i], p_op(_mm256_loadu_si256((const __m256i*)&p_a[i]), _mm256_loadu_si256((const __m256i*)&p_b[i]))); \
+    }
+
+VVM_VECTOR_AVX2_F64(vector_addf_avx2, _mm256_add_pd, vector_addf_sse2)
+VVM_VECTOR_AVX2_F64(vector_subf_avx2, _mm256_sub_pd, vector_subf_sse2)
+VVM_VECTOR_AVX2_F64(vector_mulf_avx2, _mm256_mul_pd, vector_mulf_sse2)
+VVM_VECTOR_AVX2_F64(vector_divf_avx2, _mm256_div_pd, vector_divf_sse2)
+VVM_VECTOR_AVX2_I64(vector_addi_avx2, _mm256_add_epi64, vector_addi_sse2)
+VVM_VECTOR_AVX2_I64(vector_subi_avx2, _mm256_sub_epi64, vector_subi_sse2)
+#undef VVM_VECTOR_AVX2_F64
+#undef VVM_VECTOR_AVX2_I64
+
+__attribute__((target("avx2")))
+static double vector_sumf_avx2(const word_t* p_lanes, uint64_t p_count)
+{
+    if (p_count == 2)
+        return vector_sumf_sse2(p_lanes, p_count);
+
+    __m256d sum = _mm256_loadu_pd(&p_lanes[0].as_f64);
+    if (p_count == 8)
+        sum = _mm256_add_pd(sum, _mm256_loadu_pd(&p_lanes[4].as_f64));
+
+    const __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+}
+
+__attribute__((target("avx2")))
+static uint64_t vector_sumi_avx2(const word_t* p_lanes, uint64_t p_count)
+{
+    if (p_count == 2)
+        return vector_sumi_sse2(p_lanes, p_count);
+
+    __m256i sum = _mm256_loadu_si256((const __m256i*)p_lanes);
+    if (p_count == 8)
+        sum = _mm256_add_epi64(sum, _mm256_loadu_si256((const __m256i*)&p_lanes[4]));
+
+    const __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    return (uint64_t)_mm_cvtsi128_si64(_mm_add_epi64(half, _mm_unpackhi_epi64(half, half)));
+}
+
+__attribute__((target("avx2")))
+static void vector_bcast_avx2(word_t* p_lanes, uint64_t p_count)
+{
+    if (p_count == 2)
+    {
+        vector_bcast_sse2(p_lanes, p_count);
+        return;
+    }
+
+    const __m256i lanes = _mm256_set1_epi64x(p_lanes[0].as_i64);
+    for (uint64_t i = 0; i < p_count; i += 4)
+        _mm256_storeu_si256((__m256i*)&p_lanes[i], lanes);
+}
+
+static const vector_kernels_t vector_kernels_avx2 = {
+    .name = "avx2",
+    .binary = {
+        vector_addf_avx2, vector_subf_avx2, vector_mulf_avx2, vector_divf_avx2,
+        vector_addi_avx2, vector_subi_avx2, vector_muli_scalar, vector_divi_scalar,
+    },
+    .sumf = vector_sumf_avx2,
+    .sumi = vector_sumi_avx2,
+    .bcast = vector_bcast_avx2,
+};
+#endif
+
+const vector_kernels_t* vm_vector_kernels(const char* p_name)
+{
+    // The widest kernels the CPU supports when p_name is NULL, or the ones by
+    // that name, or NULL if they are unknown or not supported.
+    const vector_kernels_t* supported[3];
+    size_t count = 0;
+
+#ifdef VVM_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        supported[count++] = &vector_kernels_avx2;
+    supported[count++] = &vector_kernels_sse2;
+#endif
+    supported[count++] = &vector_kernels_scalar;
+
+    if (p_name == NULL)
+        return supported[0];
+
+    for (size_t i = 0; i < count; ++i)
+        if (strcmp(supported[i]->name, p_name) == 0)
+            return supported[i];
+
+    return NULL;
+}
+
+static int vector_lanes_valid(uint64_t p_lanes)
+{
+    return p_lanes == 2 || p_lanes == 4 || p_lanes == 8;
+}
+
+// Runs a vector instruction over the stack of an engine. The stack is left
+// alone when it fails.
+static error vm_execute_vector(const vector_kernels_t* p_kernels, inst_type p_type, uint64_t p_lanes,
+                               word_t* p_stack, uint64_t* p_stack_size, uint64_t p_stack_capacity)
+{
+    const uint64_t sp = *p_stack_size;
+
+    if (!vector_lanes_valid(p_lanes))
+        return ERR_ILLEGAL_OPERAND;
+
+    if (p_type == INST_VBCAST)
+    {
+        if (sp < 1)
+            return ERR_STACK_UNDERFLOW;
+        if (p_stack_capacity - sp < p_lanes - 1)
+            return ERR_STACK_OVERFLOW;
+        p_kernels->bcast(&p_stack[sp - 1], p_lanes);
+        *p_stack_size = sp + p_lanes - 1;
+        return ERR_OK;
+    }
+
+    if (p_type == INST_VSUMF || p_type == INST_VSUMI)
+    {
+        if (sp < p_lanes)
+            return ERR_STACK_UNDERFLOW;
+        word_t* lanes = &p_stack[sp - p_lanes];
+        if (p_type == INST_VSUMF)
+            lanes[0].as_f64 = p_kernels->sumf(lanes, p_lanes);
+        else
+            lanes[0].as_u64 = p_kernels->sumi(lanes, p_lanes);
+        *p_stack_size = sp - p_lanes + 1;
+        return ERR_OK;
+    }
+
+    if (sp < 2 * p_lanes)
+        return ERR_STACK_UNDERFLOW;
+
+    word_t* a = &p_stack[sp - 2 * p_lanes];
+    const word_t* b = &p_stack[sp - p_lanes];
+    if (p_type == INST_VDIVI)
+        for (uint64_t i = 0; i < p_lanes; ++i)
+            if (b[i].as_u64 == 0)
+                return ERR_DIV_BY_ZERO;
+
+    p_kernels->binary[p_type - INST_VADDF](a, b, p_lanes);
+    *p_stack_size = sp - p_lanes;
+    return ERR_OK;
+}
+
+// Whether f2i can convert p_value. NaN, the infinities and anything whose
+// integer part does not fit into 64 bits are illegal operands.
+static inline int vm_float_fits_int(double p_value)
+{
+    return p_value >= -0x1p63 && p_value < 0x1p63;
+}
+
+// What memcpy does, or 0 when one of the ranges of p_count words does not
+// lie within the memory. Ranges are checked without overflowing, and empty
+// ones are always in bounds.
+static inline int vm_memory_copy(vvm_t* p_vm, uint64_t p_dst, uint64_t p_src, uint64_t p_count)
+{
+    if (p_count > p_vm->memory_size || p_dst > p_vm->memory_size - p_count || p_src > p_vm->memory_size - p_count)
+        return 0;
+    if (p_count > 0)
+        memmove(p_vm->memory + p_dst, p_vm->memory + p_src, sizeof(word_t) * p_count);
+    return 1;
+}
+
+// What memset does, or 0 when the range does not lie within the memory.
+static inline int vm_memory_fill(vvm_t* p_vm, uint64_t p_dst, word_t p_value, uint64_t p_count)
+{
+    if (p_count > p_vm->memory_size || p_dst > p_vm->memory_size - p_count)
+        return 0;
+    for (uint64_t i = 0; i < p_count; ++i)
+        p_vm->memory[p_dst + i] = p_value;
+    return 1;
+}
+
+// The entry native p_id calls, or NULL when there is none.
+static inline const native_t* vm_native(const native_table_t* p_natives, uint64_t p_id)
+{
+    return p_natives != NULL && p_id < p_natives->count ? &p_natives->entries[p_id] : NULL;
+}
+
+// Runs native p_id over the stack of an engine, making the checks its entry
+// declares. The stack size is left alone when it fails.
+static error vm_execute_native(const native_table_t* p_natives, uint64_t p_id,
+                               word_t* p_stack, uint64_t* p_stack_size, uint64_t p_stack_capacity)
+{
+    const native_t* native = vm_native(p_natives, p_id);
+    const uint64_t sp = *p_stack_size;
+
+    if (native == NULL)
+        return ERR_ILLEGAL_OPERAND;
+    if (sp < native->pops)
+        return ERR_STACK_UNDERFLOW;
+    if (p_stack_capacity - (sp - native->pops) < native->pushes)
+        return ERR_STACK_OVERFLOW;
+
+    const error err = native->fn(p_natives->user, &p_stack[sp - native->pops]);
+    if (err != ERR_OK)
+        return err;
+
+    *p_stack_size = sp - native->pops + native->pushes;
+    return ERR_OK;
+}
+
+// Building blocks of the bodies in VVM_INSTRUCTIONS. VVM_CHECK is a stack or
+// memory check, made unless the interpreter is the unchecked one.
+#define VVM_SP p_vm->stack_size
+#define VVM_TOP(p_depth) p_vm->stack[p_vm->stack_size - 1 - (p_depth)]
+#define VVM_NEXT() p_vm->inst_pointer++
+#define VVM_CHECK(p_condition, p_error) do { if (checked && (p_condition)) return (p_error); } while (0)
+// Checks of superinstructions that fail after the push they fused would have
+// succeeded, which they leave on the stack so they fail like the unfused pair.
+#define VVM_CHECK_PUSHED(p_condition, p_pushed, p_error) \
+    do { if (checked && (p_condition)) { p_vm->stack[VVM_SP++] = (p_pushed); return (p_error); } } while (0)
+
+#define VVM_BINARY(p_field, p_op)                                   \
+    VVM_CHECK(VVM_SP < 2, ERR_STACK_UNDERFLOW);                     \
+    VVM_TOP(1).p_field p_op VVM_TOP(0).p_field;                     \
+    VVM_SP--;                                                       \
+    VVM_NEXT();
+
+#define VVM_IMMEDIATE(p_field, p_op)                                \
+    VVM_CHECK(VVM_SP >= p_vm->stack_capacity, ERR_STACK_OVERFLOW);  \
+    VVM_CHECK_PUSHED(VVM_SP < 1, inst.operand, ERR_STACK_UNDERFLOW); \
+    VVM_TOP(0).p_field p_op inst.operand.p_field;                   \
+    VVM_NEXT();
+
+#define VVM_RELATIVE(p_field)                                       \
+    VVM_CHECK(VVM_SP >= p_vm->stack_capacity, ERR_STACK_OVERFLOW);  \
+    VVM_CHECK(inst.operand.as_u64 >= VVM_SP, ERR_STACK_UNDERFLOW);  \
+    VVM_TOP(0).p_field += VVM_TOP(inst.operand.as_u64).p_field;     \
+    VVM_NEXT();
+
+#define VVM_VECTOR                                                  \
+    const error err = vm_execute_vector(p_vm->vector, inst.type, inst.operand.as_u64, \
+        p_vm->stack, &p_vm->stack_size, p_vm->stack_capacity);      \
+    if (err != ERR_OK)                                              \
+        return err;                                                 \
+    VVM_NEXT();
+
+#define VVM_NATIVE                                                  \
+    const error err = vm_execute_native(p_vm->natives, inst.operand.as_u64, \
+        p_vm->stack, &p_vm->stack_size, p_vm->stack_capacity);      \
+    if (err != ERR_OK)                                              \
+        return err;                                                 \
+    VVM_NEXT();
+
+#define VVM_INST_CASE(p_id, p_name, p_operand, p_pops, p_pushes, ...) \
+        case p_id: { __VA_ARGS__ } break;
+
+error vm_execute_inst(vvm_t* p_vm)
+{
+    enum { checked = 1 };
+
+    if (p_vm->inst_pointer >= p_vm->program_size)
+        return ERR_ILLEGAL_INSTRUCTION_ACCESS;
+
+    const inst_t inst = p_vm->program[p_vm->inst_pointer];
+
+    switch (inst.type)
+    {
+        VVM_INSTRUCTIONS(VVM_INST_CASE)
+
+        case NUMBER_OF_INSTS:
+        default:
+            return ERR_ILLEGAL_INSTRUCTION;
+    }
+
+    return ERR_OK;
+}
+
+#ifdef VVM_UNCHECKED
+// vm_execute_inst without the stack checks, for programs whose reachable
+// instructions vm_verify_program proved all safe.
+static error vm_execute_inst_unchecked(vvm_t* p_vm)
+{
+    enum { checked = 0 };
+
+    if (p_vm->inst_pointer >= p_vm->program_size)
+        return ERR_ILLEGAL_INSTRUCTION_ACCESS;
+
+    const inst_t inst = p_vm->program[p_vm->inst_pointer];
+
+    switch (inst.type)
+    {
+        VVM_INSTRUCTIONS(VVM_INST_CASE)
+
+        case NUMBER_OF_INSTS:
+        default:
+            return ERR_ILLEGAL_INSTRUCTION;
+    }
+
+    return ERR_OK;
+}
+#endif
+
+#undef VVM_INST_CASE
+#undef VVM_VECTOR
+#undef VVM_NATIVE
+#undef VVM_RELATIVE
+#undef VVM_IMMEDIATE
+#undef VVM_BINARY
+#undef VVM_CHECK
+#undef VVM_CHECK_PUSHED
+#undef VVM_NEXT
+#undef VVM_TOP
+#undef VVM_SP
+
+error vm_execute_program(vvm_t* p_vm, int p_limit)
+{
+    // If p_limit is positive, it will execute a finite number of instructions,
+    // While if p_limit is negative, it will execute instructions without limit.
+    while (p_limit != 0 && !p_vm->halt)
+    {
+        error err = vm_execute_inst(p_vm);
+        if (err != ERR_OK)
+            return err;
+
+        if (p_limit > 0)
+            --p_limit;
+    }
+
+    return ERR_OK;
+}
+
+#ifdef VVM_UNCHECKED
+error vm_execute_program_unchecked(vvm_t* p_vm, int p_limit)
+{
+    // Same as vm_execute_program, without any stack checks. Only for programs
+    // where vm_verify_program, run from the current state, proved every
+    // reachable instruction safe.
+    while (p_limit != 0 && !p_vm->halt)
+    {
+        error err = vm_execute_inst_unchecked(p_vm);
+        if (err != ERR_OK)
+            return err;
+
+        if (p_limit > 0)
+            --p_limit;
+    }
+
+    return ERR_OK;
+}
+#endif
+
+// Handler ids of the threaded engine. The first NUMBER_OF_INSTS ids are the
+// instructions themselves, the rest are synthesized during translation.
+enum {
+    VVM_THREADED_JMP_FAR = NUMBER_OF_INSTS,
+    VVM_THREADED_JNZ_FAR,
+    VVM_THREADED_ACCESS,
+    VVM_THREADED_ILLEGAL,
+    VVM_THREADED_SLOW,
+    VVM_THREADED_TRACE_JMP,
+    VVM_THREADED_TRACE_JNZ,
+    VVM_THREADED_TRACE_DEC_JNZ,
+
+    // Entry points past the stack checks, used for verified instructions.
+    VVM_THREADED_FAST,
+    VVM_THREADED_HANDLERS = VVM_THREADED_FAST + NUMBER_OF_INSTS,
+};
+
+#ifdef VVM_COMPUTED_GOTO
+typedef const void* threaded_handler_t;
+#else
+typedef uint32_t threaded_handler_t;
+#endif
+
+typedef struct {
+    threaded_handler_t handler;
+    word_t operand;
+} threaded_inst_t;
+
+#ifdef VVM_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define VVM_HANDLER(id) vvm_handler_##id
+#define VVM_FAST_HANDLER(id) vvm_fast_##id
+#define VVM_HANDLER_REF(id) [id] = &&vvm_handler_##id
+#define VVM_FAST_HANDLER_REF(id) [VVM_THREADED_FAST + id] = &&vvm_fast_##id
+#define VVM_DISPATCH() goto *code[ip].handler
+#else
+#define VVM_HANDLER(id) case id
+// Jumps over the case label so the checked entry never falls through.
+#define VVM_FAST_HANDLER(id) goto vvm_fast_##id; case VVM_THREADED_FAST + id: vvm_fast_##id
+#define VVM_DISPATCH() goto dispatch
+#endif
+
+// Appends the state in front of the instruction at ip to the trace.
+#define VVM_TRACE_RECORD(p_kind, p_opcode)                                                      \
+    do {                                                                                        \
+        trace_entry_t* entry = &trace_entries[trace_head & trace_mask];                         \
+        entry->inst_pointer = ip;                                                               \
+        entry->stack_size = sp < UINT32_MAX ? (uint32_t)sp : UINT32_MAX;                        \
+        entry->opcode = (p_opcode);                                                             \
+        entry->kind = (p_kind);                                                                 \
+        atomic_signal_fence(memory_order_release);                                              \
+        atomic_store_explicit(&p_trace->head, ++trace_head, memory_order_relaxed);              \
+    } while (0)
+#define VVM_TRACE_OPCODE() (ip < size ? (uint8_t)p_vm->program[ip].type : VVM_TRACE_NO_OPCODE)
+
+// Charges one instruction against the budget and jumps to the next handler.
+#define VVM_NEXT()                \
+    do {                          \
+        if (budget-- == 0)        \
+            goto done;            \
+        VVM_DISPATCH();           \
+    } while (0)
+
+#define VVM_FAIL(p_error)         \
+    do {                          \
+        err = (p_error);          \
+        goto done;                \
+    } while (0)
+
+// Fails a superinstruction with the push it fused on the stack, see
+// VVM_CHECK_PUSHED.
+#define VVM_FAIL_PUSHED(p_pushed, p_error) \
+    do {                          \
+        stack[sp++] = (p_pushed); \
+        VVM_FAIL(p_error);        \
+    } while (0)
+
+error vm_execute_program_threaded(vvm_t* p_vm, int p_limit)
+{
+    return vm_execute_threaded(p_vm, NULL, p_limit);
+}
+
+error vm_execute_threaded(vvm_t* p_vm, trace_t* p_trace, int p_limit)
+{
+    // Same contract as vm_execute_program, but the program is translated into
+    // an array of handler addresses up front so every instruction costs one
+    // indirect jump instead of a call, a bounds check and a switch.
+    //
+    // With a trace, jumps go to handlers that record them when they are
+    // taken, so runs without one are not slowed down at all, and straight
+    // line code is not slowed down by one.
+    if (p_limit == 0 || p_vm->halt)
+        return ERR_OK;
+
+#ifdef VVM_COMPUTED_GOTO
+    // Every row of VVM_INSTRUCTIONS needs both handlers below, or this does
+    // not build.
+#define VVM_INST_HANDLER_REFS(p_id, p_name, p_operand, p_pops, p_pushes, ...) \
+        VVM_HANDLER_REF(p_id), VVM_FAST_HANDLER_REF(p_id),
+    static const void* const handlers[VVM_THREADED_HANDLERS] = {
+        VVM_INSTRUCTIONS(VVM_INST_HANDLER_REFS)
+        VVM_HANDLER_REF(VVM_THREADED_JMP_FAR),
+        VVM_HANDLER_REF(VVM_THREADED_JNZ_FAR),
+        VVM_HANDLER_REF(VVM_THREADED_ACCESS),
+        VVM_HANDLER_REF(VVM_THREADED_ILLEGAL),
+        VVM_HANDLER_REF(VVM_THREADED_SLOW),
+#ifdef VVM_TRACE
+        VVM_HANDLER_REF(VVM_THREADED_TRACE_JMP),
+        VVM_HANDLER_REF(VVM_THREADED_TRACE_JNZ),
+        VVM_HANDLER_REF(VVM_THREADED_TRACE_DEC_JNZ),
+#endif
+    };
+#undef VVM_INST_HANDLER_REFS
+#define VVM_HANDLER_OF(id) handlers[id]
+#else
+#define VVM_HANDLER_OF(id) (id)
+#endif
+
+    // One extra slot so that running off the end of the program lands on a
+    // handler that reports ERR_ILLEGAL_INSTRUCTION_ACCESS.
+    const arena_mark_t mark = arena_mark(p_vm->arena);
+    const uint64_t size = p_vm->program_size;
+    threaded_inst_t* code = arena_alloc(p_vm->arena, sizeof(code[0]) * (size + 1));
+    if (code == NULL)
+        return ERR_OUT_OF_MEMORY;
+
+    for (inst_addr_t i = 0; i < size; ++i)
+    {
+        const inst_t inst = p_vm->program[i];
+        uint32_t id = inst.type;
+
+        if (inst.type >= NUMBER_OF_INSTS)
+            id = VVM_THREADED_ILLEGAL;
+        else if (inst.type == INST_JMP && inst.operand.as_u64 >= size)
+            id = VVM_THREADED_JMP_FAR;
+        else if (inst.type == INST_JMP_NZ && inst.operand.as_u64 >= size)
+            id = VVM_THREADED_JNZ_FAR;
+        else if (inst_is_jump(inst.type) && inst.operand.as_u64 >= size)
+            id = VVM_THREADED_SLOW;
+#ifdef VVM_TRACE
+        else if (p_trace != NULL && inst.type == INST_JMP)
+            id = VVM_THREADED_TRACE_JMP;
+        else if (p_trace != NULL && inst.type == INST_JMP_NZ)
+            id = VVM_THREADED_TRACE_JNZ;
+        else if (p_trace != NULL && inst.type == INST_DEC_JMP_NZ)
+            id = VVM_THREADED_TRACE_DEC_JNZ;
+#endif
+        else if (p_vm->verified[i])
+            id = VVM_THREADED_FAST + inst.type;
+
+        code[i].handler = VVM_HANDLER_OF(id);
+        code[i].operand = inst.operand;
+    }
+    code[size].handler = VVM_HANDLER_OF(VVM_THREADED_ACCESS);
+    code[size].operand.as_u64 = 0;
+
+#ifdef VVM_TRACE
+    trace_entry_t* trace_entries = NULL;
+    uint64_t trace_head = 0;
+    uint64_t trace_mask = 0;
+    if (p_trace != NULL)
+    {
+        trace_entries = p_trace->entries;
+        trace_head = atomic_load_explicit(&p_trace->head, memory_order_relaxed);
+        trace_mask = p_trace->capacity - 1;
+    }
+#else
+    (void)p_trace;
+#endif
+
+#undef VVM_HANDLER_OF
+
+    word_t* stack = p_vm->stack;
+    const uint64_t capacity = p_vm->stack_capacity;
+    word_t* const memory = p_vm->memory;
+    const uint64_t memory_size = p_vm->memory_size;
+    const native_table_t* const natives = p_vm->natives;
+    const native_t* native = NULL;
+    uint64_t sp = p_vm->stack_size;
+    inst_addr_t ip = p_vm->inst_pointer;
+    uint64_t budget = p_limit < 0 ? UINT64_MAX : (uint64_t)p_limit;
+    error err = ERR_OK;
+#ifndef VVM_COMPUTED_GOTO
+    threaded_handler_t handler = 0;
+#endif
+#ifdef VVM_TRACE
+    if (p_trace != NULL)
+        VVM_TRACE_RECORD(TRACE_START, VVM_TRACE_OPCODE());
+#endif
+
+    // The instruction pointer may already be out of range on entry.
+    if (ip >= size)
+    {
+        if (budget-- == 0)
+            goto done;
+        goto access;
+    }
+
+    VVM_NEXT();
+
+#ifndef VVM_COMPUTED_GOTO
+dispatch:
+    handler = code[ip].handler;
+    switch (handler)
+    {
+#endif
+
+    VVM_HANDLER(INST_NOP):
+    VVM_FAST_HANDLER(INST_NOP):
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_PUSH):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+    VVM_FAST_HANDLER(INST_PUSH):
+        stack[sp++] = code[ip].operand;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_DUP_REL):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (code[ip].operand.as_u64 >= sp)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_DUP_REL):
+        stack[sp] = stack[sp - 1 - code[ip].operand.as_u64];
+        sp++;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_SWAP):
+        if (code[ip].operand.as_u64 >= sp)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_SWAP):
+        {
+            const uint64_t b = sp - 1 - code[ip].operand.as_u64;
+            word_t t = stack[sp - 1];
+            stack[sp - 1] = stack[b];
+            stack[b] = t;
+        }
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_ADDI):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_ADDI):
+        stack[sp - 2].as_u64 += stack[sp - 1].as_u64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_SUBI):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_SUBI):
+        stack[sp - 2].as_u64 -= stack[sp - 1].as_u64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_MULI):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_MULI):
+        stack[sp - 2].as_u64 *= stack[sp - 1].as_u64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_DIVI):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_DIVI):
+        if (stack[sp - 1].as_u64 == 0)
+            VVM_FAIL(ERR_DIV_BY_ZERO);
+        stack[sp - 2].as_u64 /= stack[sp - 1].as_u64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_ADDF):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_ADDF):
+        stack[sp - 2].as_f64 += stack[sp - 1].as_f64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_SUBF):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_SUBF):
+        stack[sp - 2].as_f64 -= stack[sp - 1].as_f64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_MULF):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_MULF):
+        stack[sp - 2].as_f64 *= stack[sp - 1].as_f64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_DIVF):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_DIVF):
+        stack[sp - 2].as_f64 /= stack[sp - 1].as_f64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_JMP):
+    VVM_FAST_HANDLER(INST_JMP):
+        ip = code[ip].operand.as_u64;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_JMP_NZ):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_JMP_NZ):
+        if (stack[--sp].as_u64)
+            ip = code[ip].operand.as_u64;
+        else
+            ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_EQ):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_EQ):
+        stack[sp - 2].as_u64 = stack[sp - 2].as_u64 == stack[sp - 1].as_u64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_NOT):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+    VVM_FAST_HANDLER(INST_NOT):
+        stack[sp - 1].as_u64 = !stack[sp - 1].as_u64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_GEQ):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+    VVM_FAST_HANDLER(INST_GEQ):
+        stack[sp - 2].as_u64 = stack[sp - 1].as_f64 >= stack[sp - 2].as_f64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_HALT):
+    VVM_FAST_HANDLER(INST_HALT):
+        p_vm->halt = 1;
+        goto done;
+
+    VVM_HANDLER(INST_PRINT_DEBUG):
+    VVM_FAST_HANDLER(INST_PRINT_DEBUG):
+        p_vm->stack_size = sp;
+        vm_dump_stack(p_vm->output, p_vm);
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_ADDI_IMM):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (sp < 1)
+            VVM_FAIL_PUSHED(code[ip].operand, ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_ADDI_IMM):
+        stack[sp - 1].as_u64 += code[ip].operand.as_u64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_SUBI_IMM):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (sp < 1)
+            VVM_FAIL_PUSHED(code[ip].operand, ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_SUBI_IMM):
+        stack[sp - 1].as_u64 -= code[ip].operand.as_u64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_MULI_IMM):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (sp < 1)
+            VVM_FAIL_PUSHED(code[ip].operand, ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_MULI_IMM):
+        stack[sp - 1].as_u64 *= code[ip].operand.as_u64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_ADDF_IMM):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (sp < 1)
+            VVM_FAIL_PUSHED(code[ip].operand, ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_ADDF_IMM):
+        stack[sp - 1].as_f64 += code[ip].operand.as_f64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_SUBF_IMM):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (sp < 1)
+            VVM_FAIL_PUSHED(code[ip].operand, ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_SUBF_IMM):
+        stack[sp - 1].as_f64 -= code[ip].operand.as_f64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_MULF_IMM):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (sp < 1)
+            VVM_FAIL_PUSHED(code[ip].operand, ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_MULF_IMM):
+        stack[sp - 1].as_f64 *= code[ip].operand.as_f64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_DIVF_IMM):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (sp < 1)
+            VVM_FAIL_PUSHED(code[ip].operand, ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_DIVF_IMM):
+        stack[sp - 1].as_f64 /= code[ip].operand.as_f64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_ADDI_REL):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (code[ip].operand.as_u64 >= sp)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_ADDI_REL):
+        stack[sp - 1].as_u64 += stack[sp - 1 - code[ip].operand.as_u64].as_u64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_ADDF_REL):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (code[ip].operand.as_u64 >= sp)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_ADDF_REL):
+        stack[sp - 1].as_f64 += stack[sp - 1 - code[ip].operand.as_u64].as_f64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_DEC_JMP_NZ):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (sp < 1)
+            VVM_FAIL_PUSHED((word_t){ .as_u64 = 1 }, ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_DEC_JMP_NZ):
+        if (--stack[sp - 1].as_u64)
+            ip = code[ip].operand.as_u64;
+        else
+            ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_OUT):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_OUT):
+        vm_channel_word(&p_vm->channel, stack[--sp]);
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_OUTI):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_OUTI):
+        vm_channel_decimal(&p_vm->channel, stack[--sp].as_i64);
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_FMA):
+        if (sp < 3)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_FMA):
+        stack[sp - 3].as_f64 = fma(stack[sp - 3].as_f64, stack[sp - 2].as_f64, stack[sp - 1].as_f64);
+        sp -= 2;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_SQRTF):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_SQRTF):
+        stack[sp - 1].as_f64 = sqrt(stack[sp - 1].as_f64);
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_I2F):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_I2F):
+        stack[sp - 1].as_f64 = (double)stack[sp - 1].as_i64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_F2I):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_F2I):
+        if (!vm_float_fits_int(stack[sp - 1].as_f64))
+            VVM_FAIL(ERR_ILLEGAL_OPERAND);
+        stack[sp - 1].as_i64 = (int64_t)stack[sp - 1].as_f64;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_NEGF):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_NEGF):
+        stack[sp - 1].as_u64 ^= UINT64_C(1) << 63;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_MINF):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_MINF):
+        if (!(stack[sp - 2].as_f64 < stack[sp - 1].as_f64))
+            stack[sp - 2] = stack[sp - 1];
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_MAXF):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_MAXF):
+        if (!(stack[sp - 2].as_f64 > stack[sp - 1].as_f64))
+            stack[sp - 2] = stack[sp - 1];
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_LTF):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_LTF):
+        stack[sp - 2].as_u64 = stack[sp - 2].as_f64 < stack[sp - 1].as_f64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_LTI):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_LTI):
+        stack[sp - 2].as_u64 = stack[sp - 2].as_i64 < stack[sp - 1].as_i64;
+        sp--;
+        ip++;
+        VVM_NEXT();
+
+    // Addresses on the stack are checked even when verified, the _imm forms
+    // are only checked until the verifier proves their address in bounds.
+    VVM_HANDLER(INST_LOAD):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_LOAD):
+        if (stack[sp - 1].as_u64 >= memory_size)
+            VVM_FAIL(ERR_ILLEGAL_MEMORY_ACCESS);
+        stack[sp - 1] = memory[stack[sp - 1].as_u64];
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_STORE):
+        if (sp < 2)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_STORE):
+        if (stack[sp - 1].as_u64 >= memory_size)
+            VVM_FAIL(ERR_ILLEGAL_MEMORY_ACCESS);
+        memory[stack[sp - 1].as_u64] = stack[sp - 2];
+        sp -= 2;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_LOAD_IMM):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (code[ip].operand.as_u64 >= memory_size)
+            VVM_FAIL_PUSHED(code[ip].operand, ERR_ILLEGAL_MEMORY_ACCESS);
+    VVM_FAST_HANDLER(INST_LOAD_IMM):
+        stack[sp++] = memory[code[ip].operand.as_u64];
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_STORE_IMM):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (sp < 1)
+            VVM_FAIL_PUSHED(code[ip].operand, ERR_STACK_UNDERFLOW);
+        if (code[ip].operand.as_u64 >= memory_size)
+            VVM_FAIL_PUSHED(code[ip].operand, ERR_ILLEGAL_MEMORY_ACCESS);
+    VVM_FAST_HANDLER(INST_STORE_IMM):
+        memory[code[ip].operand.as_u64] = stack[--sp];
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_MEMCPY):
+        if (sp < 3)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_MEMCPY):
+        if (!vm_memory_copy(p_vm, stack[sp - 3].as_u64, stack[sp - 2].as_u64, stack[sp - 1].as_u64))
+            VVM_FAIL(ERR_ILLEGAL_MEMORY_ACCESS);
+        sp -= 3;
+        ip++;
+        VVM_NEXT();
+
+    VVM_HANDLER(INST_MEMSET):
+        if (sp < 3)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+    VVM_FAST_HANDLER(INST_MEMSET):
+        if (!vm_memory_fill(p_vm, stack[sp - 3].as_u64, stack[sp - 2], stack[sp - 1].as_u64))
+            VVM_FAIL(ERR_ILLEGAL_MEMORY_ACCESS);
+        sp -= 3;
+        ip++;
+        VVM_NEXT();
+
+    // The verifier proves natives safe from the arities in the table, so the
+    // fast entry calls straight into it.
+    VVM_HANDLER(INST_NATIVE):
+        native = vm_native(natives, code[ip].operand.as_u64);
+        if (native == NULL)
+            VVM_FAIL(ERR_ILLEGAL_OPERAND);
+        if (sp < native->pops)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+        if (capacity - (sp - native->pops) < native->pushes)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+    VVM_FAST_HANDLER(INST_NATIVE):
+        native = &natives->entries[code[ip].operand.as_u64];
+        err = native->fn(natives->user, &stack[sp - native->pops]);
+        if (err != ERR_OK)
+            goto done;
+        sp = sp - native->pops + native->pushes;
+        ip++;
+        VVM_NEXT();
+
+    // Jumps whose target lies outside of the program. The jump itself
+    // succeeds, it is the next fetch that fails.
+    VVM_HANDLER(VVM_THREADED_JMP_FAR):
+        ip = code[ip].operand.as_u64;
+        if (budget-- == 0)
+            goto done;
+        goto access;
+
+    VVM_HANDLER(VVM_THREADED_JNZ_FAR):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+        if (stack[--sp].as_u64 == 0)
+        {
+            ip++;
+            VVM_NEXT();
+        }
+        ip = code[ip].operand.as_u64;
+        if (budget-- == 0)
+            goto done;
+        goto access;
+
+    access:
+        VVM_FAIL(ERR_ILLEGAL_INSTRUCTION_ACCESS);
+
+    VVM_HANDLER(VVM_THREADED_ACCESS):
+        VVM_FAIL(ERR_ILLEGAL_INSTRUCTION_ACCESS);
+
+    VVM_HANDLER(VVM_THREADED_ILLEGAL):
+        VVM_FAIL(ERR_ILLEGAL_INSTRUCTION);
+
+    // Anything without a dedicated handler goes through vm_execute_inst.
+    VVM_HANDLER(VVM_THREADED_SLOW):
+        p_vm->stack_size = sp;
+        p_vm->inst_pointer = ip;
+        err = vm_execute_inst(p_vm);
+        sp = p_vm->stack_size;
+        ip = p_vm->inst_pointer;
+        if (err != ERR_OK || p_vm->halt)
+            goto done;
+        if (ip >= size)
+        {
+            if (budget-- == 0)
+                goto done;
+            goto access;
+        }
+        VVM_NEXT();
+
+    // Vector instructions share one handler, and vm_execute_vector makes
+    // their checks whether or not they were verified.
+    VVM_HANDLER(INST_VADDF):
+    VVM_FAST_HANDLER(INST_VADDF):
+    VVM_HANDLER(INST_VSUBF):
+    VVM_FAST_HANDLER(INST_VSUBF):
+    VVM_HANDLER(INST_VMULF):
+    VVM_FAST_HANDLER(INST_VMULF):
+    VVM_HANDLER(INST_VDIVF):
+    VVM_FAST_HANDLER(INST_VDIVF):
+    VVM_HANDLER(INST_VADDI):
+    VVM_FAST_HANDLER(INST_VADDI):
+    VVM_HANDLER(INST_VSUBI):
+    VVM_FAST_HANDLER(INST_VSUBI):
+    VVM_HANDLER(INST_VMULI):
+    VVM_FAST_HANDLER(INST_VMULI):
+    VVM_HANDLER(INST_VDIVI):
+    VVM_FAST_HANDLER(INST_VDIVI):
+    VVM_HANDLER(INST_VSUMF):
+    VVM_FAST_HANDLER(INST_VSUMF):
+    VVM_HANDLER(INST_VSUMI):
+    VVM_FAST_HANDLER(INST_VSUMI):
+    VVM_HANDLER(INST_VBCAST):
+    VVM_FAST_HANDLER(INST_VBCAST):
+        err = vm_execute_vector(p_vm->vector, p_vm->program[ip].type, code[ip].operand.as_u64, stack, &sp, capacity);
+        if (err != ERR_OK)
+            goto done;
+        ip++;
+        VVM_NEXT();
+
+#ifdef VVM_TRACE
+    // The jumps of traced runs, which record where they are taken from.
+    VVM_HANDLER(VVM_THREADED_TRACE_JMP):
+        VVM_TRACE_RECORD(TRACE_JUMP, INST_JMP);
+        ip = code[ip].operand.as_u64;
+        VVM_NEXT();
+
+    VVM_HANDLER(VVM_THREADED_TRACE_JNZ):
+        if (sp < 1)
+            VVM_FAIL(ERR_STACK_UNDERFLOW);
+        if (stack[sp - 1].as_u64)
+        {
+            VVM_TRACE_RECORD(TRACE_JUMP, INST_JMP_NZ);
+            ip = code[ip].operand.as_u64;
+        }
+        else
+            ip++;
+        sp--;
+        VVM_NEXT();
+
+    VVM_HANDLER(VVM_THREADED_TRACE_DEC_JNZ):
+        if (sp >= capacity)
+            VVM_FAIL(ERR_STACK_OVERFLOW);
+        if (sp < 1)
+            VVM_FAIL_PUSHED((word_t){ .as_u64 = 1 }, ERR_STACK_UNDERFLOW);
+        if (--stack[sp - 1].as_u64)
+        {
+            VVM_TRACE_RECORD(TRACE_JUMP, INST_DEC_JMP_NZ);
+            ip = code[ip].operand.as_u64;
+        }
+        else
+            ip++;
+        VVM_NEXT();
+#endif
+
+#ifndef VVM_COMPUTED_GOTO
+    }
+#endif
+
+done:
+#ifdef VVM_TRACE
+    if (p_trace != NULL && err != ERR_OK)
+        VVM_TRACE_RECORD(TRACE_STOP, VVM_TRACE_OPCODE());
+#endif
+    p_vm->stack_size = sp;
+    p_vm->inst_pointer = ip;
+    arena_rewind(p_vm->arena, mark);
+    return err;
+}
+
+#undef VVM_FAIL
+#undef VVM_FAIL_PUSHED
+#undef VVM_NEXT
+#undef VVM_DISPATCH
+#undef VVM_TRACE_RECORD
+#undef VVM_TRACE_OPCODE
+#undef VVM_HANDLER
+#undef VVM_FAST_HANDLER
+#ifdef VVM_COMPUTED_GOTO
+#undef VVM_HANDLER_REF
+#undef VVM_FAST_HANDLER_REF
+#pragma GCC diagnostic pop
+#endif
+
+typedef struct {
+    uint64_t* lo;
+    uint64_t* hi;
+    uint8_t* seen;
+    uint8_t* leader;
+    uint8_t* queued;
+    inst_addr_t* worklist;
+    size_t worklist_size;
+} verifier_t;
+
+// Widens the depth interval recorded at the leader p_addr and queues the
+// leader again if the interval grew. Every loop goes through at least one
+// edge back to a lower or the same address, and a bound that such a p_back
+// edge moves goes straight to 0 or p_capacity, so loops that grow or shrink
+// the stack take a few passes instead of one per word of the stack.
+static void verifier_merge(verifier_t* p_verifier, inst_addr_t p_addr, uint64_t p_lo, uint64_t p_hi,
+                           int p_back, uint64_t p_capacity)
+{
+    if (p_verifier->seen[p_addr])
+    {
+        if (p_verifier->lo[p_addr] <= p_lo && p_verifier->hi[p_addr] >= p_hi)
+            return;
+        if (p_lo > p_verifier->lo[p_addr])
+            p_lo = p_verifier->lo[p_addr];
+        else if (p_back && p_lo < p_verifier->lo[p_addr])
+            p_lo = 0;
+        if (p_hi < p_verifier->hi[p_addr])
+            p_hi = p_verifier->hi[p_addr];
+        else if (p_back && p_hi > p_verifier->hi[p_addr])
+            p_hi = p_capacity;
+    }
+
+    p_verifier->seen[p_addr] = 1;
+    p_verifier->lo[p_addr] = p_lo;
+    p_verifier->hi[p_addr] = p_hi;
+
+    if (!p_verifier->queued[p_addr])
+    {
+        p_verifier->queued[p_addr] = 1;
+        p_verifier->worklist[p_verifier->worklist_size++] = p_addr;
+    }
+}
+
+// How many elements an instruction takes off the top of the stack and how
+// many it leaves there, for the verifier and the optimizer, as given by
+// VVM_INSTRUCTIONS. Instructions that only read deeper elements, like rdup
+// and swap, count as taking none of them. Returns 0 for vector instructions
+// with illegal lanes, and for natives, whose effect is only known to the
+// table they run against.
+#define VVM_INST_EFFECT(p_id, p_name, p_operand, p_taken, p_left, ...) \
+        case p_id: *p_pops = (p_taken); *p_pushes = (p_left); break;
+#define VVM_LANES p_inst.operand.as_u64
+
+static int vm_stack_effect(inst_t p_inst, uint64_t* p_pops, uint64_t* p_pushes)
+{
+    if ((inst_is_vector(p_inst.type) && !vector_lanes_valid(VVM_LANES)) || p_inst.type == INST_NATIVE)
+        return 0;
+
+    switch (p_inst.type)
+    {
+        VVM_INSTRUCTIONS(VVM_INST_EFFECT)
+
+        case NUMBER_OF_INSTS:
+        default:
+            return 0;
+    }
+
+    return 1;
+}
+
+#undef VVM_LANES
+#undef VVM_INST_EFFECT
+
+// What an instruction needs of the stack to succeed: at least *p_need
+// elements, and room for *p_room more above the depth it starts at. Its
+// pops and pushes give both, except for the instructions that read an
+// element deeper than they take, and for the superinstructions, which check
+// for an overflow like the push they were fused from. Returns 0 if it can
+// never succeed, and -1 for natives missing from p_natives.
+static int verifier_demand(inst_t p_inst, uint64_t p_capacity, const native_table_t* p_natives,
+                           uint64_t* p_pops, uint64_t* p_pushes, uint64_t* p_need, uint64_t* p_room)
+{
+    if (p_inst.type == INST_NATIVE)
+    {
+        const native_t* native = vm_native(p_natives, p_inst.operand.as_u64);
+        if (native == NULL)
+            return -1;
+        *p_pops = native->pops;
+        *p_pushes = native->pushes;
+    }
+    else if (!vm_stack_effect(p_inst, p_pops, p_pushes))
+        return 0;
+
+    *p_need = *p_pops;
+    *p_room = *p_pushes > *p_pops ? *p_pushes - *p_pops : 0;
+
+    if (p_inst.type == INST_DUP_REL || p_inst.type == INST_SWAP ||
+        p_inst.type == INST_ADDI_REL || p_inst.type == INST_ADDF_REL)
+    {
+        if (p_inst.operand.as_u64 >= p_capacity)
+            return 0;
+        if (*p_need <= p_inst.operand.as_u64)
+            *p_need = p_inst.operand.as_u64 + 1;
+    }
+
+    // The superinstructions sit between addi_imm and dec_jnz in the table.
+    if ((p_inst.type >= INST_ADDI_IMM && p_inst.type <= INST_DEC_JMP_NZ) || p_inst.type == INST_STORE_IMM)
+        *p_room = 1;
+
+    return 1;
+}
+
+// Narrows [*p_lo, *p_hi] from the depths an instruction may start at to the
+// depths it leaves behind when it succeeds. Returns 0 if it can never succeed.
+// Natives missing from p_natives may still be found in the table the program
+// runs with, so they can leave any depth.
+static int verifier_step(inst_t p_inst, uint64_t p_capacity, const native_table_t* p_natives, uint64_t* p_lo, uint64_t* p_hi)
+{
+    uint64_t pops, pushes, need, room;
+    const int demand = verifier_demand(p_inst, p_capacity, p_natives, &pops, &pushes, &need, &room);
+    if (demand < 0)
+    {
+        *p_lo = 0;
+        *p_hi = p_capacity;
+        return 1;
+    }
+    if (demand == 0 || room > p_capacity)
+        return 0;
+
+    const uint64_t lo = *p_lo < need ? need : *p_lo;
+    const uint64_t hi = room > 0 && *p_hi > p_capacity - room ? p_capacity - room : *p_hi;
+    if (lo > hi)
+        return 0;
+
+    *p_lo = lo - pops + pushes;
+    *p_hi = hi - pops + pushes;
+    return 1;
+}
+
+// Whether none of the stack checks of an instruction can fail for any depth
+// in [p_lo, p_hi], nor its memory checks for a memory of p_memory_size words,
+// nor the checks of a native against its entry in p_natives.
+static int verifier_is_safe(inst_t p_inst, uint64_t p_capacity, uint64_t p_memory_size, const native_table_t* p_natives,
+                            uint64_t p_lo, uint64_t p_hi)
+{
+    uint64_t pops, pushes, need, room;
+    if (verifier_demand(p_inst, p_capacity, p_natives, &pops, &pushes, &need, &room) <= 0 || room > p_capacity)
+        return 0;
+
+    // Only the address of the _imm forms is known before they run, the
+    // others check theirs every time.
+    if ((p_inst.type == INST_LOAD_IMM || p_inst.type == INST_STORE_IMM) && p_inst.operand.as_u64 >= p_memory_size)
+        return 0;
+
+    return p_lo >= need && (room == 0 || p_hi <= p_capacity - room);
+}
+
+// Runs the block of the leader p_start from [p_lo, p_hi]. Every instruction
+// records the interval it starts at when p_in_lo is NULL, otherwise the
+// intervals leaving the block are joined into p_in_lo and p_in_hi.
+static void verifier_walk(const vvm_t* p_vm, verifier_t* p_verifier, inst_addr_t p_start, uint64_t p_lo, uint64_t p_hi,
+                          uint64_t* p_in_lo, uint64_t* p_in_hi, uint8_t* p_in_seen)
+{
+    const uint64_t size = p_vm->program_size;
+    inst_addr_t i = p_start;
+    inst_addr_t exits[2];
+    int exits_count = 0;
+
+    for (;;)
+    {
+        const inst_t inst = p_vm->program[i];
+        if (p_in_lo == NULL)
+        {
+            p_verifier->lo[i] = p_lo;
+            p_verifier->hi[i] = p_hi;
+        }
+
+        if (!verifier_step(inst, p_vm->stack_capacity, p_vm->natives, &p_lo, &p_hi) || inst.type == INST_HALT)
+            break;
+
+        if (inst_is_jump(inst.type))
+        {
+            if (inst.operand.as_u64 < size)
+                exits[exits_count++] = inst.operand.as_u64;
+            if (inst.type == INST_JMP)
+                break;
+        }
+
+        if (++i >= size)
+            break;
+
+        if (p_verifier->leader[i])
+        {
+            exits[exits_count++] = i;
+            break;
+        }
+    }
+
+    for (int e = 0; e < exits_count && p_in_lo != NULL; ++e)
+    {
+        const inst_addr_t to = exits[e];
+        if (!p_in_seen[to] || p_lo < p_in_lo[to])
+            p_in_lo[to] = p_lo;
+        if (!p_in_seen[to] || p_hi > p_in_hi[to])
+            p_in_hi[to] = p_hi;
+        p_in_seen[to] = 1;
+    }
+}
+
+// Widening leaves loops with the whole stack above or below them. One more
+// round from the intervals found so far gives every leader the join of what
+// its predecessors can actually hand it, which still holds for every path,
+// and runs the blocks again from there. Without the memory for it, the wider
+// intervals stand.
+static void verifier_narrow(const vvm_t* p_vm, verifier_t* p_verifier)
+{
+    const uint64_t size = p_vm->program_size;
+    uint64_t* in_lo = arena_alloc(p_vm->arena, sizeof(in_lo[0]) * size);
+    uint64_t* in_hi = arena_alloc(p_vm->arena, sizeof(in_hi[0]) * size);
+    uint8_t* in_seen = arena_alloc(p_vm->arena, size);
+    if (in_lo == NULL || in_hi == NULL || in_seen == NULL)
+        return;
+    memset(in_seen, 0, size);
+
+    in_lo[p_vm->inst_pointer] = p_vm->stack_size;
+    in_hi[p_vm->inst_pointer] = p_vm->stack_size;
+    in_seen[p_vm->inst_pointer] = 1;
+
+    for (inst_addr_t i = 0; i < size; ++i)
+        if (p_verifier->leader[i] && p_verifier->seen[i])
+            verifier_walk(p_vm, p_verifier, i, p_verifier->lo[i], p_verifier->hi[i], in_lo, in_hi, in_seen);
+
+    for (inst_addr_t i = 0; i < size; ++i)
+        if (p_verifier->leader[i] && p_verifier->seen[i] && in_seen[i])
+            verifier_walk(p_vm, p_verifier, i, in_lo[i], in_hi[i], NULL, NULL, NULL);
+}
+
+// Abstract interpretation of the stack depth: every instruction reachable
+// from the current inst_pointer and stack_size gets the interval of depths it
+// can start executing at. Counts the jumps leaving the program in
+// p_bad_jumps. The tables of p_verifier are allocated from the arena of p_vm.
+static error verifier_analyze(const vvm_t* p_vm, verifier_t* p_verifier, FILE* p_diagnostics, uint64_t* p_bad_jumps)
+{
+    uint64_t bad_jumps = 0;
+    const uint64_t size = p_vm->program_size;
+
+    p_verifier->lo = arena_alloc(p_vm->arena, sizeof(p_verifier->lo[0]) * size);
+    p_verifier->hi = arena_alloc(p_vm->arena, sizeof(p_verifier->hi[0]) * size);
+    p_verifier->seen = arena_alloc(p_vm->arena, size);
+    p_verifier->leader = arena_alloc(p_vm->arena, size);
+    p_verifier->queued = arena_alloc(p_vm->arena, size);
+    p_verifier->worklist = arena_alloc(p_vm->arena, sizeof(p_verifier->worklist[0]) * size);
+    if (p_verifier->lo == NULL || p_verifier->hi == NULL || p_verifier->seen == NULL ||
+        p_verifier->leader == NULL || p_verifier->queued == NULL || p_verifier->worklist == NULL)
+        return ERR_OUT_OF_MEMORY;
+    memset(p_verifier->seen, 0, size);
+    memset(p_verifier->leader, 0, size);
+    memset(p_verifier->queued, 0, size);
+    p_verifier->worklist_size = 0;
+
+    // Split the program into basic blocks.
+    for (inst_addr_t i = 0; i < size; ++i)
+    {
+        const inst_t inst = p_vm->program[i];
+        if (!inst_is_jump(inst.type) && inst.type != INST_HALT)
+            continue;
+
+        if (i + 1 < size)
+            p_verifier->leader[i + 1] = 1;
+
+        if (inst.type == INST_HALT)
+            continue;
+
+        if (inst.operand.as_u64 < size)
+        {
+            p_verifier->leader[inst.operand.as_u64] = 1;
+        }
+        else
+        {
+            bad_jumps++;
+            if (p_diagnostics != NULL)
+                fprintf(p_diagnostics, "[WARNING]: Jump At Address %lu Targets %lu, Outside Of The Program\n",
+                    i, inst.operand.as_u64);
+        }
+    }
+
+    *p_bad_jumps = bad_jumps;
+    if (p_vm->inst_pointer >= size)
+        return ERR_OK;
+
+    p_verifier->leader[p_vm->inst_pointer] = 1;
+    verifier_merge(p_verifier, p_vm->inst_pointer, p_vm->stack_size, p_vm->stack_size, 0, p_vm->stack_capacity);
+
+    while (p_verifier->worklist_size > 0)
+    {
+        inst_addr_t i = p_verifier->worklist[--p_verifier->worklist_size];
+        p_verifier->queued[i] = 0;
+
+        uint64_t lo = p_verifier->lo[i];
+        uint64_t hi = p_verifier->hi[i];
+
+        for (;;)
+        {
+            const inst_t inst = p_vm->program[i];
+            p_verifier->seen[i] = 1;
+            p_verifier->lo[i] = lo;
+            p_verifier->hi[i] = hi;
+
+            if (!verifier_step(inst, p_vm->stack_capacity, p_vm->natives, &lo, &hi) || inst.type == INST_HALT)
+                break;
+
+            if (inst_is_jump(inst.type))
+            {
+                if (inst.operand.as_u64 < size)
+                    verifier_merge(p_verifier, inst.operand.as_u64, lo, hi, inst.operand.as_u64 <= i, p_vm->stack_capacity);
+                if (inst.type == INST_JMP)
+                    break;
+            }
+
+            if (++i >= size)
+                break;
+
+            if (p_verifier->leader[i])
+            {
+                verifier_merge(p_verifier, i, lo, hi, 0, p_vm->stack_capacity);
+                break;
+            }
+        }
+    }
+
+    verifier_narrow(p_vm, p_verifier);
+    return ERR_OK;
+}
+
+verification_t vm_verify_program(vvm_t* p_vm, FILE* p_diagnostics)
+{
+    // Instructions whose checks hold for the whole depth interval are marked
+    // so the threaded engine can skip them.
+    verifier_t verifier;
+    verification_t result = {0};
+    const uint64_t size = p_vm->program_size;
+    const arena_mark_t mark = arena_mark(p_vm->arena);
+
+    // Without the memory for the analysis nothing is proven, which only
+    // costs the fast paths.
+    if (size > 0)
+        memset(p_vm->verified, 0, size);
+    if (verifier_analyze(p_vm, &verifier, p_diagnostics, &result.bad_jumps) != ERR_OK)
+    {
+        arena_rewind(p_vm->arena, mark);
+        return result;
+    }
+
+    for (inst_addr_t i = 0; i < size; ++i)
+    {
+        if (!verifier.seen[i])
+            continue;
+
+        const inst_t inst = p_vm->program[i];
+        const int far = inst_is_jump(inst.type) && inst.operand.as_u64 >= size;
+
+        result.reachable++;
+        if (!far && verifier_is_safe(inst, p_vm->stack_capacity, p_vm->memory_size, p_vm->natives, verifier.lo[i], verifier.hi[i]))
+        {
+            p_vm->verified[i] = 1;
+            result.proven++;
+        }
+    }
+
+    arena_rewind(p_vm->arena, mark);
+    return result;
+}
+
+typedef struct {
+    reg_program_t* program;
+    uint32_t* sym;      // Register holding each stack slot.
+    uint64_t depth;
+    uint32_t temps;
+    int failed;
+} reg_translator_t;
+
+static void reg_emit(reg_translator_t* p_tr, reg_inst_t p_inst)
+{
+    if (p_tr->program->code_size >= p_tr->program->code_capacity)
+    {
+        p_tr->failed = 1;
+        return;
+    }
+    p_tr->program->code[p_tr->program->code_size++] = p_inst;
+}
+
+static uint32_t reg_temp(reg_translator_t* p_tr)
+{
+    const reg_program_t* program = p_tr->program;
+    if (p_tr->temps >= program->first_const - program->first_temp)
+    {
+        p_tr->failed = 1;
+        return program->first_temp;
+    }
+    return program->first_temp + p_tr->temps++;
+}
+
+static uint32_t reg_const(reg_translator_t* p_tr, word_t p_value)
+{
+    reg_program_t* program = p_tr->program;
+    for (uint32_t i = 0; i < program->consts_size; ++i)
+        if (program->consts[i].as_u64 == p_value.as_u64)
+            return program->first_const + i;
+
+    if (program->consts_size >= program->consts_capacity)
+    {
+        p_tr->failed = 1;
+        return program->first_const;
+    }
+    program->consts[program->consts_size] = p_value;
+    return program->first_const + program->consts_size++;
+}
+
+// Picks the register the result for stack slot p_slot is written to. The slot
+// register itself is used unless another live slot still refers to it.
+static uint32_t reg_destination(reg_translator_t* p_tr, uint64_t p_slot)
+{
+    for (uint64_t j = 0; j < p_tr->depth; ++j)
+        if (j != p_slot && p_tr->sym[j] == p_slot)
+            return reg_temp(p_tr);
+    return (uint32_t)p_slot;
+}
+
+// Writes every slot below the current depth back to its own register. p_keep,
+// if given, is a register read after the flush and is preserved as well.
+static void reg_flush(reg_translator_t* p_tr, uint32_t* p_keep)
+{
+    const uint64_t depth = p_tr->depth;
+
+    // Slots that are about to be overwritten but are still read by another
+    // slot are saved in a temporary first.
+    for (uint64_t r = 0; r < depth; ++r)
+    {
+        if (p_tr->sym[r] == r)
+            continue;
+
+        int read = p_keep != NULL && *p_keep == r;
+        for (uint64_t j = 0; j < depth && !read; ++j)
+            read = j != r && p_tr->sym[j] == r;
+
+        if (!read)
+            continue;
+
+        uint32_t t = reg_temp(p_tr);
+        reg_emit(p_tr, (reg_inst_t){ .op = REG_OP_MOV, .dst = t, .a = (uint32_t)r });
+        for (uint64_t j = 0; j < depth; ++j)
+            if (p_tr->sym[j] == r)
+                p_tr->sym[j] = t;
+        if (p_keep != NULL && *p_keep == r)
+            *p_keep = t;
+    }
+
+    for (uint64_t j = 0; j < depth; ++j)
+    {
+        if (p_tr->sym[j] != j)
+            reg_emit(p_tr, (reg_inst_t){ .op = REG_OP_MOV, .dst = (uint32_t)j, .a = p_tr->sym[j] });
+        p_tr->sym[j] = (uint32_t)j;
+    }
+}
+
+static void reg_binary(reg_translator_t* p_tr, reg_op_type p_op, uint32_t p_a, uint32_t p_b)
+{
+    // The top slot is consumed, so it does not keep its register alive.
+    p_tr->depth--;
+    const uint64_t slot = p_tr->depth - 1;
+    const uint32_t dst = reg_destination(p_tr, slot);
+    reg_emit(p_tr, (reg_inst_t){ .op = p_op, .dst = dst, .a = p_a, .b = p_b });
+    p_tr->sym[slot] = dst;
+}
+
+// Same as reg_binary, but the result replaces the top of the stack.
+static void reg_unary(reg_translator_t* p_tr, reg_op_type p_op, uint32_t p_a, uint32_t p_b)
+{
+    const uint64_t slot = p_tr->depth - 1;
+    const uint32_t dst = reg_destination(p_tr, slot);
+    reg_emit(p_tr, (reg_inst_t){ .op = p_op, .dst = dst, .a = p_a, .b = p_b });
+    p_tr->sym[slot] = dst;
+}
+
+static reg_op_type reg_op_of(inst_type p_type)
+{
+    switch (p_type)
+    {
+        case INST_ADDI: case INST_ADDI_IMM: case INST_ADDI_REL: return REG_OP_ADDI;
+        case INST_SUBI: case INST_SUBI_IMM:                     return REG_OP_SUBI;
+        case INST_MULI: case INST_MULI_IMM:                     return REG_OP_MULI;
+        case INST_ADDF: case INST_ADDF_IMM: case INST_ADDF_REL: return REG_OP_ADDF;
+        case INST_SUBF: case INST_SUBF_IMM:                     return REG_OP_SUBF;
+        case INST_MULF: case INST_MULF_IMM:                     return REG_OP_MULF;
+        case INST_DIVF: case INST_DIVF_IMM:                     return REG_OP_DIVF;
+        case INST_EQ:                                           return REG_OP_EQ;
+        case INST_SQRTF:                                        return REG_OP_SQRTF;
+        case INST_I2F:                                          return REG_OP_I2F;
+        case INST_NEGF:                                         return REG_OP_NEGF;
+        case INST_MINF:                                         return REG_OP_MINF;
+        case INST_MAXF:                                         return REG_OP_MAXF;
+        case INST_LTF:                                          return REG_OP_LTF;
+        case INST_LTI:                                          return REG_OP_LTI;
+        case INST_NOP:
+        case INST_PUSH:
+        case INST_DUP_REL:
+        case INST_SWAP:
+        case INST_DIVI:
+        case INST_JMP:
+        case INST_JMP_NZ:
+        case INST_NOT:
+        case INST_GEQ:
+        case INST_HALT:
+        case INST_PRINT_DEBUG:
+        case INST_DEC_JMP_NZ:
+        case INST_OUT:
+        case INST_OUTI:
+        case INST_VADDF:
+        case INST_VSUBF:
+        case INST_VMULF:
+        case INST_VDIVF:
+        case INST_VADDI:
+        case INST_VSUBI:
+        case INST_VMULI:
+        case INST_VDIVI:
+        case INST_VSUMF:
+        case INST_VSUMI:
+        case INST_VBCAST:
+        case INST_FMA:
+        case INST_F2I:
+        case INST_LOAD:
+        case INST_STORE:
+        case INST_LOAD_IMM:
+        case INST_STORE_IMM:
+        case INST_MEMCPY:
+        case INST_MEMSET:
+        case INST_NATIVE:
+        case NUMBER_OF_INSTS:
+        default:
+            assert(0 && "reg_op_of: Unreachable (How Did You Get Here)");
+            return REG_OP_MOV;
+    }
+}
+
+int vm_translate_to_registers(const vvm_t* p_vm, reg_program_t* p_program, int p_counted)
+{
+    // Only programs where every reachable instruction has one statically known
+    // stack depth and no check but division by zero, the range of f2i, the
+    // addresses on the stack and natives themselves can fail are translated.
+    // Stack slots become registers, rdup and swap only rename registers, and
+    // the slots are written back at block boundaries, before print_debug and
+    // halt, and before anything that can fail. With p_counted, every block
+    // starts by taking its instructions from the limit, like vvm2c does. The
+    // program and the scratch memory of the translation are allocated from
+    // the arena of p_vm.
+    verifier_t verifier;
+    const uint64_t size = p_vm->program_size;
+    const uint64_t temps = 2 * size + 2;
+
+    if (p_vm->stack_capacity + temps + size + 1 > UINT32_MAX)
+        return 0;
+
+    uint64_t bad_jumps = 0;
+    if (verifier_analyze(p_vm, &verifier, NULL, &bad_jumps) != ERR_OK || bad_jumps != 0 || p_vm->inst_pointer >= size)
+        return 0;
+
+    for (inst_addr_t i = 0; i < size; ++i)
+    {
+        if (!verifier.seen[i])
+            continue;
+        if (verifier.lo[i] != verifier.hi[i] ||
+            !verifier_is_safe(p_vm->program[i], p_vm->stack_capacity, p_vm->memory_size, p_vm->natives, verifier.lo[i], verifier.hi[i]))
+            return 0;
+    }
+
+    p_program->code_capacity = 5 * size + 4;
+    p_program->code = arena_alloc(p_vm->arena, sizeof(p_program->code[0]) * p_program->code_capacity);
+    p_program->code_size = 0;
+    p_program->consts_capacity = (uint32_t)size + 1;
+    p_program->consts = arena_alloc(p_vm->arena, sizeof(p_program->consts[0]) * p_program->consts_capacity);
+    p_program->consts_size = 0;
+    p_program->entry = arena_alloc(p_vm->arena, sizeof(p_program->entry[0]) * size);
+    p_program->first_temp = (uint32_t)p_vm->stack_capacity;
+    p_program->first_const = (uint32_t)(p_vm->stack_capacity + temps);
+
+    reg_translator_t tr = {
+        .program = p_program,
+        .sym = arena_alloc(p_vm->arena, sizeof(tr.sym[0]) * p_vm->stack_capacity),
+    };
+    if (p_program->code == NULL || p_program->consts == NULL || p_program->entry == NULL || tr.sym == NULL)
+        return 0;
+
+    int in_block = 0;
+    for (inst_addr_t i = 0; i < size && !tr.failed; ++i)
+    {
+        if (!verifier.seen[i])
+        {
+            in_block = 0;
+            continue;
+        }
+
+        p_program->entry[i] = p_program->code_size;
+        if (verifier.leader[i] || !in_block)
+        {
+            tr.depth = verifier.lo[i];
+            tr.temps = 0;
+            for (uint64_t j = 0; j < tr.depth; ++j)
+                tr.sym[j] = (uint32_t)j;
+            in_block = 1;
+
+            if (p_counted)
+            {
+                inst_addr_t end = i + 1;
+                while (end < size && verifier.seen[end] && !verifier.leader[end])
+                    ++end;
+                reg_emit(&tr, (reg_inst_t){
+                    .op = REG_OP_BUDGET, .c = (uint32_t)(end - i),
+                    .vm_ip = (uint32_t)i, .depth = (uint32_t)tr.depth
+                });
+            }
+        }
+
+        const inst_t inst = p_vm->program[i];
+        const uint64_t d = tr.depth;
+
+        switch (inst.type)
+        {
+            case INST_NOP:
+                break;
+
+            case INST_PUSH:
+                tr.sym[d] = reg_const(&tr, inst.operand);
+                tr.depth++;
+                break;
+
+            case INST_DUP_REL:
+                tr.sym[d] = tr.sym[d - 1 - inst.operand.as_u64];
+                tr.depth++;
+                break;
+
+            case INST_SWAP: {
+                const uint32_t t = tr.sym[d - 1];
+                tr.sym[d - 1] = tr.sym[d - 1 - inst.operand.as_u64];
+                tr.sym[d - 1 - inst.operand.as_u64] = t;
+            } break;
+
+            case INST_ADDI:
+            case INST_SUBI:
+            case INST_MULI:
+            case INST_ADDF:
+            case INST_SUBF:
+            case INST_MULF:
+            case INST_DIVF:
+            case INST_EQ:
+                reg_binary(&tr, reg_op_of(inst.type), tr.sym[d - 2], tr.sym[d - 1]);
+                break;
+
+            case INST_GEQ:
+                reg_binary(&tr, REG_OP_GEQ, tr.sym[d - 1], tr.sym[d - 2]);
+                break;
+
+            case INST_DIVI:
+                reg_flush(&tr, NULL);
+                reg_emit(&tr, (reg_inst_t){
+                    .op = REG_OP_DIVI,
+                    .dst = (uint32_t)(d - 2), .a = (uint32_t)(d - 2), .b = (uint32_t)(d - 1),
+                    .vm_ip = (uint32_t)i, .depth = (uint32_t)d
+                });
+                tr.depth--;
+                break;
+
+            case INST_NOT:
+                reg_unary(&tr, REG_OP_NOT, tr.sym[d - 1], 0);
+                break;
+
+            case INST_FMA: {
+                const uint32_t a = tr.sym[d - 3];
+                const uint32_t b = tr.sym[d - 2];
+                const uint32_t c = tr.sym[d - 1];
+                tr.depth -= 2;
+                const uint32_t dst = reg_destination(&tr, d - 3);
+                reg_emit(&tr, (reg_inst_t){ .op = REG_OP_FMA, .dst = dst, .a = a, .b = b, .c = c });
+                tr.sym[d - 3] = dst;
+            } break;
+
+            case INST_SQRTF:
+            case INST_I2F:
+            case INST_NEGF:
+                reg_unary(&tr, reg_op_of(inst.type), tr.sym[d - 1], 0);
+                break;
+
+            case INST_F2I:
+                reg_flush(&tr, NULL);
+                reg_emit(&tr, (reg_inst_t){
+                    .op = REG_OP_F2I,
+                    .dst = (uint32_t)(d - 1), .a = (uint32_t)(d - 1),
+                    .vm_ip = (uint32_t)i, .depth = (uint32_t)d
+                });
+                break;
+
+            case INST_MINF:
+            case INST_MAXF:
+            case INST_LTF:
+            case INST_LTI:
+                reg_binary(&tr, reg_op_of(inst.type), tr.sym[d - 2], tr.sym[d - 1]);
+                break;
+
+            case INST_LOAD:
+                reg_flush(&tr, NULL);
+                reg_emit(&tr, (reg_inst_t){
+                    .op = REG_OP_LOAD,
+                    .dst = (uint32_t)(d - 1), .a = (uint32_t)(d - 1),
+                    .vm_ip = (uint32_t)i, .depth = (uint32_t)d
+                });
+                break;
+
+            case INST_STORE:
+                reg_flush(&tr, NULL);
+                reg_emit(&tr, (reg_inst_t){
+                    .op = REG_OP_STORE,
+                    .a = (uint32_t)(d - 2), .b = (uint32_t)(d - 1),
+                    .vm_ip = (uint32_t)i, .depth = (uint32_t)d
+                });
+                tr.depth -= 2;
+                break;
+
+            // The verifier proved their address in bounds, so they cannot
+            // fail and nothing is written back.
+            case INST_LOAD_IMM: {
+                const uint32_t dst = reg_destination(&tr, d);
+                reg_emit(&tr, (reg_inst_t){ .op = REG_OP_LOAD, .dst = dst, .a = reg_const(&tr, inst.operand) });
+                tr.sym[d] = dst;
+                tr.depth++;
+            } break;
+
+            case INST_STORE_IMM:
+                tr.depth--;
+                reg_emit(&tr, (reg_inst_t){ .op = REG_OP_STORE, .a = tr.sym[d - 1], .b = reg_const(&tr, inst.operand) });
+                break;
+
+            case INST_MEMCPY:
+            case INST_MEMSET:
+                reg_flush(&tr, NULL);
+                reg_emit(&tr, (reg_inst_t){
+                    .op = inst.type == INST_MEMCPY ? REG_OP_MEMCPY : REG_OP_MEMSET,
+                    .a = (uint32_t)(d - 3), .b = (uint32_t)(d - 2), .c = (uint32_t)(d - 1),
+                    .vm_ip = (uint32_t)i, .depth = (uint32_t)d
+                });
+                tr.depth -= 3;
+                break;
+
+            // Slots are their own registers once written back, so a native
+            // works on the register file as it would on the stack.
+            case INST_NATIVE: {
+                const native_t* native = &p_vm->natives->entries[inst.operand.as_u64];
+                reg_flush(&tr, NULL);
+                reg_emit(&tr, (reg_inst_t){
+                    .op = REG_OP_NATIVE, .a = (uint32_t)(d - native->pops), .b = reg_const(&tr, inst.operand),
+                    .vm_ip = (uint32_t)i, .depth = (uint32_t)d
+                });
+                tr.depth = d - native->pops + native->pushes;
+                for (uint64_t j = d - native->pops; j < tr.depth; ++j)
+                    tr.sym[j] = (uint32_t)j;
+            } break;
+
+            case INST_ADDI_IMM:
+            case INST_SUBI_IMM:
+            case INST_MULI_IMM:
+            case INST_ADDF_IMM:
+            case INST_SUBF_IMM:
+            case INST_MULF_IMM:
+            case INST_DIVF_IMM:
+                reg_unary(&tr, reg_op_of(inst.type), tr.sym[d - 1], reg_const(&tr, inst.operand));
+                break;
+
+            case INST_ADDI_REL:
+            case INST_ADDF_REL:
+                reg_unary(&tr, reg_op_of(inst.type), tr.sym[d - 1], tr.sym[d - 1 - inst.operand.as_u64]);
+                break;
+
+            case INST_JMP:
+                reg_flush(&tr, NULL);
+                reg_emit(&tr, (reg_inst_t){ .op = REG_OP_JMP, .target = (uint32_t)inst.operand.as_u64 });
+                in_block = 0;
+                break;
+
+            case INST_JMP_NZ: {
+                uint32_t cond = tr.sym[d - 1];
+                tr.depth--;
+                reg_flush(&tr, &cond);
+                reg_emit(&tr, (reg_inst_t){ .op = REG_OP_JNZ, .a = cond, .target = (uint32_t)inst.operand.as_u64 });
+            } break;
+
+            case INST_DEC_JMP_NZ: {
+                word_t one = { .as_u64 = 1 };
+                reg_unary(&tr, REG_OP_SUBI, tr.sym[d - 1], reg_const(&tr, one));
+                reg_flush(&tr, NULL);
+                reg_emit(&tr, (reg_inst_t){ .op = REG_OP_JNZ, .a = (uint32_t)(d - 1), .target = (uint32_t)inst.operand.as_u64 });
+            } break;
+
+            case INST_HALT:
+                reg_flush(&tr, NULL);
+                reg_emit(&tr, (reg_inst_t){ .op = REG_OP_HALT, .vm_ip = (uint32_t)i, .depth = (uint32_t)d });
+                in_block = 0;
+                break;
+
+            case INST_PRINT_DEBUG:
+                reg_flush(&tr, NULL);
+                reg_emit(&tr, (reg_inst_t){ .op = REG_OP_PRINT, .depth = (uint32_t)d });
+                break;
+
+            // The channel is not part of the stack, so nothing is written back.
+            case INST_OUT:
+            case INST_OUTI:
+                tr.depth--;
+                reg_emit(&tr, (reg_inst_t){ .op = inst.type == INST_OUT ? REG_OP_OUT : REG_OP_OUTI, .a = tr.sym[d - 1] });
+                break;
+
+            // Lanes have no registers of their own, so programs with vector
+            // instructions stay on the threaded engine.
+            case INST_VADDF:
+            case INST_VSUBF:
+            case INST_VMULF:
+            case INST_VDIVF:
+            case INST_VADDI:
+            case INST_VSUBI:
+            case INST_VMULI:
+            case INST_VDIVI:
+            case INST_VSUMF:
+            case INST_VSUMI:
+            case INST_VBCAST:
+                return 0;
+
+            case NUMBER_OF_INSTS:
+            default:
+                return 0;
+        }
+
+        // Blocks end before the next leader, and the program ends in a fetch
+        // from past its last instruction.
+        if (in_block && (i + 1 >= size || verifier.leader[i + 1]))
+        {
+            reg_flush(&tr, NULL);
+            if (i + 1 >= size)
+                reg_emit(&tr, (reg_inst_t){ .op = REG_OP_EXIT, .vm_ip = (uint32_t)size, .depth = (uint32_t)tr.depth });
+        }
+    }
+
+    if (tr.failed)
+        return 0;
+
+    // Jump targets were recorded as program addresses.
+    for (uint64_t i = 0; i < p_program->code_size; ++i)
+        if (p_program->code[i].op == REG_OP_JMP || p_program->code[i].op == REG_OP_JNZ)
+            p_program->code[i].target = p_program->entry[p_program->code[i].target];
+
+    p_program->start = p_program->entry[p_vm->inst_pointer];
+    p_program->regs = arena_alloc(p_vm->arena, sizeof(p_program->regs[0]) * (p_program->first_const + p_program->consts_size));
+    return p_program->regs != NULL;
+}
+
+// Writes the stack back from the registers when p_inst fails, and reports
+// its instruction.
+static error reg_leave(vvm_t* p_vm, const word_t* p_regs, const reg_inst_t* p_inst, error p_error)
+{
+    memcpy(p_vm->stack, p_regs, sizeof(p_regs[0]) * p_inst->depth);
+    p_vm->stack_size = p_inst->depth;
+    p_vm->inst_pointer = p_inst->vm_ip;
+    return p_error;
+}
+
+error vm_execute_registers(vvm_t* p_vm, const reg_program_t* p_program, int p_limit)
+{
+    word_t* regs = p_program->regs;
+    const reg_inst_t* code = p_program->code;
+    uint64_t pc = p_program->start;
+    uint64_t budget = p_limit < 0 ? UINT64_MAX : (uint64_t)p_limit;
+
+    memcpy(regs, p_vm->stack, sizeof(p_vm->stack[0]) * p_vm->stack_size);
+    memcpy(regs + p_program->first_const, p_program->consts, sizeof(p_program->consts[0]) * p_program->consts_size);
+
+    for (;;)
+    {
+        const reg_inst_t* in = &code[pc++];
+
+        switch (in->op)
+        {
+            case REG_OP_MOV:
+                regs[in->dst] = regs[in->a];
+                break;
+
+            case REG_OP_ADDI:
+                regs[in->dst].as_u64 = regs[in->a].as_u64 + regs[in->b].as_u64;
+                break;
+            case REG_OP_SUBI:
+                regs[in->dst].as_u64 = regs[in->a].as_u64 - regs[in->b].as_u64;
+                break;
+            case REG_OP_MULI:
+                regs[in->dst].as_u64 = regs[in->a].as_u64 * regs[in->b].as_u64;
+                break;
+            case REG_OP_DIVI:
+                if (regs[in->b].as_u64 == 0)
+                    return reg_leave(p_vm, regs, in, ERR_DIV_BY_ZERO);
+                regs[in->dst].as_u64 = regs[in->a].as_u64 / regs[in->b].as_u64;
+                break;
+
+            case REG_OP_ADDF:
+                regs[in->dst].as_f64 = regs[in->a].as_f64 + regs[in->b].as_f64;
+                break;
+            case REG_OP_SUBF:
+                regs[in->dst].as_f64 = regs[in->a].as_f64 - regs[in->b].as_f64;
+                break;
+            case REG_OP_MULF:
+                regs[in->dst].as_f64 = regs[in->a].as_f64 * regs[in->b].as_f64;
+                break;
+            case REG_OP_DIVF:
+                regs[in->dst].as_f64 = regs[in->a].as_f64 / regs[in->b].as_f64;
+                break;
+
+            case REG_OP_EQ:
+                regs[in->dst].as_u64 = regs[in->a].as_u64 == regs[in->b].as_u64;
+                break;
+            case REG_OP_NOT:
+                regs[in->dst].as_u64 = !regs[in->a].as_u64;
+                break;
+            case REG_OP_GEQ:
+                regs[in->dst].as_u64 = regs[in->a].as_f64 >= regs[in->b].as_f64;
+                break;
+
+            case REG_OP_FMA:
+                regs[in->dst].as_f64 = fma(regs[in->a].as_f64, regs[in->b].as_f64, regs[in->c].as_f64);
+                break;
+            case REG_OP_SQRTF:
+                regs[in->dst].as_f64 = sqrt(regs[in->a].as_f64);
+                break;
+            case REG_OP_I2F:
+                regs[in->dst].as_f64 = (double)regs[in->a].as_i64;
+                break;
+            case REG_OP_F2I:
+                if (!vm_float_fits_int(regs[in->a].as_f64))
+                    return reg_leave(p_vm, regs, in, ERR_ILLEGAL_OPERAND);
+                regs[in->dst].as_i64 = (int64_t)regs[in->a].as_f64;
+                break;
+            case REG_OP_NEGF:
+                regs[in->dst].as_u64 = regs[in->a].as_u64 ^ UINT64_C(1) << 63;
+                break;
+            case REG_OP_MINF:
+                regs[in->dst] = regs[in->a].as_f64 < regs[in->b].as_f64 ? regs[in->a] : regs[in->b];
+                break;
+            case REG_OP_MAXF:
+                regs[in->dst] = regs[in->a].as_f64 > regs[in->b].as_f64 ? regs[in->a] : regs[in->b];
+                break;
+            case REG_OP_LTF:
+                regs[in->dst].as_u64 = regs[in->a].as_f64 < regs[in->b].as_f64;
+                break;
+            case REG_OP_LTI:
+                regs[in->dst].as_u64 = regs[in->a].as_i64 < regs[in->b].as_i64;
+                break;
+
+            case REG_OP_LOAD:
+                if (regs[in->a].as_u64 >= p_vm->memory_size)
+                    return reg_leave(p_vm, regs, in, ERR_ILLEGAL_MEMORY_ACCESS);
+                regs[in->dst] = p_vm->memory[regs[in->a].as_u64];
+                break;
+            case REG_OP_STORE:
+                if (regs[in->b].as_u64 >= p_vm->memory_size)
+                    return reg_leave(p_vm, regs, in, ERR_ILLEGAL_MEMORY_ACCESS);
+                p_vm->memory[regs[in->b].as_u64] = regs[in->a];
+                break;
+            case REG_OP_MEMCPY:
+                if (!vm_memory_copy(p_vm, regs[in->a].as_u64, regs[in->b].as_u64, regs[in->c].as_u64))
+                    return reg_leave(p_vm, regs, in, ERR_ILLEGAL_MEMORY_ACCESS);
+                break;
+            case REG_OP_MEMSET:
+                if (!vm_memory_fill(p_vm, regs[in->a].as_u64, regs[in->b], regs[in->c].as_u64))
+                    return reg_leave(p_vm, regs, in, ERR_ILLEGAL_MEMORY_ACCESS);
+                break;
+            case REG_OP_NATIVE: {
+                const native_t* native = &p_vm->natives->entries[regs[in->b].as_u64];
+                const error err = native->fn(p_vm->natives->user, &regs[in->a]);
+                if (err != ERR_OK)
+                    return reg_leave(p_vm, regs, in, err);
+            } break;
+
+            case REG_OP_JMP:
+                pc = in->target;
+                break;
+            case REG_OP_JNZ:
+                if (regs[in->a].as_u64)
+                    pc = in->target;
+                break;
+
+            // The block the limit runs out in is finished on the threaded
+            // engine, from the stack as it was written back at its start.
+            case REG_OP_BUDGET:
+                if (budget < in->c)
+                {
+                    reg_leave(p_vm, regs, in, ERR_OK);
+                    return vm_execute_program_threaded(p_vm, (int)budget);
+                }
+                budget -= in->c;
+                break;
+
+            case REG_OP_PRINT:
+                memcpy(p_vm->stack, regs, sizeof(regs[0]) * in->depth);
+                p_vm->stack_size = in->depth;
+                vm_dump_stack(p_vm->output, p_vm);
+                break;
+
+            case REG_OP_OUT:
+                vm_channel_word(&p_vm->channel, regs[in->a]);
+                break;
+            case REG_OP_OUTI:
+                vm_channel_decimal(&p_vm->channel, regs[in->a].as_i64);
+                break;
+
+            case REG_OP_HALT:
+                memcpy(p_vm->stack, regs, sizeof(regs[0]) * in->depth);
+                p_vm->stack_size = in->depth;
+                p_vm->inst_pointer = in->vm_ip;
+                p_vm->halt = 1;
+                return ERR_OK;
+
+            // The fetch past the end only fails if the limit lets it happen.
+            case REG_OP_EXIT:
+                memcpy(p_vm->stack, regs, sizeof(regs[0]) * in->depth);
+                p_vm->stack_size = in->depth;
+                p_vm->inst_pointer = in->vm_ip;
+                return budget == 0 ? ERR_OK : ERR_ILLEGAL_INSTRUCTION_ACCESS;
+
+            default:
+                assert(0 && "vm_execute_registers: Unreachable (How Did You Get Here)");
+        }
+    }
+}
+
+error vm_execute_program_registers(vvm_t* p_vm, int p_limit)
+{
+    // The register code does not map one to one onto instructions, so runs
+    // with a limit count whole blocks. Programs that cannot be translated use
+    // the threaded engine instead.
+    if (p_limit == 0 || p_vm->halt)
+        return ERR_OK;
+
+    const arena_mark_t mark = arena_mark(p_vm->arena);
+    reg_program_t program;
+    if (vm_translate_to_registers(p_vm, &program, p_limit >= 0))
+    {
+        error err = vm_execute_registers(p_vm, &program, p_limit);
+        arena_rewind(p_vm->arena, mark);
+        return err;
+    }
+    arena_rewind(p_vm->arena, mark);
+
+    return vm_execute_program_threaded(p_vm, p_limit);
+}
+
+#ifdef VVM_JIT
+
+// Machine code emitter. Stack slots are addressed as [rbx + r12*8 + disp],
+// where rbx holds the address of the stack and r12 the stack size.
+typedef struct {
+    uint8_t* code;
+    size_t size;
+    size_t capacity;
+} jit_buffer_t;
+
+typedef struct {
+    size_t at;          // Offset of the rel32 to patch.
+    uint64_t addr;      // Instruction or stub it refers to.
+    int kind;
+} jit_fixup_t;
+
+enum {
+    JIT_TO_INST,        // Native code of instruction addr.
+    JIT_TO_STUB,        // Hands instruction addr back to the interpreter.
+    JIT_TO_FAR,         // Leaves with inst_pointer = addr after a jump.
+    JIT_TO_EXIT,
+};
+
+#define JIT_RAX 0
+#define JIT_RCX 1
+#define JIT_RDX 2
+#define JIT_SLOT(n) (-8 * (int32_t)(n))     // n = 1 is the top of the stack.
+
+static void jit_byte(jit_buffer_t* p_buf, uint8_t p_byte)
+{
+    assert(p_buf->size < p_buf->capacity);
+    p_buf->code[p_buf->size++] = p_byte;
+}
+
+static void jit_bytes(jit_buffer_t* p_buf, const uint8_t* p_bytes, size_t p_count)
+{
+    for (size_t i = 0; i < p_count; ++i)
+        jit_byte(p_buf, p_bytes[i]);
+}
+
+static void jit_u32(jit_buffer_t* p_buf, uint32_t p_value)
+{
+    for (int i = 0; i < 4; ++i)
+        jit_byte(p_buf, (uint8_t)(p_value >> (8 * i)));
+}
+
+static void jit_u64(jit_buffer_t* p_buf, uint64_t p_value)
+{
+    for (int i = 0; i < 8; ++i)
+        jit_byte(p_buf, (uint8_t)(p_value >> (8 * i)));
+}
+
+// <prefix> REX <opcode> with a [rbx + r12*8 + disp32] operand.
+static void jit_slot_op(jit_buffer_t* p_buf, uint8_t p_prefix, int p_wide, const char* p_opcode, int p_reg, int32_t p_disp)
+{
+    if (p_prefix)
+        jit_byte(p_buf, p_prefix);
+    jit_byte(p_buf, (uint8_t)(0x42 | (p_wide ? 0x08 : 0) | ((p_reg >> 3) << 2)));
+    jit_bytes(p_buf, (const uint8_t*)p_opcode, strlen(p_opcode));
+    jit_byte(p_buf, (uint8_t)(0x84 | ((p_reg & 7) << 3)));
+    jit_byte(p_buf, 0xE3);
+    jit_u32(p_buf, (uint32_t)p_disp);
+}
+
+static void jit_load(jit_buffer_t* p_buf, int p_reg, int32_t p_disp)   { jit_slot_op(p_buf, 0, 1, "\x8B", p_reg, p_disp); }
+static void jit_store(jit_buffer_t* p_buf, int p_reg, int32_t p_disp)  { jit_slot_op(p_buf, 0, 1, "\x89", p_reg, p_disp); }
+static void jit_loadsd(jit_buffer_t* p_buf, int32_t p_disp)            { jit_slot_op(p_buf, 0xF2, 0, "\x0F\x10", 0, p_disp); }
+static void jit_storesd(jit_buffer_t* p_buf, int32_t p_disp)           { jit_slot_op(p_buf, 0xF2, 0, "\x0F\x11", 0, p_disp); }
+
+static void jit_jump(jit_buffer_t* p_buf, jit_fixup_t* p_fixups, size_t* p_fixups_size,
+                     const char* p_opcode, int p_kind, uint64_t p_addr)
+{
+    jit_bytes(p_buf, (const uint8_t*)p_opcode, strlen(p_opcode));
+    p_fixups[(*p_fixups_size)++] = (jit_fixup_t){ .at = p_buf->size, .addr = p_addr, .kind = p_kind };
+    jit_u32(p_buf, 0);
+}
+
+#define JIT_JMP  "\xE9"
+#define JIT_JB   "\x0F\x82"
+#define JIT_JAE  "\x0F\x83"
+#define JIT_JZ   "\x0F\x84"
+#define JIT_JNZ  "\x0F\x85"
+#define JIT_JBE  "\x0F\x86"
+
+// cmp r12, imm32
+static void jit_cmp_sp(jit_buffer_t* p_buf, uint32_t p_value)
+{
+    jit_bytes(p_buf, (const uint8_t*)"\x49\x81\xFC", 3);
+    jit_u32(p_buf, p_value);
+}
+
+// cmp rax, [r13 + memory_size]; jae to the stub of p_addr, which reports the
+// address in rax as out of bounds.
+static void jit_check_address(jit_buffer_t* p_buf, jit_fixup_t* p_fixups, size_t* p_fixups_size, uint64_t p_addr)
+{
+    jit_bytes(p_buf, (const uint8_t*)"\x49\x3B\x85", 3);
+    jit_u32(p_buf, (uint32_t)offsetof(vvm_t, memory_size));
+    jit_jump(p_buf, p_fixups, p_fixups_size, JIT_JAE, JIT_TO_STUB, p_addr);
+}
+
+// mov rcx, [r13 + memory], for the address of word rax at [rcx + rax*8].
+static void jit_load_memory(jit_buffer_t* p_buf)
+{
+    jit_bytes(p_buf, (const uint8_t*)"\x49\x8B\x8D", 3);
+    jit_u32(p_buf, (uint32_t)offsetof(vvm_t, memory));
+}
+
+// Whether fma can be compiled to vfmadd231sd, or has to be interpreted.
+static int jit_has_fma(void)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("fma");
+#else
+    return 0;
+#endif
+}
+
+int vm_jit_compile(const vvm_t* p_vm, jit_t* p_jit)
+{
+    // The entry table and the scratch memory of the compiler are allocated
+    // from the arena of p_vm, the machine code is mapped separately.
+    const uint64_t size = p_vm->program_size;
+    const size_t capacity = 256 + size * 192;
+
+    // Addresses and the stack capacity are encoded as 32 bit immediates, and
+    // slots as 32 bit displacements of 8 bytes each.
+    if (size > INT32_MAX || p_vm->stack_capacity > INT32_MAX / 8)
+        return 0;
+
+    void* memory = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return 0;
+
+    p_jit->entries = arena_alloc(p_vm->arena, sizeof(p_jit->entries[0]) * (size + 1));
+
+    jit_buffer_t buf = { .code = memory, .capacity = capacity };
+    jit_fixup_t* fixups = arena_alloc(p_vm->arena, sizeof(jit_fixup_t) * (size * 8 + 8));
+    size_t fixups_size = 0;
+    size_t* native = arena_alloc(p_vm->arena, sizeof(native[0]) * (size + 1));
+    size_t* stubs = arena_alloc(p_vm->arena, sizeof(stubs[0]) * (size + 1));
+    if (p_jit->entries == NULL || fixups == NULL || native == NULL || stubs == NULL)
+    {
+        munmap(memory, capacity);
+        return 0;
+    }
+    const uint32_t stack_capacity = (uint32_t)p_vm->stack_capacity;
+    const int has_fma = jit_has_fma();
+    size_t exit_at;
+
+#define FIX(p_opcode, p_kind, p_addr) jit_jump(&buf, fixups, &fixups_size, (p_opcode), (p_kind), (p_addr))
+#define EMIT(p_string) jit_bytes(&buf, (const uint8_t*)(p_string), sizeof(p_string) - 1)
+
+    // Entry: (vvm_t* vm, void* const* entries, uint64_t budget) -> budget.
+    EMIT("\x53\x41\x54\x41\x55\x41\x56");         // push rbx; push r12; push r13; push r14
+    EMIT("\x49\x89\xFD");                         // mov r13, rdi
+    EMIT("\x48\x8B\x9F"); jit_u32(&buf, (uint32_t)offsetof(vvm_t, stack));        // mov rbx, [rdi + stack]
+    EMIT("\x4C\x8B\xA7"); jit_u32(&buf, (uint32_t)offsetof(vvm_t, stack_size));   // mov r12, [rdi + stack_size]
+    EMIT("\x49\x89\xD6");                         // mov r14, rdx
+    EMIT("\x48\x8B\x87"); jit_u32(&buf, (uint32_t)offsetof(vvm_t, inst_pointer)); // mov rax, [rdi + inst_pointer]
+    EMIT("\xFF\x24\xC6");                         // jmp [rsi + rax*8]
+
+    for (inst_addr_t i = 0; i < size; ++i)
+    {
+        const inst_t inst = p_vm->program[i];
+        const int checked = !p_vm->verified[i];
+        const uint64_t k = inst.operand.as_u64;
+        native[i] = buf.size;
+
+        // Charge the budget; running out hands the instruction back.
+        EMIT("\x49\x83\xEE\x01");                 // sub r14, 1
+        FIX(JIT_JB, JIT_TO_STUB, i);
+
+        switch (inst.type)
+        {
+            case INST_NOP:
+                break;
+
+            case INST_PUSH:
+                if (checked) { jit_cmp_sp(&buf, stack_capacity); FIX(JIT_JAE, JIT_TO_STUB, i); }
+                EMIT("\x48\xB8"); jit_u64(&buf, k);   // mov rax, imm64
+                jit_store(&buf, JIT_RAX, 0);
+                EMIT("\x49\xFF\xC4");                 // inc r12
+                break;
+
+            case INST_DUP_REL:
+                if (k >= stack_capacity) { FIX(JIT_JMP, JIT_TO_STUB, i); break; }
+                if (checked)
+                {
+                    jit_cmp_sp(&buf, stack_capacity); FIX(JIT_JAE, JIT_TO_STUB, i);
+                    jit_cmp_sp(&buf, (uint32_t)k);        FIX(JIT_JBE, JIT_TO_STUB, i);
+                }
+                jit_load(&buf, JIT_RAX, JIT_SLOT(k + 1));
+                jit_store(&buf, JIT_RAX, 0);
+                EMIT("\x49\xFF\xC4");                 // inc r12
+                break;
+
+            case INST_SWAP:
+                if (k >= stack_capacity) { FIX(JIT_JMP, JIT_TO_STUB, i); break; }
+                if (checked) { jit_cmp_sp(&buf, (uint32_t)k); FIX(JIT_JBE, JIT_TO_STUB, i); }
+                jit_load(&buf, JIT_RAX, JIT_SLOT(1));
+                jit_load(&buf, JIT_RCX, JIT_SLOT(k + 1));
+                jit_store(&buf, JIT_RCX, JIT_SLOT(1));
+                jit_store(&buf, JIT_RAX, JIT_SLOT(k + 1));
+                break;
+
+            case INST_ADDI:
+            case INST_SUBI:
+            case INST_MULI:
+            case INST_EQ:
+                if (checked) { jit_cmp_sp(&buf, 2); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_load(&buf, JIT_RAX, JIT_SLOT(2));
+                if (inst.type == INST_ADDI)      jit_slot_op(&buf, 0, 1, "\x03", JIT_RAX, JIT_SLOT(1));
+                else if (inst.type == INST_SUBI) jit_slot_op(&buf, 0, 1, "\x2B", JIT_RAX, JIT_SLOT(1));
+                else if (inst.type == INST_MULI) jit_slot_op(&buf, 0, 1, "\x0F\xAF", JIT_RAX, JIT_SLOT(1));
+                else
+                {
+                    jit_slot_op(&buf, 0, 1, "\x3B", JIT_RAX, JIT_SLOT(1));
+                    EMIT("\x0F\x94\xC0\x0F\xB6\xC0"); // sete al; movzx eax, al
+                }
+                jit_store(&buf, JIT_RAX, JIT_SLOT(2));
+                EMIT("\x49\xFF\xCC");                 // dec r12
+                break;
+
+            case INST_DIVI:
+                if (checked) { jit_cmp_sp(&buf, 2); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_load(&buf, JIT_RCX, JIT_SLOT(1));
+                EMIT("\x48\x85\xC9");                 // test rcx, rcx
+                FIX(JIT_JZ, JIT_TO_STUB, i);
+                jit_load(&buf, JIT_RAX, JIT_SLOT(2));
+                EMIT("\x31\xD2\x48\xF7\xF1");         // xor edx, edx; div rcx
+                jit_store(&buf, JIT_RAX, JIT_SLOT(2));
+                EMIT("\x49\xFF\xCC");                 // dec r12
+                break;
+
+            case INST_ADDF:
+            case INST_SUBF:
+            case INST_MULF:
+            case INST_DIVF: {
+                static const char* const ops[] = { "\x0F\x58", "\x0F\x5C", "\x0F\x59", "\x0F\x5E" };
+                if (checked) { jit_cmp_sp(&buf, 2); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_loadsd(&buf, JIT_SLOT(2));
+                jit_slot_op(&buf, 0xF2, 0, ops[inst.type - INST_ADDF], 0, JIT_SLOT(1));
+                jit_storesd(&buf, JIT_SLOT(2));
+                EMIT("\x49\xFF\xCC");                 // dec r12
+            } break;
+
+            case INST_GEQ:
+                if (checked) { jit_cmp_sp(&buf, 2); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_loadsd(&buf, JIT_SLOT(1));
+                jit_slot_op(&buf, 0x66, 0, "\x0F\x2E", 0, JIT_SLOT(2));   // ucomisd xmm0, second
+                EMIT("\x0F\x93\xC0\x0F\xB6\xC0");     // setae al; movzx eax, al
+                jit_store(&buf, JIT_RAX, JIT_SLOT(2));
+                EMIT("\x49\xFF\xCC");                 // dec r12
+                break;
+
+            case INST_NOT:
+                if (checked) { jit_cmp_sp(&buf, 1); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_load(&buf, JIT_RAX, JIT_SLOT(1));
+                EMIT("\x48\x85\xC0\x0F\x94\xC0\x0F\xB6\xC0"); // test rax, rax; sete al; movzx eax, al
+                jit_store(&buf, JIT_RAX, JIT_SLOT(1));
+                break;
+
+            case INST_FMA:
+                if (!has_fma) { FIX(JIT_JMP, JIT_TO_STUB, i); break; }
+                if (checked) { jit_cmp_sp(&buf, 3); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_loadsd(&buf, JIT_SLOT(1));
+                jit_slot_op(&buf, 0xF2, 0, "\x0F\x10", 1, JIT_SLOT(3));    // movsd xmm1, a
+                EMIT("\xC4\xA2\xF1\xB9\x84\xE3");     // vfmadd231sd xmm0, xmm1, b
+                jit_u32(&buf, (uint32_t)JIT_SLOT(2));
+                jit_storesd(&buf, JIT_SLOT(3));
+                EMIT("\x49\x83\xEC\x02");             // sub r12, 2
+                break;
+
+            case INST_SQRTF:
+            case INST_I2F:
+                if (checked) { jit_cmp_sp(&buf, 1); FIX(JIT_JB, JIT_TO_STUB, i); }
+                if (inst.type == INST_SQRTF) jit_slot_op(&buf, 0xF2, 0, "\x0F\x51", 0, JIT_SLOT(1));  // sqrtsd xmm0, top
+                else                         jit_slot_op(&buf, 0xF2, 1, "\x0F\x2A", 0, JIT_SLOT(1));  // cvtsi2sd xmm0, top
+                jit_storesd(&buf, JIT_SLOT(1));
+                break;
+
+            // Conversions that fail give 0x8000000000000000, which is left
+            // to the interpreter to tell apart from a valid -2^63.
+            case INST_F2I:
+                if (checked) { jit_cmp_sp(&buf, 1); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_slot_op(&buf, 0xF2, 1, "\x0F\x2C", JIT_RAX, JIT_SLOT(1));  // cvttsd2si rax, top
+                EMIT("\x48\xB9"); jit_u64(&buf, UINT64_C(1) << 63);           // mov rcx, imm64
+                EMIT("\x48\x39\xC8");                 // cmp rax, rcx
+                FIX(JIT_JZ, JIT_TO_STUB, i);
+                jit_store(&buf, JIT_RAX, JIT_SLOT(1));
+                break;
+
+            case INST_NEGF:
+                if (checked) { jit_cmp_sp(&buf, 1); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_load(&buf, JIT_RAX, JIT_SLOT(1));
+                EMIT("\x48\x0F\xBA\xF8\x3F");         // btc rax, 63
+                jit_store(&buf, JIT_RAX, JIT_SLOT(1));
+                break;
+
+            case INST_MINF:
+            case INST_MAXF:
+                if (checked) { jit_cmp_sp(&buf, 2); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_loadsd(&buf, JIT_SLOT(2));
+                jit_slot_op(&buf, 0xF2, 0, inst.type == INST_MINF ? "\x0F\x5D" : "\x0F\x5F", 0, JIT_SLOT(1));   // minsd/maxsd xmm0, top
+                jit_storesd(&buf, JIT_SLOT(2));
+                EMIT("\x49\xFF\xCC");                 // dec r12
+                break;
+
+            case INST_LTF:
+                if (checked) { jit_cmp_sp(&buf, 2); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_loadsd(&buf, JIT_SLOT(1));
+                jit_slot_op(&buf, 0x66, 0, "\x0F\x2E", 0, JIT_SLOT(2));   // ucomisd xmm0, second
+                EMIT("\x0F\x97\xC0\x0F\xB6\xC0");     // seta al; movzx eax, al
+                jit_store(&buf, JIT_RAX, JIT_SLOT(2));
+                EMIT("\x49\xFF\xCC");                 // dec r12
+                break;
+
+            case INST_LTI:
+                if (checked) { jit_cmp_sp(&buf, 2); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_load(&buf, JIT_RAX, JIT_SLOT(2));
+                jit_slot_op(&buf, 0, 1, "\x3B", JIT_RAX, JIT_SLOT(1));
+                EMIT("\x0F\x9C\xC0\x0F\xB6\xC0");     // setl al; movzx eax, al
+                jit_store(&buf, JIT_RAX, JIT_SLOT(2));
+                EMIT("\x49\xFF\xCC");                 // dec r12
+                break;
+
+            case INST_JMP:
+                FIX(JIT_JMP, k < size ? JIT_TO_INST : JIT_TO_FAR, k);
+                break;
+
+            case INST_JMP_NZ:
+                if (checked) { jit_cmp_sp(&buf, 1); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_load(&buf, JIT_RAX, JIT_SLOT(1));
+                EMIT("\x49\xFF\xCC\x48\x85\xC0");     // dec r12; test rax, rax
+                FIX(JIT_JNZ, k < size ? JIT_TO_INST : JIT_TO_FAR, k);
+                break;
+
+            case INST_ADDI_IMM:
+            case INST_SUBI_IMM:
+            case INST_MULI_IMM:
+                if (checked)
+                {
+                    jit_cmp_sp(&buf, stack_capacity); FIX(JIT_JAE, JIT_TO_STUB, i);
+                    jit_cmp_sp(&buf, 1);                  FIX(JIT_JB, JIT_TO_STUB, i);
+                }
+                EMIT("\x48\xB9"); jit_u64(&buf, k);   // mov rcx, imm64
+                jit_load(&buf, JIT_RAX, JIT_SLOT(1));
+                if (inst.type == INST_ADDI_IMM)      EMIT("\x48\x01\xC8");       // add rax, rcx
+                else if (inst.type == INST_SUBI_IMM) EMIT("\x48\x29\xC8");       // sub rax, rcx
+                else                                 EMIT("\x48\x0F\xAF\xC1");   // imul rax, rcx
+                jit_store(&buf, JIT_RAX, JIT_SLOT(1));
+                break;
+
+            case INST_ADDF_IMM:
+            case INST_SUBF_IMM:
+            case INST_MULF_IMM:
+            case INST_DIVF_IMM: {
+                static const char* const ops[] = { "\xF2\x0F\x58\xC1", "\xF2\x0F\x5C\xC1", "\xF2\x0F\x59\xC1", "\xF2\x0F\x5E\xC1" };
+                if (checked)
+                {
+                    jit_cmp_sp(&buf, stack_capacity); FIX(JIT_JAE, JIT_TO_STUB, i);
+                    jit_cmp_sp(&buf, 1);                  FIX(JIT_JB, JIT_TO_STUB, i);
+                }
+                EMIT("\x48\xB8"); jit_u64(&buf, k);   // mov rax, imm64
+                EMIT("\x66\x48\x0F\x6E\xC8");         // movq xmm1, rax
+                jit_loadsd(&buf, JIT_SLOT(1));
+                jit_bytes(&buf, (const uint8_t*)ops[inst.type - INST_ADDF_IMM], 4);  // op xmm0, xmm1
+                jit_storesd(&buf, JIT_SLOT(1));
+            } break;
+
+            case INST_ADDI_REL:
+            case INST_ADDF_REL:
+                if (k >= stack_capacity) { FIX(JIT_JMP, JIT_TO_STUB, i); break; }
+                if (checked)
+                {
+                    jit_cmp_sp(&buf, stack_capacity); FIX(JIT_JAE, JIT_TO_STUB, i);
+                    jit_cmp_sp(&buf, (uint32_t)k);        FIX(JIT_JBE, JIT_TO_STUB, i);
+                }
+                if (inst.type == INST_ADDI_REL)
+                {
+                    jit_load(&buf, JIT_RAX, JIT_SLOT(1));
+                    jit_slot_op(&buf, 0, 1, "\x03", JIT_RAX, JIT_SLOT(k + 1));
+                    jit_store(&buf, JIT_RAX, JIT_SLOT(1));
+                }
+                else
+                {
+                    jit_loadsd(&buf, JIT_SLOT(1));
+                    jit_slot_op(&buf, 0xF2, 0, "\x0F\x58", 0, JIT_SLOT(k + 1));
+                    jit_storesd(&buf, JIT_SLOT(1));
+                }
+                break;
+
+            case INST_DEC_JMP_NZ:
+                if (checked)
+                {
+                    jit_cmp_sp(&buf, stack_capacity); FIX(JIT_JAE, JIT_TO_STUB, i);
+                    jit_cmp_sp(&buf, 1);                  FIX(JIT_JB, JIT_TO_STUB, i);
+                }
+                jit_load(&buf, JIT_RAX, JIT_SLOT(1));
+                EMIT("\x48\x83\xE8\x01");             // sub rax, 1
+                jit_store(&buf, JIT_RAX, JIT_SLOT(1));
+                FIX(JIT_JNZ, k < size ? JIT_TO_INST : JIT_TO_FAR, k);
+                break;
+
+            case INST_LOAD:
+                if (checked) { jit_cmp_sp(&buf, 1); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_load(&buf, JIT_RAX, JIT_SLOT(1));
+                jit_check_address(&buf, fixups, &fixups_size, i);
+                jit_load_memory(&buf);
+                EMIT("\x48\x8B\x04\xC1");             // mov rax, [rcx + rax*8]
+                jit_store(&buf, JIT_RAX, JIT_SLOT(1));
+                break;
+
+            case INST_STORE:
+                if (checked) { jit_cmp_sp(&buf, 2); FIX(JIT_JB, JIT_TO_STUB, i); }
+                jit_load(&buf, JIT_RAX, JIT_SLOT(1));
+                jit_check_address(&buf, fixups, &fixups_size, i);
+                jit_load(&buf, JIT_RDX, JIT_SLOT(2));
+                jit_load_memory(&buf);
+                EMIT("\x48\x89\x14\xC1");             // mov [rcx + rax*8], rdx
+                EMIT("\x49\x83\xEC\x02");             // sub r12, 2
+                break;
+
+            case INST_LOAD_IMM:
+                if (checked) { jit_cmp_sp(&buf, stack_capacity); FIX(JIT_JAE, JIT_TO_STUB, i); }
+                EMIT("\x48\xB8"); jit_u64(&buf, k);   // mov rax, imm64
+                if (checked) jit_check_address(&buf, fixups, &fixups_size, i);
+                jit_load_memory(&buf);
+                EMIT("\x48\x8B\x04\xC1");             // mov rax, [rcx + rax*8]
+                jit_store(&buf, JIT_RAX, 0);
+                EMIT("\x49\xFF\xC4");                 // inc r12
+                break;
+
+            case INST_STORE_IMM:
+                if (checked)
+                {
+                    jit_cmp_sp(&buf, stack_capacity); FIX(JIT_JAE, JIT_TO_STUB, i);
+                    jit_cmp_sp(&buf, 1);                  FIX(JIT_JB, JIT_TO_STUB, i);
+                }
+                EMIT("\x48\xB8"); jit_u64(&buf, k);   // mov rax, imm64
+                if (checked) jit_check_address(&buf, fixups, &fixups_size, i);
+                jit_load(&buf, JIT_RDX, JIT_SLOT(1));
+                jit_load_memory(&buf);
+                EMIT("\x48\x89\x14\xC1");             // mov [rcx + rax*8], rdx
+                EMIT("\x49\xFF\xCC");                 // dec r12
+                break;
+
+            // Everything else, like halt, print_debug, output, the bulk
+            // memory instructions and natives, is interpreted.
+            case INST_HALT:
+            case INST_PRINT_DEBUG:
+            case INST_OUT:
+            case INST_OUTI:
+            case INST_MEMCPY:
+            case INST_MEMSET:
+            case INST_NATIVE:
+            case INST_VADDF:
+            case INST_VSUBF:
+            case INST_VMULF:
+            case INST_VDIVF:
+            case INST_VADDI:
+            case INST_VSUBI:
+            case INST_VMULI:
+            case INST_VDIVI:
+            case INST_VSUMF:
+            case INST_VSUMI:
+            case INST_VBCAST:
+            case NUMBER_OF_INSTS:
+            default:
+                FIX(JIT_JMP, JIT_TO_STUB, i);
+                break;
+        }
+    }
+
+    // Running off the end of the program.
+    native[size] = buf.size;
+    EMIT("\xB8"); jit_u32(&buf, (uint32_t)size);  // mov eax, size
+    FIX(JIT_JMP, JIT_TO_EXIT, 0);
+
+    // Stubs hand an instruction back to the interpreter without charging it.
+    for (inst_addr_t i = 0; i < size; ++i)
+    {
+        stubs[i] = buf.size;
+        EMIT("\x49\xFF\xC6\xB8");                 // inc r14; mov eax, i
+        jit_u32(&buf, (uint32_t)i);
+        FIX(JIT_JMP, JIT_TO_EXIT, 0);
+    }
+
+    exit_at = buf.size;
+    EMIT("\x49\x89\x85"); jit_u32(&buf, (uint32_t)offsetof(vvm_t, inst_pointer));  // mov [r13 + inst_pointer], rax
+    EMIT("\x4D\x89\xA5"); jit_u32(&buf, (uint32_t)offsetof(vvm_t, stack_size));    // mov [r13 + stack_size], r12
+    EMIT("\x4C\x89\xF0");                         // mov rax, r14
+    EMIT("\x41\x5E\x41\x5D\x41\x5C\x5B\xC3");     // pop r14; pop r13; pop r12; pop rbx; ret
+
+    // Far jumps get a stub each, placed after everything else.
+    for (size_t f = 0; f < fixups_size; ++f)
+    {
+        jit_fixup_t* fixup = &fixups[f];
+        size_t target = 0;
+
+        switch (fixup->kind)
+        {
+            case JIT_TO_INST: target = native[fixup->addr]; break;
+            case JIT_TO_STUB: target = stubs[fixup->addr];  break;
+            case JIT_TO_EXIT: target = exit_at;             break;
+            case JIT_TO_FAR:
+                target = buf.size;
+                EMIT("\xB8"); jit_u32(&buf, (uint32_t)fixup->addr);   // mov eax, addr
+                EMIT("\xE9"); jit_u32(&buf, (uint32_t)(exit_at - (buf.size + 4)));
+                break;
+            default:
+                assert(0 && "vm_jit_compile: Unreachable (How Did You Get Here)");
+        }
+
+        const uint32_t rel = (uint32_t)(target - (fixup->at + 4));
+        memcpy(buf.code + fixup->at, &rel, sizeof(rel));
+    }
+
+#undef EMIT
+#undef FIX
+
+    if (mprotect(memory, capacity, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, capacity);
+        return 0;
+    }
+
+    p_jit->code = memory;
+    p_jit->capacity = capacity;
+    p_jit->program_size = size;
+    for (inst_addr_t i = 0; i < size; ++i)
+        p_jit->entries[i] = buf.code + native[i];
+
+    return 1;
+}
+
+void vm_jit_free(jit_t* p_jit)
+{
+    if (p_jit->code != NULL)
+        munmap(p_jit->code, p_jit->capacity);
+    p_jit->code = NULL;
+}
+
+error vm_execute_jit(vvm_t* p_vm, const jit_t* p_jit, int p_limit)
+{
+    // Native code runs until it reaches an instruction it does not handle, a
+    // check that might fail, or the end of the budget. It then leaves with the
+    // exact inst_pointer and stack_size, and vm_execute_inst takes over for
+    // one instruction, reporting any error exactly like the interpreter.
+    typedef uint64_t (*jit_entry_t)(vvm_t*, void* const*, uint64_t);
+    jit_entry_t entry;
+    void* code = p_jit->code;
+    memcpy(&entry, &code, sizeof(entry));
+
+    uint64_t budget = p_limit < 0 ? UINT64_MAX : (uint64_t)p_limit;
+
+    while (budget > 0 && !p_vm->halt)
+    {
+        if (p_vm->inst_pointer < p_jit->program_size)
+        {
+            budget = entry(p_vm, p_jit->entries, budget);
+            if (budget == 0)
+                break;
+        }
+
+        error err = vm_execute_inst(p_vm);
+        if (err != ERR_OK)
+            return err;
+        budget--;
+    }
+
+    return ERR_OK;
+}
+
+#endif // VVM_JIT
+
+error vm_execute_program_jit(vvm_t* p_vm, int p_limit)
+{
+    // Interprets until backward jumps show a hot loop, then compiles the whole
+    // program and continues natively. Without JIT support this is the threaded
+    // engine.
+#ifdef VVM_JIT
+    uint64_t budget = p_limit < 0 ? UINT64_MAX : (uint64_t)p_limit;
+    uint64_t backward_jumps = 0;
+
+    while (budget > 0 && !p_vm->halt && backward_jumps < VVM_JIT_THRESHOLD)
+    {
+        const inst_addr_t ip = p_vm->inst_pointer;
+        error err = vm_execute_inst(p_vm);
+        if (err != ERR_OK)
+            return err;
+        budget--;
+
+        if (p_vm->inst_pointer <= ip)
+            backward_jumps++;
+    }
+
+    if (budget == 0 || p_vm->halt)
+        return ERR_OK;
+
+    const arena_mark_t mark = arena_mark(p_vm->arena);
+    jit_t jit;
+    if (vm_jit_compile(p_vm, &jit))
+    {
+        error err = vm_execute_jit(p_vm, &jit, budget == UINT64_MAX ? -1 : (int)budget);
+        vm_jit_free(&jit);
+        arena_rewind(p_vm->arena, mark);
+        return err;
+    }
+    arena_rewind(p_vm->arena, mark);
+
+    return vm_execute_program_threaded(p_vm, budget == UINT64_MAX ? -1 : (int)budget);
+#else
+    return vm_execute_program_threaded(p_vm, p_limit);
+#endif
+}
+
+// Opcode of the compact layout for instructions that are handed to
+// vm_execute_inst: halt, print_debug, illegal instructions and jumps out of
+// the program. It is also the opcode past the last instruction.
+#define VVM_COMPACT_SLOW NUMBER_OF_INSTS
+
+error vm_compact_program(const vvm_t* p_vm, compact_program_t* p_program)
+{
+    // The layout is allocated from the arena of p_vm. Jump targets are packed
+    // into 32 bits, so the program must have fewer than UINT32_MAX instructions.
+    const uint64_t size = p_vm->program_size;
+    uint64_t k = 0;
+
+    assert(size < UINT32_MAX);
+    p_program->ops = arena_alloc(p_vm->arena, size + 1);
+    p_program->operands = arena_alloc(p_vm->arena, sizeof(p_program->operands[0]) * (size + 1));
+    p_program->operand_index = arena_alloc(p_vm->arena, sizeof(p_program->operand_index[0]) * (size + 1));
+    if (p_program->ops == NULL || p_program->operands == NULL || p_program->operand_index == NULL)
+        return ERR_OUT_OF_MEMORY;
+
+    for (inst_addr_t i = 0; i < size; ++i)
+    {
+        const inst_type type = p_vm->program[i].type;
+
+        p_program->operand_index[i] = k;
+        if (type >= NUMBER_OF_INSTS || type == INST_HALT || type == INST_PRINT_DEBUG)
+            p_program->ops[i] = VVM_COMPACT_SLOW;
+        else
+            p_program->ops[i] = type;
+
+        if (type < NUMBER_OF_INSTS && inst_has_operand(type))
+            p_program->operands[k++] = p_vm->program[i].operand;
+    }
+    p_program->operand_index[size] = k;
+    p_program->ops[size] = VVM_COMPACT_SLOW;
+    p_program->program_size = size;
+    p_program->operands_size = k;
+
+    // Jumps carry the operand index of their target next to it, so taking a
+    // jump never touches operand_index.
+    for (inst_addr_t i = 0; i < size; ++i)
+    {
+        if (p_vm->program[i].type >= NUMBER_OF_INSTS || !inst_is_jump(p_vm->program[i].type))
+            continue;
+
+        const uint64_t target = p_vm->program[i].operand.as_u64;
+        word_t* operand = &p_program->operands[p_program->operand_index[i]];
+        if (target < size)
+            operand->as_u64 = (uint64_t)p_program->operand_index[target] << 32 | target;
+        else
+            p_program->ops[i] = VVM_COMPACT_SLOW;
+    }
+    return ERR_OK;
+}
+
+error vm_execute_compact(vvm_t* p_vm, const compact_program_t* p_program, int p_limit)
+{
+    // Same contract as vm_execute_program, over the layout produced by
+    // vm_compact_program from the program currently loaded into p_vm.
+    if (p_limit == 0 || p_vm->halt)
+        return ERR_OK;
+
+    const uint8_t* ops = p_program->ops;
+    const word_t* operands = p_program->operands;
+    const uint64_t size = p_program->program_size;
+
+    word_t* stack = p_vm->stack;
+    const uint64_t capacity = p_vm->stack_capacity;
+    word_t* const memory = p_vm->memory;
+    const uint64_t memory_size = p_vm->memory_size;
+    uint64_t sp = p_vm->stack_size;
+    inst_addr_t ip = p_vm->inst_pointer;
+    uint64_t budget = p_limit < 0 ? UINT64_MAX : (uint64_t)p_limit;
+    error err = ERR_OK;
+
+    if (ip >= size)
+        return ERR_ILLEGAL_INSTRUCTION_ACCESS;
+
+    uint64_t k = p_program->operand_index[ip];
+
+    for (; budget > 0; --budget)
+    {
+        switch (ops[ip])
+        {
+            case INST_NOP:
+                ip++;
+                break;
+
+            case INST_PUSH:
+                if (sp >= capacity)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                stack[sp++] = operands[k++];
+                ip++;
+                break;
+
+            case INST_DUP_REL:
+                if (sp >= capacity)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                if (operands[k].as_u64 >= sp)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                stack[sp] = stack[sp - 1 - operands[k++].as_u64];
+                sp++;
+                ip++;
+                break;
+
+            case INST_SWAP:
+                if (operands[k].as_u64 >= sp)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                {
+                    const uint64_t b = sp - 1 - operands[k++].as_u64;
+                    word_t t = stack[sp - 1];
+                    stack[sp - 1] = stack[b];
+                    stack[b] = t;
+                }
+                ip++;
+                break;
+
+#define VVM_COMPACT_BINARY(p_type, p_field, p_op)   \
+            case p_type:                            \
+                if (sp < 2)                         \
+                {                                   \
+                    err = ERR_STACK_UNDERFLOW;      \
+                    goto done;                      \
+                }                                   \
+                stack[sp - 2].p_field p_op stack[sp - 1].p_field; \
+                sp--;                               \
+                ip++;                               \
+                break;
+
+            VVM_COMPACT_BINARY(INST_ADDI, as_u64, +=)
+            VVM_COMPACT_BINARY(INST_SUBI, as_u64, -=)
+            VVM_COMPACT_BINARY(INST_MULI, as_u64, *=)
+            VVM_COMPACT_BINARY(INST_ADDF, as_f64, +=)
+            VVM_COMPACT_BINARY(INST_SUBF, as_f64, -=)
+            VVM_COMPACT_BINARY(INST_MULF, as_f64, *=)
+            VVM_COMPACT_BINARY(INST_DIVF, as_f64, /=)
+#undef VVM_COMPACT_BINARY
+
+            case INST_DIVI:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (stack[sp - 1].as_u64 == 0)
+                {
+                    err = ERR_DIV_BY_ZERO;
+                    goto done;
+                }
+                stack[sp - 2].as_u64 /= stack[sp - 1].as_u64;
+                sp--;
+                ip++;
+                break;
+
+            case INST_JMP:
+                ip = operands[k].as_u64 & UINT32_MAX;
+                k = operands[k].as_u64 >> 32;
+                break;
+
+            case INST_JMP_NZ:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (stack[--sp].as_u64)
+                {
+                    ip = operands[k].as_u64 & UINT32_MAX;
+                    k = operands[k].as_u64 >> 32;
+                }
+                else
+                {
+                    ip++;
+                    k++;
+                }
+                break;
+
+            case INST_EQ:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                stack[sp - 2].as_u64 = stack[sp - 2].as_u64 == stack[sp - 1].as_u64;
+                sp--;
+                ip++;
+                break;
+
+            case INST_NOT:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                stack[sp - 1].as_u64 = !stack[sp - 1].as_u64;
+                ip++;
+                break;
+
+            case INST_GEQ:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                stack[sp - 2].as_u64 = stack[sp - 1].as_f64 >= stack[sp - 2].as_f64;
+                sp--;
+                ip++;
+                break;
+
+#define VVM_COMPACT_IMMEDIATE(p_type, p_field, p_op) \
+            case p_type:                            \
+                if (sp >= capacity)                 \
+                {                                   \
+                    err = ERR_STACK_OVERFLOW;       \
+                    goto done;                      \
+                }                                   \
+                if (sp < 1)                         \
+                {                                   \
+                    stack[sp++] = operands[k];      \
+                    err = ERR_STACK_UNDERFLOW;      \
+                    goto done;                      \
+                }                                   \
+                stack[sp - 1].p_field p_op operands[k++].p_field; \
+                ip++;                               \
+                break;
+
+            VVM_COMPACT_IMMEDIATE(INST_ADDI_IMM, as_u64, +=)
+            VVM_COMPACT_IMMEDIATE(INST_SUBI_IMM, as_u64, -=)
+            VVM_COMPACT_IMMEDIATE(INST_MULI_IMM, as_u64, *=)
+            VVM_COMPACT_IMMEDIATE(INST_ADDF_IMM, as_f64, +=)
+            VVM_COMPACT_IMMEDIATE(INST_SUBF_IMM, as_f64, -=)
+            VVM_COMPACT_IMMEDIATE(INST_MULF_IMM, as_f64, *=)
+            VVM_COMPACT_IMMEDIATE(INST_DIVF_IMM, as_f64, /=)
+#undef VVM_COMPACT_IMMEDIATE
+
+#define VVM_COMPACT_RELATIVE(p_type, p_field)       \
+            case p_type:                            \
+                if (sp >= capacity)                 \
+                {                                   \
+                    err = ERR_STACK_OVERFLOW;       \
+                    goto done;                      \
+                }                                   \
+                if (operands[k].as_u64 >= sp)       \
+                {                                   \
+                    err = ERR_STACK_UNDERFLOW;      \
+                    goto done;                      \
+                }                                   \
+                stack[sp - 1].p_field += stack[sp - 1 - operands[k++].as_u64].p_field; \
+                ip++;                               \
+                break;
+
+            VVM_COMPACT_RELATIVE(INST_ADDI_REL, as_u64)
+            VVM_COMPACT_RELATIVE(INST_ADDF_REL, as_f64)
+#undef VVM_COMPACT_RELATIVE
+
+            case INST_DEC_JMP_NZ:
+                if (sp >= capacity)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                if (sp < 1)
+                {
+                    stack[sp++] = (word_t){ .as_u64 = 1 };
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (--stack[sp - 1].as_u64)
+                {
+                    ip = operands[k].as_u64 & UINT32_MAX;
+                    k = operands[k].as_u64 >> 32;
+                }
+                else
+                {
+                    ip++;
+                    k++;
+                }
+                break;
+
+            case INST_OUT:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                vm_channel_word(&p_vm->channel, stack[--sp]);
+                ip++;
+                break;
+
+            case INST_OUTI:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                vm_channel_decimal(&p_vm->channel, stack[--sp].as_i64);
+                ip++;
+                break;
+
+            case INST_VADDF:
+            case INST_VSUBF:
+            case INST_VMULF:
+            case INST_VDIVF:
+            case INST_VADDI:
+            case INST_VSUBI:
+            case INST_VMULI:
+            case INST_VDIVI:
+            case INST_VSUMF:
+            case INST_VSUMI:
+            case INST_VBCAST:
+                err = vm_execute_vector(p_vm->vector, (inst_type)ops[ip], operands[k].as_u64, stack, &sp, capacity);
+                if (err != ERR_OK)
+                    goto done;
+                k++;
+                ip++;
+                break;
+
+            case INST_NATIVE:
+                err = vm_execute_native(p_vm->natives, operands[k].as_u64, stack, &sp, capacity);
+                if (err != ERR_OK)
+                    goto done;
+                k++;
+                ip++;
+                break;
+
+            case INST_FMA:
+                if (sp < 3)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                stack[sp - 3].as_f64 = fma(stack[sp - 3].as_f64, stack[sp - 2].as_f64, stack[sp - 1].as_f64);
+                sp -= 2;
+                ip++;
+                break;
+
+            case INST_SQRTF:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                stack[sp - 1].as_f64 = sqrt(stack[sp - 1].as_f64);
+                ip++;
+                break;
+
+            case INST_I2F:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                stack[sp - 1].as_f64 = (double)stack[sp - 1].as_i64;
+                ip++;
+                break;
+
+            case INST_F2I:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (!vm_float_fits_int(stack[sp - 1].as_f64))
+                {
+                    err = ERR_ILLEGAL_OPERAND;
+                    goto done;
+                }
+                stack[sp - 1].as_i64 = (int64_t)stack[sp - 1].as_f64;
+                ip++;
+                break;
+
+            case INST_NEGF:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                stack[sp - 1].as_u64 ^= UINT64_C(1) << 63;
+                ip++;
+                break;
+
+            case INST_MINF:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (!(stack[sp - 2].as_f64 < stack[sp - 1].as_f64))
+                    stack[sp - 2] = stack[sp - 1];
+                sp--;
+                ip++;
+                break;
+
+            case INST_MAXF:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (!(stack[sp - 2].as_f64 > stack[sp - 1].as_f64))
+                    stack[sp - 2] = stack[sp - 1];
+                sp--;
+                ip++;
+                break;
+
+            case INST_LTF:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                stack[sp - 2].as_u64 = stack[sp - 2].as_f64 < stack[sp - 1].as_f64;
+                sp--;
+                ip++;
+                break;
+
+            case INST_LTI:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                stack[sp - 2].as_u64 = stack[sp - 2].as_i64 < stack[sp - 1].as_i64;
+                sp--;
+                ip++;
+                break;
+
+            case INST_LOAD:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (stack[sp - 1].as_u64 >= memory_size)
+                {
+                    err = ERR_ILLEGAL_MEMORY_ACCESS;
+                    goto done;
+                }
+                stack[sp - 1] = memory[stack[sp - 1].as_u64];
+                ip++;
+                break;
+
+            case INST_STORE:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (stack[sp - 1].as_u64 >= memory_size)
+                {
+                    err = ERR_ILLEGAL_MEMORY_ACCESS;
+                    goto done;
+                }
+                memory[stack[sp - 1].as_u64] = stack[sp - 2];
+                sp -= 2;
+                ip++;
+                break;
+
+            case INST_LOAD_IMM:
+                if (sp >= capacity)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                if (operands[k].as_u64 >= memory_size)
+                {
+                    stack[sp++] = operands[k];
+                    err = ERR_ILLEGAL_MEMORY_ACCESS;
+                    goto done;
+                }
+                stack[sp++] = memory[operands[k++].as_u64];
+                ip++;
+                break;
+
+            case INST_STORE_IMM:
+                if (sp >= capacity)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                if (sp < 1)
+                {
+                    stack[sp++] = operands[k];
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (operands[k].as_u64 >= memory_size)
+                {
+                    stack[sp++] = operands[k];
+                    err = ERR_ILLEGAL_MEMORY_ACCESS;
+                    goto done;
+                }
+                memory[operands[k++].as_u64] = stack[--sp];
+                ip++;
+                break;
+
+            // memcpy and memset spend their time copying, not dispatching.
+            case VVM_COMPACT_SLOW:
+            default:
+                p_vm->stack_size = sp;
+                p_vm->inst_pointer = ip;
+                err = vm_execute_inst(p_vm);
+                sp = p_vm->stack_size;
+                ip = p_vm->inst_pointer;
+                if (err != ERR_OK || p_vm->halt)
+                    goto done;
+
+                // A jump out of the program fails on the next instruction.
+                if (ip >= size)
+                {
+                    if (budget > 1)
+                        err = ERR_ILLEGAL_INSTRUCTION_ACCESS;
+                    goto done;
+                }
+                k = p_program->operand_index[ip];
+                break;
+        }
+    }
+
+done:
+    p_vm->stack_size = sp;
+    p_vm->inst_pointer = ip;
+    return err;
+}
+
+error vm_execute_program_compact(vvm_t* p_vm, int p_limit)
+{
+    if (p_vm->program_size >= UINT32_MAX)
+        return vm_execute_program(p_vm, p_limit);
+
+    const arena_mark_t mark = arena_mark(p_vm->arena);
+    compact_program_t program;
+    error err = vm_compact_program(p_vm, &program);
+    if (err == ERR_OK)
+        err = vm_execute_compact(p_vm, &program, p_limit);
+    arena_rewind(p_vm->arena, mark);
+
+    return err;
+}
+
+// The tos engine runs the compact layout with the top of the stack kept in a
+// local variable, so most instructions touch at most one other stack slot.
+// stack[sp - 1] is stale while sp > 0 and is only written back before
+// anything that looks at the stack in memory. Pushing onto an empty stack
+// writes the stale tos into stack[0], which is about to be stale anyway.
+#define VVM_TOS_SPILL() do { if (sp > 0) stack[sp - 1] = tos; } while (0)
+#define VVM_TOS_FILL() do { if (sp > 0) tos = stack[sp - 1]; } while (0)
+#define VVM_TOS_PUSH(p_value) do { stack[sp - (sp > 0)] = tos; tos = (p_value); sp++; } while (0)
+#define VVM_TOS_POP() do { sp--; tos = stack[sp - (sp > 0)]; } while (0)
+
+// Element p_depth below the top of the stack.
+#define VVM_TOS_AT(p_depth) ((p_depth) == 0 ? tos : stack[sp - 1 - (p_depth)])
+
+error vm_execute_tos(vvm_t* p_vm, const compact_program_t* p_program, int p_limit)
+{
+    // Same contract as vm_execute_compact, and the same checks in the same
+    // order, so it fails exactly where the other engines do.
+    if (p_limit == 0 || p_vm->halt)
+        return ERR_OK;
+
+    const uint8_t* ops = p_program->ops;
+    const word_t* operands = p_program->operands;
+    const uint64_t size = p_program->program_size;
+
+    word_t* stack = p_vm->stack;
+    const uint64_t capacity = p_vm->stack_capacity;
+    word_t* const memory = p_vm->memory;
+    const uint64_t memory_size = p_vm->memory_size;
+    uint64_t sp = p_vm->stack_size;
+    inst_addr_t ip = p_vm->inst_pointer;
+    uint64_t budget = p_limit < 0 ? UINT64_MAX : (uint64_t)p_limit;
+    error err = ERR_OK;
+    word_t tos = {0};
+
+    if (ip >= size)
+        return ERR_ILLEGAL_INSTRUCTION_ACCESS;
+
+    uint64_t k = p_program->operand_index[ip];
+    VVM_TOS_FILL();
+
+    for (; budget > 0; --budget)
+    {
+        switch (ops[ip])
+        {
+            case INST_NOP:
+                ip++;
+                break;
+
+            case INST_PUSH:
+                if (sp >= capacity)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                VVM_TOS_PUSH(operands[k++]);
+                ip++;
+                break;
+
+            case INST_DUP_REL:
+                if (sp >= capacity)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                if (operands[k].as_u64 >= sp)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                {
+                    const word_t value = VVM_TOS_AT(operands[k].as_u64);
+                    k++;
+                    VVM_TOS_PUSH(value);
+                }
+                ip++;
+                break;
+
+            case INST_SWAP:
+                if (operands[k].as_u64 >= sp)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (operands[k].as_u64 > 0)
+                {
+                    const uint64_t b = sp - 1 - operands[k].as_u64;
+                    const word_t t = stack[b];
+                    stack[b] = tos;
+                    tos = t;
+                }
+                k++;
+                ip++;
+                break;
+
+#define VVM_TOS_BINARY(p_type, p_field, p_op)       \
+            case p_type:                            \
+                if (sp < 2)                         \
+                {                                   \
+                    err = ERR_STACK_UNDERFLOW;      \
+                    goto done;                      \
+                }                                   \
+                tos.p_field = stack[sp - 2].p_field p_op tos.p_field; \
+                sp--;                               \
+                ip++;                               \
+                break;
+
+            VVM_TOS_BINARY(INST_ADDI, as_u64, +)
+            VVM_TOS_BINARY(INST_SUBI, as_u64, -)
+            VVM_TOS_BINARY(INST_MULI, as_u64, *)
+            VVM_TOS_BINARY(INST_ADDF, as_f64, +)
+            VVM_TOS_BINARY(INST_SUBF, as_f64, -)
+            VVM_TOS_BINARY(INST_MULF, as_f64, *)
+            VVM_TOS_BINARY(INST_DIVF, as_f64, /)
+#undef VVM_TOS_BINARY
+
+            case INST_DIVI:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (tos.as_u64 == 0)
+                {
+                    err = ERR_DIV_BY_ZERO;
+                    goto done;
+                }
+                tos.as_u64 = stack[sp - 2].as_u64 / tos.as_u64;
+                sp--;
+                ip++;
+                break;
+
+            case INST_JMP:
+                ip = operands[k].as_u64 & UINT32_MAX;
+                k = operands[k].as_u64 >> 32;
+                break;
+
+            case INST_JMP_NZ:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                {
+                    const uint64_t condition = tos.as_u64;
+                    VVM_TOS_POP();
+                    if (condition)
+                    {
+                        ip = operands[k].as_u64 & UINT32_MAX;
+                        k = operands[k].as_u64 >> 32;
+                    }
+                    else
+                    {
+                        ip++;
+                        k++;
+                    }
+                }
+                break;
+
+            case INST_EQ:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                tos.as_u64 = stack[sp - 2].as_u64 == tos.as_u64;
+                sp--;
+                ip++;
+                break;
+
+            case INST_NOT:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                tos.as_u64 = !tos.as_u64;
+                ip++;
+                break;
+
+            case INST_GEQ:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                tos.as_u64 = tos.as_f64 >= stack[sp - 2].as_f64;
+                sp--;
+                ip++;
+                break;
+
+#define VVM_TOS_IMMEDIATE(p_type, p_field, p_op)    \
+            case p_type:                            \
+                if (sp >= capacity)                 \
+                {                                   \
+                    err = ERR_STACK_OVERFLOW;       \
+                    goto done;                      \
+                }                                   \
+                if (sp < 1)                         \
+                {                                   \
+                    VVM_TOS_PUSH(operands[k]);      \
+                    err = ERR_STACK_UNDERFLOW;      \
+                    goto done;                      \
+                }                                   \
+                tos.p_field p_op operands[k++].p_field; \
+                ip++;                               \
+                break;
+
+            VVM_TOS_IMMEDIATE(INST_ADDI_IMM, as_u64, +=)
+            VVM_TOS_IMMEDIATE(INST_SUBI_IMM, as_u64, -=)
+            VVM_TOS_IMMEDIATE(INST_MULI_IMM, as_u64, *=)
+            VVM_TOS_IMMEDIATE(INST_ADDF_IMM, as_f64, +=)
+            VVM_TOS_IMMEDIATE(INST_SUBF_IMM, as_f64, -=)
+            VVM_TOS_IMMEDIATE(INST_MULF_IMM, as_f64, *=)
+            VVM_TOS_IMMEDIATE(INST_DIVF_IMM, as_f64, /=)
+#undef VVM_TOS_IMMEDIATE
+
+#define VVM_TOS_RELATIVE(p_type, p_field)           \
+            case p_type:                            \
+                if (sp >= capacity)                 \
+                {                                   \
+                    err = ERR_STACK_OVERFLOW;       \
+                    goto done;                      \
+                }                                   \
+                if (operands[k].as_u64 >= sp)       \
+                {                                   \
+                    err = ERR_STACK_UNDERFLOW;      \
+                    goto done;                      \
+                }                                   \
+                tos.p_field += VVM_TOS_AT(operands[k].as_u64).p_field; \
+                k++;                                \
+                ip++;                               \
+                break;
+
+            VVM_TOS_RELATIVE(INST_ADDI_REL, as_u64)
+            VVM_TOS_RELATIVE(INST_ADDF_REL, as_f64)
+#undef VVM_TOS_RELATIVE
+
+            case INST_DEC_JMP_NZ:
+                if (sp >= capacity)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                if (sp < 1)
+                {
+                    VVM_TOS_PUSH((word_t){ .as_u64 = 1 });
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (--tos.as_u64)
+                {
+                    ip = operands[k].as_u64 & UINT32_MAX;
+                    k = operands[k].as_u64 >> 32;
+                }
+                else
+                {
+                    ip++;
+                    k++;
+                }
+                break;
+
+            case INST_OUT:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                vm_channel_word(&p_vm->channel, tos);
+                VVM_TOS_POP();
+                ip++;
+                break;
+
+            case INST_OUTI:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                vm_channel_decimal(&p_vm->channel, tos.as_i64);
+                VVM_TOS_POP();
+                ip++;
+                break;
+
+            case INST_VADDF:
+            case INST_VSUBF:
+            case INST_VMULF:
+            case INST_VDIVF:
+            case INST_VADDI:
+            case INST_VSUBI:
+            case INST_VMULI:
+            case INST_VDIVI:
+            case INST_VSUMF:
+            case INST_VSUMI:
+            case INST_VBCAST:
+                // sp is copied so that its address is never taken, which
+                // would keep it in memory for every other instruction.
+                VVM_TOS_SPILL();
+                {
+                    uint64_t vector_sp = sp;
+                    err = vm_execute_vector(p_vm->vector, (inst_type)ops[ip], operands[k].as_u64, stack, &vector_sp, capacity);
+                    sp = vector_sp;
+                }
+                if (err != ERR_OK)
+                    goto done;
+                VVM_TOS_FILL();
+                k++;
+                ip++;
+                break;
+
+            case INST_NATIVE:
+                VVM_TOS_SPILL();
+                {
+                    uint64_t native_sp = sp;
+                    err = vm_execute_native(p_vm->natives, operands[k].as_u64, stack, &native_sp, capacity);
+                    sp = native_sp;
+                }
+                if (err != ERR_OK)
+                    goto done;
+                VVM_TOS_FILL();
+                k++;
+                ip++;
+                break;
+
+            case INST_FMA:
+                if (sp < 3)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                tos.as_f64 = fma(stack[sp - 3].as_f64, stack[sp - 2].as_f64, tos.as_f64);
+                sp -= 2;
+                ip++;
+                break;
+
+            case INST_SQRTF:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                tos.as_f64 = sqrt(tos.as_f64);
+                ip++;
+                break;
+
+            case INST_I2F:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                tos.as_f64 = (double)tos.as_i64;
+                ip++;
+                break;
+
+            case INST_F2I:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (!vm_float_fits_int(tos.as_f64))
+                {
+                    err = ERR_ILLEGAL_OPERAND;
+                    goto done;
+                }
+                tos.as_i64 = (int64_t)tos.as_f64;
+                ip++;
+                break;
+
+            case INST_NEGF:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                tos.as_u64 ^= UINT64_C(1) << 63;
+                ip++;
+                break;
+
+            case INST_MINF:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (stack[sp - 2].as_f64 < tos.as_f64)
+                    tos = stack[sp - 2];
+                sp--;
+                ip++;
+                break;
+
+            case INST_MAXF:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (stack[sp - 2].as_f64 > tos.as_f64)
+                    tos = stack[sp - 2];
+                sp--;
+                ip++;
+                break;
+
+            case INST_LTF:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                tos.as_u64 = stack[sp - 2].as_f64 < tos.as_f64;
+                sp--;
+                ip++;
+                break;
+
+            case INST_LTI:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                tos.as_u64 = stack[sp - 2].as_i64 < tos.as_i64;
+                sp--;
+                ip++;
+                break;
+
+            case INST_LOAD:
+                if (sp < 1)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (tos.as_u64 >= memory_size)
+                {
+                    err = ERR_ILLEGAL_MEMORY_ACCESS;
+                    goto done;
+                }
+                tos = memory[tos.as_u64];
+                ip++;
+                break;
+
+            case INST_STORE:
+                if (sp < 2)
+                {
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (tos.as_u64 >= memory_size)
+                {
+                    err = ERR_ILLEGAL_MEMORY_ACCESS;
+                    goto done;
+                }
+                memory[tos.as_u64] = stack[sp - 2];
+                sp -= 2;
+                VVM_TOS_FILL();
+                ip++;
+                break;
+
+            case INST_LOAD_IMM:
+                if (sp >= capacity)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                if (operands[k].as_u64 >= memory_size)
+                {
+                    VVM_TOS_PUSH(operands[k]);
+                    err = ERR_ILLEGAL_MEMORY_ACCESS;
+                    goto done;
+                }
+                VVM_TOS_PUSH(memory[operands[k++].as_u64]);
+                ip++;
+                break;
+
+            case INST_STORE_IMM:
+                if (sp >= capacity)
+                {
+                    err = ERR_STACK_OVERFLOW;
+                    goto done;
+                }
+                if (sp < 1)
+                {
+                    VVM_TOS_PUSH(operands[k]);
+                    err = ERR_STACK_UNDERFLOW;
+                    goto done;
+                }
+                if (operands[k].as_u64 >= memory_size)
+                {
+                    VVM_TOS_PUSH(operands[k]);
+                    err = ERR_ILLEGAL_MEMORY_ACCESS;
+                    goto done;
+                }
+                memory[operands[k++].as_u64] = tos;
+                VVM_TOS_POP();
+                ip++;
+                break;
+
+            // memcpy and memset, like everything else without a case of its
+            // own, look at the stack in memory.
+            case VVM_COMPACT_SLOW:
+            default:
+                VVM_TOS_SPILL();
+                p_vm->stack_size = sp;
+                p_vm->inst_pointer = ip;
+                err = vm_execute_inst(p_vm);
+                sp = p_vm->stack_size;
+                ip = p_vm->inst_pointer;
+                VVM_TOS_FILL();
+                if (err != ERR_OK || p_vm->halt)
+                    goto done;
+
+                // A jump out of the program fails on the next instruction.
+                if (ip >= size)
+                {
+                    if (budget > 1)
+                        err = ERR_ILLEGAL_INSTRUCTION_ACCESS;
+                    goto done;
+                }
+                k = p_program->operand_index[ip];
+                break;
+        }
+    }
+
+done:
+    VVM_TOS_SPILL();
+    p_vm->stack_size = sp;
+    p_vm->inst_pointer = ip;
+    return err;
+}
+
+#undef VVM_TOS_SPILL
+#undef VVM_TOS_FILL
+#undef VVM_TOS_PUSH
+#undef VVM_TOS_POP
+#undef VVM_TOS_AT
+
+error vm_execute_program_tos(vvm_t* p_vm, int p_limit)
+{
+    if (p_vm->program_size >= UINT32_MAX)
+        return vm_execute_program(p_vm, p_limit);
+
+    const arena_mark_t mark = arena_mark(p_vm->arena);
+    compact_program_t program;
+    error err = vm_compact_program(p_vm, &program);
+    if (err == ERR_OK)
+        err = vm_execute_tos(p_vm, &program, p_limit);
+    arena_rewind(p_vm->arena, mark);
+
+    return err;
+}
+
+#ifdef VVM_PROFILE
+static inline uint64_t vm_profile_ticks(void)
+{
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+error vm_profile_init(const vvm_t* p_vm, profile_t* p_profile)
+{
+    memset(p_profile, 0, sizeof(*p_profile));
+    p_profile->program_size = p_vm->program_size;
+    p_profile->counts = arena_alloc(p_vm->arena, sizeof(p_profile->counts[0]) * (p_vm->program_size + 1));
+    p_profile->taken = arena_alloc(p_vm->arena, sizeof(p_profile->taken[0]) * (p_vm->program_size + 1));
+    if (p_profile->counts == NULL || p_profile->taken == NULL)
+        return ERR_OUT_OF_MEMORY;
+    memset(p_profile->counts, 0, sizeof(p_profile->counts[0]) * (p_vm->program_size + 1));
+    memset(p_profile->taken, 0, sizeof(p_profile->taken[0]) * (p_vm->program_size + 1));
+
+    p_profile->clock_overhead = UINT64_MAX;
+    for (int i = 0; i < 64; ++i)
+    {
+        const uint64_t start = vm_profile_ticks();
+        const uint64_t ticks = vm_profile_ticks() - start;
+        if (ticks < p_profile->clock_overhead)
+            p_profile->clock_overhead = ticks;
+    }
+
+    p_profile->random = 0x9E3779B97F4A7C15;
+    p_profile->next_sample = 1;
+    return ERR_OK;
+}
+
+// Samples are spaced at random, between 1 and 2 * VVM_PROFILE_SAMPLE_PERIOD - 1
+// instructions apart, so loops whose length divides the period are still
+// timed at every instruction.
+static uint64_t vm_profile_sample_gap(profile_t* p_profile)
+{
+    p_profile->random ^= p_profile->random << 13;
+    p_profile->random ^= p_profile->random >> 7;
+    p_profile->random ^= p_profile->random << 17;
+    return 1 + p_profile->random % (2 * VVM_PROFILE_SAMPLE_PERIOD - 1);
+}
+
+error vm_execute_program_profiled(vvm_t* p_vm, profile_t* p_profile, int p_limit)
+{
+    // Interprets one instruction at a time like vm_execute_program, counting
+    // every instruction and timing about one in VVM_PROFILE_SAMPLE_PERIOD. The
+    // profile must have been set up for the loaded program.
+    assert(p_profile->program_size == p_vm->program_size);
+
+    while (p_limit != 0 && !p_vm->halt)
+    {
+        const inst_addr_t addr = p_vm->inst_pointer;
+        const int sample = --p_profile->next_sample == 0;
+        const uint64_t start = sample ? vm_profile_ticks() : 0;
+
+        error err = vm_execute_inst(p_vm);
+        if (err != ERR_OK)
+            return err;
+
+        uint64_t ticks = 0;
+        if (sample)
+        {
+            ticks = vm_profile_ticks() - start;
+            ticks = ticks > p_profile->clock_overhead ? ticks - p_profile->clock_overhead : 0;
+            p_profile->next_sample = vm_profile_sample_gap(p_profile);
+        }
+        const inst_t inst = p_vm->program[addr];
+        profile_opcode_t* opcode = &p_profile->opcodes[inst.type];
+
+        opcode->count++;
+        opcode->samples += sample;
+        opcode->ticks += ticks;
+        p_profile->counts[addr]++;
+        p_profile->retired++;
+
+        if ((inst.type == INST_JMP_NZ || inst.type == INST_DEC_JMP_NZ) && p_vm->inst_pointer == inst.operand.as_u64)
+            p_profile->taken[addr]++;
+
+        if (p_limit > 0)
+            --p_limit;
+    }
+
+    return ERR_OK;
+}
+
+typedef struct {
+    uint64_t key;
+    uint64_t count;
+} profile_entry_t;
+
+static int profile_entry_compare(const void* p_a, const void* p_b)
+{
+    const profile_entry_t* a = p_a;
+    const profile_entry_t* b = p_b;
+    if (a->count != b->count)
+        return a->count < b->count ? 1 : -1;
+    return a->key < b->key ? -1 : a->key > b->key;
+}
+
+error vm_profile_report(FILE* p_stream, const vvm_t* p_vm, const profile_t* p_profile)
+{
+    // The hot spot lines start with the address and the count, which is what
+    // devasm reads back to annotate the disassembly.
+    const double total = p_profile->retired > 0 ? (double)p_profile->retired : 1.0;
+    const arena_mark_t mark = arena_mark(p_vm->arena);
+    profile_entry_t* entries = arena_alloc(p_vm->arena, sizeof(entries[0]) * (p_profile->program_size + NUMBER_OF_INSTS));
+    if (entries == NULL)
+        return ERR_OUT_OF_MEMORY;
+
+    fprintf(p_stream, "Profile: %lu instructions retired, about 1 in %d timed in %s\n\n", p_profile->retired,
+        VVM_PROFILE_SAMPLE_PERIOD,
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+        "rdtsc ticks"
+#else
+        "nanoseconds"
+#endif
+        );
+
+    size_t count = 0;
+    for (size_t i = 0; i < NUMBER_OF_INSTS; ++i)
+        if (p_profile->opcodes[i].count > 0)
+            entries[count++] = (profile_entry_t) { .key = i, .count = p_profile->opcodes[i].count };
+    qsort(entries, count, sizeof(entries[0]), profile_entry_compare);
+
+    fprintf(p_stream, "Opcodes:\n%14s %8s %12s  %s\n", "count", "share", "ticks/inst", "opcode");
+    for (size_t i = 0; i < count; ++i)
+    {
+        const profile_opcode_t* opcode = &p_profile->opcodes[entries[i].key];
+        fprintf(p_stream, "%14lu %7.2f%% ", opcode->count, opcode->count * 100.0 / total);
+        if (opcode->samples > 0)
+            fprintf(p_stream, "%12.1f", (double)opcode->ticks / opcode->samples);
+        else
+            fprintf(p_stream, "%12s", "-");
+        fprintf(p_stream, "  %s\n", inst_name(entries[i].key));
+    }
+
+    count = 0;
+    for (inst_addr_t i = 0; i < p_profile->program_size; ++i)
+        if (p_profile->counts[i] > 0)
+            entries[count++] = (profile_entry_t) { .key = i, .count = p_profile->counts[i] };
+    qsort(entries, count, sizeof(entries[0]), profile_entry_compare);
+
+    fprintf(p_stream, "\nHot spots:\n%-10s %14s %8s %8s  %s\n", "addr", "count", "share", "taken", "inst");
+    for (size_t i = 0; i < count; ++i)
+    {
+        const inst_addr_t addr = entries[i].key;
+        const inst_t inst = p_vm->program[addr];
+
+        fprintf(p_stream, "%-10lu %14lu %7.2f%% ", addr, entries[i].count, entries[i].count * 100.0 / total);
+        if (inst.type == INST_JMP_NZ || inst.type == INST_DEC_JMP_NZ)
+            fprintf(p_stream, "%7.1f%%", p_profile->taken[addr] * 100.0 / entries[i].count);
+        else
+            fprintf(p_stream, "%8s", "-");
+
+        fprintf(p_stream, "  %s", inst_name(inst.type));
+        if (inst_has_operand(inst.type))
+            fprintf(p_stream, " %ld", inst.operand.as_i64);
+        fprintf(p_stream, "\n");
+    }
+
+    arena_rewind(p_vm->arena, mark);
+    return ERR_OK;
+}
+#endif
+
+#ifdef VVM_TRACE
+error vm_trace_init(const vvm_t* p_vm, trace_t* p_trace, uint64_t p_capacity)
+{
+    uint64_t capacity = 1;
+    while (capacity < p_capacity)
+        capacity *= 2;
+
+    p_trace->entries = arena_alloc(p_vm->arena, sizeof(p_trace->entries[0]) * capacity);
+    if (p_trace->entries == NULL)
+        return ERR_OUT_OF_MEMORY;
+    p_trace->capacity = capacity;
+    memset(p_trace->entries, 0, sizeof(p_trace->entries[0]) * capacity);
+    atomic_init(&p_trace->head, 0);
+    return ERR_OK;
+}
+
+error vm_execute_program_traced(vvm_t* p_vm, trace_t* p_trace, int p_limit)
+{
+    // Runs on the threaded engine, recording every instruction before it
+    // executes, so the last entry is the instruction that failed.
+    return vm_execute_threaded(p_vm, p_trace, p_limit);
+}
+
+int vm_trace_write(const trace_t* p_trace, int p_fd, error p_error, int p_signal)
+{
+    // Only uses write(2), so it is safe to call from a signal handler. Returns
+    // 0 if the file could not be written.
+    const uint64_t head = atomic_load_explicit(&p_trace->head, memory_order_relaxed);
+    atomic_signal_fence(memory_order_acquire);
+    const uint64_t count = head < p_trace->capacity ? head : p_trace->capacity;
+    const uint64_t first = (head - count) & (p_trace->capacity - 1);
+
+    trace_file_header_t header = {
+        .version = VVM_TRACE_VERSION,
+        .entry_size = sizeof(trace_entry_t),
+        .error = p_error,
+        .signal = p_signal,
+        .recorded = head,
+        .count = count,
+    };
+    memcpy(header.magic, VVM_TRACE_MAGIC, sizeof(header.magic));
+
+    // The oldest entries are at the end of the buffer once it has wrapped.
+    const uint64_t tail = first + count > p_trace->capacity ? p_trace->capacity - first : count;
+    const struct {
+        const void* data;
+        size_t size;
+    } parts[] = {
+        { &header, sizeof(header) },
+        { p_trace->entries + first, sizeof(trace_entry_t) * tail },
+        { p_trace->entries, sizeof(trace_entry_t) * (count - tail) },
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(parts); ++i)
+    {
+        const uint8_t* data = parts[i].data;
+        size_t left = parts[i].size;
+        while (left > 0)
+        {
+            const ssize_t n = write(p_fd, data, left);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return 0;
+            data += n;
+            left -= n;
+        }
+    }
+
+    return 1;
+}
+#endif
+
+void vm_dump_stack(FILE* p_stream, const vvm_t* p_vm)
+{
+    fprintf(p_stream, "Stack:\n");
+    if (p_vm->stack_size > 0)
+        for (uint64_t i = 0; i < p_vm->stack_size; ++i)
+            fprintf(p_stream, "  u64: %lu, i64: %ld, f64: %lf, ptr: %p\n", 
+                p_vm->stack[i].as_u64,
+                p_vm->stack[i].as_i64,
+                p_vm->stack[i].as_f64,
+                p_vm->stack[i].as_ptr);
+    else
+        fprintf(p_stream, "  [Empty]\n");
+}
+
+error vm_flush_channel(vvm_t* p_vm)
+{
+    // Engines only flush the channel when it fills up, so whoever runs a
+    // program flushes what is left once it stops.
+    vvm_channel_t* channel = &p_vm->channel;
+    vm_channel_drain(channel);
+
+    if (channel->failed == 0)
+        return ERR_OK;
+
+    vvm_diagnose(p_vm->diagnostics, "[ERROR]: Could Not Write Program Output: %s\n", strerror(channel->failed));
+    channel->failed = 0;
+    return ERR_FILE_ACCESS;
+}
+
+static void vm_release_mapping(vvm_t* p_vm)
+{
+#ifdef VVM_MMAP
+    if (p_vm->mapping != NULL)
+        munmap(p_vm->mapping, p_vm->mapping_size);
+#endif
+    p_vm->mapping = NULL;
+    p_vm->mapping_size = 0;
+}
+
+error vm_reserve_program(vvm_t* p_vm, uint64_t p_count)
+{
+    // Grows the program geometrically, which also makes a mapped program
+    // writable by copying it into the arena. The program is left as it was
+    // when there is no memory for that.
+    if (p_vm->program_capacity >= p_count && p_vm->mapping == NULL)
+        return ERR_OK;
+
+    uint64_t capacity = p_vm->program_capacity > 0 ? p_vm->program_capacity : 64;
+    while (capacity < p_count && capacity <= SIZE_MAX / sizeof(inst_t) / 2)
+        capacity *= 2;
+
+    inst_t* program = capacity >= p_count ? arena_alloc(p_vm->arena, sizeof(program[0]) * capacity) : NULL;
+    uint8_t* verified = program != NULL ? arena_alloc(p_vm->arena, capacity) : NULL;
+    if (verified == NULL)
+    {
+        vvm_diagnose(p_vm->diagnostics, "[ERROR]: Could Not Allocate Memory For %lu Instructions\n", p_count);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    if (p_vm->program_size > 0)
+    {
+        memcpy(program, p_vm->program, sizeof(program[0]) * p_vm->program_size);
+        memcpy(verified, p_vm->verified, p_vm->program_size);
+    }
+
+    vm_release_mapping(p_vm);
+    p_vm->program = program;
+    p_vm->verified = verified;
+    p_vm->program_capacity = capacity;
+    return ERR_OK;
+}
+
+error vm_push_inst(vvm_t* p_vm, inst_t p_inst)
+{
+    const error err = vm_reserve_program(p_vm, p_vm->program_size + 1);
+    if (err != ERR_OK)
+        return err;
+
+    p_vm->verified[p_vm->program_size] = 0;
+    p_vm->program[p_vm->program_size++] = p_inst;
+    return ERR_OK;
+}
+
+error vm_load_program_from_memory(vvm_t* p_vm, inst_t* p_program, size_t p_program_size)
+{
+    vm_unload_program(p_vm);
+    const error err = vm_reserve_program(p_vm, p_program_size);
+    if (err != ERR_OK)
+        return err;
+
+    if (p_program_size > 0)
+    {
+        memcpy(p_vm->program, p_program, sizeof(p_program[0]) * p_program_size);
+        memset(p_vm->verified, 0, p_program_size);
+    }
+    p_vm->program_size = p_program_size;
+    return ERR_OK;
+}
+
+static uint64_t vm_file_hash(const uint8_t* p_data, size_t p_size)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < p_size; ++i)
+    {
+        hash ^= p_data[i];
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+static int vm_file_is_container(const uint8_t* p_data, size_t p_size)
+{
+    return p_size >= sizeof(vvm_file_header_t) && memcmp(p_data, VVM_FILE_MAGIC, 4) == 0;
+}
+
+// Validates a container image and finds the section of the given kind, or
+// NULL if the file has none.
+static error vm_file_find_section(const uint8_t* p_data, size_t p_size, uint32_t p_kind, const char* p_file_path,
+                                  FILE* p_diagnostics, const vvm_section_t** p_section)
+{
+    const vvm_file_header_t* header = (const vvm_file_header_t*)p_data;
+    const char* problem = NULL;
+
+    if (header->byte_order != VVM_FILE_BYTE_ORDER)
+        problem = "Written With A Different Byte Order";
+    else if (header->version != VVM_FILE_VERSION)
+        problem = "Unsupported Version";
+    else if (header->sections_count > (p_size - sizeof(*header)) / sizeof(vvm_section_t))
+        problem = "Truncated Section Table";
+    else if (vm_file_hash(p_data + sizeof(*header), p_size - sizeof(*header)) != header->hash)
+        problem = "Hash Mismatch";
+
+    if (problem != NULL)
+    {
+        vvm_diagnose(p_diagnostics, "[ERROR]: Invalid Program File `%s`: %s\n", p_file_path, problem);
+        return ERR_INVALID_FILE;
+    }
+
+    const vvm_section_t* sections = (const vvm_section_t*)(p_data + sizeof(*header));
+    *p_section = NULL;
+    for (uint32_t i = 0; i < header->sections_count; ++i)
+    {
+        if (sections[i].offset % VVM_FILE_ALIGNMENT != 0 || sections[i].offset > p_size || sections[i].size > p_size - sections[i].offset)
+        {
+            vvm_diagnose(p_diagnostics, "[ERROR]: Invalid Program File `%s`: Section Out Of Bounds\n", p_file_path);
+            return ERR_INVALID_FILE;
+        }
+
+        if (sections[i].kind == p_kind)
+            *p_section = &sections[i];
+    }
+
+    return ERR_OK;
+}
+
+// Finds the instructions of a .vm image, of either format.
+static error vm_file_code(const uint8_t* p_data, size_t p_size, const char* p_file_path, FILE* p_diagnostics,
+                          const inst_t** p_code, uint64_t* p_count)
+{
+    const inst_t* code = (const inst_t*)p_data;
+    uint64_t size = p_size;
+
+    if (vm_file_is_container(p_data, p_size))
+    {
+        const vvm_section_t* section = NULL;
+        const error err = vm_file_find_section(p_data, p_size, VVM_SECTION_CODE, p_file_path, p_diagnostics, &section);
+        if (err != ERR_OK)
+            return err;
+        if (section == NULL)
+        {
+            vvm_diagnose(p_diagnostics, "[ERROR]: Invalid Program File `%s`: No Code Section\n", p_file_path);
+            return ERR_INVALID_FILE;
+        }
+        code = (const inst_t*)(p_data + section->offset);
+        size = section->size;
+    }
+
+    if (size % sizeof(inst_t) != 0)
+    {
+        vvm_diagnose(p_diagnostics, "[ERROR]: Invalid Program File `%s`: Truncated Code\n", p_file_path);
+        return ERR_INVALID_FILE;
+    }
+
+    *p_code = code;
+    *p_count = size / sizeof(inst_t);
+    return ERR_OK;
+}
+
+error vm_load_program_from_image(vvm_t* p_vm, const void* p_image, size_t p_size)
+{
+    // The image is copied, so it can go away once the program is loaded.
+    const inst_t* code = NULL;
+    uint64_t count = 0;
+    const error err = vm_file_code(p_image, p_size, "<memory>", p_vm->diagnostics, &code, &count);
+    if (err != ERR_OK)
+        return err;
+
+    return vm_load_program_from_memory(p_vm, (inst_t*)code, count);
+}
+
+error vm_load_program_from_file(vvm_t* p_vm, const char* p_file_path)
+{
+    string_view_t image = {0};
+    error err = sv_slurp_file(p_file_path, &image, p_vm->diagnostics);
+    if (err != ERR_OK)
+        return err;
+
+    const inst_t* code = NULL;
+    uint64_t count = 0;
+    err = vm_file_code((const uint8_t*)image.data, image.count, p_file_path, p_vm->diagnostics, &code, &count);
+    if (err == ERR_OK)
+        err = vm_load_program_from_memory(p_vm, (inst_t*)code, count);
+
+    free((char*)image.data);
+    return err;
+}
+
+error vm_map_program_from_file(vvm_t* p_vm, const char* p_file_path)
+{
+    // The program is executed straight from a read-only shared mapping, so
+    // nothing is copied and processes running the same file share its pages.
+#ifdef VVM_MMAP
+    int fd = open(p_file_path, O_RDONLY);
+    if (fd < 0)
+    {
+        vvm_diagnose(p_vm->diagnostics, "[ERROR]: Could Not Open File `%s`: %s\n", p_file_path, strerror(errno));
+        return ERR_FILE_ACCESS;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        vvm_diagnose(p_vm->diagnostics, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
+        close(fd);
+        return ERR_FILE_ACCESS;
+    }
+
+    // Empty files cannot be mapped.
+    if (st.st_size == 0)
+    {
+        close(fd);
+        vm_unload_program(p_vm);
+        return ERR_OK;
+    }
+
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return vm_load_program_from_file(p_vm, p_file_path);
+
+    const inst_t* code = NULL;
+    uint64_t count = 0;
+    const error err = vm_file_code(mapping, st.st_size, p_file_path, p_vm->diagnostics, &code, &count);
+    if (err != ERR_OK)
+    {
+        munmap(mapping, st.st_size);
+        return err;
+    }
+
+    uint8_t* verified = arena_alloc(p_vm->arena, count);
+    if (verified == NULL)
+    {
+        vvm_diagnose(p_vm->diagnostics, "[ERROR]: Could Not Allocate Memory For %lu Instructions\n", count);
+        munmap(mapping, st.st_size);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    vm_unload_program(p_vm);
+    p_vm->program = (inst_t*)code;
+    p_vm->program_size = count;
+    p_vm->program_capacity = 0;
+    p_vm->verified = verified;
+    memset(p_vm->verified, 0, count);
+    p_vm->mapping = mapping;
+    p_vm->mapping_size = st.st_size;
+    return ERR_OK;
+#else
+    return vm_load_program_from_file(p_vm, p_file_path);
+#endif
+}
+
+void vm_unload_program(vvm_t* p_vm)
+{
+    // An owned program keeps its storage for the next one.
+    if (p_vm->mapping != NULL)
+    {
+        vm_release_mapping(p_vm);
+        p_vm->program = NULL;
+        p_vm->verified = NULL;
+        p_vm->program_capacity = 0;
+    }
+    p_vm->program_size = 0;
+}
+
+error vm_load_symbols_from_file(const char* p_file_path, vasm_t* p_vasm)
+{
+    // Labels keep pointing into the file contents, which are never freed.
+    string_view_t image = {0};
+    error err = sv_slurp_file(p_file_path, &image, p_vasm->diagnostics);
+    if (err != ERR_OK)
+        return err;
+    const uint8_t* data = (const uint8_t*)image.data;
+
+    if (!vm_file_is_container(data, image.count))
+        return ERR_OK;
+
+    const vvm_section_t* section = NULL;
+    err = vm_file_find_section(data, image.count, VVM_SECTION_SYMBOLS, p_file_path, p_vasm->diagnostics, &section);
+    if (err != ERR_OK || section == NULL)
+        return err;
+
+    uint64_t at = section->offset;
+    const uint64_t end = section->offset + section->size;
+    while (at + sizeof(vvm_symbol_t) <= end)
+    {
+        vvm_symbol_t symbol;
+        memcpy(&symbol, data + at, sizeof(symbol));
+        at += sizeof(symbol);
+        if (symbol.name_size > end - at)
+            break;
+
+        err = vasm_push_label(p_vasm, (string_view_t) { .count = symbol.name_size, .data = image.data + at }, symbol.addr);
+        if (err != ERR_OK)
+            return err;
+        at += (symbol.name_size + 7) / 8 * 8;
+    }
+
+    return ERR_OK;
+}
+
+static size_t vm_file_align(size_t p_offset)
+{
+    return (p_offset + VVM_FILE_ALIGNMENT - 1) / VVM_FILE_ALIGNMENT * VVM_FILE_ALIGNMENT;
+}
+
+static uint8_t* vm_file_alloc_image(size_t p_size, FILE* p_diagnostics)
+{
+    uint8_t* image = calloc(p_size, 1);
+    if (image == NULL)
+        vvm_diagnose(p_diagnostics, "[ERROR]: Could Not Allocate Memory For File: %s\n", strerror(errno));
+
+    return image;
+}
+
+// Fills in the header of an image whose section table and sections are in
+// place, then writes it out and frees it.
+static error vm_file_write(const char* p_file_path, uint8_t* p_image, size_t p_size, uint32_t p_sections_count, FILE* p_diagnostics)
+{
+    vvm_file_header_t header = {
+        .version = VVM_FILE_VERSION,
+        .byte_order = VVM_FILE_BYTE_ORDER,
+        .sections_count = p_sections_count,
+        .hash = vm_file_hash(p_image + sizeof(vvm_file_header_t), p_size - sizeof(vvm_file_header_t)),
+    };
+    memcpy(header.magic, VVM_FILE_MAGIC, sizeof(header.magic));
+    memcpy(p_image, &header, sizeof(header));
+
+    error err = ERR_OK;
+    FILE* f = fopen(p_file_path, "wb");
+    if (f == NULL)
+    {
+        vvm_diagnose(p_diagnostics, "[ERROR]: Could Not Open File `%s`: %s\n", p_file_path, strerror(errno));
+        err = ERR_FILE_ACCESS;
+    }
+    else
+    {
+        fwrite(p_image, 1, p_size, f);
+        if (ferror(f) | (fclose(f) != 0))
+        {
+            vvm_diagnose(p_diagnostics, "[ERROR]: Could Not Write To File `%s`: %s\n", p_file_path, strerror(errno));
+            err = ERR_FILE_ACCESS;
+        }
+    }
+
+    free(p_image);
+    return err;
+}
+
+error vm_save_program_to_file(const vvm_t* p_vm, const vasm_t* p_vasm, const char* p_file_path)
+{
+    // Labels are written to the symbols section when p_vasm is given.
+    const uint32_t sections_count = p_vasm != NULL ? 2 : 1;
+    vvm_section_t sections[2] = {0};
+
+    size_t symbols_size = 0;
+    if (p_vasm != NULL)
+        for (size_t i = 0; i < p_vasm->labels_size; ++i)
+            symbols_size += sizeof(vvm_symbol_t) + (p_vasm->labels[i].name.count + 7) / 8 * 8;
+
+    sections[0].kind = VVM_SECTION_CODE;
+    sections[0].offset = vm_file_align(sizeof(vvm_file_header_t) + sizeof(vvm_section_t) * sections_count);
+    sections[0].size = sizeof(p_vm->program[0]) * p_vm->program_size;
+    sections[1].kind = VVM_SECTION_SYMBOLS;
+    sections[1].offset = vm_file_align(sections[0].offset + sections[0].size);
+    sections[1].size = symbols_size;
+
+    const size_t size = sections[sections_count - 1].offset + sections[sections_count - 1].size;
+    uint8_t* image = vm_file_alloc_image(size, p_vm->diagnostics);
+    if (image == NULL)
+        return ERR_OUT_OF_MEMORY;
+
+    memcpy(image + sizeof(vvm_file_header_t), sections, sizeof(vvm_section_t) * sections_count);
+    if (p_vm->program_size > 0)
+        memcpy(image + sections[0].offset, p_vm->program, sections[0].size);
+
+    if (p_vasm != NULL)
+    {
+        uint8_t* at = image + sections[1].offset;
+        for (size_t i = 0; i < p_vasm->labels_size; ++i)
+        {
+            const vvm_symbol_t symbol = {
+                .addr = p_vasm->labels[i].addr,
+                .name_size = p_vasm->labels[i].name.count,
+            };
+            memcpy(at, &symbol, sizeof(symbol));
+            at += sizeof(symbol);
+            memcpy(at, p_vasm->labels[i].name.data, symbol.name_size);
+            at += (symbol.name_size + 7) / 8 * 8;
+        }
+    }
+
+    return vm_file_write(p_file_path, image, size, sections_count, p_vm->diagnostics);
+}
+
+error vm_save_snapshot_to_file(const vvm_t* p_vm, const char* p_file_path)
+{
+    // Memory is only written up to its last word that is not 0, and only
+    // when the machine has any.
+    const uint32_t sections_count = p_vm->memory_size > 0 ? 4 : 3;
+    vvm_section_t sections[4] = {0};
+    uint64_t memory_used = p_vm->memory_size;
+    while (memory_used > 0 && p_vm->memory[memory_used - 1].as_u64 == 0)
+        memory_used--;
+
+    const vvm_state_t state = {
+        .inst_pointer = p_vm->inst_pointer,
+        .stack_size = p_vm->stack_size,
+        .stack_capacity = p_vm->stack_capacity,
+        .halt = p_vm->halt != 0,
+    };
+
+    sections[0].kind = VVM_SECTION_STATE;
+    sections[0].offset = vm_file_align(sizeof(vvm_file_header_t) + sizeof(vvm_section_t) * sections_count);
+    sections[0].size = sizeof(state);
+    sections[1].kind = VVM_SECTION_CODE;
+    sections[1].offset = vm_file_align(sections[0].offset + sections[0].size);
+    sections[1].size = sizeof(p_vm->program[0]) * p_vm->program_size;
+    sections[2].kind = VVM_SECTION_STACK;
+    sections[2].offset = vm_file_align(sections[1].offset + sections[1].size);
+    sections[2].size = sizeof(p_vm->stack[0]) * p_vm->stack_size;
+    sections[3].kind = VVM_SECTION_MEMORY;
+    sections[3].offset = vm_file_align(sections[2].offset + sections[2].size);
+    sections[3].size = sizeof(uint64_t) + sizeof(p_vm->memory[0]) * memory_used;
+
+    const size_t size = sections[sections_count - 1].offset + sections[sections_count - 1].size;
+    uint8_t* image = vm_file_alloc_image(size, p_vm->diagnostics);
+    if (image == NULL)
+        return ERR_OUT_OF_MEMORY;
+
+    memcpy(image + sizeof(vvm_file_header_t), sections, sizeof(vvm_section_t) * sections_count);
+    memcpy(image + sections[0].offset, &state, sizeof(state));
+    if (p_vm->program_size > 0)
+        memcpy(image + sections[1].offset, p_vm->program, sections[1].size);
+    if (p_vm->stack_size > 0)
+        memcpy(image + sections[2].offset, p_vm->stack, sections[2].size);
+    if (sections_count > 3)
+    {
+        memcpy(image + sections[3].offset, &p_vm->memory_size, sizeof(uint64_t));
+        if (memory_used > 0)
+            memcpy(image + sections[3].offset + sizeof(uint64_t), p_vm->memory, sizeof(p_vm->memory[0]) * memory_used);
+    }
+
+    return vm_file_write(p_file_path, image, size, sections_count, p_vm->diagnostics);
+}
+
+error snapshot_open(const char* p_file_path, snapshot_t* p_snapshot, FILE* p_diagnostics)
+{
+    // The file stays mapped until snapshot_close, the program and the stack
+    // point into it.
+    snapshot_t snapshot = {0};
+    error err = file_view_open(p_file_path, &snapshot.file, p_diagnostics);
+    if (err != ERR_OK)
+        return err;
+
+    const uint8_t* data = (const uint8_t*)snapshot.file.content.data;
+    const size_t size = snapshot.file.content.count;
+    const vvm_section_t* state = NULL;
+    const vvm_section_t* stack = NULL;
+    const vvm_section_t* memory = NULL;
+    const char* problem = NULL;
+
+    if (!vm_file_is_container(data, size))
+    {
+        problem = "Not A Container";
+    }
+    else
+    {
+        err = vm_file_find_section(data, size, VVM_SECTION_STATE, p_file_path, p_diagnostics, &state);
+        if (err == ERR_OK)
+            err = vm_file_find_section(data, size, VVM_SECTION_STACK, p_file_path, p_diagnostics, &stack);
+        if (err == ERR_OK)
+            err = vm_file_find_section(data, size, VVM_SECTION_MEMORY, p_file_path, p_diagnostics, &memory);
+        if (err == ERR_OK)
+            err = vm_file_code(data, size, p_file_path, p_diagnostics, &snapshot.program, &snapshot.program_size);
+        if (err != ERR_OK)
+        {
+            file_view_close(&snapshot.file);
+            return err;
+        }
+
+        if (state == NULL || state->size != sizeof(vvm_state_t))
+            problem = "No State Section";
+        else if (stack == NULL)
+            problem = "No Stack Section";
+    }
+
+    if (problem == NULL)
+    {
+        memcpy(&snapshot.state, data + state->offset, sizeof(snapshot.state));
+        if (stack->size != sizeof(word_t) * snapshot.state.stack_size || snapshot.state.stack_size > snapshot.state.stack_capacity)
+            problem = "Stack Size Mismatch";
+    }
+
+    if (problem == NULL && memory != NULL)
+    {
+        if (memory->size < sizeof(uint64_t) || (memory->size - sizeof(uint64_t)) % sizeof(word_t) != 0)
+        {
+            problem = "Memory Size Mismatch";
+        }
+        else
+        {
+            memcpy(&snapshot.memory_size, data + memory->offset, sizeof(uint64_t));
+            snapshot.memory_used = (memory->size - sizeof(uint64_t)) / sizeof(word_t);
+            snapshot.memory = (const word_t*)(data + memory->offset + sizeof(uint64_t));
+            if (snapshot.memory_used > snapshot.memory_size)
+                problem = "Memory Size Mismatch";
+        }
+    }
+
+    if (problem != NULL)
+    {
+        vvm_diagnose(p_diagnostics, "[ERROR]: Invalid Snapshot File `%s`: %s\n", p_file_path, problem);
+        file_view_close(&snapshot.file);
+        return ERR_INVALID_FILE;
+    }
+
+    snapshot.stack = (const word_t*)(data + stack->offset);
+    *p_snapshot = snapshot;
+    return ERR_OK;
+}
+
+void snapshot_close(snapshot_t* p_snapshot)
+{
+    file_view_close(&p_snapshot->file);
+    *p_snapshot = (snapshot_t) {0};
+}
+
+error vm_restore_snapshot(vvm_t* p_vm, const snapshot_t* p_snapshot)
+{
+    // Restoring the snapshot a machine already runs only copies the stack and
+    // the memory, and keeps the verification of the earlier restore, which
+    // started from the same state.
+    if (p_snapshot->state.stack_size > p_vm->stack_capacity)
+    {
+        vvm_diagnose(p_vm->diagnostics, "[ERROR]: Snapshot Stack Of %lu Words Does Not Fit In A Stack Of %lu Words\n",
+                     p_snapshot->state.stack_size, p_vm->stack_capacity);
+        return ERR_STACK_OVERFLOW;
+    }
+
+    // Only the words the snapshot holds need to fit, the others are 0.
+    if (p_snapshot->memory_used > p_vm->memory_size)
+    {
+        vvm_diagnose(p_vm->diagnostics, "[ERROR]: Snapshot Memory Of %lu Words Does Not Fit In A Memory Of %lu Words\n",
+                     p_snapshot->memory_used, p_vm->memory_size);
+        return ERR_ILLEGAL_MEMORY_ACCESS;
+    }
+
+    if (p_vm->program != p_snapshot->program || p_vm->program_size != p_snapshot->program_size)
+    {
+        uint8_t* verified = arena_alloc(p_vm->arena, p_snapshot->program_size);
+        if (verified == NULL)
+        {
+            vvm_diagnose(p_vm->diagnostics, "[ERROR]: Could Not Allocate Memory For %lu Instructions\n", p_snapshot->program_size);
+            return ERR_OUT_OF_MEMORY;
+        }
+
+        vm_unload_program(p_vm);
+        p_vm->program = (inst_t*)p_snapshot->program;
+        p_vm->program_size = p_snapshot->program_size;
+        p_vm->program_capacity = 0;
+        p_vm->verified = verified;
+        memset(p_vm->verified, 0, p_snapshot->program_size);
+    }
+
+    memcpy(p_vm->stack, p_snapshot->stack, sizeof(p_vm->stack[0]) * p_snapshot->state.stack_size);
+    if (p_snapshot->memory_used > 0)
+        memcpy(p_vm->memory, p_snapshot->memory, sizeof(p_vm->memory[0]) * p_snapshot->memory_used);
+    if (p_vm->memory_size > p_snapshot->memory_used)
+        memset(p_vm->memory + p_snapshot->memory_used, 0, sizeof(p_vm->memory[0]) * (p_vm->memory_size - p_snapshot->memory_used));
+    p_vm->stack_size = p_snapshot->state.stack_size;
+    p_vm->inst_pointer = p_snapshot->state.inst_pointer;
+    p_vm->halt = p_snapshot->state.halt != 0;
+    return ERR_OK;
+}
+
+error vm_translate_source(string_view_t p_source, vvm_t* p_vm, vasm_t* p_vasm)
+{
+    // Failures are described on p_vasm->diagnostics, running out of memory
+    // for the program on p_vm->diagnostics. The program is left partially
+    // translated.
+    error err = ERR_OK;
+    while (p_source.count > 0)
+    {
+        err = vm_reserve_program(p_vm, p_vm->program_size + 1);
+        if (err != ERR_OK)
+            return err;
+
+        string_view_t line = sv_trim(sv_chop_by_delim(&p_source, '\n'));
+        if (line.count > 0 && *line.data != '#')
+        {
+            line = sv_trim_left(line);
+            string_view_t token = sv_chop_by_delim(&line, ' ');
+
+            if (token.count > 0 && token.data[token.count - 1] == ':') {
+                string_view_t label = {
+                    .count = token.count - 1,
+                    .data = token.data
+                };
+                err = vasm_push_label(p_vasm, label, p_vm->program_size);
+                if (err != ERR_OK)
+                    return err;
+
+                // Try to repeat the instruction name.
+                token = sv_trim(sv_chop_by_delim(&line, ' '));
+            } 
+            
+            if (token.count > 0)
+            {
+                string_view_t operand = sv_trim(sv_chop_by_delim(&line, '#'));
+                inst_t inst = { .type = inst_from_name(token) };
+                if (inst.type == NUMBER_OF_INSTS)
+                {
+                    vvm_diagnose(p_vasm->diagnostics, "[ERROR]: Unknown Instruction `%.*s`.\n", (int)token.count, token.data);
+                    return ERR_INVALID_SOURCE;
+                }
+
+                switch (inst_operand_type(inst.type))
+                {
+                    case OPERAND_NONE:
+                        break;
+
+                    case OPERAND_WORD:
+                        if (number_literal_as_word(operand, &inst.operand) != ERR_OK)
+                        {
+                            vvm_diagnose(p_vasm->diagnostics, "[ERROR]: `%.*s` is not a number literal\n", (int)operand.count, operand.data);
+                            return ERR_INVALID_SOURCE;
+                        }
+                        break;
+
+                    case OPERAND_INT:
+                        inst.operand.as_i64 = sv_to_int(operand);
+                        break;
+
+                    // Engines check lane counts as well, for programs vasm did not write.
+                    case OPERAND_LANES:
+                        inst.operand.as_i64 = sv_to_int(operand);
+                        if (!vector_lanes_valid(inst.operand.as_u64))
+                        {
+                            vvm_diagnose(p_vasm->diagnostics, "[ERROR]: Vector Instructions Take 2, 4 Or 8 Lanes, Not `%.*s`\n", (int)operand.count, operand.data);
+                            return ERR_INVALID_SOURCE;
+                        }
+                        break;
+
+                    // Names are resolved against the table of the assembler,
+                    // ids are taken as they are.
+                    case OPERAND_NATIVE:
+                        if (operand.count > 0 && isdigit(*operand.data))
+                        {
+                            inst.operand.as_i64 = sv_to_int(operand);
+                        }
+                        else if (!native_lookup(p_vasm->natives, operand, &inst.operand.as_u64))
+                        {
+                            vvm_diagnose(p_vasm->diagnostics, "[ERROR]: Unknown Native `%.*s`\n", (int)operand.count, operand.data);
+                            return ERR_INVALID_SOURCE;
+                        }
+                        break;
+
+                    case OPERAND_ADDR:
+                        if (operand.count > 0 && isdigit(*operand.data))
+                        {
+                            inst.operand.as_i64 = sv_to_int(operand);
+                        }
+                        else
+                        {
+                            err = vasm_resolve_label(p_vasm, p_vm->program_size, operand, &inst.operand.as_u64);
+                            if (err != ERR_OK)
+                                return err;
+                        }
+                        break;
+                }
+
+                p_vm->program[p_vm->program_size++] = inst;
+            }
+        }
     }
-}
 
-inst_addr_t vasm_find_label_addr(vasm_t* p_vasm, string_view_t p_name)
-{
-    for (size_t i = 0; i < p_vasm->labels_size; ++i)
+    // Second pass to resolve forward references.
+    for (size_t i = 0; i < p_vasm->deferred_operands_size; ++i)
     {
-        if (sv_equal(p_vasm->labels[i].name, p_name))
-            return p_vasm->labels[i].addr;
+        inst_addr_t addr = 0;
+        err = vasm_find_label_addr(p_vasm, p_vasm->deferred_operands[i].label, &addr);
+        if (err != ERR_OK)
+            return err;
+        p_vm->program[p_vasm->deferred_operands[i].addr].operand.as_u64 = addr;
     }
 
-    fprintf(stderr, "[ERROR]: label `%.*s` does not exist\n", (int)p_name.count, p_name.data);
-    exit(1);
+    if (p_vm->program_size > 0)
+        memset(p_vm->verified, 0, p_vm->program_size);
+    return ERR_OK;
 }
 
-void vasm_push_label(vasm_t* p_vasm, string_view_t p_name, inst_addr_t p_addr)
+// Moves what refers to addresses after instructions were merged or removed,
+// and the first p_new_size instructions are the program that is left. p_map
+// holds the new address of every old one, up to and including the old size.
+static void vm_relocate_program(vvm_t* p_vm, vasm_t* p_vasm, const inst_addr_t* p_map, size_t p_new_size)
 {
-    assert(p_vasm->labels_size < VVM_LABEL_CAPACITY);
-    p_vasm->labels[p_vasm->labels_size++] = (label_t){
-        .name = p_name,
-        .addr = p_addr
-    };
+    const size_t size = p_vm->program_size;
+
+    // Jumps to the end of the program or past it go to the new end, which
+    // is just as far out of range.
+    for (size_t i = 0; i < p_new_size; ++i)
+        if (inst_is_jump(p_vm->program[i].type))
+            p_vm->program[i].operand.as_u64 = p_vm->program[i].operand.as_u64 < size
+                ? p_map[p_vm->program[i].operand.as_u64]
+                : p_new_size;
+
+    for (size_t i = 0; i < p_vasm->labels_size; ++i)
+        p_vasm->labels[i].addr = p_map[p_vasm->labels[i].addr];
+
+    for (size_t i = 0; i < p_vasm->deferred_operands_size; ++i)
+        p_vasm->deferred_operands[i].addr = p_map[p_vasm->deferred_operands[i].addr];
+
+    p_vm->program_size = p_new_size;
+    if (p_new_size > 0)
+        memset(p_vm->verified, 0, p_new_size);
 }
 
-void vasm_push_deferred_operand(vasm_t* p_vasm, inst_addr_t p_addr, string_view_t p_name)
+// Matches a superinstruction pattern at p_program[p_at]. On a match the fused
+// instruction is stored in p_fused and the length of the pattern is returned.
+static size_t vm_match_superinstruction(const inst_t* p_program, size_t p_count, size_t p_at, inst_t* p_fused)
 {
-    assert(p_vasm->deferred_operands_size < VVM_DEFERRED_OPERANDS_CAPACITY);
-    p_vasm->deferred_operands[p_vasm->deferred_operands_size++] = (deferred_operand_t){
-        .addr = p_addr,
-        .label = p_name,
-    };
+    const inst_t* in = p_program + p_at;
+    const size_t left = p_count - p_at;
+
+    // push 1; subi; rdup 0; jnz <addr>
+    if (left >= 4 &&
+        in[0].type == INST_PUSH && in[0].operand.as_u64 == 1 &&
+        in[1].type == INST_SUBI &&
+        in[2].type == INST_DUP_REL && in[2].operand.as_u64 == 0 &&
+        in[3].type == INST_JMP_NZ)
+    {
+        *p_fused = (inst_t){ .type = INST_DEC_JMP_NZ, .operand = in[3].operand };
+        return 4;
+    }
+
+    if (left >= 2 && in[0].type == INST_PUSH)
+    {
+        inst_type type = NUMBER_OF_INSTS;
+        if (in[1].type == INST_ADDI)      type = INST_ADDI_IMM;
+        else if (in[1].type == INST_SUBI) type = INST_SUBI_IMM;
+        else if (in[1].type == INST_MULI) type = INST_MULI_IMM;
+        else if (in[1].type == INST_ADDF) type = INST_ADDF_IMM;
+        else if (in[1].type == INST_SUBF) type = INST_SUBF_IMM;
+        else if (in[1].type == INST_MULF) type = INST_MULF_IMM;
+        else if (in[1].type == INST_DIVF) type = INST_DIVF_IMM;
+        else if (in[1].type == INST_LOAD) type = INST_LOAD_IMM;
+        else if (in[1].type == INST_STORE) type = INST_STORE_IMM;
+
+        if (type != NUMBER_OF_INSTS)
+        {
+            *p_fused = (inst_t){ .type = type, .operand = in[0].operand };
+            return 2;
+        }
+    }
+
+    if (left >= 2 && in[0].type == INST_DUP_REL && (in[1].type == INST_ADDI || in[1].type == INST_ADDF))
+    {
+        *p_fused = (inst_t){
+            .type = in[1].type == INST_ADDI ? INST_ADDI_REL : INST_ADDF_REL,
+            .operand = in[0].operand
+        };
+        return 2;
+    }
+
+    return 0;
 }
 
-error vm_execute_inst(vvm_t* p_vm)
+error vm_fuse_superinstructions(vvm_t* p_vm, vasm_t* p_vasm)
 {
-    if (p_vm->inst_pointer >= p_vm->program_size)
-        return ERR_ILLEGAL_INSTRUCTION_ACCESS;
+    // Runs after label resolution, so every jump operand is an address. A
+    // pattern is only fused if nothing jumps into the middle of it. Without
+    // the memory for it, the program is left as it was.
+    const error err = vm_reserve_program(p_vm, p_vm->program_size);
+    if (err != ERR_OK)
+        return err;
 
-    inst_t inst = p_vm->program[p_vm->inst_pointer];
+    const size_t size = p_vm->program_size;
+    const arena_mark_t mark = arena_mark(p_vm->arena);
+    uint8_t* target = arena_alloc(p_vm->arena, size + 1);
+    inst_addr_t* map = arena_alloc(p_vm->arena, sizeof(map[0]) * (size + 1));
+    if (target == NULL || map == NULL)
+    {
+        vvm_diagnose(p_vasm->diagnostics, "[ERROR]: Could Not Allocate Memory To Fuse %lu Instructions\n", size);
+        arena_rewind(p_vm->arena, mark);
+        return ERR_OUT_OF_MEMORY;
+    }
+    memset(target, 0, size + 1);
 
-    switch (inst.type) {
-        case INST_NOP:
-            p_vm->inst_pointer++;
-            break;
-        
-        case INST_PUSH:
-            if (p_vm->stack_size >= VVM_STACK_CAPACITY)
-                return ERR_STACK_OVERFLOW;
-            p_vm->stack[p_vm->stack_size++] = inst.operand;
-            p_vm->inst_pointer++;
-            break;
+    for (size_t i = 0; i < size; ++i)
+        if (inst_is_jump(p_vm->program[i].type) && p_vm->program[i].operand.as_u64 < size)
+            target[p_vm->program[i].operand.as_u64] = 1;
 
-        case INST_DUP_REL:
-            if (p_vm->stack_size >= VVM_STACK_CAPACITY)
-                return ERR_STACK_OVERFLOW;
-            if (p_vm->stack_size - inst.operand.as_u64 <= 0)
-                return ERR_STACK_UNDERFLOW;
-            p_vm->stack[p_vm->stack_size].as_u64 = p_vm->stack[p_vm->stack_size - 1 - inst.operand.as_u64].as_u64;
-            p_vm->stack_size++;
-            p_vm->inst_pointer++;
-            break;
+    for (size_t i = 0; i < p_vasm->labels_size; ++i)
+        target[p_vasm->labels[i].addr] = 1;
 
-        case INST_SWAP:
-            if (inst.operand.as_u64 >= p_vm->stack_size)
-                return ERR_STACK_UNDERFLOW;
-
-            const uint64_t a = p_vm->stack_size - 1;
-            const uint64_t b = p_vm->stack_size - 1 - inst.operand.as_u64;
-  
-            word_t t = p_vm->stack[a];
-            p_vm->stack[a] = p_vm->stack[b];
-            p_vm->stack[b] = t;
-            p_vm->inst_pointer++;
-            break;
+    size_t fused_size = 0;
+    for (size_t i = 0; i < size;)
+    {
+        inst_t fused;
+        size_t n = vm_match_superinstruction(p_vm->program, size, i, &fused);
+        for (size_t j = 1; j < n; ++j)
+            if (target[i + j])
+                n = 0;
 
-        case INST_ADDI:
-            if (p_vm->stack_size < 2)
-                return ERR_STACK_UNDERFLOW;
-            p_vm->stack[p_vm->stack_size - 2].as_u64 += p_vm->stack[p_vm->stack_size - 1].as_u64;
-            p_vm->stack_size -= 1;
-            p_vm->inst_pointer++;
-            break; 
+        if (n == 0)
+        {
+            fused = p_vm->program[i];
+            n = 1;
+        }
+
+        for (size_t j = 0; j < n; ++j)
+            map[i + j] = fused_size;
+
+        p_vm->program[fused_size++] = fused;
+        i += n;
+    }
+    map[size] = fused_size;
+
+    vm_relocate_program(p_vm, p_vasm, map, fused_size);
+    arena_rewind(p_vm->arena, mark);
+    return ERR_OK;
+}
 
+// Computes what an instruction leaves on the stack from the constants it
+// takes, p_args[0] being the deepest of them. Returns 0 for instructions that
+// are not folded, and for operands they would fail on, so that they still fail
+// when run.
+static int vm_fold_constants(inst_type p_type, const word_t* p_args, word_t* p_result)
+{
+    word_t result = {0};
+
+    switch (p_type)
+    {
+        case INST_ADDI:
+            result.as_u64 = p_args[0].as_u64 + p_args[1].as_u64;
+            break;
         case INST_SUBI:
-            if (p_vm->stack_size < 2)
-                return ERR_STACK_UNDERFLOW;
-            p_vm->stack[p_vm->stack_size - 2].as_u64 -= p_vm->stack[p_vm->stack_size - 1].as_u64;
-            p_vm->stack_size -= 1;
-            p_vm->inst_pointer++;
+            result.as_u64 = p_args[0].as_u64 - p_args[1].as_u64;
             break;
-        
         case INST_MULI:
-            if (p_vm->stack_size < 2)
-                return ERR_STACK_UNDERFLOW;
-            p_vm->stack[p_vm->stack_size - 2].as_u64 *= p_vm->stack[p_vm->stack_size - 1].as_u64;
-            p_vm->stack_size -= 1;
-            p_vm->inst_pointer++;
+            result.as_u64 = p_args[0].as_u64 * p_args[1].as_u64;
             break;
-        
         case INST_DIVI:
-            if (p_vm->stack_size < 2)
-                return ERR_STACK_UNDERFLOW;
-            if (p_vm->stack[p_vm->stack_size - 1].as_u64 == 0)
-                return ERR_DIV_BY_ZERO;
-            p_vm->stack[p_vm->stack_size - 2].as_u64 /= p_vm->stack[p_vm->stack_size - 1].as_u64;
-            p_vm->stack_size -= 1;
-            p_vm->inst_pointer++;
+            if (p_args[1].as_u64 == 0)
+                return 0;
+            result.as_u64 = p_args[0].as_u64 / p_args[1].as_u64;
             break;
-
         case INST_ADDF:
-            if (p_vm->stack_size < 2)
-                return ERR_STACK_UNDERFLOW;
-            p_vm->stack[p_vm->stack_size - 2].as_f64 += p_vm->stack[p_vm->stack_size - 1].as_f64;
-            p_vm->stack_size -= 1;
-            p_vm->inst_pointer++;
+            result.as_f64 = p_args[0].as_f64 + p_args[1].as_f64;
             break;
-
         case INST_SUBF:
-            if (p_vm->stack_size < 2)
-                return ERR_STACK_UNDERFLOW;
-            p_vm->stack[p_vm->stack_size - 2].as_f64 -= p_vm->stack[p_vm->stack_size - 1].as_f64;
-            p_vm->stack_size -= 1;
-            p_vm->inst_pointer++;
+            result.as_f64 = p_args[0].as_f64 - p_args[1].as_f64;
             break;
-        
         case INST_MULF:
-            if (p_vm->stack_size < 2)
-                return ERR_STACK_UNDERFLOW;
-            p_vm->stack[p_vm->stack_size - 2].as_f64 *= p_vm->stack[p_vm->stack_size - 1].as_f64;
-            p_vm->stack_size -= 1;
-            p_vm->inst_pointer++;
+            result.as_f64 = p_args[0].as_f64 * p_args[1].as_f64;
             break;
-        
         case INST_DIVF:
-            if (p_vm->stack_size < 2)
-                return ERR_STACK_UNDERFLOW;
-            // if (p_vm->stack[p_vm->stack_size - 1].as_f64 == 0.0)
-             //    return ERR_DIV_BY_ZERO;
-            p_vm->stack[p_vm->stack_size - 2].as_f64 /= p_vm->stack[p_vm->stack_size - 1].as_f64;
-            p_vm->stack_size -= 1;
-            p_vm->inst_pointer++;
-            break;
-
-        case INST_JMP:
-            p_vm->inst_pointer = inst.operand.as_u64;
-            break;
-
-        case INST_JMP_NZ:
-            if (p_vm->stack_size < 1)
-                return ERR_STACK_UNDERFLOW;
-
-            if (p_vm->stack[p_vm->stack_size - 1].as_u64)
-                p_vm->inst_pointer = inst.operand.as_u64;
-            else
-                p_vm->inst_pointer++;
-
-            p_vm->stack_size--;
+            result.as_f64 = p_args[0].as_f64 / p_args[1].as_f64;
             break;
-
         case INST_EQ:
-            if (p_vm->stack_size < 2)
-                return ERR_STACK_UNDERFLOW;
-            p_vm->stack[p_vm->stack_size - 2].as_u64 = p_vm->stack[p_vm->stack_size - 2].as_u64 == p_vm->stack[p_vm->stack_size - 1].as_u64;
-            p_vm->stack_size -= 1;
-            p_vm->inst_pointer++;
+            result.as_u64 = p_args[0].as_u64 == p_args[1].as_u64;
             break;
-        
         case INST_NOT:
-            if (p_vm->stack_size < 1)
-                return ERR_STACK_OVERFLOW;
-            p_vm->stack[p_vm->stack_size - 1].as_u64 = !p_vm->stack[p_vm->stack_size - 1].as_u64;
-            p_vm->inst_pointer++;
+            result.as_u64 = !p_args[0].as_u64;
             break;
-
         case INST_GEQ:
-            if (p_vm->stack_size < 2)
-                return ERR_STACK_OVERFLOW;
-            p_vm->stack[p_vm->stack_size - 2].as_u64 = p_vm->stack[p_vm->stack_size - 1].as_f64 >= p_vm->stack[p_vm->stack_size - 2].as_f64;
-            p_vm->stack_size--;
-            p_vm->inst_pointer++;
+            result.as_u64 = p_args[1].as_f64 >= p_args[0].as_f64;
             break;
-
-        case INST_HALT:
-            p_vm->halt = 1;
+        case INST_FMA:
+            result.as_f64 = fma(p_args[0].as_f64, p_args[1].as_f64, p_args[2].as_f64);
+            break;
+        case INST_SQRTF:
+            result.as_f64 = sqrt(p_args[0].as_f64);
+            break;
+        case INST_I2F:
+            result.as_f64 = (double)p_args[0].as_i64;
+            break;
+        case INST_F2I:
+            if (!vm_float_fits_int(p_args[0].as_f64))
+                return 0;
+            result.as_i64 = (int64_t)p_args[0].as_f64;
+            break;
+        case INST_NEGF:
+            result.as_u64 = p_args[0].as_u64 ^ (UINT64_C(1) << 63);
+            break;
+        case INST_MINF:
+            result = p_args[0].as_f64 < p_args[1].as_f64 ? p_args[0] : p_args[1];
+            break;
+        case INST_MAXF:
+            result = p_args[0].as_f64 > p_args[1].as_f64 ? p_args[0] : p_args[1];
+            break;
+        case INST_LTF:
+            result.as_u64 = p_args[0].as_f64 < p_args[1].as_f64;
+            break;
+        case INST_LTI:
+            result.as_u64 = p_args[0].as_i64 < p_args[1].as_i64;
             break;
 
+        case INST_NOP:
+        case INST_PUSH:
+        case INST_DUP_REL:
+        case INST_SWAP:
+        case INST_JMP:
+        case INST_JMP_NZ:
+        case INST_HALT:
         case INST_PRINT_DEBUG:
-            //if (p_vm->stack_size < 1)
-            //   return ERR_STACK_UNDERFLOW;
-            // fprintf(stdout, "  u64: %lu, i64: %ld, f64: %lf, ptr: %p\n", 
-            //     p_vm->stack[p_vm->stack_size - 1].as_u64,
-            //     p_vm->stack[p_vm->stack_size - 1].as_i64,
-            //     p_vm->stack[p_vm->stack_size - 1].as_f64,
-            //     p_vm->stack[p_vm->stack_size - 1].as_ptr);
-            vm_dump_stack(stdout, p_vm);
-            //p_vm->stack_size -= 1;
-            p_vm->inst_pointer++;
-            break;
-        
+        case INST_ADDI_IMM:
+        case INST_SUBI_IMM:
+        case INST_MULI_IMM:
+        case INST_ADDF_IMM:
+        case INST_SUBF_IMM:
+        case INST_MULF_IMM:
+        case INST_DIVF_IMM:
+        case INST_ADDI_REL:
+        case INST_ADDF_REL:
+        case INST_DEC_JMP_NZ:
+        case INST_OUT:
+        case INST_OUTI:
+        case INST_VADDF:
+        case INST_VSUBF:
+        case INST_VMULF:
+        case INST_VDIVF:
+        case INST_VADDI:
+        case INST_VSUBI:
+        case INST_VMULI:
+        case INST_VDIVI:
+        case INST_VSUMF:
+        case INST_VSUMI:
+        case INST_VBCAST:
+        case INST_LOAD:
+        case INST_STORE:
+        case INST_LOAD_IMM:
+        case INST_STORE_IMM:
+        case INST_MEMCPY:
+        case INST_MEMSET:
+        case INST_NATIVE:
         case NUMBER_OF_INSTS:
         default:
-            return ERR_ILLEGAL_INSTRUCTION;
+            return 0;
     }
 
-    return ERR_OK;
+    *p_result = result;
+    return 1;
 }
 
-error vm_execute_program(vvm_t* p_vm, int p_limit)
+// An element of the stack as far as the optimizer knows it.
+typedef struct {
+    int known;
+    word_t value;
+    size_t producer;    // Address of the push that left the constant there, or
+                        // SIZE_MAX if it was moved since.
+} opt_value_t;
+
+// Folds the constants of every basic block. Blocks are followed from their
+// first instruction with nothing known about the stack, and a run of pushes
+// directly followed by an instruction that only takes constants is replaced
+// by a push of the result. Removed instructions become nops.
+static int vm_optimize_blocks(vvm_t* p_vm, const uint8_t* p_leader, opt_value_t* p_stack, size_t* p_live)
 {
-    // If p_limit is positive, it will execute a finite number of instructions,
-    // While if p_limit is negative, it will execute instructions without limit.
-    while (p_limit != 0 && !p_vm->halt)
+    inst_t* program = p_vm->program;
+    const size_t size = p_vm->program_size;
+    int changed = 0;
+
+    // p_live holds the addresses of the instructions of the block so far that
+    // are not nops.
+    size_t depth = 0;
+    size_t live = 0;
+    for (size_t i = 0; i < size; ++i)
     {
-        error err = vm_execute_inst(p_vm);
-        if (err != ERR_OK)
-            return err;
+        if (p_leader[i])
+        {
+            depth = 0;
+            live = 0;
+        }
 
-        if (p_limit > 0)
-            --p_limit;
-    }
+        inst_t* inst = &program[i];
+        if (inst->type == INST_NOP)
+            continue;
 
-    return ERR_OK;
-}
+        if (inst->type == INST_DUP_REL)
+        {
+            const uint64_t k = inst->operand.as_u64;
+            if (k < depth && p_stack[depth - 1 - k].known)
+            {
+                *inst = (inst_t){ .type = INST_PUSH, .operand = p_stack[depth - 1 - k].value };
+                changed = 1;
+            }
+        }
 
-void vm_dump_stack(FILE* p_stream, const vvm_t* p_vm)
-{
-    fprintf(p_stream, "Stack:\n");
-    if (p_vm->stack_size > 0)
-        for (uint64_t i = 0; i < p_vm->stack_size; ++i)
-            fprintf(p_stream, "  u64: %lu, i64: %ld, f64: %lf, ptr: %p\n", 
-                p_vm->stack[i].as_u64,
-                p_vm->stack[i].as_i64,
-                p_vm->stack[i].as_f64,
-                p_vm->stack[i].as_ptr);
-    else
-        fprintf(p_stream, "  [Empty]\n");
-}
+        if (inst->type == INST_PUSH)
+        {
+            p_stack[depth++] = (opt_value_t){ .known = 1, .value = inst->operand, .producer = i };
+            p_live[live++] = i;
+            continue;
+        }
 
-void vm_push_inst(vvm_t* p_vm, inst_t p_inst)
-{
-    assert(p_vm->program_size < VVM_PROGRAM_CAPACITY);
-    p_vm->program[p_vm->program_size++] = p_inst;
-}
+        if (inst->type == INST_DUP_REL)
+        {
+            p_stack[depth++] = (opt_value_t){ .producer = SIZE_MAX };
+            p_live[live++] = i;
+            continue;
+        }
 
-void vm_load_program_from_memory(vvm_t* p_vm, inst_t* p_program, size_t p_program_size)
-{
-    assert(p_program_size < VVM_PROGRAM_CAPACITY);
-    memcpy(p_vm->program, p_program, sizeof(p_program[0]) * p_program_size);
-    p_vm->program_size = p_program_size;
-}
+        if (inst->type == INST_SWAP)
+        {
+            const uint64_t k = inst->operand.as_u64;
+            if (k == 1 && depth >= 2 && live >= 2 &&
+                p_stack[depth - 2].producer == p_live[live - 2] &&
+                p_stack[depth - 1].producer == p_live[live - 1])
+            {
+                // Swapping two pushes is pushing the other way around.
+                const word_t operand = program[p_live[live - 2]].operand;
+                program[p_live[live - 2]].operand = program[p_live[live - 1]].operand;
+                program[p_live[live - 1]].operand = operand;
 
-void vm_load_program_from_file(vvm_t* p_vm, const char* p_file_path)
-{
-    FILE *f = fopen(p_file_path, "rb");
-    if (f == NULL)
-    {
-        fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
-    }
+                const word_t value = p_stack[depth - 2].value;
+                p_stack[depth - 2].value = p_stack[depth - 1].value;
+                p_stack[depth - 1].value = value;
 
-    if (fseek(f, 0, SEEK_END) < 0)
-    {
-        fprintf(stderr, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
-    }
+                inst->type = INST_NOP;
+                changed = 1;
+                continue;
+            }
 
-    long m = ftell(f);
-    if (m < 0)
-    {
-        fprintf(stderr, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
-    }
+            if (k < depth)
+            {
+                const opt_value_t t = p_stack[depth - 1];
+                p_stack[depth - 1] = p_stack[depth - 1 - k];
+                p_stack[depth - 1 - k] = t;
+                p_stack[depth - 1].producer = SIZE_MAX;
+                p_stack[depth - 1 - k].producer = SIZE_MAX;
+            }
+            else if (depth > 0)
+            {
+                p_stack[depth - 1] = (opt_value_t){ .producer = SIZE_MAX };
+            }
 
-    assert(m % sizeof(p_vm->program[0]) == 0);
-    assert((size_t)m <= VVM_PROGRAM_CAPACITY * sizeof(p_vm->program[0]));
+            p_live[live++] = i;
+            continue;
+        }
 
-    if (fseek(f, 0, SEEK_SET) < 0)
-    {
-        fprintf(stderr, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
-    }
+        // A conditional jump on a constant either always or never jumps.
+        if (inst->type == INST_JMP_NZ && depth >= 1 && live >= 1 &&
+            p_stack[depth - 1].producer == p_live[live - 1])
+        {
+            program[p_live[live - 1]].type = INST_NOP;
+            inst->type = p_stack[depth - 1].value.as_u64 != 0 ? INST_JMP : INST_NOP;
+            --depth;
+            --live;
+            if (inst->type != INST_NOP)
+                p_live[live++] = i;
+            changed = 1;
+            continue;
+        }
 
-    p_vm->program_size = fread(p_vm->program, sizeof(p_vm->program[0]), m / sizeof(p_vm->program[0]), f);
-    if (ferror(f))
-    {
-        fprintf(stderr, "[ERROR]: Could Not Read File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
+        uint64_t pops = 0;
+        uint64_t pushes = 0;
+        if (!vm_stack_effect(*inst, &pops, &pushes))
+        {
+            depth = 0;
+            p_live[live++] = i;
+            continue;
+        }
+
+        if (pushes == 1 && pops >= 1 && pops <= 3 && depth >= pops && live >= pops)
+        {
+            word_t args[3];
+            int constant = 1;
+            for (size_t j = 0; j < pops; ++j)
+            {
+                const opt_value_t* value = &p_stack[depth - pops + j];
+                constant = constant && value->producer == p_live[live - pops + j];
+                args[j] = value->value;
+            }
+
+            word_t result;
+            if (constant && vm_fold_constants(inst->type, args, &result))
+            {
+                const size_t first = p_live[live - pops];
+                program[first].operand = result;
+                for (size_t j = 1; j < pops; ++j)
+                    program[p_live[live - pops + j]].type = INST_NOP;
+                inst->type = INST_NOP;
+
+                depth -= pops;
+                live -= pops - 1;
+                p_stack[depth++] = (opt_value_t){ .known = 1, .value = result, .producer = first };
+                changed = 1;
+                continue;
+            }
+        }
+
+        depth = depth > pops ? depth - pops : 0;
+        for (uint64_t j = 0; j < pushes; ++j)
+            p_stack[depth++] = (opt_value_t){ .producer = SIZE_MAX };
+        p_live[live++] = i;
     }
 
-    fclose(f);
+    return changed;
 }
 
-void vm_save_program_to_file(const vvm_t* p_vm, const char* p_file_path)
+// Where a jump to p_addr ends up, skipping nops and following other jumps.
+static inst_addr_t vm_thread_jump(const vvm_t* p_vm, inst_addr_t p_addr)
 {
-    FILE* f = fopen(p_file_path, "wb");
-    if (f == NULL)
-    {
-        fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
-    }
-
-    fwrite(p_vm->program, sizeof(p_vm->program[0]), p_vm->program_size, f);
-    if (ferror(f))
+    const size_t size = p_vm->program_size;
+    for (size_t steps = 0; p_addr < size && steps < size; ++steps)
     {
-        fprintf(stderr, "[ERROR]: Could Not Write To File `%s`: %s\n", p_file_path, strerror(errno));
-        exit(1);
+        const inst_t* inst = &p_vm->program[p_addr];
+        if (inst->type == INST_NOP)
+            p_addr++;
+        else if (inst->type == INST_JMP && inst->operand.as_u64 != p_addr)
+            p_addr = inst->operand.as_u64;
+        else
+            break;
     }
 
-    fclose(f);
+    return p_addr;
 }
 
-void vm_translate_source(string_view_t p_source, vvm_t* p_vm, vasm_t* p_vasm)
+error vm_optimize_program(vvm_t* p_vm, vasm_t* p_vasm)
 {
-    while (p_source.count > 0)
+    // Runs after label resolution, like vm_fuse_superinstructions. Every pass
+    // replaces the instructions it removes with nops, so that addresses stay
+    // put until the nops are removed at the end. Without the memory for it,
+    // the program is left as it was.
+    const error err = vm_reserve_program(p_vm, p_vm->program_size);
+    if (err != ERR_OK)
+        return err;
+
+    inst_t* program = p_vm->program;
+    const size_t size = p_vm->program_size;
+    const arena_mark_t mark = arena_mark(p_vm->arena);
+    uint8_t* leader = arena_alloc(p_vm->arena, size + 1);
+    inst_addr_t* work = arena_alloc(p_vm->arena, sizeof(work[0]) * (size + 1));
+    size_t* live = arena_alloc(p_vm->arena, sizeof(live[0]) * (size + 1));
+    opt_value_t* stack = arena_alloc(p_vm->arena, sizeof(stack[0]) * (8 * size + 1));
+    if (leader == NULL || work == NULL || live == NULL || stack == NULL)
     {
-        assert(p_vm->program_size < VVM_PROGRAM_CAPACITY);
+        vvm_diagnose(p_vasm->diagnostics, "[ERROR]: Could Not Allocate Memory To Optimize %lu Instructions\n", size);
+        arena_rewind(p_vm->arena, mark);
+        return ERR_OUT_OF_MEMORY;
+    }
 
-        string_view_t line = sv_trim(sv_chop_by_delim(&p_source, '\n'));
-        if (line.count > 0 && *line.data != '#')
+    int changed = 1;
+    for (int round = 0; changed && round < VVM_OPTIMIZE_ROUNDS; ++round)
+    {
+        changed = 0;
+
+        // Jump threading. A jump to the instruction that runs next anyway is
+        // a nop, a jump to a halt halts.
+        for (size_t i = 0; i < size; ++i)
         {
-            line = sv_trim_left(line);
-            string_view_t token = sv_chop_by_delim(&line, ' ');
+            inst_t* inst = &program[i];
+            if (!inst_is_jump(inst->type) || inst->operand.as_u64 >= size)
+                continue;
 
-            if (token.count > 0 && token.data[token.count - 1] == ':') {
-                string_view_t label = {
-                    .count = token.count - 1,
-                    .data = token.data
-                };
-                vasm_push_label(p_vasm, label, p_vm->program_size);
+            const inst_addr_t target = vm_thread_jump(p_vm, inst->operand.as_u64);
+            if (target != inst->operand.as_u64)
+            {
+                inst->operand.as_u64 = target;
+                changed = 1;
+            }
 
-                // Try to repeat the instruction name.
-                token = sv_trim(sv_chop_by_delim(&line, ' '));
-            } 
-            
-            if (token.count > 0)
+            if (inst->type == INST_JMP && target == vm_thread_jump(p_vm, i + 1) && target != i)
             {
-                string_view_t operand = sv_trim(sv_chop_by_delim(&line, '#'));
-                if (sv_equal(token, cstr_as_sv(inst_name(INST_NOP)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){0};
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_PUSH)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_PUSH, 
-                        .operand = number_literal_as_word(operand),
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_DUP_REL)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_DUP_REL, 
-                        .operand = { .as_i64 = sv_to_int(operand) }
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_SWAP)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_SWAP,
-                        .operand = { .as_i64 = sv_to_int(operand) }
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_ADDI)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_ADDI
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_SUBI)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_SUBI
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_MULI)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_MULI
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_DIVI)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_DIVI
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_ADDF)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_ADDF
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_SUBF)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_SUBF
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_MULF)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_MULF
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_DIVF)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_DIVF
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_JMP)))) {
-                    if (operand.count > 0 && isdigit(*operand.data)) {
-                        p_vm->program[p_vm->program_size++] = (inst_t){
-                            .type = INST_JMP,
-                            .operand = { .as_i64 = sv_to_int(operand) }
-                        };
-                    } else {
-                        vasm_push_deferred_operand(p_vasm, p_vm->program_size, operand);
-                        p_vm->program[p_vm->program_size++] = (inst_t){
-                            .type = INST_JMP
-                        };
-                    }
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_JMP_NZ)))) {
-                    if (operand.count > 0 && isdigit(*operand.data)) {
-                        p_vm->program[p_vm->program_size++] = (inst_t) {
-                            .type = INST_JMP_NZ,
-                            .operand = { .as_i64 = sv_to_int(operand)}
-                        };
-                    } else {
-                        vasm_push_deferred_operand(p_vasm, p_vm->program_size, operand);
-                        p_vm->program[p_vm->program_size++] = (inst_t) {
-                            .type = INST_JMP_NZ
-                        };
-                    }
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_EQ)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_EQ
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_NOT)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_NOT
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_GEQ)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_GEQ
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_HALT)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_HALT
-                    };
-                } else if (sv_equal(token, cstr_as_sv(inst_name(INST_PRINT_DEBUG)))) {
-                    p_vm->program[p_vm->program_size++] = (inst_t){
-                        .type = INST_PRINT_DEBUG
-                    };
-                } else {
-                    fprintf(stderr, "[ERROR]: Unknown Instruction `%.*s`.\n", (int)token.count, token.data);
-                    exit(1);
-                }
+                inst->type = INST_NOP;
+                changed = 1;
+            }
+            else if (inst->type == INST_JMP && target < size && program[target].type == INST_HALT)
+            {
+                *inst = (inst_t){ .type = INST_HALT };
+                changed = 1;
+            }
+        }
+
+        // Unreachable code. Labels don't make code reachable, jumps do.
+        memset(leader, 0, size + 1);
+        size_t count = 0;
+        if (size > 0)
+        {
+            leader[0] = 1;
+            work[count++] = 0;
+        }
+        while (count > 0)
+        {
+            const inst_addr_t i = work[--count];
+            const inst_t* inst = &program[i];
+            if (inst_is_jump(inst->type) && inst->operand.as_u64 < size && !leader[inst->operand.as_u64])
+            {
+                leader[inst->operand.as_u64] = 1;
+                work[count++] = inst->operand.as_u64;
+            }
+            if (inst->type != INST_JMP && inst->type != INST_HALT && i + 1 < size && !leader[i + 1])
+            {
+                leader[i + 1] = 1;
+                work[count++] = i + 1;
+            }
+        }
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (!leader[i] && program[i].type != INST_NOP)
+            {
+                program[i].type = INST_NOP;
+                changed = 1;
             }
         }
+
+        // Basic blocks start at the start of the program, at labels and jump
+        // targets, and after jumps and halts.
+        memset(leader, 0, size + 1);
+        leader[0] = 1;
+        for (size_t i = 0; i < p_vasm->labels_size; ++i)
+            leader[p_vasm->labels[i].addr] = 1;
+        for (size_t i = 0; i < size; ++i)
+        {
+            const inst_t* inst = &program[i];
+            if (inst_is_jump(inst->type) && inst->operand.as_u64 < size)
+                leader[inst->operand.as_u64] = 1;
+            if (inst_is_jump(inst->type) || inst->type == INST_HALT)
+                leader[i + 1] = 1;
+        }
+
+        changed |= vm_optimize_blocks(p_vm, leader, stack, live);
     }
 
-    // Second pass to resolve labels.
-    for (size_t i = 0; i < p_vasm->deferred_operands_size; ++i)
+    // Drops the nops, and moves everything that refers to an address to the
+    // next instruction that is kept.
+    size_t kept = 0;
+    for (size_t i = 0; i < size; ++i)
     {
-        inst_addr_t addr = vasm_find_label_addr(p_vasm, p_vasm->deferred_operands[i].label);
-        p_vm->program[p_vasm->deferred_operands[i].addr].operand.as_u64 = addr;
+        work[i] = kept;
+        if (program[i].type != INST_NOP)
+            program[kept++] = program[i];
     }
+    work[size] = kept;
+
+    vm_relocate_program(p_vm, p_vasm, work, kept);
+    arena_rewind(p_vm->arena, mark);
+    return ERR_OK;
 }
 
 #endif // VM_IMPLEMENTATION
\ No newline at end of file
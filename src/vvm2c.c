@@ -0,0 +1,539 @@
+#define VM_IMPLEMENTATION
+#include "./vvm.h"
+
+// Compiles a .vm file ahead of time into a C translation unit, which the
+// system compiler turns into a standalone executable. Every instruction
+// becomes straight-line code over a local stack, with the stack pointer in a
+// local variable, and jumps become gotos to the labels of their targets.
+//
+// Like the JIT, the generated code only does the common case. Whenever one of
+// its checks might fail, and for print_debug, halt, memcpy, memset, natives
+// and vector instructions, the instruction is handed to vm_execute_inst with
+// the exact inst_pointer and stack_size, so errors and output are those of
+// `vme`.
+// Checks of the instructions vm_verify_program proves safe are left out.
+// Instructions are counted per basic block, and a run whose limit ends inside
+// a block, or that jumps out of the program, finishes on vm_execute_program.
+
+arena_t arena = {0};
+vvm_t vm = {0};
+
+static const char* const prelude =
+    "#define VM_IMPLEMENTATION\n"
+    "#include \"vvm.h\"\n"
+    "\n"
+    "// Writes the machine state back and runs one instruction on the interpreter.\n"
+    "#define VVM2C_INTERPRET(p_addr) do {                                    \\\n"
+    "        p_vm->stack_size = sp;                                          \\\n"
+    "        p_vm->inst_pointer = (p_addr);                                  \\\n"
+    "        const error err = vm_execute_inst(p_vm);                        \\\n"
+    "        if (err != ERR_OK || p_vm->halt)                                \\\n"
+    "            return err;                                                 \\\n"
+    "        sp = p_vm->stack_size;                                          \\\n"
+    "    } while (0)\n"
+    "\n"
+    "// Leaves the rest of the run, and whatever is left of the limit, to the\n"
+    "// interpreter.\n"
+    "#define VVM2C_BUDGET (p_limit < 0 ? -1 : (int)budget)\n"
+    "#define VVM2C_RESUME(p_addr) do {                                       \\\n"
+    "        p_vm->stack_size = sp;                                          \\\n"
+    "        p_vm->inst_pointer = (p_addr);                                  \\\n"
+    "        return vm_execute_program(p_vm, VVM2C_BUDGET);                  \\\n"
+    "    } while (0)\n"
+    "#define VVM2C_INTERPRET_JUMP(p_addr) do {                               \\\n"
+    "        VVM2C_INTERPRET(p_addr);                                        \\\n"
+    "        return vm_execute_program(p_vm, VVM2C_BUDGET);                  \\\n"
+    "    } while (0)\n"
+    "\n"
+    "static inline double vvm2c_f64(uint64_t p_bits)\n"
+    "{\n"
+    "    const word_t word = { .as_u64 = p_bits };\n"
+    "    return word.as_f64;\n"
+    "}\n"
+    "\n";
+
+static const char* const epilogue =
+    "static void usage(FILE* p_stream, const char* p_program)\n"
+    "{\n"
+    "    fprintf(p_stream, \"Usage: %s [-l <limit>] [--native <lib.so>] [-s] [-h]\\n\", p_program);\n"
+    "}\n"
+    "\n"
+    "int main(int argc, char** argv)\n"
+    "{\n"
+    "    int limit = -1;\n"
+    "    int dump = 0;\n"
+    "    const char* native_file_path = NULL;\n"
+    "\n"
+    "    for (int i = 1; i < argc; ++i)\n"
+    "    {\n"
+    "        if (strcmp(argv[i], \"-l\") == 0) {\n"
+    "            if (i + 1 == argc)\n"
+    "            {\n"
+    "                usage(stderr, argv[0]);\n"
+    "                fprintf(stderr, \"[ERROR]: No Argument Provided For Flag `%s`\\n\", argv[i]);\n"
+    "                exit(1);\n"
+    "            }\n"
+    "            limit = atoi(argv[++i]);\n"
+    "        } else if (strcmp(argv[i], \"--native\") == 0) {\n"
+    "            if (i + 1 == argc)\n"
+    "            {\n"
+    "                usage(stderr, argv[0]);\n"
+    "                fprintf(stderr, \"[ERROR]: No Argument Provided For Flag `%s`\\n\", argv[i]);\n"
+    "                exit(1);\n"
+    "            }\n"
+    "            native_file_path = argv[++i];\n"
+    "        } else if (strcmp(argv[i], \"-s\") == 0) {\n"
+    "            dump = 1;\n"
+    "        } else if (strcmp(argv[i], \"-h\") == 0) {\n"
+    "            usage(stdout, argv[0]);\n"
+    "            exit(0);\n"
+    "        } else {\n"
+    "            usage(stderr, argv[0]);\n"
+    "            fprintf(stderr, \"[ERROR]: Unknown Flag `%s`\\n\", argv[i]);\n"
+    "            exit(1);\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    arena_t arena = {0};\n"
+    "    vvm_t vm = {0};\n"
+    "    if (vm_init(&vm, &arena, VVM2C_STACK_CAPACITY) != ERR_OK)\n"
+    "    {\n"
+    "        fprintf(stderr, \"[ERROR]: %s\\n\", error_as_cstr(ERR_OUT_OF_MEMORY));\n"
+    "        exit(1);\n"
+    "    }\n"
+    "    if (vm_map_memory(&vm, VVM2C_MEMORY_SIZE, 0) != ERR_OK ||\n"
+    "        vm_load_program_from_memory(&vm, program, VVM2C_PROGRAM_SIZE) != ERR_OK)\n"
+    "        exit(1);\n"
+    "\n"
+    "    // Natives are always interpreted, and the program is compiled against\n"
+    "    // no table, so any table with the ids it calls will do.\n"
+    "#ifdef VVM_DLOPEN\n"
+    "    native_library_t natives = {0};\n"
+    "    if (native_file_path != NULL)\n"
+    "    {\n"
+    "        if (native_library_open(native_file_path, &natives, stderr) != ERR_OK)\n"
+    "            exit(1);\n"
+    "        vm.natives = natives.table;\n"
+    "    }\n"
+    "#else\n"
+    "    if (native_file_path != NULL)\n"
+    "    {\n"
+    "        fprintf(stderr, \"[ERROR]: Flag `--native` Is Not Supported By This Build\\n\");\n"
+    "        exit(1);\n"
+    "    }\n"
+    "#endif\n"
+    "\n"
+    "    const error err = vvm2c_run(&vm, limit);\n"
+    "\n"
+    "    // Output up to an error is written out all the same.\n"
+    "    if (vm_flush_channel(&vm) != ERR_OK)\n"
+    "        exit(1);\n"
+    "    if (dump)\n"
+    "        vm_dump_stack(stdout, &vm);\n"
+    "    if (err != ERR_OK)\n"
+    "    {\n"
+    "        fprintf(stderr, \"[ERROR]: %s\\n\", error_as_cstr(err));\n"
+    "        exit(1);\n"
+    "    }\n"
+    "\n"
+    "    vm_unmap_memory(&vm);\n"
+    "#ifdef VVM_DLOPEN\n"
+    "    native_library_close(&natives);\n"
+    "#endif\n"
+    "    arena_free(&arena);\n"
+    "    return 0;\n"
+    "}\n";
+
+// Writes the native body of an instruction, which is handed to the
+// interpreter instead whenever p_condition holds. p_condition is NULL when it
+// never does.
+static void emit_inst(FILE* p_stream, inst_addr_t p_addr, const char* p_condition, const char* p_format, ...)
+{
+    if (p_condition != NULL)
+        fprintf(p_stream, "    if (%s) VVM2C_INTERPRET(%lu); else { ", p_condition, p_addr);
+    else
+        fprintf(p_stream, "    { ");
+
+    va_list args;
+    va_start(args, p_format);
+    vfprintf(p_stream, p_format, args);
+    va_end(args);
+
+    fprintf(p_stream, " }\n");
+}
+
+// Jumps inside the program go to the label of their target, the others to the
+// interpreter, which reports them once the limit lets it get that far.
+static void emit_goto(FILE* p_stream, inst_addr_t p_target, uint64_t p_program_size)
+{
+    if (p_target < p_program_size)
+        fprintf(p_stream, "goto L_%lu;", p_target);
+    else
+        fprintf(p_stream, "VVM2C_RESUME(UINT64_C(%lu));", p_target);
+}
+
+static void emit_program(FILE* p_stream, const vvm_t* p_vm, uint64_t p_stack_capacity, uint64_t p_memory_size)
+{
+    const uint64_t size = p_vm->program_size;
+
+    // Blocks start at the first instruction, at jump targets and after jumps.
+    // Only targets need a label.
+    uint8_t* leaders = arena_alloc(&arena, size + 1);
+    uint8_t* targets = arena_alloc(&arena, size + 1);
+    if (leaders == NULL || targets == NULL)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+    memset(leaders, 0, size + 1);
+    memset(targets, 0, size + 1);
+    leaders[0] = 1;
+    for (inst_addr_t i = 0; i < size; ++i)
+    {
+        const inst_t inst = p_vm->program[i];
+        if (!inst_is_jump(inst.type))
+            continue;
+
+        leaders[i + 1] = 1;
+        if (inst.operand.as_u64 < size)
+            leaders[inst.operand.as_u64] = targets[inst.operand.as_u64] = 1;
+    }
+
+    fprintf(p_stream, "%s", prelude);
+    fprintf(p_stream, "#define VVM2C_STACK_CAPACITY UINT64_C(%lu)\n", p_stack_capacity);
+    fprintf(p_stream, "#define VVM2C_MEMORY_SIZE UINT64_C(%lu)\n", p_memory_size);
+    fprintf(p_stream, "#define VVM2C_PROGRAM_SIZE UINT64_C(%lu)\n\n", size);
+
+    // The interpreter runs the same program for the instructions it is handed.
+    fprintf(p_stream, "static inst_t program[] = {\n");
+    for (inst_addr_t i = 0; i < size; ++i)
+        fprintf(p_stream, "    { %s, { .as_u64 = UINT64_C(0x%016lx) } },\n",
+            p_vm->program[i].type < NUMBER_OF_INSTS ? inst_type_as_cstr(p_vm->program[i].type) : "NUMBER_OF_INSTS",
+            p_vm->program[i].operand.as_u64);
+    if (size == 0)
+        fprintf(p_stream, "    { INST_NOP, { .as_u64 = 0 } },\n");
+    fprintf(p_stream, "};\n\n");
+
+    fprintf(p_stream, "static error vvm2c_run(vvm_t* p_vm, int p_limit)\n{\n");
+    fprintf(p_stream, "    static word_t stack[VVM2C_STACK_CAPACITY];\n");
+    fprintf(p_stream, "    uint64_t sp = 0;\n");
+    fprintf(p_stream, "    uint64_t budget = p_limit < 0 ? UINT64_MAX : (uint64_t)p_limit;\n");
+    fprintf(p_stream, "    word_t* const memory = p_vm->memory;\n");
+    fprintf(p_stream, "    p_vm->stack = stack;\n");
+
+    char condition[128];
+    inst_addr_t block_end = 0;
+    for (inst_addr_t i = 0; i < size; ++i)
+    {
+        const inst_t inst = p_vm->program[i];
+        const uint64_t k = inst.operand.as_u64;
+        const int checked = !p_vm->verified[i];
+
+        if (leaders[i])
+        {
+            block_end = i + 1;
+            while (!leaders[block_end] && block_end < size)
+                ++block_end;
+
+            fprintf(p_stream, "\n");
+            if (targets[i])
+                fprintf(p_stream, "L_%lu:\n", i);
+            fprintf(p_stream, "    if (budget < %lu) VVM2C_RESUME(%lu);\n", block_end - i, i);
+            fprintf(p_stream, "    budget -= %lu;\n", block_end - i);
+        }
+
+        if (inst.type < NUMBER_OF_INSTS)
+        {
+            fprintf(p_stream, "    /* %lu: %s", i, inst_name(inst.type));
+            if (inst_has_operand(inst.type))
+                fprintf(p_stream, " %ld", inst.operand.as_i64);
+            fprintf(p_stream, " */\n");
+        }
+
+        switch (inst.type)
+        {
+            case INST_NOP:
+                break;
+
+            case INST_PUSH:
+                emit_inst(p_stream, i, checked ? "sp >= VVM2C_STACK_CAPACITY" : NULL,
+                    "stack[sp++].as_u64 = UINT64_C(0x%016lx);", k);
+                break;
+            case INST_DUP_REL:
+                snprintf(condition, sizeof(condition), "sp >= VVM2C_STACK_CAPACITY || sp <= UINT64_C(%lu)", k);
+                emit_inst(p_stream, i, checked ? condition : NULL,
+                    "stack[sp] = stack[sp - 1 - UINT64_C(%lu)]; sp++;", k);
+                break;
+            case INST_SWAP:
+                snprintf(condition, sizeof(condition), "sp <= UINT64_C(%lu)", k);
+                emit_inst(p_stream, i, checked ? condition : NULL,
+                    "const word_t t = stack[sp - 1]; stack[sp - 1] = stack[sp - 1 - UINT64_C(%lu)]; stack[sp - 1 - UINT64_C(%lu)] = t;", k, k);
+                break;
+
+            case INST_ADDI:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_u64 += stack[sp - 1].as_u64; sp--;");
+                break;
+            case INST_SUBI:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_u64 -= stack[sp - 1].as_u64; sp--;");
+                break;
+            case INST_MULI:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_u64 *= stack[sp - 1].as_u64; sp--;");
+                break;
+            case INST_DIVI:
+                emit_inst(p_stream, i, checked ? "sp < 2 || stack[sp - 1].as_u64 == 0" : "stack[sp - 1].as_u64 == 0",
+                    "stack[sp - 2].as_u64 /= stack[sp - 1].as_u64; sp--;");
+                break;
+            case INST_ADDF:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_f64 += stack[sp - 1].as_f64; sp--;");
+                break;
+            case INST_SUBF:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_f64 -= stack[sp - 1].as_f64; sp--;");
+                break;
+            case INST_MULF:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_f64 *= stack[sp - 1].as_f64; sp--;");
+                break;
+            case INST_DIVF:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_f64 /= stack[sp - 1].as_f64; sp--;");
+                break;
+
+            case INST_JMP:
+                fprintf(p_stream, "    ");
+                emit_goto(p_stream, k, size);
+                fprintf(p_stream, "\n");
+                break;
+            case INST_JMP_NZ:
+                if (checked)
+                    fprintf(p_stream, "    if (sp < 1) VVM2C_INTERPRET_JUMP(%lu);\n", i);
+                fprintf(p_stream, "    if (stack[--sp].as_u64) ");
+                emit_goto(p_stream, k, size);
+                fprintf(p_stream, "\n");
+                break;
+            case INST_DEC_JMP_NZ:
+                if (checked)
+                    fprintf(p_stream, "    if (sp >= VVM2C_STACK_CAPACITY || sp < 1) VVM2C_INTERPRET_JUMP(%lu);\n", i);
+                fprintf(p_stream, "    if (--stack[sp - 1].as_u64) ");
+                emit_goto(p_stream, k, size);
+                fprintf(p_stream, "\n");
+                break;
+
+            case INST_EQ:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_u64 = stack[sp - 2].as_u64 == stack[sp - 1].as_u64; sp--;");
+                break;
+            case INST_NOT:
+                emit_inst(p_stream, i, checked ? "sp < 1" : NULL, "stack[sp - 1].as_u64 = !stack[sp - 1].as_u64;");
+                break;
+            case INST_GEQ:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_u64 = stack[sp - 1].as_f64 >= stack[sp - 2].as_f64; sp--;");
+                break;
+
+            case INST_ADDI_IMM:
+                emit_inst(p_stream, i, checked ? "sp >= VVM2C_STACK_CAPACITY || sp < 1" : NULL,
+                    "stack[sp - 1].as_u64 += UINT64_C(0x%016lx);", k);
+                break;
+            case INST_SUBI_IMM:
+                emit_inst(p_stream, i, checked ? "sp >= VVM2C_STACK_CAPACITY || sp < 1" : NULL,
+                    "stack[sp - 1].as_u64 -= UINT64_C(0x%016lx);", k);
+                break;
+            case INST_MULI_IMM:
+                emit_inst(p_stream, i, checked ? "sp >= VVM2C_STACK_CAPACITY || sp < 1" : NULL,
+                    "stack[sp - 1].as_u64 *= UINT64_C(0x%016lx);", k);
+                break;
+            case INST_ADDF_IMM:
+                emit_inst(p_stream, i, checked ? "sp >= VVM2C_STACK_CAPACITY || sp < 1" : NULL,
+                    "stack[sp - 1].as_f64 += vvm2c_f64(UINT64_C(0x%016lx));", k);
+                break;
+            case INST_SUBF_IMM:
+                emit_inst(p_stream, i, checked ? "sp >= VVM2C_STACK_CAPACITY || sp < 1" : NULL,
+                    "stack[sp - 1].as_f64 -= vvm2c_f64(UINT64_C(0x%016lx));", k);
+                break;
+            case INST_MULF_IMM:
+                emit_inst(p_stream, i, checked ? "sp >= VVM2C_STACK_CAPACITY || sp < 1" : NULL,
+                    "stack[sp - 1].as_f64 *= vvm2c_f64(UINT64_C(0x%016lx));", k);
+                break;
+            case INST_DIVF_IMM:
+                emit_inst(p_stream, i, checked ? "sp >= VVM2C_STACK_CAPACITY || sp < 1" : NULL,
+                    "stack[sp - 1].as_f64 /= vvm2c_f64(UINT64_C(0x%016lx));", k);
+                break;
+            case INST_ADDI_REL:
+                snprintf(condition, sizeof(condition), "sp >= VVM2C_STACK_CAPACITY || sp <= UINT64_C(%lu)", k);
+                emit_inst(p_stream, i, checked ? condition : NULL,
+                    "stack[sp - 1].as_u64 += stack[sp - 1 - UINT64_C(%lu)].as_u64;", k);
+                break;
+            case INST_ADDF_REL:
+                snprintf(condition, sizeof(condition), "sp >= VVM2C_STACK_CAPACITY || sp <= UINT64_C(%lu)", k);
+                emit_inst(p_stream, i, checked ? condition : NULL,
+                    "stack[sp - 1].as_f64 += stack[sp - 1 - UINT64_C(%lu)].as_f64;", k);
+                break;
+
+            case INST_OUT:
+                emit_inst(p_stream, i, checked ? "sp < 1" : NULL, "vm_channel_word(&p_vm->channel, stack[--sp]);");
+                break;
+            case INST_OUTI:
+                emit_inst(p_stream, i, checked ? "sp < 1" : NULL, "vm_channel_decimal(&p_vm->channel, stack[--sp].as_i64);");
+                break;
+
+            case INST_FMA:
+                emit_inst(p_stream, i, checked ? "sp < 3" : NULL,
+                    "stack[sp - 3].as_f64 = fma(stack[sp - 3].as_f64, stack[sp - 2].as_f64, stack[sp - 1].as_f64); sp -= 2;");
+                break;
+            case INST_SQRTF:
+                emit_inst(p_stream, i, checked ? "sp < 1" : NULL, "stack[sp - 1].as_f64 = sqrt(stack[sp - 1].as_f64);");
+                break;
+            case INST_I2F:
+                emit_inst(p_stream, i, checked ? "sp < 1" : NULL, "stack[sp - 1].as_f64 = (double)stack[sp - 1].as_i64;");
+                break;
+            case INST_F2I:
+                emit_inst(p_stream, i, checked ? "sp < 1 || !vm_float_fits_int(stack[sp - 1].as_f64)" : "!vm_float_fits_int(stack[sp - 1].as_f64)",
+                    "stack[sp - 1].as_i64 = (int64_t)stack[sp - 1].as_f64;");
+                break;
+            case INST_NEGF:
+                emit_inst(p_stream, i, checked ? "sp < 1" : NULL, "stack[sp - 1].as_u64 ^= UINT64_C(1) << 63;");
+                break;
+            case INST_MINF:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL,
+                    "if (!(stack[sp - 2].as_f64 < stack[sp - 1].as_f64)) stack[sp - 2] = stack[sp - 1]; sp--;");
+                break;
+            case INST_MAXF:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL,
+                    "if (!(stack[sp - 2].as_f64 > stack[sp - 1].as_f64)) stack[sp - 2] = stack[sp - 1]; sp--;");
+                break;
+            case INST_LTF:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_u64 = stack[sp - 2].as_f64 < stack[sp - 1].as_f64; sp--;");
+                break;
+            case INST_LTI:
+                emit_inst(p_stream, i, checked ? "sp < 2" : NULL, "stack[sp - 2].as_u64 = stack[sp - 2].as_i64 < stack[sp - 1].as_i64; sp--;");
+                break;
+
+            // Addresses on the stack are always checked.
+            case INST_LOAD:
+                emit_inst(p_stream, i,
+                    checked ? "sp < 1 || stack[sp - 1].as_u64 >= VVM2C_MEMORY_SIZE" : "stack[sp - 1].as_u64 >= VVM2C_MEMORY_SIZE",
+                    "stack[sp - 1] = memory[stack[sp - 1].as_u64];");
+                break;
+            case INST_STORE:
+                emit_inst(p_stream, i,
+                    checked ? "sp < 2 || stack[sp - 1].as_u64 >= VVM2C_MEMORY_SIZE" : "stack[sp - 1].as_u64 >= VVM2C_MEMORY_SIZE",
+                    "memory[stack[sp - 1].as_u64] = stack[sp - 2]; sp -= 2;");
+                break;
+            case INST_LOAD_IMM:
+                snprintf(condition, sizeof(condition), "sp >= VVM2C_STACK_CAPACITY || UINT64_C(%lu) >= VVM2C_MEMORY_SIZE", k);
+                emit_inst(p_stream, i, checked ? condition : NULL,
+                    "stack[sp++] = memory[UINT64_C(%lu)];", k);
+                break;
+            case INST_STORE_IMM:
+                snprintf(condition, sizeof(condition), "sp >= VVM2C_STACK_CAPACITY || sp < 1 || UINT64_C(%lu) >= VVM2C_MEMORY_SIZE", k);
+                emit_inst(p_stream, i, checked ? condition : NULL,
+                    "memory[UINT64_C(%lu)] = stack[--sp];", k);
+                break;
+
+            // Rare or large enough that the interpreter is as good, and
+            // anything that is not an instruction, which it reports.
+            case INST_HALT:
+            case INST_PRINT_DEBUG:
+            case INST_MEMCPY:
+            case INST_MEMSET:
+            case INST_NATIVE:
+            case INST_VADDF:
+            case INST_VSUBF:
+            case INST_VMULF:
+            case INST_VDIVF:
+            case INST_VADDI:
+            case INST_VSUBI:
+            case INST_VMULI:
+            case INST_VDIVI:
+            case INST_VSUMF:
+            case INST_VSUMI:
+            case INST_VBCAST:
+            case NUMBER_OF_INSTS:
+            default:
+                fprintf(p_stream, "    VVM2C_INTERPRET(%lu);\n", i);
+                break;
+        }
+    }
+
+    // Running off the end of the program is reported by the interpreter.
+    fprintf(p_stream, "\n    (void)budget;\n");
+    fprintf(p_stream, "    VVM2C_RESUME(VVM2C_PROGRAM_SIZE);\n");
+    fprintf(p_stream, "}\n\n");
+    fprintf(p_stream, "%s", epilogue);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: ./vvm2c <input.vm> <output.c> [--stack-size <n>] [--memory-size <n>]\n");
+        fprintf(stderr, "[ERROR]: No Input Provided\n");
+        exit(1);
+    }
+
+    const char* input_file_path = argv[1];
+    const char* output_file_path = argv[2];
+
+    // The verifier proves instructions safe against a stack and a memory of
+    // these sizes, so they are fixed when the program is compiled.
+    uint64_t stack_size = VVM_DEFAULT_STACK_CAPACITY;
+    uint64_t memory_size = VVM_DEFAULT_MEMORY_SIZE;
+    for (int i = 3; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--stack-size") == 0 && i + 1 < argc)
+        {
+            char* end = NULL;
+            const char* size = argv[++i];
+            stack_size = strtoull(size, &end, 10);
+            if (*size == '\0' || *end != '\0' || stack_size == 0)
+            {
+                fprintf(stderr, "[ERROR]: Invalid Stack Size `%s`\n", size);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--memory-size") == 0 && i + 1 < argc)
+        {
+            char* end = NULL;
+            const char* size = argv[++i];
+            memory_size = strtoull(size, &end, 10);
+            if (*size == '\0' || *end != '\0')
+            {
+                fprintf(stderr, "[ERROR]: Invalid Memory Size `%s`\n", size);
+                exit(1);
+            }
+        }
+        else
+        {
+            fprintf(stderr, "[ERROR]: Unknown Flag `%s`\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if (vm_init(&vm, &arena, stack_size) != ERR_OK)
+    {
+        fprintf(stderr, "[ERROR]: %s\n", error_as_cstr(ERR_OUT_OF_MEMORY));
+        exit(1);
+    }
+    if (vm_map_memory(&vm, memory_size, 0) != ERR_OK)
+        exit(1);
+    if (vm_load_program_from_file(&vm, input_file_path) != ERR_OK)
+        exit(1);
+    vm_verify_program(&vm, NULL);
+
+    // `-` writes the translation unit to stdout.
+    FILE* f = strcmp(output_file_path, "-") == 0 ? stdout : fopen(output_file_path, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERROR]: Could Not Open File `%s`: %s\n", output_file_path, strerror(errno));
+        exit(1);
+    }
+
+    emit_program(f, &vm, stack_size, memory_size);
+
+    if (ferror(f) || (f != stdout && fclose(f) != 0))
+    {
+        fprintf(stderr, "[ERROR]: Could Not Write To File `%s`: %s\n", output_file_path, strerror(errno));
+        exit(1);
+    }
+
+    vm_unload_program(&vm);
+    vm_unmap_memory(&vm);
+    arena_free(&arena);
+    return 0;
+}